@@ -0,0 +1,83 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_BASE_THREAD_H
+#define LIBMV_BASE_THREAD_H
+
+#include <pthread.h>
+
+namespace libmv {
+
+// Thin wrappers around the pthread primitives. On Windows these come from the
+// bundled pthreads-w32.
+
+class Mutex {
+ public:
+  Mutex()  { pthread_mutex_init(&mutex_, NULL); }
+  ~Mutex() { pthread_mutex_destroy(&mutex_);    }
+
+  void Lock()   { pthread_mutex_lock(&mutex_);   }
+  void Unlock() { pthread_mutex_unlock(&mutex_); }
+
+ private:
+  friend class ConditionVariable;
+  pthread_mutex_t mutex_;
+
+  // No copying allowed.
+  Mutex(const Mutex &);
+  void operator=(const Mutex &);
+};
+
+// Holds a mutex for the lifetime of the object.
+class MutexLock {
+ public:
+  explicit MutexLock(Mutex *mutex) : mutex_(mutex) { mutex_->Lock(); }
+  ~MutexLock() { mutex_->Unlock(); }
+
+ private:
+  Mutex *mutex_;
+
+  // No copying allowed.
+  MutexLock(const MutexLock &);
+  void operator=(const MutexLock &);
+};
+
+class ConditionVariable {
+ public:
+  ConditionVariable()  { pthread_cond_init(&condition_, NULL); }
+  ~ConditionVariable() { pthread_cond_destroy(&condition_);    }
+
+  // Atomically releases mutex and waits; the mutex is held again on return.
+  // As usual, spurious wakeups are possible so wait in a loop.
+  void Wait(Mutex *mutex) { pthread_cond_wait(&condition_, &mutex->mutex_); }
+  void Signal()           { pthread_cond_signal(&condition_);              }
+  void SignalAll()        { pthread_cond_broadcast(&condition_);           }
+
+ private:
+  pthread_cond_t condition_;
+
+  // No copying allowed.
+  ConditionVariable(const ConditionVariable &);
+  void operator=(const ConditionVariable &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_BASE_THREAD_H
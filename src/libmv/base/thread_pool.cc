@@ -0,0 +1,94 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/base/thread_pool.h"
+
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace libmv {
+
+int NumberOfProcessors() {
+#if (defined WIN32 || defined _WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+#else
+  long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_processors > 0 ? num_processors : 1;
+#endif
+}
+
+ThreadPool::ThreadPool(int num_threads) : stopping_(false) {
+  if (num_threads <= 0) {
+    num_threads = NumberOfProcessors();
+  }
+  threads_.resize(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    pthread_create(&threads_[i], NULL, &ThreadPool::WorkerMain, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    MutexLock lock(&mutex_);
+    stopping_ = true;
+    task_ready_.SignalAll();
+  }
+  for (int i = 0; i < threads_.size(); ++i) {
+    pthread_join(threads_[i], NULL);
+  }
+}
+
+void ThreadPool::Schedule(Task *task) {
+  MutexLock lock(&mutex_);
+  tasks_.push_back(task);
+  task_ready_.Signal();
+}
+
+void *ThreadPool::WorkerMain(void *pool) {
+  static_cast<ThreadPool *>(pool)->RunTasks();
+  return NULL;
+}
+
+void ThreadPool::RunTasks() {
+  for (;;) {
+    Task *task;
+    {
+      MutexLock lock(&mutex_);
+      while (tasks_.empty() && !stopping_) {
+        task_ready_.Wait(&mutex_);
+      }
+      if (tasks_.empty()) {
+        // Stopping, and all the remaining tasks ran.
+        return;
+      }
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+    task->Run();
+    delete task;
+  }
+}
+
+}  // namespace libmv
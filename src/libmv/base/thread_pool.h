@@ -0,0 +1,195 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_BASE_THREAD_POOL_H
+#define LIBMV_BASE_THREAD_POOL_H
+
+#include <deque>
+#include <vector>
+
+#include "libmv/base/thread.h"
+
+namespace libmv {
+
+// A unit of work for a ThreadPool.
+class Task {
+ public:
+  virtual ~Task() {}
+  virtual void Run() = 0;
+};
+
+// Returns the number of processors available, or 1 if unknown.
+int NumberOfProcessors();
+
+// A fixed set of worker threads running tasks from a shared queue. Tasks are
+// started in the order they are scheduled.
+class ThreadPool {
+ public:
+  // Starts num_threads workers; if num_threads is 0, one per processor.
+  explicit ThreadPool(int num_threads = 0);
+
+  // Runs every task already scheduled, then stops the workers.
+  ~ThreadPool();
+
+  int num_threads() const { return threads_.size(); }
+
+  // Queues a task to run on one of the workers. The pool takes ownership of
+  // the task and deletes it once it ran.
+  void Schedule(Task *task);
+
+ private:
+  static void *WorkerMain(void *pool);
+  void RunTasks();
+
+  std::vector<pthread_t> threads_;
+  Mutex mutex_;
+  ConditionVariable task_ready_;
+  std::deque<Task *> tasks_;
+  bool stopping_;
+
+  // No copying allowed.
+  ThreadPool(const ThreadPool &);
+  void operator=(const ThreadPool &);
+};
+
+namespace internal {
+
+// State shared between the caller of ParallelFor() and the helper tasks it
+// schedules. It is reference counted because helper tasks may only start
+// after the loop is over and the caller has returned.
+template<typename Functor>
+class ParallelForState {
+ public:
+  ParallelForState(int begin, int end, int chunk_size, Functor *functor)
+      : next_(begin), end_(end), chunk_size_(chunk_size), functor_(functor),
+        running_(0), references_(1) {}
+
+  void AddReference() {
+    MutexLock lock(&mutex_);
+    ++references_;
+  }
+
+  // Deletes the state on the last reference.
+  void RemoveReference() {
+    bool last;
+    {
+      MutexLock lock(&mutex_);
+      last = --references_ == 0;
+    }
+    if (last) {
+      delete this;
+    }
+  }
+
+  // Repeatedly claims the next chunk of indices and runs it, until none are
+  // left. Indices are handed out first come first served, so threads that
+  // finish early keep taking work off the others.
+  void RunChunks() {
+    {
+      MutexLock lock(&mutex_);
+      if (next_ >= end_) {
+        // Nothing left; do not touch the functor, the loop may be over.
+        return;
+      }
+      ++running_;
+    }
+    for (;;) {
+      int begin, end;
+      {
+        MutexLock lock(&mutex_);
+        if (next_ >= end_) {
+          if (--running_ == 0) {
+            done_.SignalAll();
+          }
+          return;
+        }
+        begin = next_;
+        end = next_ + chunk_size_ < end_ ? next_ + chunk_size_ : end_;
+        next_ = end;
+      }
+      for (int i = begin; i < end; ++i) {
+        (*functor_)(i);
+      }
+    }
+  }
+
+  // Blocks until every claimed chunk has finished running.
+  void WaitForChunks() {
+    MutexLock lock(&mutex_);
+    while (next_ < end_ || running_ > 0) {
+      done_.Wait(&mutex_);
+    }
+  }
+
+ private:
+  Mutex mutex_;
+  ConditionVariable done_;
+  int next_, end_, chunk_size_;
+  Functor *functor_;
+  int running_;
+  int references_;
+};
+
+template<typename Functor>
+class ParallelForTask : public Task {
+ public:
+  explicit ParallelForTask(ParallelForState<Functor> *state) : state_(state) {
+    state_->AddReference();
+  }
+  virtual ~ParallelForTask() { state_->RemoveReference(); }
+  virtual void Run() { state_->RunChunks(); }
+
+ private:
+  ParallelForState<Functor> *state_;
+};
+
+}  // namespace internal
+
+// Calls functor(i) for every i in [begin, end), spread over the threads of
+// pool; the calling thread takes part too. Returns once every call finished.
+// If pool is NULL the loop runs serially on the calling thread. Calls for
+// different i may run concurrently, so the functor must only write to state
+// owned by index i (e.g. the i'th element of an output array); in exchange the
+// results do not depend on the scheduling.
+template<typename Functor>
+void ParallelFor(ThreadPool *pool, int begin, int end, Functor &functor,
+                 int chunk_size = 1) {
+  if (!pool || pool->num_threads() == 0 || end - begin <= chunk_size) {
+    for (int i = begin; i < end; ++i) {
+      functor(i);
+    }
+    return;
+  }
+  internal::ParallelForState<Functor> *state =
+      new internal::ParallelForState<Functor>(begin, end, chunk_size, &functor);
+  int num_chunks = (end - begin + chunk_size - 1) / chunk_size;
+  int num_tasks = pool->num_threads() < num_chunks - 1 ?
+                  pool->num_threads() : num_chunks - 1;
+  for (int i = 0; i < num_tasks; ++i) {
+    pool->Schedule(new internal::ParallelForTask<Functor>(state));
+  }
+  state->RunChunks();
+  state->WaitForChunks();
+  state->RemoveReference();
+}
+
+}  // namespace libmv
+
+#endif  // LIBMV_BASE_THREAD_POOL_H
@@ -0,0 +1,88 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/base/vector.h"
+#include "testing/testing.h"
+
+namespace {
+using namespace libmv;
+
+struct Square {
+  Square(vector<int> *squares) : squares(squares) {}
+  void operator()(int i) { (*squares)[i] = i * i; }
+  vector<int> *squares;
+};
+
+TEST(ThreadPool, ParallelForVisitsEveryIndexOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(4, pool.num_threads());
+
+  vector<int> squares(1000, -1);
+  Square square(&squares);
+  ParallelFor(&pool, 0, 1000, square);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(i * i, squares[i]);
+  }
+}
+
+TEST(ThreadPool, ParallelForChunks) {
+  ThreadPool pool(3);
+  vector<int> squares(101, -1);
+  Square square(&squares);
+  ParallelFor(&pool, 1, 101, square, 7);
+  EXPECT_EQ(-1, squares[0]);
+  for (int i = 1; i < 101; ++i) {
+    EXPECT_EQ(i * i, squares[i]);
+  }
+}
+
+TEST(ThreadPool, ParallelForWithoutPool) {
+  vector<int> squares(10, -1);
+  Square square(&squares);
+  ParallelFor(static_cast<ThreadPool *>(NULL), 0, 10, square);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i * i, squares[i]);
+  }
+}
+
+struct Increment : public Task {
+  Increment(Mutex *mutex, int *count) : mutex(mutex), count(count) {}
+  virtual void Run() {
+    MutexLock lock(mutex);
+    ++*count;
+  }
+  Mutex *mutex;
+  int *count;
+};
+
+TEST(ThreadPool, DestructorRunsScheduledTasks) {
+  Mutex mutex;
+  int count = 0;
+  {
+    ThreadPool pool(2);
+    for (int i = 0; i < 100; ++i) {
+      pool.Schedule(new Increment(&mutex, &count));
+    }
+  }
+  EXPECT_EQ(100, count);
+}
+
+}  // namespace
@@ -26,7 +26,9 @@
 namespace libmv {
 namespace correspondence  {
 
-template < typename Scalar = float >
+// Distance is the type of the distances between the arrays, e.g. int for the
+// Hamming distance between arrays of bytes.
+template < typename Scalar = float, typename Distance = Scalar >
 class ArrayMatcher
 {
   public:
@@ -53,7 +55,7 @@ class ArrayMatcher
    *
    * \return True if success.
    */
-  virtual bool searchNeighbour( const Scalar * query, int * indice, Scalar * distance)=0;
+  virtual bool searchNeighbour( const Scalar * query, int * indice, Distance * distance)=0;
 
 
 /**
@@ -68,7 +70,7 @@ class ArrayMatcher
    * \return True if success.
    */
   virtual bool searchNeighbours( const Scalar * query, int nbQuery,
-    vector<int> * indice, vector<Scalar> * distance, int NN)=0;
+    vector<int> * indice, vector<Distance> * distance, int NN)=0;
 };
 
 } // namespace correspondence
@@ -21,24 +21,39 @@
 #ifndef LIBMV_CORRESPONDENCE_ARRAYMATCHER_BRUTE_FORCE_H_
 #define LIBMV_CORRESPONDENCE_ARRAYMATCHER_BRUTE_FORCE_H_
 
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "libmv/base/thread_pool.h"
 #include "libmv/correspondence/ArrayMatcher.h"
-#include "third_party/flann/src/cpp/flann.h"
+#include "libmv/numeric/numeric.h"
 
 namespace libmv {
 namespace correspondence  {
 
-/// Implement ArrayMatcher as a FLANN LINEAR matcher.
-// http://www.cs.ubc.ca/~mariusm/index.php/FLANN/FLANN
-// David G. Lowe and Marius Muja
+/// Implement ArrayMatcher as an exhaustive (exact) matcher.
+//
+// The squared distances between a block of queries and a block of the dataset
+// are computed at once as
+//
+//   ||q - d||^2 = ||q||^2 + ||d||^2 - 2 q.d,
+//
+// where the dot products of all the pairs are one matrix product, and the NN
+// nearest neighbours of each query are kept while going over the blocks. The
+// distances of the results are recomputed directly at the end, so that they
+// are as accurate as a difference. The blocks of queries are spread over the
+// thread pool, if any. Distances are squared euclidean distances, like the
+// FLANN matchers return.
 template < typename Scalar >
 class ArrayMatcher_BruteForce : public ArrayMatcher<Scalar>
 {
   public:
-  ArrayMatcher_BruteForce():_index_id(NULL) {}
+  explicit ArrayMatcher_BruteForce(ThreadPool *pool = NULL)
+    : _dimension(0), _pool(pool) {}
 
-  ~ArrayMatcher_BruteForce()  {
-    flann_free_index(_index_id, &_p);
-    }
+  ~ArrayMatcher_BruteForce()  {}
 
   /**
    * Build the matching structure
@@ -51,19 +66,13 @@ class ArrayMatcher_BruteForce : public ArrayMatcher<Scalar>
    * \return True if success.
    */
   bool build( const Scalar * dataset, int nbRows, int dimension)  {
-
-    _p.log_destination = NULL;
-    _p.log_level = LOG_INFO;
-
-    // Force LINEAR MATCHING : Brute Force.
-    _p.algorithm = LINEAR;
-    _p.target_precision = -1.0f;
-
-    //-- Build FLANN index
-    float fspeedUp;
-    _index_id = flann_build_index( (float*)dataset, nbRows, dimension,
-      &fspeedUp, &_p);
-    return (_index_id != NULL);
+    if (nbRows <= 0 || dimension <= 0) {
+      return false;
+    }
+    _dimension = dimension;
+    _dataset = Eigen::Map<const RowMatrix>(dataset, nbRows, dimension);
+    _squaredNorms = _dataset.rowwise().squaredNorm();
+    return true;
   }
 
   /**
@@ -78,14 +87,14 @@ class ArrayMatcher_BruteForce : public ArrayMatcher<Scalar>
    */
   bool searchNeighbour( const Scalar * query, int * indice, Scalar * distance)
   {
-    if (_index_id != NULL) {
-      int iRet = flann_find_nearest_neighbors_index(_index_id, (Scalar*)query,
-        1, indice, distance, 1, _p.checks, &_p);
-        return (iRet == 0);
-    }
-    else  {
+    vector<int> indices;
+    vector<Scalar> distances;
+    if (!searchNeighbours(query, 1, &indices, &distances, 1)) {
       return false;
     }
+    *indice = indices[0];
+    *distance = distances[0];
+    return true;
   }
 
 
@@ -103,27 +112,123 @@ class ArrayMatcher_BruteForce : public ArrayMatcher<Scalar>
   bool searchNeighbours( const Scalar * query, int nbQuery,
     vector<int> * indice, vector<Scalar> * distance, int NN)
   {
-    if (_index_id != NULL)  {
-      //-- Check if resultIndices is allocated
-      indice->resize(nbQuery * NN);
-      distance->resize(nbQuery * NN);
-
-      int * indicePTR = &((*indice)[0]);
-      float * distancePTR = &(*distance)[0];
-      int iRet = flann_find_nearest_neighbors_index(_index_id, (Scalar*)query,
-          nbQuery, indicePTR, distancePTR, NN, _p.checks, &_p);
-        return (iRet == 0);
-    }
-    else  {
+    if (_dimension == 0 || NN < 1 || NN > _dataset.rows())  {
       return false;
     }
+    indice->resize(nbQuery * NN);
+    distance->resize(nbQuery * NN);
+    if (nbQuery == 0) {
+      return true;
+    }
+
+    Eigen::Map<const RowMatrix> queries(query, nbQuery, _dimension);
+    SearchBlock search(*this, queries, NN, &(*indice)[0], &(*distance)[0]);
+    int nbBlocks = (nbQuery + kQueryBlockSize - 1) / kQueryBlockSize;
+    ParallelFor(_pool, 0, nbBlocks, search);
+    return true;
   }
 
   private :
-  FLANN_INDEX _index_id;
-  FLANNParameters _p;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor> RowMatrix;
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> ColumnVector;
+
+  // Small enough blocks for the dot products of a block of queries with a
+  // block of the dataset to stay in L2.
+  static const int kQueryBlockSize = 64;
+  static const int kDatasetBlockSize = 256;
+
+  // Finds the NN nearest neighbours of one block of queries, for
+  // ParallelFor().
+  class SearchBlock {
+    public:
+    SearchBlock(const ArrayMatcher_BruteForce &matcher,
+                const Eigen::Map<const RowMatrix> &queries,
+                int NN, int *indices, Scalar *distances)
+      : _matcher(matcher), _queries(queries), _NN(NN),
+        _indices(indices), _distances(distances) {}
+
+    void operator()(int block) const {
+      const RowMatrix &dataset = _matcher._dataset;
+      const int dimension = _matcher._dimension;
+      const int q0 = block * kQueryBlockSize;
+      const int nq = std::min(kQueryBlockSize, int(_queries.rows()) - q0);
+
+      RowMatrix queries = _queries.block(q0, 0, nq, dimension);
+      ColumnVector queryNorms = queries.rowwise().squaredNorm();
+
+      // The NN best (distance, index) of each query, sorted by distance.
+      std::vector<std::pair<Scalar, int> > best(
+          nq * _NN, std::make_pair(std::numeric_limits<Scalar>::max(), -1));
+
+      RowMatrix products;
+      for (int d0 = 0; d0 < dataset.rows(); d0 += kDatasetBlockSize) {
+        const int nd = std::min(kDatasetBlockSize, int(dataset.rows()) - d0);
+        products.noalias() =
+            queries * dataset.block(d0, 0, nd, dimension).transpose();
+        for (int i = 0; i < nq; ++i) {
+          std::pair<Scalar, int> *bestOfQuery = &best[i * _NN];
+          const Scalar *dots = &products(i, 0);
+          for (int j = 0; j < nd; ++j) {
+            Scalar d = queryNorms(i) + _matcher._squaredNorms(d0 + j)
+                       - 2 * dots[j];
+            if (d < bestOfQuery[_NN - 1].first) {
+              Insert(std::make_pair(d, d0 + j), bestOfQuery);
+            }
+          }
+        }
+      }
+
+      for (int i = 0; i < nq; ++i) {
+        std::pair<Scalar, int> *bestOfQuery = &best[i * _NN];
+        for (int k = 0; k < _NN; ++k) {
+          bestOfQuery[k].first =
+              (queries.row(i) - dataset.row(bestOfQuery[k].second))
+              .squaredNorm();
+        }
+        std::stable_sort(bestOfQuery, bestOfQuery + _NN, CompareDistances);
+        for (int k = 0; k < _NN; ++k) {
+          _indices[(q0 + i) * _NN + k] = bestOfQuery[k].second;
+          _distances[(q0 + i) * _NN + k] = bestOfQuery[k].first;
+        }
+      }
+    }
+
+    private:
+    // Inserts candidate in the sorted list of the NN best, dropping the last.
+    void Insert(const std::pair<Scalar, int> &candidate,
+                std::pair<Scalar, int> *best) const {
+      int k = _NN - 1;
+      for (; k > 0 && candidate.first < best[k - 1].first; --k) {
+        best[k] = best[k - 1];
+      }
+      best[k] = candidate;
+    }
+
+    static bool CompareDistances(const std::pair<Scalar, int> &a,
+                                 const std::pair<Scalar, int> &b) {
+      return a.first < b.first;
+    }
+
+    const ArrayMatcher_BruteForce &_matcher;
+    const Eigen::Map<const RowMatrix> &_queries;
+    int _NN;
+    int *_indices;
+    Scalar *_distances;
+  };
+
+  int _dimension;
+  RowMatrix _dataset;
+  ColumnVector _squaredNorms;
+  ThreadPool *_pool;
 };
 
+template < typename Scalar >
+const int ArrayMatcher_BruteForce<Scalar>::kQueryBlockSize;
+
+template < typename Scalar >
+const int ArrayMatcher_BruteForce<Scalar>::kDatasetBlockSize;
+
 } // namespace correspondence
 } // namespace libmv
 
@@ -0,0 +1,232 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_H_
+#define LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_H_
+
+#if defined(__POPCNT__) && defined(__x86_64__)
+#define LIBMV_HAMMING_POPCNT
+#include <nmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define LIBMV_HAMMING_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/correspondence/ArrayMatcher.h"
+
+namespace libmv {
+namespace correspondence  {
+
+/// The number of bits which differ between the num_bytes bytes of a and b.
+inline int HammingDistance(const unsigned char *a,
+                           const unsigned char *b,
+                           int num_bytes) {
+  int distance = 0;
+  int i = 0;
+#if defined(LIBMV_HAMMING_POPCNT)
+  // Use the popcnt instruction on 8 bytes at once.
+  for (; i + 8 <= num_bytes; i += 8) {
+    unsigned long long x, y;
+    std::memcpy(&x, a + i, 8);
+    std::memcpy(&y, b + i, 8);
+    distance += int(_mm_popcnt_u64(x ^ y));
+  }
+#elif defined(LIBMV_HAMMING_SSE2)
+  // Count the bits of 16 bytes at once: sum the bits by pairs, then by
+  // nibbles, then by bytes. The byte counts are accumulated over up to 31
+  // blocks before psadbw adds them up in each half.
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0f);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  while (i + 16 <= num_bytes) {
+    const int end = std::min(num_bytes - 15, i + 31 * 16);
+    __m128i counts = zero;
+    for (; i < end; i += 16) {
+      __m128i x = _mm_xor_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+      x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi64(x, 1), m1));
+      x = _mm_add_epi8(_mm_and_si128(x, m2),
+                       _mm_and_si128(_mm_srli_epi64(x, 2), m2));
+      counts = _mm_add_epi8(counts,
+          _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi64(x, 4)), m4));
+    }
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(counts, zero));
+  }
+  distance = _mm_cvtsi128_si32(sums) +
+             _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+#endif
+  for (; i < num_bytes; ++i) {
+    unsigned int x = a[i] ^ b[i];
+    x = x - ((x >> 1) & 0x55);
+    x = (x & 0x33) + ((x >> 2) & 0x33);
+    distance += (x + (x >> 4)) & 0x0f;
+  }
+  return distance;
+}
+
+/// Implement ArrayMatcher as an exhaustive (exact) matcher of binary
+/// descriptors with the Hamming distance.
+//
+// Each row of the dataset is an array of bytes of packed bits. A linear scan
+// with the popcount above is the fastest way to match the few thousands of
+// descriptors of an image; see ArrayMatcher_HammingMultiIndex for large
+// datasets. The queries are spread over the thread pool, if any.
+class ArrayMatcher_Hamming : public ArrayMatcher<unsigned char, int>
+{
+  public:
+  explicit ArrayMatcher_Hamming(ThreadPool *pool = NULL)
+    : _nbRows(0), _dimension(0), _pool(pool) {}
+
+  ~ArrayMatcher_Hamming()  {}
+
+  /**
+   * Build the matching structure
+   *
+   * \param[in] dataset   Input data.
+   * \param[in] nbRows    The number of component.
+   * \param[in] dimension Length in bytes of each row of the dataset.
+   *
+   * \return True if success.
+   */
+  bool build( const unsigned char * dataset, int nbRows, int dimension)  {
+    if (nbRows <= 0 || dimension <= 0) {
+      return false;
+    }
+    _nbRows = nbRows;
+    _dimension = dimension;
+    _dataset.assign(dataset, dataset + nbRows * dimension);
+    return true;
+  }
+
+  /**
+   * Search the nearest Neighbour of the array query.
+   *
+   * \param[in]   query     The query array
+   * \param[out]  indice    The indice of array in the dataset that
+   *  have been computed as the nearest array.
+   * \param[out]  distance  The Hamming distance between the two arrays.
+   *
+   * \return True if success.
+   */
+  bool searchNeighbour( const unsigned char * query,
+                        int * indice, int * distance)
+  {
+    vector<int> indices;
+    vector<int> distances;
+    if (!searchNeighbours(query, 1, &indices, &distances, 1)) {
+      return false;
+    }
+    *indice = indices[0];
+    *distance = distances[0];
+    return true;
+  }
+
+  /**
+   * Search the N nearest Neighbour of the array query.
+   *
+   * \param[in]   query     The query array
+   * \param[in]   nbQuery   The number of query rows
+   * \param[out]  indice    The indices of arrays in the dataset that
+   *  have been computed as the nearest arrays.
+   * \param[out]  distance  The Hamming distances between the matched arrays.
+   *
+   * \return True if success.
+   */
+  bool searchNeighbours( const unsigned char * query, int nbQuery,
+    vector<int> * indice, vector<int> * distance, int NN)
+  {
+    if (_dimension == 0 || NN < 1 || NN > _nbRows)  {
+      return false;
+    }
+    indice->resize(nbQuery * NN);
+    distance->resize(nbQuery * NN);
+    if (nbQuery == 0) {
+      return true;
+    }
+
+    SearchQueries search(*this, query, NN, &(*indice)[0], &(*distance)[0]);
+    ParallelFor(_pool, 0, nbQuery, search, kQueriesPerChunk);
+    return true;
+  }
+
+  private :
+  static const int kQueriesPerChunk = 16;
+
+  // Scans the dataset for the NN nearest neighbours of each query, for
+  // ParallelFor().
+  class SearchQueries {
+    public:
+    SearchQueries(const ArrayMatcher_Hamming &matcher,
+                  const unsigned char *queries,
+                  int NN, int *indices, int *distances)
+      : _matcher(matcher), _queries(queries), _NN(NN),
+        _indices(indices), _distances(distances) {}
+
+    void operator()(int q) const {
+      const int dimension = _matcher._dimension;
+      const unsigned char *query = _queries + q * dimension;
+      int *indices = _indices + q * _NN;
+      int *distances = _distances + q * _NN;
+      std::fill(indices, indices + _NN, -1);
+      std::fill(distances, distances + _NN, 8 * dimension + 1);
+
+      const unsigned char *row = &_matcher._dataset[0];
+      for (int i = 0; i < _matcher._nbRows; ++i, row += dimension) {
+        int d = HammingDistance(query, row, dimension);
+        if (d < distances[_NN - 1]) {
+          // Insert in the sorted list of the NN best, dropping the last.
+          int k = _NN - 1;
+          for (; k > 0 && d < distances[k - 1]; --k) {
+            distances[k] = distances[k - 1];
+            indices[k] = indices[k - 1];
+          }
+          distances[k] = d;
+          indices[k] = i;
+        }
+      }
+    }
+
+    private:
+    const ArrayMatcher_Hamming &_matcher;
+    const unsigned char *_queries;
+    int _NN;
+    int *_indices;
+    int *_distances;
+  };
+
+  int _nbRows;
+  int _dimension;
+  std::vector<unsigned char> _dataset;
+  ThreadPool *_pool;
+};
+
+} // namespace correspondence
+} // namespace libmv
+
+#endif // LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_H_
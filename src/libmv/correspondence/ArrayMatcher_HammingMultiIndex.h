@@ -0,0 +1,270 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_MULTI_INDEX_H_
+#define LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_MULTI_INDEX_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/correspondence/ArrayMatcher.h"
+#include "libmv/correspondence/ArrayMatcher_Hamming.h"
+
+namespace libmv {
+namespace correspondence  {
+
+/// Implement ArrayMatcher for binary descriptors with multi-index hashing [1].
+//
+// The rows are cut in m substrings of 8 bits (16 bits for large datasets),
+// and each substring indexes a table of the rows by its value. Two rows at
+// Hamming distance d have at least one substring at distance d / m or less,
+// so probing the buckets within distance s of each substring of the query
+// finds all the rows within distance m * (s + 1) - 1. The search widens s
+// until the NN nearest neighbours are known for sure, so the results are
+// exact, but it stops at maxDistance: the neighbours further than that are
+// not searched, and come back with the index -1 and the distance
+// maxDistance + 1. The cost grows quickly with the number of levels s, so
+// this pays off over ArrayMatcher_Hamming for large datasets and small
+// maxDistance. The default of 47 bits is the widest distance which needs
+// at most two bits flipped in the 16 bits substrings of a 256 bits
+// descriptor.
+//
+// [1] M. Norouzi, A. Punjani and D. J. Fleet. Fast search in Hamming space
+// with multi-index hashing. In CVPR, 2012.
+class ArrayMatcher_HammingMultiIndex : public ArrayMatcher<unsigned char, int>
+{
+  public:
+  explicit ArrayMatcher_HammingMultiIndex(int maxDistance = 47,
+                                          ThreadPool *pool = NULL)
+    : _nbRows(0), _dimension(0), _substringBytes(1), _nbSubstrings(0),
+      _maxDistance(maxDistance), _pool(pool) {}
+
+  ~ArrayMatcher_HammingMultiIndex()  {}
+
+  /**
+   * Build the matching structure
+   *
+   * \param[in] dataset   Input data.
+   * \param[in] nbRows    The number of component.
+   * \param[in] dimension Length in bytes of each row of the dataset.
+   *
+   * \return True if success.
+   */
+  bool build( const unsigned char * dataset, int nbRows, int dimension)  {
+    if (nbRows <= 0 || dimension <= 0) {
+      return false;
+    }
+    _nbRows = nbRows;
+    _dimension = dimension;
+    _dataset.assign(dataset, dataset + nbRows * dimension);
+
+    // Substrings of about log2(nbRows) bits keep a few rows per bucket.
+    _substringBytes = (nbRows >= kMinRowsFor16Bits && dimension % 2 == 0)
+                      ? 2 : 1;
+    _nbSubstrings = dimension / _substringBytes;
+    const int nbBuckets = 1 << (8 * _substringBytes);
+
+    // Sort the rows by bucket in each table, with a counting sort.
+    _offsets.assign(_nbSubstrings * (nbBuckets + 1), 0);
+    _rows.resize(_nbSubstrings * nbRows);
+    for (int t = 0; t < _nbSubstrings; ++t) {
+      int *offsets = &_offsets[t * (nbBuckets + 1)];
+      for (int i = 0; i < nbRows; ++i) {
+        ++offsets[Substring(&_dataset[i * dimension], t) + 1];
+      }
+      for (int b = 0; b < nbBuckets; ++b) {
+        offsets[b + 1] += offsets[b];
+      }
+      std::vector<int> next(offsets, offsets + nbBuckets);
+      for (int i = 0; i < nbRows; ++i) {
+        int b = Substring(&_dataset[i * dimension], t);
+        _rows[t * nbRows + next[b]++] = i;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Search the nearest Neighbour of the array query.
+   *
+   * \param[in]   query     The query array
+   * \param[out]  indice    The indice of array in the dataset that
+   *  have been computed as the nearest array.
+   * \param[out]  distance  The Hamming distance between the two arrays.
+   *
+   * \return True if success.
+   */
+  bool searchNeighbour( const unsigned char * query,
+                        int * indice, int * distance)
+  {
+    vector<int> indices;
+    vector<int> distances;
+    if (!searchNeighbours(query, 1, &indices, &distances, 1)) {
+      return false;
+    }
+    *indice = indices[0];
+    *distance = distances[0];
+    return true;
+  }
+
+  /**
+   * Search the N nearest Neighbour of the array query.
+   *
+   * \param[in]   query     The query array
+   * \param[in]   nbQuery   The number of query rows
+   * \param[out]  indice    The indices of arrays in the dataset that
+   *  have been computed as the nearest arrays, or -1.
+   * \param[out]  distance  The Hamming distances between the matched arrays.
+   *
+   * \return True if success.
+   */
+  bool searchNeighbours( const unsigned char * query, int nbQuery,
+    vector<int> * indice, vector<int> * distance, int NN)
+  {
+    if (_dimension == 0 || NN < 1 || NN > _nbRows)  {
+      return false;
+    }
+    indice->resize(nbQuery * NN);
+    distance->resize(nbQuery * NN);
+    if (nbQuery == 0) {
+      return true;
+    }
+
+    SearchQueries search(*this, query, nbQuery, NN,
+                         &(*indice)[0], &(*distance)[0]);
+    int nbChunks = (nbQuery + kQueriesPerChunk - 1) / kQueriesPerChunk;
+    ParallelFor(_pool, 0, nbChunks, search);
+    return true;
+  }
+
+  private :
+  static const int kQueriesPerChunk = 16;
+  static const int kMinRowsFor16Bits = 1 << 12;
+
+  // The value of the substring t of the row.
+  int Substring(const unsigned char *row, int t) const {
+    if (_substringBytes == 1) {
+      return row[t];
+    }
+    return row[2 * t] | (row[2 * t + 1] << 8);
+  }
+
+  // Searches the NN nearest neighbours of a chunk of queries, for
+  // ParallelFor().
+  class SearchQueries {
+    public:
+    SearchQueries(const ArrayMatcher_HammingMultiIndex &matcher,
+                  const unsigned char *queries, int nbQuery,
+                  int NN, int *indices, int *distances)
+      : _matcher(matcher), _queries(queries), _nbQuery(nbQuery), _NN(NN),
+        _indices(indices), _distances(distances) {}
+
+    void operator()(int chunk) const {
+      const ArrayMatcher_HammingMultiIndex &m = _matcher;
+      const int bits = 8 * m._substringBytes;
+      const int nbBuckets = 1 << bits;
+
+      // The last query which has seen each row, not to measure it twice.
+      std::vector<int> seen(m._nbRows, -1);
+      const int q0 = chunk * kQueriesPerChunk;
+      const int q1 = std::min(q0 + kQueriesPerChunk, _nbQuery);
+      for (int q = q0; q < q1; ++q) {
+        const unsigned char *query = _queries + q * m._dimension;
+        int *indices = _indices + q * _NN;
+        int *distances = _distances + q * _NN;
+        std::fill(indices, indices + _NN, -1);
+        std::fill(distances, distances + _NN, m._maxDistance + 1);
+
+        for (int s = 0; s <= bits; ++s) {
+          for (int t = 0; t < m._nbSubstrings; ++t) {
+            const int key = m.Substring(query, t);
+            const int *offsets = &m._offsets[t * (nbBuckets + 1)];
+            const int *rows = &m._rows[t * m._nbRows];
+            // Go over the masks of s bits set, in increasing order.
+            unsigned int mask = (1u << s) - 1;
+            while (mask < unsigned(nbBuckets)) {
+              const int b = key ^ mask;
+              for (int j = offsets[b]; j < offsets[b + 1]; ++j) {
+                const int i = rows[j];
+                if (seen[i] == q) {
+                  continue;
+                }
+                seen[i] = q;
+                int d = HammingDistance(query, &m._dataset[i * m._dimension],
+                                        m._dimension);
+                if (d < distances[_NN - 1]) {
+                  Insert(d, i, indices, distances);
+                }
+              }
+              if (mask == 0) {
+                break;
+              }
+              unsigned int lowest = mask & (~mask + 1);
+              unsigned int carried = mask + lowest;
+              mask = (((carried ^ mask) >> 2) / lowest) | carried;
+            }
+          }
+          // All the rows up to this distance have been measured.
+          const int covered = m._nbSubstrings * (s + 1) - 1;
+          if (distances[_NN - 1] <= covered || covered >= m._maxDistance) {
+            break;
+          }
+        }
+      }
+    }
+
+    private:
+    // Inserts (d, i) in the sorted list of the NN best, dropping the last.
+    void Insert(int d, int i, int *indices, int *distances) const {
+      int k = _NN - 1;
+      for (; k > 0 && d < distances[k - 1]; --k) {
+        distances[k] = distances[k - 1];
+        indices[k] = indices[k - 1];
+      }
+      distances[k] = d;
+      indices[k] = i;
+    }
+
+    const ArrayMatcher_HammingMultiIndex &_matcher;
+    const unsigned char *_queries;
+    int _nbQuery;
+    int _NN;
+    int *_indices;
+    int *_distances;
+  };
+
+  int _nbRows;
+  int _dimension;
+  int _substringBytes;
+  int _nbSubstrings;
+  int _maxDistance;
+  std::vector<unsigned char> _dataset;
+  // For each table, the start of each bucket in _rows, and the rows sorted
+  // by bucket.
+  std::vector<int> _offsets;
+  std::vector<int> _rows;
+  ThreadPool *_pool;
+};
+
+} // namespace correspondence
+} // namespace libmv
+
+#endif // LIBMV_CORRESPONDENCE_ARRAYMATCHER_HAMMING_MULTI_INDEX_H_
@@ -21,6 +21,7 @@
 #ifndef LIBMV_CORRESPONDENCE_ARRAYMATCHER_KDTREE_H_
 #define LIBMV_CORRESPONDENCE_ARRAYMATCHER_KDTREE_H_
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/correspondence/ArrayMatcher.h"
 #include "libmv/correspondence/kdtree.h"
 
@@ -28,11 +29,17 @@ namespace libmv {
 namespace correspondence  {
 
 /// Implement ArrayMatcher as the native KDtree libmv matcher.
+//
+// The search explores at most maxLeafs leafs of the tree per query: more
+// leafs find the true nearest neighbours more often, fewer are faster. The
+// default explores every leaf of the trees built here, which have at most
+// 512. Batched queries are spread over the thread pool, if any.
 template < typename Scalar >
 class ArrayMatcher_Kdtree : public ArrayMatcher<Scalar>
 {
   public:
-  ArrayMatcher_Kdtree() {}
+  explicit ArrayMatcher_Kdtree(int maxLeafs = 1000, ThreadPool *pool = NULL)
+    : _maxLeafs(maxLeafs), _pool(pool) {}
 
   ~ArrayMatcher_Kdtree() {}
 
@@ -54,6 +61,9 @@ class ArrayMatcher_Kdtree : public ArrayMatcher<Scalar>
       _tree.AddPoint( ptrDataset,i);
       ptrDataset+=dimension;
     }
+    if (nbRows <= 0) {
+      return false;
+    }
     _tree.Build(10);
     return true;
   }
@@ -72,7 +82,8 @@ class ArrayMatcher_Kdtree : public ArrayMatcher<Scalar>
   {
     Scalar distanceToQuery;
     int nni;
-    _tree.ApproximateNearestNeighborBestBinFirst(query, 1000, &nni, &distanceToQuery);
+    _tree.ApproximateNearestNeighborBestBinFirst(query, _maxLeafs, &nni,
+                                                 &distanceToQuery);
     *indice = nni;
     *distance = distanceToQuery;
     return true;
@@ -93,26 +104,22 @@ class ArrayMatcher_Kdtree : public ArrayMatcher<Scalar>
   bool searchNeighbours( const Scalar * query, int nbQuery,
     vector<int> * indice, vector<Scalar> * distance, int NN)
   {
-    if (NN==1)  {
-      const Scalar * ptrQuery =  query;
-      for (int i=0; i < nbQuery; ++i) {
-        Scalar distanceToQuery;
-        int nni;
-        _tree.ApproximateNearestNeighborBestBinFirst(ptrQuery, 1000, &nni, &distanceToQuery);
-        distance->push_back(distanceToQuery);
-        indice->push_back(nni);
-        ptrQuery+=_tree.NumDimension();
-      }
-      return true;
-    }
-    else  {
-      //-- Not yet implemented
+    if (NN < 1 || NN > _tree.NumPoints())  {
       return false;
     }
+    indice->resize(nbQuery * NN);
+    distance->resize(nbQuery * NN);
+    if (nbQuery > 0)  {
+      _tree.ApproximateKnnBestBinFirst(query, nbQuery, NN, _maxLeafs,
+                                       &(*indice)[0], &(*distance)[0], _pool);
+    }
+    return true;
   }
 
   private :
   KdTree<Scalar> _tree;
+  int _maxLeafs;
+  ThreadPool *_pool;
 
 };
 
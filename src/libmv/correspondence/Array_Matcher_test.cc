@@ -20,9 +20,12 @@
 
 #include "libmv/correspondence/ArrayMatcher.h"
 #include "libmv/correspondence/ArrayMatcher_BruteForce.h"
+#include "libmv/correspondence/ArrayMatcher_Hamming.h"
+#include "libmv/correspondence/ArrayMatcher_HammingMultiIndex.h"
 #include "libmv/correspondence/ArrayMatcher_Kdtree_Flann.h"
 #include "libmv/correspondence/ArrayMatcher_Kdtree.h"
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/correspondence/feature_matching.h"
 #include "libmv/logging/logging.h"
 #include "testing/testing.h"
@@ -183,4 +186,263 @@ TYPED_TEST(MatchingKernelTest, MatcherInterface)
 }
 
 
+// Exhaustive search, one pair at a time.
+void NaiveNearestNeighbours(const float *dataset, int nbRows,
+                            const float *query, int dimension,
+                            int *first, int *second) {
+  float best[2] = { 1e30f, 1e30f };
+  for (int j = 0; j < nbRows; ++j) {
+    float d = 0;
+    for (int k = 0; k < dimension; ++k) {
+      float difference = query[k] - dataset[j * dimension + k];
+      d += difference * difference;
+    }
+    if (d < best[0]) {
+      best[1] = best[0];
+      *second = *first;
+      best[0] = d;
+      *first = j;
+    } else if (d < best[1]) {
+      best[1] = d;
+      *second = j;
+    }
+  }
+}
+
+// More queries and rows than one block, and two neighbours as for the ratio
+// test, on a thread pool and without.
+TEST(ArrayMatcher_BruteForce, TwoNearestNeighboursOfManyQueries)
+{
+  const int dimension = 64, nbRows = 600, nbQuery = 150;
+  libmv::vector<float> dataset(nbRows * dimension);
+  libmv::vector<float> queries(nbQuery * dimension);
+  unsigned seed = 1;
+  for (int i = 0; i < nbRows * dimension; ++i) {
+    seed = seed * 1103515245 + 12345;
+    dataset[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+  for (int i = 0; i < nbQuery * dimension; ++i) {
+    seed = seed * 1103515245 + 12345;
+    queries[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+
+  ThreadPool pool(2);
+  ThreadPool *pools[] = { NULL, &pool };
+  for (int p = 0; p < 2; ++p) {
+    ArrayMatcher_BruteForce<float> matcher(pools[p]);
+    ASSERT_TRUE(matcher.build(&dataset[0], nbRows, dimension));
+    libmv::vector<int> indices;
+    libmv::vector<float> distances;
+    ASSERT_TRUE(matcher.searchNeighbours(&queries[0], nbQuery,
+                                         &indices, &distances, 2));
+    ASSERT_EQ(2 * nbQuery, indices.size());
+    ASSERT_EQ(2 * nbQuery, distances.size());
+    for (int i = 0; i < nbQuery; ++i) {
+      int first = -1, second = -1;
+      NaiveNearestNeighbours(&dataset[0], nbRows, &queries[i * dimension],
+                             dimension, &first, &second);
+      EXPECT_EQ(first, indices[2 * i]);
+      EXPECT_EQ(second, indices[2 * i + 1]);
+      EXPECT_LE(distances[2 * i], distances[2 * i + 1]);
+    }
+  }
+
+  // A query in the dataset is its own nearest neighbour, at distance 0.
+  ArrayMatcher_BruteForce<float> matcher;
+  ASSERT_TRUE(matcher.build(&dataset[0], nbRows, dimension));
+  int indice;
+  float distance;
+  ASSERT_TRUE(matcher.searchNeighbour(&dataset[42 * dimension],
+                                      &indice, &distance));
+  EXPECT_EQ(42, indice);
+  EXPECT_EQ(0, distance);
+}
+
+// With every leaf explored, the kd-tree finds the same two neighbours.
+TEST(ArrayMatcher_Kdtree, TwoNearestNeighboursLikeBruteForce)
+{
+  const int dimension = 16, nbRows = 300, nbQuery = 80;
+  libmv::vector<float> dataset(nbRows * dimension);
+  libmv::vector<float> queries(nbQuery * dimension);
+  unsigned seed = 2;
+  for (int i = 0; i < nbRows * dimension; ++i) {
+    seed = seed * 1103515245 + 12345;
+    dataset[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+  for (int i = 0; i < nbQuery * dimension; ++i) {
+    seed = seed * 1103515245 + 12345;
+    queries[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+
+  ThreadPool pool(2);
+  ArrayMatcher_Kdtree<float> kdtree(1000, &pool);
+  ArrayMatcher_BruteForce<float> bruteForce;
+  ASSERT_TRUE(kdtree.build(&dataset[0], nbRows, dimension));
+  ASSERT_TRUE(bruteForce.build(&dataset[0], nbRows, dimension));
+
+  libmv::vector<int> indices, expectedIndices;
+  libmv::vector<float> distances, expectedDistances;
+  ASSERT_TRUE(kdtree.searchNeighbours(&queries[0], nbQuery,
+                                      &indices, &distances, 2));
+  ASSERT_TRUE(bruteForce.searchNeighbours(&queries[0], nbQuery,
+                                          &expectedIndices,
+                                          &expectedDistances, 2));
+  ASSERT_EQ(2 * nbQuery, indices.size());
+  for (int i = 0; i < 2 * nbQuery; ++i) {
+    EXPECT_EQ(expectedIndices[i], indices[i]);
+    EXPECT_NEAR(expectedDistances[i], distances[i], 1e-5);
+  }
+  EXPECT_FALSE(kdtree.searchNeighbours(&queries[0], nbQuery,
+                                       &indices, &distances, nbRows + 1));
+}
+
+// Random bytes, and queries which are copies of some rows with a few bits
+// flipped.
+static void RandomBinaryDescriptors(int nbRows, int nbQuery, int dimension,
+                                    int flippedBits, unsigned seed,
+                                    libmv::vector<unsigned char> *dataset,
+                                    libmv::vector<unsigned char> *queries) {
+  dataset->resize(nbRows * dimension);
+  queries->resize(nbQuery * dimension);
+  for (int i = 0; i < nbRows * dimension; ++i) {
+    seed = seed * 1103515245 + 12345;
+    (*dataset)[i] = (seed >> 16) & 0xff;
+  }
+  for (int q = 0; q < nbQuery; ++q) {
+    int row = (q * 7) % nbRows;
+    for (int j = 0; j < dimension; ++j) {
+      (*queries)[q * dimension + j] = (*dataset)[row * dimension + j];
+    }
+    for (int k = 0; k < flippedBits; ++k) {
+      seed = seed * 1103515245 + 12345;
+      int bit = (seed >> 16) % (8 * dimension);
+      (*queries)[q * dimension + bit / 8] ^= 1 << (bit % 8);
+    }
+  }
+}
+
+static int NaiveHammingDistance(const unsigned char *a,
+                                const unsigned char *b,
+                                int dimension) {
+  int distance = 0;
+  for (int i = 0; i < 8 * dimension; ++i) {
+    distance += ((a[i / 8] ^ b[i / 8]) >> (i % 8)) & 1;
+  }
+  return distance;
+}
+
+TEST(HammingDistance, CountsTheDifferentBits)
+{
+  libmv::vector<unsigned char> a, b;
+  RandomBinaryDescriptors(2, 0, 50, 0, 3, &a, &b);
+  for (int dimension = 0; dimension <= 50; ++dimension) {
+    EXPECT_EQ(NaiveHammingDistance(&a[0], &a[50], dimension),
+              HammingDistance(&a[0], &a[50], dimension));
+  }
+  EXPECT_EQ(0, HammingDistance(&a[0], &a[0], 50));
+}
+
+// Both Hamming matchers find the two nearest neighbours of an exhaustive
+// search, as long as the multi-index one searches far enough.
+TEST(ArrayMatcher_Hamming, TwoNearestNeighboursOfManyQueries)
+{
+  const int dimension = 32, nbQuery = 30;
+  const int nbRows[] = { 500, 5000 };
+  for (int n = 0; n < 2; ++n) {
+    libmv::vector<unsigned char> dataset, queries;
+    RandomBinaryDescriptors(nbRows[n], nbQuery, dimension, 20, 4,
+                            &dataset, &queries);
+
+    ThreadPool pool(2);
+    ArrayMatcher_Hamming linear(&pool);
+    ArrayMatcher_HammingMultiIndex multiIndex(8 * dimension, &pool);
+    ASSERT_TRUE(linear.build(&dataset[0], nbRows[n], dimension));
+    ASSERT_TRUE(multiIndex.build(&dataset[0], nbRows[n], dimension));
+
+    libmv::vector<int> indices[2], distances[2];
+    ASSERT_TRUE(linear.searchNeighbours(&queries[0], nbQuery,
+                                        &indices[0], &distances[0], 2));
+    ASSERT_TRUE(multiIndex.searchNeighbours(&queries[0], nbQuery,
+                                            &indices[1], &distances[1], 2));
+    for (int q = 0; q < nbQuery; ++q) {
+      const unsigned char *query = &queries[q * dimension];
+      std::vector<std::pair<int, int> > expected;
+      for (int i = 0; i < nbRows[n]; ++i) {
+        expected.push_back(std::make_pair(
+            NaiveHammingDistance(query, &dataset[i * dimension], dimension),
+            i));
+      }
+      std::sort(expected.begin(), expected.end());
+      EXPECT_EQ((q * 7) % nbRows[n], expected[0].second);
+      for (int m = 0; m < 2; ++m) {
+        for (int k = 0; k < 2; ++k) {
+          EXPECT_EQ(expected[k].first, distances[m][2 * q + k]);
+          EXPECT_EQ(expected[k].first, NaiveHammingDistance(
+              query, &dataset[indices[m][2 * q + k] * dimension], dimension));
+        }
+      }
+      EXPECT_EQ(expected[0].second, indices[0][2 * q]);
+      EXPECT_EQ(expected[1].second, indices[0][2 * q + 1]);
+    }
+  }
+}
+
+// The multi-index matcher does not search beyond its maximum distance.
+TEST(ArrayMatcher_HammingMultiIndex, MaxDistance)
+{
+  const int dimension = 32, nbRows = 1000, nbQuery = 50;
+  libmv::vector<unsigned char> dataset, queries;
+  RandomBinaryDescriptors(nbRows, nbQuery, dimension, 10, 5,
+                          &dataset, &queries);
+
+  ArrayMatcher_HammingMultiIndex matcher;
+  ASSERT_TRUE(matcher.build(&dataset[0], nbRows, dimension));
+  libmv::vector<int> indices, distances;
+  ASSERT_TRUE(matcher.searchNeighbours(&queries[0], nbQuery,
+                                       &indices, &distances, 2));
+  for (int q = 0; q < nbQuery; ++q) {
+    // The row the query comes from is found, while the other random rows
+    // are about 128 bits away.
+    EXPECT_EQ((q * 7) % nbRows, indices[2 * q]);
+    EXPECT_GE(10, distances[2 * q]);
+    EXPECT_EQ(-1, indices[2 * q + 1]);
+    EXPECT_EQ(48, distances[2 * q + 1]);
+  }
+}
+
+TEST(FindCandidateMatches, Hamming)
+{
+  const int dimension = 32, nbFeatures = 200;
+  libmv::vector<unsigned char> dataset, queries;
+  RandomBinaryDescriptors(nbFeatures, nbFeatures, dimension, 10, 6,
+                          &dataset, &queries);
+
+  // The left features are the right ones with a few bits flipped, in an
+  // other order.
+  FeatureSet left, right;
+  left.features.resize(nbFeatures);
+  right.features.resize(nbFeatures);
+  for (int i = 0; i < nbFeatures; ++i) {
+    left.features[i].binary_descriptor.bits.resize(dimension);
+    right.features[i].binary_descriptor.bits.resize(dimension);
+    for (int j = 0; j < dimension; ++j) {
+      left.features[i].binary_descriptor.bits[j] = queries[i * dimension + j];
+      right.features[i].binary_descriptor.bits[j] = dataset[i * dimension + j];
+    }
+  }
+
+  eLibmvMatchMethod methods[] = { eMATCH_HAMMING, eMATCH_HAMMING_MULTI_INDEX };
+  for (int m = 0; m < 2; ++m) {
+    Matches matches;
+    FindCandidateMatches(left, right, &matches, methods[m]);
+    EXPECT_EQ(nbFeatures, matches.NumTracks());
+    std::map<size_t, size_t> correspondences;
+    FindCorrespondences(left, right, &correspondences, methods[m]);
+    EXPECT_EQ(nbFeatures, correspondences.size());
+    for (int i = 0; i < nbFeatures; ++i) {
+      EXPECT_EQ((i * 7) % nbFeatures, correspondences[i]);
+    }
+  }
+}
+
 }  // namespace
@@ -20,96 +20,136 @@
 
 #include "libmv/correspondence/feature_matching.h"
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "libmv/correspondence/ArrayMatcher.h"
 #include "libmv/correspondence/ArrayMatcher_BruteForce.h"
+#include "libmv/correspondence/ArrayMatcher_Hamming.h"
+#include "libmv/correspondence/ArrayMatcher_HammingMultiIndex.h"
 #include "libmv/correspondence/ArrayMatcher_Kdtree_Flann.h"
 #include "libmv/correspondence/ArrayMatcher_Kdtree.h"
 
-// Compute candidate matches between 2 sets of features.  Two features A and B
-// are a candidate match if A is the nearest neighbor of B and B is the nearest
-// neighbor of A.
-void FindCandidateMatches(const FeatureSet &left,
-                          const FeatureSet &right,
-                          Matches *matches,
-                          eLibmvMatchMethod eMatchMethod) {
-  if (left.features.size() == 0 ||
-      right.features.size() == 0 )  {
-    return;
+// Search the NN nearest neighbours of the query features in the dataset
+// features. The Hamming distances of the binary descriptors are returned as
+// floats, so that the callers handle both kinds of descriptors alike. The
+// neighbours which are not found have a negative index.
+static bool SearchNeighbours(const FeatureSet &dataset,
+                             const FeatureSet &queries,
+                             eLibmvMatchMethod eMatchMethod,
+                             int NN,
+                             libmv::vector<int> *indices,
+                             libmv::vector<float> *distances) {
+  if (eMatchMethod == eMATCH_HAMMING ||
+      eMatchMethod == eMATCH_HAMMING_MULTI_INDEX)  {
+    int descriptorSize = dataset.features[0].binary_descriptor.bits.size();
+    correspondence::ArrayMatcher<unsigned char, int> * pArrayMatcher = NULL;
+    if (eMatchMethod == eMATCH_HAMMING) {
+      pArrayMatcher = new correspondence::ArrayMatcher_Hamming;
+    } else {
+      pArrayMatcher = new correspondence::ArrayMatcher_HammingMultiIndex;
+    }
+    unsigned char * arrayData =
+      FeatureSet::FeatureSetBinaryDescriptorsToContiguousArray(dataset);
+    unsigned char * arrayQueries =
+      FeatureSet::FeatureSetBinaryDescriptorsToContiguousArray(queries);
+
+    libmv::vector<int> hammingDistances;
+    bool breturn =
+      pArrayMatcher->build(arrayData, dataset.features.size(),
+                           descriptorSize) &&
+      pArrayMatcher->searchNeighbours(arrayQueries, queries.features.size(),
+                                      indices, &hammingDistances, NN);
+    delete pArrayMatcher;
+    delete [] arrayData;
+    delete [] arrayQueries;
+
+    distances->resize(hammingDistances.size());
+    for (int i = 0; i < hammingDistances.size(); ++i) {
+      (*distances)[i] = hammingDistances[i];
+    }
+    return breturn;
   }
-  int descriptorSize = left.features[0].descriptor.coords.size();
 
-  correspondence::ArrayMatcher<float> * pArrayMatcherA = NULL;
-  correspondence::ArrayMatcher<float> * pArrayMatcherB = NULL;
+  int descriptorSize = dataset.features[0].descriptor.coords.size();
+  correspondence::ArrayMatcher<float> * pArrayMatcher = NULL;
   switch (eMatchMethod)
   {
   case eMATCH_KDTREE:
     {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree<float>;
-      pArrayMatcherB = new correspondence::ArrayMatcher_Kdtree<float>;
+      pArrayMatcher = new correspondence::ArrayMatcher_Kdtree<float>;
     }
     break;
     case eMATCH_KDTREE_FLANN:
     {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree_Flann<float>;
-      pArrayMatcherB = new correspondence::ArrayMatcher_Kdtree_Flann<float>;
+      pArrayMatcher = new correspondence::ArrayMatcher_Kdtree_Flann<float>;
     }
     break;
     case eMATCH_LINEAR:
     {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_BruteForce<float>;
-      pArrayMatcherB = new correspondence::ArrayMatcher_BruteForce<float>;
+      pArrayMatcher = new correspondence::ArrayMatcher_BruteForce<float>;
     }
     break;
+    default:
+    {
+      LOG(INFO) << "[SearchNeighbours] Unknown input match method.";
+      return false;
+    }
   };
 
-  if (pArrayMatcherA != NULL && pArrayMatcherB != NULL) {
-
-    // Paste the necessary data in contiguous arrays.
-    float * arrayA = FeatureSet::FeatureSetDescriptorsToContiguousArray(left);
-    float * arrayB = FeatureSet::FeatureSetDescriptorsToContiguousArray(right);
-
-    libmv::vector<int> indices, indicesReverse;
-    libmv::vector<float> distances, distancesReverse;
+  // Paste the necessary data in contiguous arrays.
+  float * arrayData =
+    FeatureSet::FeatureSetDescriptorsToContiguousArray(dataset);
+  float * arrayQueries =
+    FeatureSet::FeatureSetDescriptorsToContiguousArray(queries);
+
+  bool breturn =
+    pArrayMatcher->build(arrayData, dataset.features.size(), descriptorSize) &&
+    pArrayMatcher->searchNeighbours(arrayQueries, queries.features.size(),
+                                    indices, distances, NN);
+  delete pArrayMatcher;
+  delete [] arrayData;
+  delete [] arrayQueries;
+  return breturn;
+}
 
-    bool breturn = false;
-    if (pArrayMatcherA->build(arrayA,left.features.size(),descriptorSize) &&
-        pArrayMatcherB->build(arrayB,right.features.size(),descriptorSize) )  {
+// Compute candidate matches between 2 sets of features.  Two features A and B
+// are a candidate match if A is the nearest neighbor of B and B is the nearest
+// neighbor of A.
+void FindCandidateMatches(const FeatureSet &left,
+                          const FeatureSet &right,
+                          Matches *matches,
+                          eLibmvMatchMethod eMatchMethod) {
+  if (left.features.size() == 0 ||
+      right.features.size() == 0 )  {
+    return;
+  }
 
-      const int NN = 1;
-      breturn =
-        pArrayMatcherB->searchNeighbours(arrayA,left.features.size(),
-          &indices, &distances, NN) &&
-        pArrayMatcherA->searchNeighbours(arrayB,right.features.size(),
-          &indicesReverse, &distancesReverse, NN);
-    }
-    delete pArrayMatcherA;
-    delete pArrayMatcherB;
-
-    delete [] arrayA;
-    delete [] arrayB;
-
-    // From putative matches get symmetric matches.
-    if (breturn)  {
-      //TODO(pmoulon) clear previous matches.
-      int max_track_number = 0;
-      for (size_t i = 0; i < indices.size(); ++i) {
-        // Add the match only if we have a symmetric result.
-        if (i == indicesReverse[indices[i]])  {
-          matches->Insert(0, max_track_number, &left.features[i]);
-          matches->Insert(1, max_track_number, &right.features[indices[i]]);
-          ++max_track_number;
-        }
+  libmv::vector<int> indices, indicesReverse;
+  libmv::vector<float> distances, distancesReverse;
+
+  const int NN = 1;
+  bool breturn =
+    SearchNeighbours(right, left, eMatchMethod, NN, &indices, &distances) &&
+    SearchNeighbours(left, right, eMatchMethod, NN,
+                     &indicesReverse, &distancesReverse);
+
+  // From putative matches get symmetric matches.
+  if (breturn)  {
+    //TODO(pmoulon) clear previous matches.
+    int max_track_number = 0;
+    for (size_t i = 0; i < indices.size(); ++i) {
+      // Add the match only if we have a symmetric result.
+      if (indices[i] >= 0 && i == indicesReverse[indices[i]])  {
+        matches->Insert(0, max_track_number, &left.features[i]);
+        matches->Insert(1, max_track_number, &right.features[indices[i]]);
+        ++max_track_number;
       }
     }
-    else  {
-      LOG(INFO) << "[FindCandidateMatches] Cannot compute symmetric matches.";
-    }
   }
   else  {
-    LOG(INFO) << "[FindCandidateMatches] Unknown input match method.";
+    LOG(INFO) << "[FindCandidateMatches] Cannot compute symmetric matches.";
   }
 }
 
@@ -131,6 +171,27 @@ float * FeatureSet::FeatureSetDescriptorsToContiguousArray
   return array;
 }
 
+unsigned char * FeatureSet::FeatureSetBinaryDescriptorsToContiguousArray
+  ( const FeatureSet & featureSet ) {
+
+  if (featureSet.features.size() == 0)  {
+    return NULL;
+  }
+  int descriptorSize =
+    featureSet.features[0].binary_descriptor.bits.size();
+  // Allocate and paste the necessary data.
+  unsigned char * array =
+    new unsigned char[featureSet.features.size()*descriptorSize];
+
+  //-- Paste data in the contiguous array :
+  for (int i = 0; i < (int)featureSet.features.size(); ++i) {
+    const unsigned char * bits =
+      featureSet.features[i].binary_descriptor.bits.begin();
+    std::copy(bits, bits + descriptorSize, array + descriptorSize*i);
+  }
+  return array;
+}
+
 // Compute candidate matches between 2 sets of features with a ratio.
 void FindCandidateMatches_Ratio(const FeatureSet &left,
                           const FeatureSet &right,
@@ -142,75 +203,40 @@ void FindCandidateMatches_Ratio(const FeatureSet &left,
       right.features.size() == 0 )  {
     return;
   }
-  int descriptorSize = left.features[0].descriptor.coords.size();
-
-  correspondence::ArrayMatcher<float> * pArrayMatcherA = NULL;
-  switch (eMatchMethod)
-  {
-  case eMATCH_KDTREE:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree<float>;
-    }
-    break;
-    case eMATCH_KDTREE_FLANN:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree_Flann<float>;
-    }
-    break;
-    case eMATCH_LINEAR:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      LOG(INFO) << "Not yet implemented.";
-      return;
-    }
-    break;
-  };
 
   const int NN = 2;
-  if (pArrayMatcherA != NULL) {
-
-    // Paste the necessary data in contiguous arrays.
-    float * arrayA = FeatureSet::FeatureSetDescriptorsToContiguousArray(left);
-    float * arrayB = FeatureSet::FeatureSetDescriptorsToContiguousArray(right);
-
-    libmv::vector<int> indices;
-    libmv::vector<float> distances;
-
-    bool breturn = false;
-    if (pArrayMatcherA->build(arrayB,right.features.size(),descriptorSize))  {
-      breturn =
-        pArrayMatcherA->searchNeighbours(arrayA,left.features.size(),
-          &indices, &distances, NN);
-    }
-    delete pArrayMatcherA;
-    delete [] arrayA;
-    delete [] arrayB;
-
-    // From putative matches get matches that fit the "Ratio" heuristic.
-    if (breturn)  {
-      //TODO(pmoulon) clear previous matches.
-      int max_track_number = 0;
-
-      for (size_t i = 0; i < left.features.size(); ++i) {
-        // Test distance ratio :
-        float distance0 = distances[i*NN];
-        float distance1 = distances[i*NN+NN-1];
-
-        if (distance0 < fRatio * distance1) {
-          matches->Insert(0, max_track_number, &left.features[i]);
-          matches->Insert(1, max_track_number, &right.features[indices[i*NN]]);
-          ++max_track_number;
-        }
+  libmv::vector<int> indices;
+  libmv::vector<float> distances;
+
+  bool breturn =
+    SearchNeighbours(right, left, eMatchMethod, NN, &indices, &distances);
+
+  // From putative matches get matches that fit the "Ratio" heuristic.
+  if (breturn)  {
+    //TODO(pmoulon) clear previous matches.
+    // Keep the (ratio, left feature) of the matches which pass, so that
+    // they can be numbered from the most to the least distinctive.
+    std::vector<std::pair<float, size_t> > ranked_matches;
+    for (size_t i = 0; i < left.features.size(); ++i) {
+      // Test distance ratio :
+      float distance0 = distances[i*NN];
+      float distance1 = distances[i*NN+NN-1];
+
+      if (indices[i*NN] >= 0 && distance0 < fRatio * distance1) {
+        float ratio = distance1 > 0 ? distance0 / distance1 : 0;
+        ranked_matches.push_back(std::make_pair(ratio, i));
       }
     }
-    else  {
-      LOG(INFO) << "[FindCandidateMatches_Ratio] Cannot compute matches.";
+    std::stable_sort(ranked_matches.begin(), ranked_matches.end());
+
+    for (int track = 0; track < ranked_matches.size(); ++track) {
+      size_t i = ranked_matches[track].second;
+      matches->Insert(0, track, &left.features[i]);
+      matches->Insert(1, track, &right.features[indices[i*NN]]);
     }
   }
   else  {
-    LOG(INFO) << "[FindCandidateMatches_Ratio] Unknow input match method.";
+    LOG(INFO) << "[FindCandidateMatches_Ratio] Cannot compute matches.";
   }
 }
 
@@ -225,69 +251,27 @@ void FindCorrespondences(const FeatureSet &left,
       right.features.size() == 0 )  {
     return;
   }
-  int descriptorSize = left.features[0].descriptor.coords.size();
-
-  correspondence::ArrayMatcher<float> * pArrayMatcherA = NULL;
-  switch (eMatchMethod)
-  {
-  case eMATCH_KDTREE:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree<float>;
-    }
-    break;
-    case eMATCH_KDTREE_FLANN:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      pArrayMatcherA = new correspondence::ArrayMatcher_Kdtree_Flann<float>;
-    }
-    break;
-    case eMATCH_LINEAR:
-    {
-      // Build the arrays matcher in order to compute matches pair.
-      LOG(INFO) << "Not yet implemented.";
-      return;
-    }
-    break;
-  };
 
   const int NN = 2;
-  if (pArrayMatcherA != NULL) {
+  libmv::vector<int> indices;
+  libmv::vector<float> distances;
 
-    // Paste the necessary data in contiguous arrays.
-    float * arrayA = FeatureSet::FeatureSetDescriptorsToContiguousArray(left);
-    float * arrayB = FeatureSet::FeatureSetDescriptorsToContiguousArray(right);
+  bool breturn =
+    SearchNeighbours(right, left, eMatchMethod, NN, &indices, &distances);
 
-    libmv::vector<int> indices;
-    libmv::vector<float> distances;
+  // From putative matches get matches that fit the "Ratio" heuristic.
+  if (breturn)  {
+    for (size_t i = 0; i < left.features.size(); ++i) {
+      // Test distance ratio :
+      float distance0 = distances[i*NN];
+      float distance1 = distances[i*NN+NN-1];
 
-    bool breturn = false;
-    if (pArrayMatcherA->build(arrayB,right.features.size(),descriptorSize))  {
-      breturn =
-        pArrayMatcherA->searchNeighbours(arrayA,left.features.size(),
-          &indices, &distances, NN);
-    }
-    delete pArrayMatcherA;
-    delete [] arrayA;
-    delete [] arrayB;
-
-    // From putative matches get matches that fit the "Ratio" heuristic.
-    if (breturn)  {
-      for (size_t i = 0; i < left.features.size(); ++i) {
-        // Test distance ratio :
-        float distance0 = distances[i*NN];
-        float distance1 = distances[i*NN+NN-1];
-
-        if (distance0 < fRatio * distance1) {
-          (*correspondences)[i] = indices[i*NN];
-        }
+      if (indices[i*NN] >= 0 && distance0 < fRatio * distance1) {
+        (*correspondences)[i] = indices[i*NN];
       }
     }
-    else  {
-      LOG(INFO) << "[FindCandidateMatches_Ratio] Cannot compute matches.";
-    }
   }
   else  {
-    LOG(INFO) << "[FindCandidateMatches_Ratio] Unknow input match method.";
+    LOG(INFO) << "[FindCandidateMatches_Ratio] Cannot compute matches.";
   }
 }
@@ -26,6 +26,7 @@
 #include "libmv/correspondence/kdtree.h"
 #include "libmv/correspondence/feature.h"
 #include "libmv/correspondence/matches.h"
+#include "libmv/descriptor/binary_descriptor.h"
 #include "libmv/descriptor/descriptor.h"
 #include "libmv/descriptor/vector_descriptor.h"
 
@@ -33,9 +34,11 @@ using namespace libmv;
 
 /// Define the description of a feature described by :
 /// A PointFeature (x,y,scale,orientation),
-/// And a descriptor (a vector of floats).
+/// And a descriptor (a vector of floats), or a binary descriptor (an array of
+/// bytes of packed bits) for the binary describers.
 struct KeypointFeature : public ::PointFeature {
   descriptor::VecfDescriptor descriptor;
+  descriptor::BinaryDescriptor binary_descriptor;
   // Match kdtree traits: with this, the Feature can act as a kdtree point.
   float operator[](int i) const { return descriptor.coords(i); }
 };
@@ -48,13 +51,25 @@ struct FeatureSet {
   /// Must be deleted with []
   static float *FeatureSetDescriptorsToContiguousArray
     ( const FeatureSet & featureSet );
+
+  /// return an unsigned char * containing the concatenation of the binary
+  /// descriptors data. Must be deleted with []
+  static unsigned char *FeatureSetBinaryDescriptorsToContiguousArray
+    ( const FeatureSet & featureSet );
 };
 
+// The eMATCH_HAMMING methods match the binary descriptors of the features,
+// the other ones their float descriptors. eMATCH_HAMMING is an exhaustive
+// search, the fastest for the features of a few images, while
+// eMATCH_HAMMING_MULTI_INDEX only finds the neighbours within a Hamming
+// distance of 47 bits, but much faster in large sets of features.
 enum eLibmvMatchMethod
 {
   eMATCH_LINEAR,
   eMATCH_KDTREE,
-  eMATCH_KDTREE_FLANN
+  eMATCH_KDTREE_FLANN,
+  eMATCH_HAMMING,
+  eMATCH_HAMMING_MULTI_INDEX
 };
 
 // Compute candidate matches between 2 sets of features.  Two features a and b
@@ -74,6 +89,8 @@ void FindCandidateMatches(const FeatureSet &left,
 // You can use David Lowe's magic ratio (0.6 or 0.8).
 // 0.8 allow to remove 90% of the false matches while discarding less than 5%
 // of the correct matches.
+// The matches are numbered by increasing distance ratio, i.e. the most
+// distinctive ones come first, as ProsacSampler expects.
 void FindCandidateMatches_Ratio(const FeatureSet &left,
                           const FeatureSet &right,
                           Matches *matches,
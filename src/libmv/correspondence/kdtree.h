@@ -26,7 +26,9 @@
 #include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <limits>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/numeric/numeric.h"
 
 namespace libmv {
@@ -121,13 +123,16 @@ class KdTree {
     Id id;
   };
 
+  // The nodes are stored in a flat array, the children of node i being nodes
+  // 2i + 1 and 2i + 2. The points of a node are [begin, end) in the point
+  // arrays, which are in tree order.
   struct KdNode {
     int axis;
     Scalar cut_value;
     Scalar min_value;
     Scalar max_value;
-    Point *begin;
-    Point *end;
+    int begin;
+    int end;
   };
 
   struct AxisComparison {
@@ -161,8 +166,14 @@ class KdTree {
   /**
    * Build the tree.  This function uses the points that have been added using
    * AddPoint.
+   *
+   * The point data is copied in tree order, so that the points of a leaf are
+   * next to each other in memory, and the data passed to AddPoint is no
+   * longer needed once the tree is built.
    */
   void Build(int max_levels) {
+    assert(points_.size() > 0);
+
     // Compute the number of levels such that any leaf has at least 1 point.
     // This is num_leafs <= num_points, with num_leafs = 2**(num_levels - 1).
     int l = int(floor(log((double)points_.size()) / log(2.))) + 1;
@@ -173,12 +184,22 @@ class KdTree {
 
     // Recursively create the nodes.
     CreateNode(0, &points_.front(), &points_.back() + 1);
+
+    data_.resize(points_.size() * num_dims_);
+    ids_.resize(points_.size());
+    for (size_t i = 0; i < points_.size(); ++i) {
+      std::copy(points_[i].data, points_[i].data + num_dims_,
+                &data_[i * num_dims_]);
+      ids_[i] = points_[i].id;
+    }
+    std::vector<Point>().swap(points_);
   }
 
   int NumNodes() const { return nodes_.size(); }
   int NumLeafs() const { return (NumNodes() + 1) / 2; }
   int NumLevels() const { return num_levels_; }
   int NumDimension() const { return num_dims_; }
+  int NumPoints() const { return ids_.size(); }
 
   void PrintNodes() const {
     for (int i = 0; i < nodes_.size(); ++i) {
@@ -218,7 +239,7 @@ class KdTree {
 
     while (!queue.IsEmpty() && num_explored_leafs < max_leafs) {
       // Stop if best node is farther than worst neighbor found so far.
-      float old_distance = queue.TopPriority();
+      Scalar old_distance = queue.TopPriority();
       if (neighbors->Full() && old_distance >= neighbors->FarthestDistance()) {
         break;
       }
@@ -248,15 +269,38 @@ class KdTree {
         }
       }
       // Explore leaf.
-      for (Point *p = nodes_[i].begin; p < nodes_[i].end; ++p) {
-        Scalar distance = L2Distance2(p->data, query);
-        neighbors->AddNeighbor(p->id, distance);
+      for (int p = nodes_[i].begin; p < nodes_[i].end; ++p) {
+        Scalar distance = L2Distance2(&data_[p * num_dims_], query);
+        neighbors->AddNeighbor(ids_[p], distance);
       }
       num_explored_leafs++;
     }
     return num_explored_leafs;
   }
 
+  /**
+   * Finds the k nearest neighbors of each of the num_queries queries stored
+   * one after the other in queries, like ApproximateKnnBestBinFirst above.
+   * The queries are spread over pool if it is not NULL.
+   *
+   *  \param ids       The k neighbors of each query, one query after the
+   *                   other, sorted by distance.
+   *  \param distances The squared distances of the neighbors.
+   *
+   * If less than k neighbors are found, the missing ones have the id -1, as
+   * in the Hamming matchers, and the largest Scalar as distance.
+   */
+  void ApproximateKnnBestBinFirst(const Scalar *queries,
+                                  int num_queries,
+                                  int k,
+                                  int max_leafs,
+                                  Id *ids,
+                                  Scalar *distances,
+                                  ThreadPool *pool = NULL) const {
+    KnnSearch search(*this, queries, k, max_leafs, ids, distances);
+    ParallelFor(pool, 0, num_queries, search, kQueriesPerChunk);
+  }
+
  private:
   int LeftChild(int i) const {
     return 2 * i + 1;
@@ -271,14 +315,49 @@ class KdTree {
     return i >= NumNodes() / 2; // Note NumNodes() is odd.
   }
 
+  // Queries handed to a thread at once by the batched search.
+  static const int kQueriesPerChunk = 16;
+
+  // Searches the neighbors of one query, for ParallelFor().
+  class KnnSearch {
+   public:
+    KnnSearch(const KdTree &tree, const Scalar *queries, int k,
+              int max_leafs, Id *ids, Scalar *distances)
+        : tree_(tree), queries_(queries), k_(k), max_leafs_(max_leafs),
+          ids_(ids), distances_(distances) {}
+
+    void operator()(int i) const {
+      SearchResults neighbors(k_);
+      tree_.ApproximateKnnBestBinFirst(queries_ + i * tree_.NumDimension(),
+                                       max_leafs_, &neighbors);
+      for (int j = 0; j < k_; ++j) {
+        if (j < neighbors.Size()) {
+          ids_[i * k_ + j] = neighbors.Neighbor(j);
+          distances_[i * k_ + j] = neighbors.Distance(j);
+        } else {
+          ids_[i * k_ + j] = Id(-1);
+          distances_[i * k_ + j] = std::numeric_limits<Scalar>::max();
+        }
+      }
+    }
+
+   private:
+    const KdTree &tree_;
+    const Scalar *queries_;
+    int k_;
+    int max_leafs_;
+    Id *ids_;
+    Scalar *distances_;
+  };
+
   void CreateNode(int i, Point *begin, Point *end) {
     int num_points = end - begin;
     assert(num_points > 0);
 
     // Create the node.
     KdNode &node = nodes_[i];
-    node.begin = begin;
-    node.end = end;
+    node.begin = begin - &points_.front();
+    node.end = end - &points_.front();
 
     if (!IsLeaf(i)) {
       assert(num_points >= 2);
@@ -341,11 +420,18 @@ class KdTree {
 
  private:
   std::vector<KdNode> nodes_;
+  // The added points; emptied by Build().
   std::vector<Point> points_;
+  // The point coordinates and ids, in tree order.
+  std::vector<Scalar> data_;
+  std::vector<Id> ids_;
   int num_dims_;
   int num_levels_;
 };
 
+template <typename Scalar, typename Id>
+const int KdTree<Scalar, Id>::kQueriesPerChunk;
+
 }  // namespace libmv
 
 #endif // LIBMV_CORRESPONDENCE_KDTREE_H_
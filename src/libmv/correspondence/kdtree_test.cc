@@ -19,6 +19,7 @@
 // IN THE SOFTWARE.
 
 #include "testing/testing.h"
+#include "libmv/base/thread_pool.h"
 #include "libmv/numeric/numeric.h"
 #include "libmv/correspondence/kdtree.h"
 
@@ -187,4 +188,77 @@ TEST(KdTree, ApproximateKnnBestBinFirstBig) {
                              // 13 has been found by testing the code itself :(
 }
 
+TEST(KdTree, BatchedKnnBestBinFirst) {
+  const int dims = 8, num_points = 500, num_queries = 100, k = 3;
+  std::vector<float> points(num_points * dims), queries(num_queries * dims);
+  unsigned seed = 1;
+  for (int i = 0; i < num_points * dims; ++i) {
+    seed = seed * 1103515245 + 12345;
+    points[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+  for (int i = 0; i < num_queries * dims; ++i) {
+    seed = seed * 1103515245 + 12345;
+    queries[i] = ((seed >> 8) % 1000) / 1000.0f;
+  }
+
+  KdTree<float> tree;
+  tree.SetDimensions(dims);
+  for (int i = 0; i < num_points; ++i) tree.AddPoint(&points[i * dims], i);
+  tree.Build(10);
+  EXPECT_EQ(num_points, tree.NumPoints());
+
+  // The tree keeps its own copy of the points.
+  std::vector<float> copy(points);
+  std::fill(points.begin(), points.end(), 0.0f);
+
+  ThreadPool pool(2);
+  ThreadPool *pools[] = { NULL, &pool };
+  for (int p = 0; p < 2; ++p) {
+    // Exploring every leaf finds the exact neighbors.
+    std::vector<int> ids(num_queries * k);
+    std::vector<float> distances(num_queries * k);
+    tree.ApproximateKnnBestBinFirst(&queries[0], num_queries, k,
+                                    tree.NumLeafs(), &ids[0], &distances[0],
+                                    pools[p]);
+    for (int q = 0; q < num_queries; ++q) {
+      KnnSortedList<float, int> expected(k);
+      for (int i = 0; i < num_points; ++i) {
+        float distance = 0;
+        for (int j = 0; j < dims; ++j) {
+          float d = copy[i * dims + j] - queries[q * dims + j];
+          distance += d * d;
+        }
+        expected.AddNeighbor(i, distance);
+      }
+      for (int j = 0; j < k; ++j) {
+        EXPECT_EQ(expected.Neighbor(j), ids[q * k + j]);
+        EXPECT_FLOAT_EQ(expected.Distance(j), distances[q * k + j]);
+      }
+    }
+  }
+}
+
+TEST(KdTree, BatchedKnnBestBinFirstMoreNeighborsThanPoints) {
+  const int dims = 2, num_points = 3, k = 5;
+  float points[num_points * dims] = { 0, 0,  1, 0,  0, 2 };
+  KdTree<float> tree;
+  tree.SetDimensions(dims);
+  for (int i = 0; i < num_points; ++i) tree.AddPoint(&points[i * dims], i);
+  tree.Build(1);
+
+  float query[dims] = { 0.1f, 0 };
+  int ids[k];
+  float distances[k];
+  tree.ApproximateKnnBestBinFirst(query, 1, k, tree.NumLeafs(),
+                                  ids, distances);
+  EXPECT_EQ(0, ids[0]);
+  EXPECT_EQ(1, ids[1]);
+  EXPECT_EQ(2, ids[2]);
+  // Point 0 is a real neighbor; the missing ones must not look like it.
+  for (int j = num_points; j < k; ++j) {
+    EXPECT_EQ(-1, ids[j]);
+    EXPECT_EQ(std::numeric_limits<float>::max(), distances[j]);
+  }
+}
+
 }  // namespace
@@ -18,8 +18,16 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define LIBMV_KLT_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "libmv/base/thread_pool.h"
 #include "libmv/base/vector.h"
 #include "libmv/numeric/numeric.h"
 #include "libmv/correspondence/klt.h"
@@ -57,29 +65,6 @@ static void FindLocalMaxima(const FloatImage &trackness,
   }
 }
 
-// Compute the gradient matrix noted by Z in Good Features to Track.
-//
-//   Z = [gxx gxy; gxy gyy]
-//
-// This function computes the matrix for every pixel.
-static void ComputeGradientMatrix(const Array3Df &image_and_gradients,
-                                       int window_size,
-                                       Array3Df *gradient_matrix) {
-  Array3Df gradients;
-  gradients.ResizeLike(image_and_gradients);
-  for (int j = 0; j < image_and_gradients.Height(); ++j) {
-    for (int i = 0; i < image_and_gradients.Width(); ++i) {
-      float gx = image_and_gradients(j, i, 1);
-      float gy = image_and_gradients(j, i, 2);
-      gradients(j, i, 0) = gx * gx;
-      gradients(j, i, 1) = gx * gy;
-      gradients(j, i, 2) = gy * gy;
-    }
-  }
-  // Sum the gradient matrix over tracking window for each pixel.
-  BoxFilter(gradients, window_size, gradient_matrix);
-}
-
 // Given the three distinct elements of the symmetric 2x2 matrix
 //
 //                     [gxx gxy]
@@ -91,63 +76,288 @@ static float MinEigenValue(float gxx, float gxy, float gyy) {
   return (gxx + gyy - sqrt((gxx - gyy) * (gxx - gyy) + 4 * gxy * gxy)) / 2.0f;
 }
 
-// Compute trackness of every pixel given the gradient matrix.
-// This is done as described in the Good Features to Track paper.
-static void ComputeTrackness(const Array3Df gradient_matrix,
-                             Array3Df *trackness_pointer,
-                             double *trackness_mean) {
-  Array3Df &trackness = *trackness_pointer;
-  trackness.Resize(gradient_matrix.Height(), gradient_matrix.Width());
-  *trackness_mean = 0;
-  for (int i = 0; i < trackness.Height(); ++i) {
-    for (int j = 0; j < trackness.Width(); ++j) {
-      double t = MinEigenValue(gradient_matrix(i, j, 0),
-                               gradient_matrix(i, j, 1),
-                               gradient_matrix(i, j, 2));
-      trackness(i, j) = t;
-      *trackness_mean += t;
-    }
+namespace {
+
+// Computes MinEigenValue() of n matrices.
+void MinEigenValues(const float *gxx, const float *gxy, const float *gyy,
+                    int n, float *out) {
+  int i = 0;
+#ifdef LIBMV_KLT_SSE2
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  for (; i + 4 <= n; i += 4) {
+    __m128 xx = _mm_loadu_ps(gxx + i);
+    __m128 xy = _mm_loadu_ps(gxy + i);
+    __m128 yy = _mm_loadu_ps(gyy + i);
+    __m128 difference = _mm_sub_ps(xx, yy);
+    __m128 discriminant = _mm_add_ps(_mm_mul_ps(difference, difference),
+                                     _mm_mul_ps(four, _mm_mul_ps(xy, xy)));
+    __m128 t = _mm_sub_ps(_mm_add_ps(xx, yy), _mm_sqrt_ps(discriminant));
+    _mm_storeu_ps(out + i, _mm_mul_ps(t, half));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = MinEigenValue(gxx[i], gxy[i], gyy[i]);
   }
-  *trackness_mean /= trackness.Size();
 }
 
-// TODO(keir): Use Stan's neat trick of using a 'punch-out' array to detect
-// too-closes features. This is O(n^2)!
-static void RemoveTooCloseFeatures(KLTContext::FeatureList *features,
-                                   double squared_min_distance) {
-  // mark close features with least trackness as invalid
-  for(size_t i = 0 ; i < features->size() ; ++i) {
-    KLTPointFeature& a = features->at(i);
-    for(size_t j = 0 ; j < i ; j++) {  // compare each feature pair once
-      KLTPointFeature& b = features->at(j);
-      if ( b.trackness != 0  // skip invalidated features
-           && (a.coords-b.coords).squaredNorm() < squared_min_distance ) {
-        ((a.trackness < b.trackness) ? a : b).trackness=0;  // invalid feature
+// sums[i] += sign * values[i], for sign 1 or -1.
+void AccumulateRow(const float *values, int n, float sign, float *sums) {
+  int i = 0;
+#ifdef LIBMV_KLT_SSE2
+  const __m128 signs = _mm_set1_ps(sign);
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_mul_ps(signs, _mm_loadu_ps(values + i));
+    _mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(sums + i), v));
+  }
+#endif
+  for (; i < n; ++i) {
+    sums[i] += sign * values[i];
+  }
+}
+
+// Computes the trackness of the rows of one tile of a region. The gradient
+// matrix noted by Z in Good Features to Track,
+//
+//   Z = [gxx gxy; gxy gyy],
+//
+// is summed over the window with running sums: the column sums of the
+// window are updated by adding the row entering it and subtracting the row
+// leaving it, then summed along the row. Pixels of the window outside of the
+// image count as zero, like in BoxFilter().
+class TracknessTile {
+ public:
+  static const int kTileHeight = 32;
+
+  TracknessTile(const Array3Df &image_and_gradients, int half_width,
+                int row, int col, int rows, int cols, Array3Df *trackness)
+      : image_and_gradients_(image_and_gradients), half_width_(half_width),
+        row_(row), col_(col), rows_(rows), cols_(cols),
+        trackness_(trackness) {}
+
+  void operator()(int tile) const {
+    const int height = image_and_gradients_.Height();
+    const int width = image_and_gradients_.Width();
+    const int h = half_width_;
+
+    // Columns of the image under the windows of the region.
+    const int begin = max(0, col_ - h);
+    const int end = min(width, col_ + cols_ + h);
+    const int n = end - begin;
+
+    // Planes of gxx, gxy and gyy, for one row and for the column sums.
+    vector<float> products(3 * n), sums(3 * n, 0.0f);
+    // Window sums and trackness of one output row.
+    vector<float> window(3 * cols_), trackness_row(cols_);
+
+    const int y_begin = row_ + tile * kTileHeight;
+    const int y_end = min(row_ + rows_, y_begin + kTileHeight);
+    for (int y = max(0, y_begin - h); y <= min(height - 1, y_begin + h); ++y) {
+      ComputeProducts(y, begin, n, &products[0]);
+      AccumulateRow(&products[0], 3 * n, 1.0f, &sums[0]);
+    }
+    for (int y = y_begin; y < y_end; ++y) {
+      if (y > y_begin) {
+        if (y + h < height) {
+          ComputeProducts(y + h, begin, n, &products[0]);
+          AccumulateRow(&products[0], 3 * n, 1.0f, &sums[0]);
+        }
+        if (y - h - 1 >= 0) {
+          ComputeProducts(y - h - 1, begin, n, &products[0]);
+          AccumulateRow(&products[0], 3 * n, -1.0f, &sums[0]);
+        }
+      }
+      for (int k = 0; k < 3; ++k) {
+        SumWindows(&sums[k * n], begin, end, &window[k * cols_]);
+      }
+      MinEigenValues(&window[0], &window[cols_], &window[2 * cols_], cols_,
+                     &trackness_row[0]);
+      float *out = &(*trackness_)(y - row_, 0);
+      for (int x = 0; x < cols_; ++x) {
+        out[x] = trackness_row[x];
       }
     }
   }
-  // compress feature array in place by removing invalid features
+
+ private:
+  // Computes the gradient products of the n pixels of row y from column
+  // begin, in planes of n floats.
+  void ComputeProducts(int y, int begin, int n, float *products) const {
+    const float *pixel = &image_and_gradients_(y, begin, 0);
+    for (int x = 0; x < n; ++x, pixel += 3) {
+      float gx = pixel[1];
+      float gy = pixel[2];
+      products[x] = gx * gx;
+      products[n + x] = gx * gy;
+      products[2 * n + x] = gy * gy;
+    }
+  }
+
+  // Sums the column sums, which start at image column begin and end at
+  // column end, over the window of each column of the region.
+  void SumWindows(const float *column_sums, int begin, int end,
+                  float *window) const {
+    const int h = half_width_;
+    float sum = 0;
+    for (int x = max(begin, col_ - h); x < min(end, col_ + h); ++x) {
+      sum += column_sums[x - begin];
+    }
+    for (int x = col_; x < col_ + cols_; ++x) {
+      if (x + h < end) {
+        sum += column_sums[x + h - begin];
+      }
+      window[x - col_] = sum;
+      if (x - h >= begin) {
+        sum -= column_sums[x - h - begin];
+      }
+    }
+  }
+
+  const Array3Df &image_and_gradients_;
+  int half_width_;
+  int row_, col_, rows_, cols_;
+  Array3Df *trackness_;
+};
+
+}  // namespace
+
+void ComputeTrackness(const Array3Df &image_and_gradients,
+                      int window_size,
+                      int row, int col, int rows, int cols,
+                      Array3Df *trackness,
+                      ThreadPool *pool) {
+  assert(image_and_gradients.Depth() == 3);
+  assert(image_and_gradients.Stride(2) == 1 &&
+         image_and_gradients.Stride(1) == 3);
+  assert(row >= 0 && col >= 0 && rows >= 0 && cols >= 0);
+  assert(row + rows <= image_and_gradients.Height());
+  assert(col + cols <= image_and_gradients.Width());
+
+  trackness->Resize(rows, cols);
+  if (rows == 0 || cols == 0) {
+    return;
+  }
+  TracknessTile tile(image_and_gradients, (window_size - 1) / 2,
+                     row, col, rows, cols, trackness);
+  int num_tiles = (rows + TracknessTile::kTileHeight - 1) /
+                  TracknessTile::kTileHeight;
+  ParallelFor(pool, 0, num_tiles, tile);
+}
+
+static bool HasMoreTrackness(const KLTPointFeature &a,
+                             const KLTPointFeature &b) {
+  return a.trackness > b.trackness;
+}
+
+// Keeps the features with the highest trackness such that no two are closer
+// than min_distance, and at most max_per_cell (if positive) in each cell of
+// cell_size by cell_size pixels. The features end up sorted by decreasing
+// trackness.
+//
+// This is Stan's 'punch-out' trick with a coarser array: the kept features
+// are recorded in a grid with cells of side min_distance / sqrt(2), but at
+// least a pixel, so a cell holds at most one of them (the local maxima are on
+// integer pixels) and only the 5x5 cells around a candidate need to be
+// checked. Apart from the sort, this is linear in the number of features.
+static void RemoveTooCloseFeatures(KLTContext::FeatureList *features,
+                                   double min_distance,
+                                   int cell_size,
+                                   int max_per_cell,
+                                   int width,
+                                   int height) {
+  std::stable_sort(features->begin(), features->end(), HasMoreTrackness);
+
+  const double squared_min_distance = min_distance * min_distance;
+  const double grid_size = max(1.0, min_distance / sqrt(2.0));
+  const int grid_width = int(width / grid_size) + 1;
+  const int grid_height = int(height / grid_size) + 1;
+  vector<int> grid(grid_width * grid_height, -1);
+
+  const bool check_cells = max_per_cell > 0 && cell_size > 0;
+  const int cells_width = check_cells ? width / cell_size + 1 : 0;
+  const int cells_height = check_cells ? height / cell_size + 1 : 0;
+  vector<int> features_in_cell(cells_width * cells_height, 0);
+
   size_t size = 0;
-  for(size_t i = 0 ; i < features->size() ; ++i) {
-    const KLTPointFeature& a = features->at(i);
-    if( a.trackness != 0 ) features->at(size++) = a;
+  for (size_t i = 0; i < features->size(); ++i) {
+    const KLTPointFeature &a = features->at(i);
+    if (check_cells) {
+      int cell = int(a.coords(1)) / cell_size * cells_width +
+                 int(a.coords(0)) / cell_size;
+      if (features_in_cell[cell] >= max_per_cell) {
+        continue;
+      }
+    }
+    int gx = int(a.coords(0) / grid_size);
+    int gy = int(a.coords(1) / grid_size);
+    bool too_close = false;
+    for (int y = max(0, gy - 2); y <= min(grid_height - 1, gy + 2); ++y) {
+      for (int x = max(0, gx - 2); x <= min(grid_width - 1, gx + 2); ++x) {
+        int kept = grid[y * grid_width + x];
+        if (kept >= 0 && (a.coords - features->at(kept).coords)
+                             .squaredNorm() < squared_min_distance) {
+          too_close = true;
+        }
+      }
+    }
+    if (too_close) {
+      continue;
+    }
+    grid[gy * grid_width + gx] = size;
+    if (check_cells) {
+      ++features_in_cell[int(a.coords(1)) / cell_size * cells_width +
+                         int(a.coords(0)) / cell_size];
+    }
+    // Kept features are compacted at the front; a is not behind them.
+    features->at(size++) = a;
   }
   features->resize(size);
 }
 
 void KLTContext::DetectGoodFeatures(const Array3Df &image_and_gradients,
-                                    FeatureList *features) {
-  Array3Df gradient_matrix;
-  ComputeGradientMatrix(image_and_gradients, WindowSize(), &gradient_matrix);
+                                    FeatureList *features,
+                                    ThreadPool *pool) {
+  DetectGoodFeaturesInRegion(image_and_gradients,
+                             0, 0,
+                             image_and_gradients.Height(),
+                             image_and_gradients.Width(),
+                             features, pool);
+}
 
+void KLTContext::DetectGoodFeaturesInRegion(
+    const Array3Df &image_and_gradients,
+    int row, int col, int rows, int cols,
+    FeatureList *features,
+    ThreadPool *pool) {
+  // The trackness is computed one pixel around the region too, so that the
+  // local maxima on its border can be compared with their neighbours.
+  int height = image_and_gradients.Height();
+  int width = image_and_gradients.Width();
+  int row0 = max(0, row - 1), row1 = min(height, row + rows + 1);
+  int col0 = max(0, col - 1), col1 = min(width, col + cols + 1);
   Array3Df trackness;
-  double trackness_mean;
-  ComputeTrackness(gradient_matrix, &trackness, &trackness_mean);
-  min_trackness_ = trackness_mean;
+  ComputeTrackness(image_and_gradients, WindowSize(),
+                   row0, col0, row1 - row0, col1 - col0, &trackness, pool);
 
+  // The threshold is the mean over the region itself, without that border.
+  double trackness_mean = 0;
+  for (int r = row - row0; r < row - row0 + rows; ++r) {
+    for (int c = col - col0; c < col - col0 + cols; ++c) {
+      trackness_mean += trackness(r, c);
+    }
+  }
+  min_trackness_ = trackness_mean / max(1, rows * cols);
+
+  size_t first_new_feature = features->size();
   FindLocalMaxima(trackness, min_trackness_, features);
+  for (size_t i = first_new_feature; i < features->size(); ++i) {
+    (*features)[i].coords(0) += col0;
+    (*features)[i].coords(1) += row0;
+  }
 
-  RemoveTooCloseFeatures(features, min_feature_distance_ * min_feature_distance_);
+  RemoveTooCloseFeatures(features, min_feature_distance_,
+                         feature_cell_size_, max_features_per_cell_,
+                         width, height);
 }
 
 void KLTContext::TrackFeatures(ImagePyramid *pyramid1,
@@ -31,6 +31,8 @@
 
 namespace libmv {
 
+class ThreadPool;
+
 struct KLTPointFeature : public PointFeature {
   // (x, y) position (not row, column).
   virtual const Vec2f &Point() const {
@@ -49,12 +51,29 @@ class KLTContext {
         max_iterations_(10),
         min_trackness_(0.5),
         min_feature_distance_(10),
+        feature_cell_size_(64),
+        max_features_per_cell_(0),
         min_determinant_(1e-6),
         min_update_squared_distance_(1e-6) {
   }
 
+  // Finds the local maxima of trackness above the mean trackness, and keeps
+  // the best ones at least min_feature_distance_ apart and, if
+  // max_features_per_cell_ is positive, at most max_features_per_cell_ in each
+  // cell of feature_cell_size_ pixels, to spread the features over the image.
+  // The features are sorted by decreasing trackness. The trackness is computed
+  // on pool if it is not NULL.
   void DetectGoodFeatures(const Array3Df &image_and_gradients,
-                          FeatureList *features);
+                          FeatureList *features,
+                          ThreadPool *pool = NULL);
+
+  // Same as DetectGoodFeatures(), for the region of rows [row, row + rows)
+  // and columns [col, col + cols) only. The trackness threshold is the mean
+  // over the region, and the feature coordinates are in the whole image.
+  void DetectGoodFeaturesInRegion(const Array3Df &image_and_gradients,
+                                  int row, int col, int rows, int cols,
+                                  FeatureList *features,
+                                  ThreadPool *pool = NULL);
 
   bool TrackFeature(ImagePyramid *pyramid1,
                     const KLTPointFeature &feature1,
@@ -80,10 +99,24 @@ class KLTContext {
   int max_iterations_;
   double min_trackness_;
   double min_feature_distance_;
+  int feature_cell_size_;
+  int max_features_per_cell_;
   double min_determinant_;
   double min_update_squared_distance_;
 };
 
+// Computes the trackness, the smallest eigenvalue of the gradient matrix summed
+// over a window_size by window_size window as in Good Features to Track, of
+// the pixels in rows [row, row + rows) and columns [col, col + cols) of
+// image_and_gradients, whose channels are the blurred image and its x and y
+// gradients. Gradients outside of the image count as zero. The tiles of rows
+// are spread over pool if it is not NULL.
+void ComputeTrackness(const Array3Df &image_and_gradients,
+                      int window_size,
+                      int row, int col, int rows, int cols,
+                      Array3Df *trackness,
+                      ThreadPool *pool = NULL);
+
 }  // namespace libmv
 
 #endif  // LIBMV_CORRESPONDENCE_KLT_H_
@@ -18,6 +18,7 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/image.h"
 #include "libmv/image/image_pyramid.h"
 #include "libmv/image/convolve.h"
@@ -46,6 +47,169 @@ TEST(KLTContext, DetectGoodFeaturesSimple) {
   EXPECT_EQ(features.back().coords(1), 25);
 }
 
+// Dots at pseudo random positions, with a lot of nearby local maxima.
+void MakeTexturedImage(int height, int width, Array3Df *image) {
+  image->Resize(height, width);
+  image->Fill(0);
+  unsigned seed = 1;
+  for (int i = 0; i < height * width / 8; ++i) {
+    seed = seed * 1103515245 + 12345;
+    int r = (seed >> 8) % height;
+    seed = seed * 1103515245 + 12345;
+    int c = (seed >> 8) % width;
+    (*image)(r, c) = 1.f;
+  }
+}
+
+TEST(KLTContext, DetectGoodFeaturesMinDistance) {
+  Array3Df image, derivatives;
+  MakeTexturedImage(128, 160, &image);
+  BlurredImageAndDerivativesChannels(image, 1.0, &derivatives);
+
+  KLTContext klt;
+  klt.min_feature_distance_ = 7;
+  KLTContext::FeatureList features;
+  klt.DetectGoodFeatures(derivatives, &features);
+  ASSERT_GT(features.size(), 20);
+
+  for (size_t i = 0; i < features.size(); ++i) {
+    if (i > 0) {
+      EXPECT_LE(features[i].trackness, features[i - 1].trackness);
+    }
+    for (size_t j = 0; j < i; ++j) {
+      EXPECT_GE((features[i].coords - features[j].coords).norm(), 7);
+    }
+  }
+}
+
+// Below sqrt(2), the grid cells would be smaller than a pixel; adjacent
+// local maxima of equal trackness must still be culled.
+TEST(KLTContext, DetectGoodFeaturesSmallMinDistance) {
+  Array3Df image(51, 51);
+  image.Fill(0);
+  image(25, 25) = 1.f;
+  image(25, 26) = 1.f;
+  Array3Df derivatives;
+  BlurredImageAndDerivativesChannels(image, 3.0, &derivatives);
+
+  KLTContext klt;
+  klt.min_feature_distance_ = 1.2;
+  KLTContext::FeatureList features;
+  klt.DetectGoodFeatures(derivatives, &features);
+  ASSERT_GT(features.size(), 0);
+
+  for (size_t i = 0; i < features.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      EXPECT_GE((features[i].coords - features[j].coords).norm(), 1.2);
+    }
+  }
+}
+
+TEST(KLTContext, DetectGoodFeaturesMaxPerCell) {
+  Array3Df image, derivatives;
+  MakeTexturedImage(128, 160, &image);
+  BlurredImageAndDerivativesChannels(image, 1.0, &derivatives);
+
+  KLTContext klt;
+  klt.min_feature_distance_ = 3;
+  klt.feature_cell_size_ = 32;
+  klt.max_features_per_cell_ = 2;
+  KLTContext::FeatureList features;
+  klt.DetectGoodFeatures(derivatives, &features);
+
+  // Every cell is textured, so every cell is full.
+  EXPECT_EQ(4 * 5 * 2, features.size());
+  int features_in_cell[4][5] = {{ 0 }};
+  for (size_t i = 0; i < features.size(); ++i) {
+    ++features_in_cell[int(features[i].coords(1)) / 32]
+                      [int(features[i].coords(0)) / 32];
+  }
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 5; ++c) {
+      EXPECT_EQ(2, features_in_cell[r][c]);
+    }
+  }
+}
+
+// Sums the gradient matrix over the window of each pixel, pixel by pixel.
+float BruteForceTrackness(const Array3Df &image_and_gradients,
+                          int half_width, int r, int c) {
+  double gxx = 0, gxy = 0, gyy = 0;
+  for (int y = r - half_width; y <= r + half_width; ++y) {
+    for (int x = c - half_width; x <= c + half_width; ++x) {
+      if (y < 0 || y >= image_and_gradients.Height() ||
+          x < 0 || x >= image_and_gradients.Width()) {
+        continue;
+      }
+      double gx = image_and_gradients(y, x, 1);
+      double gy = image_and_gradients(y, x, 2);
+      gxx += gx * gx;
+      gxy += gx * gy;
+      gyy += gy * gy;
+    }
+  }
+  return (gxx + gyy - sqrt((gxx - gyy) * (gxx - gyy) + 4 * gxy * gxy)) / 2;
+}
+
+TEST(ComputeTrackness, MatchesBruteForce) {
+  Array3Df image, derivatives;
+  MakeTexturedImage(70, 90, &image);
+  BlurredImageAndDerivativesChannels(image, 1.0, &derivatives);
+
+  ThreadPool pool(2);
+  ThreadPool *pools[] = { NULL, &pool };
+  for (int p = 0; p < 2; ++p) {
+    // The whole image, then a region with windows crossing its border.
+    Array3Df trackness;
+    ComputeTrackness(derivatives, 7, 0, 0, 70, 90, &trackness, pools[p]);
+    ASSERT_EQ(70, trackness.Height());
+    ASSERT_EQ(90, trackness.Width());
+    for (int r = 0; r < 70; ++r) {
+      for (int c = 0; c < 90; ++c) {
+        EXPECT_NEAR(BruteForceTrackness(derivatives, 3, r, c),
+                    trackness(r, c), 1e-5);
+      }
+    }
+
+    ComputeTrackness(derivatives, 5, 40, 2, 30, 50, &trackness, pools[p]);
+    ASSERT_EQ(30, trackness.Height());
+    ASSERT_EQ(50, trackness.Width());
+    for (int r = 0; r < 30; ++r) {
+      for (int c = 0; c < 50; ++c) {
+        EXPECT_NEAR(BruteForceTrackness(derivatives, 2, 40 + r, 2 + c),
+                    trackness(r, c), 1e-5);
+      }
+    }
+  }
+}
+
+TEST(KLTContext, DetectGoodFeaturesInRegion) {
+  Array3Df image, derivatives;
+  MakeTexturedImage(128, 160, &image);
+  BlurredImageAndDerivativesChannels(image, 1.0, &derivatives);
+
+  KLTContext klt;
+  klt.min_feature_distance_ = 5;
+  KLTContext::FeatureList features;
+  klt.DetectGoodFeaturesInRegion(derivatives, 30, 40, 50, 60, &features);
+  ASSERT_GT(features.size(), 5);
+  for (size_t i = 0; i < features.size(); ++i) {
+    EXPECT_GE(features[i].coords(0), 40);
+    EXPECT_LT(features[i].coords(0), 100);
+    EXPECT_GE(features[i].coords(1), 30);
+    EXPECT_LT(features[i].coords(1), 80);
+  }
+
+  // The threshold is the mean trackness over the region only.
+  Array3Df trackness;
+  ComputeTrackness(derivatives, klt.WindowSize(), 30, 40, 50, 60, &trackness);
+  double trackness_mean = 0;
+  for (int i = 0; i < trackness.Size(); ++i) {
+    trackness_mean += trackness.Data()[i];
+  }
+  EXPECT_NEAR(trackness_mean / trackness.Size(), klt.min_trackness_, 1e-6);
+}
+
 TEST(KLTContext, TrackFeatureOneLevel) {
   Array3Df image1(51, 51);
   image1.Fill(0);
@@ -23,6 +23,7 @@
 #include "libmv/correspondence/feature.h"
 #include "libmv/correspondence/feature_matching.h"
 #include "libmv/correspondence/nRobustViewMatching.h"
+#include "libmv/descriptor/binary_descriptor.h"
 #include "libmv/descriptor/descriptor.h"
 #include "libmv/descriptor/vector_descriptor.h"
 #include "libmv/detector/detector.h"
@@ -79,16 +80,35 @@ bool nRobustViewMatching::computeData(const string & filename)
     libmv::vector<descriptor::Descriptor *> descriptors;
     m_pDescriber->Describe(features, im, NULL, &descriptors);
 
-    // Copy data.
+    // Copy data. The features the describer could not describe, which have
+    // a NULL descriptor, are dropped.
     m_ViewData.insert( make_pair(filename,FeatureSet()) );
     FeatureSet & KeypointData = m_ViewData[filename];
     KeypointData.features.resize(descriptors.size());
+    int num_described = 0;
     for(int i = 0;i < descriptors.size(); ++i)
     {
-      KeypointFeature & feat = KeypointData.features[i];
-      feat.descriptor = *(descriptor::VecfDescriptor*)descriptors[i];
-      *(PointFeature*)(&feat) = *(PointFeature*)features[i];
+      PointFeature *point = dynamic_cast<PointFeature*>(features[i]);
+      if (!descriptors[i] || !point) {
+        continue;
+      }
+      KeypointFeature & feat = KeypointData.features[num_described++];
+      descriptor::BinaryDescriptor *binary_descriptor =
+        dynamic_cast<descriptor::BinaryDescriptor*>(descriptors[i]);
+      if (binary_descriptor) {
+        feat.binary_descriptor = *binary_descriptor;
+      } else {
+        feat.descriptor = *(descriptor::VecfDescriptor*)descriptors[i];
+      }
+      *(PointFeature*)(&feat) = *point;
+    }
+    if (num_described < descriptors.size()) {
+      LOG(INFO) << "[nViewMatching::computeData] "
+                << descriptors.size() - num_described << " of the "
+                << descriptors.size() << " features of " << filename
+                << " could not be described.";
     }
+    KeypointData.features.resize(num_described);
 
     DeleteElements(&features);
     DeleteElements(&descriptors);
@@ -133,11 +153,20 @@ bool nRobustViewMatching::MatchData(const string & dataA, const string & dataB)
   int iDataB = find(m_vec_InputNames.begin(), m_vec_InputNames.end(), dataB)
                 - m_vec_InputNames.begin();
 
+  // Binary descriptors are matched with the Hamming distance.
+  eLibmvMatchMethod eMatchMethod = eMATCH_KDTREE_FLANN;
+  const FeatureSet & featureSetA = m_ViewData[dataA];
+  if (featureSetA.features.size() > 0 &&
+      featureSetA.features[0].binary_descriptor.bits.size() > 0) {
+    eMatchMethod = eMATCH_HAMMING;
+  }
+
   Matches matches;
   //TODO(pmoulon) make FindCandidatesMatches a parameter.
   FindCandidateMatches(m_ViewData[dataA],
                        m_ViewData[dataB],
-                       &matches);
+                       &matches,
+                       eMatchMethod);
   /*FindCandidateMatches_Ratio(m_ViewData[dataA],
                        m_ViewData[dataB],
                        &matches,eMATCH_KDTREE_FLANN , 0.6f);*/
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <unistd.h>
+#include <string>
+
+#include "libmv/base/scoped_ptr.h"
+#include "libmv/correspondence/feature.h"
+#include "libmv/correspondence/feature_matching.h"
+#include "libmv/correspondence/nRobustViewMatching.h"
+#include "libmv/descriptor/descriptor_factory.h"
+#include "libmv/detector/detector.h"
+#include "libmv/image/image.h"
+#include "libmv/image/image_io.h"
+#include "testing/testing.h"
+
+using namespace libmv;
+using namespace libmv::correspondence;
+
+namespace {
+
+// Detects the same features in every image: two points, and a feature which
+// is not a point.
+class FixedDetector : public detector::Detector {
+ public:
+  virtual void Detect(const Image &image,
+                      libmv::vector<Feature *> *features,
+                      detector::DetectorData **data) {
+    features->push_back(new PointFeature(2, 2));
+    features->push_back(new Feature);
+    features->push_back(new PointFeature(30, 20));
+    if (data) {
+      *data = NULL;
+    }
+  }
+};
+
+void WriteRandomImage(int rows, int cols, const std::string &filename) {
+  ByteImage image(rows, cols);
+  unsigned seed = 1;
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      seed = seed * 1103515245 + 12345;
+      image(r, c) = (seed >> 16) & 0xff;
+    }
+  }
+  WritePnm(image, filename.c_str());
+}
+
+// The BRIEF describer gives no descriptor for the features of images too
+// small for its boxes, nor for the features which are not points.
+TEST(nRobustViewMatching, ComputeDataDropsUndescribedFeatures) {
+  std::string small_fn = std::string(THIS_SOURCE_DIR) + "/small.pgm";
+  std::string large_fn = std::string(THIS_SOURCE_DIR) + "/large.pgm";
+  WriteRandomImage(4, 4, small_fn);
+  WriteRandomImage(40, 50, large_fn);
+
+  FixedDetector detector;
+  scoped_ptr<descriptor::Describer> describer(
+      descriptor::describerFactory(descriptor::BRIEF_DESCRIBER));
+  nRobustViewMatching matching(&detector, describer.get());
+
+  EXPECT_TRUE(matching.computeData(small_fn));
+  EXPECT_TRUE(matching.computeData(large_fn));
+  const FeatureSet &small = matching.getViewData().find(small_fn)->second;
+  const FeatureSet &large = matching.getViewData().find(large_fn)->second;
+  EXPECT_EQ(0, small.features.size());
+  ASSERT_EQ(2, large.features.size());
+  EXPECT_EQ(2, large.features[0].x());
+  EXPECT_EQ(30, large.features[1].x());
+  EXPECT_EQ(32, large.features[1].binary_descriptor.bits.size());
+
+  unlink(small_fn.c_str());
+  unlink(large_fn.c_str());
+}
+
+}  // namespace
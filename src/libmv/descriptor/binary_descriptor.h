@@ -0,0 +1,43 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_DESCRIPTOR_BINARY_DESCRIPTOR_H
+#define LIBMV_DESCRIPTOR_BINARY_DESCRIPTOR_H
+
+#include "libmv/base/vector.h"
+#include "libmv/descriptor/descriptor.h"
+
+namespace libmv {
+namespace descriptor {
+
+// A descriptor made of bits packed in bytes, which is compared with the
+// Hamming distance (see correspondence/ArrayMatcher_Hamming.h).
+struct BinaryDescriptor : public Descriptor {
+  virtual ~BinaryDescriptor() {}
+  BinaryDescriptor(int num_bytes) : bits(num_bytes, 0) {}
+  BinaryDescriptor() {};
+
+  vector<unsigned char> bits;
+};
+
+}  // namespace descriptor
+}  // namespace libmv
+
+#endif  // LIBMV_DESCRIPTOR_BINARY_DESCRIPTOR_H
@@ -0,0 +1,219 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "libmv/base/vector.h"
+#include "libmv/correspondence/feature.h"
+#include "libmv/descriptor/binary_descriptor.h"
+#include "libmv/descriptor/brief_descriptor.h"
+#include "libmv/descriptor/descriptor.h"
+#include "libmv/image/image.h"
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+namespace descriptor {
+
+namespace {
+
+const int kBriefBytes = 32;
+const int kBriefTests = 8 * kBriefBytes;
+// The tests lie in the disc of this radius around the feature.
+const int kPatchRadius = 15;
+// The intensities are summed over boxes of (2 * kBoxRadius + 1)^2 pixels.
+const int kBoxRadius = 2;
+// The pattern is rotated by steps of 2 * PI / kNumAngles, as in ORB.
+const int kNumAngles = 30;
+
+// Sums the image over the box centered on each pixel, for the pixels at least
+// kBoxRadius away from the border, with running sums of the columns and then
+// of the rows. The sums are at most (2 * kBoxRadius + 1)^2 * 255.
+void BoxSums(const Array3Du &image, Array3D<unsigned short> *box_sums) {
+  const int rows = image.Height(), cols = image.Width();
+  const int box_size = 2 * kBoxRadius + 1;
+  box_sums->Resize(rows, cols);
+  box_sums->Fill(0);
+  std::vector<int> column_sums(cols, 0);
+  for (int r = 0; r < box_size - 1; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      column_sums[c] += image(r, c);
+    }
+  }
+  for (int r = kBoxRadius; r < rows - kBoxRadius; ++r) {
+    const unsigned char *added = &image(r + kBoxRadius, 0);
+    for (int c = 0; c < cols; ++c) {
+      column_sums[c] += added[c];
+    }
+    int sum = 0;
+    for (int c = 0; c < box_size - 1; ++c) {
+      sum += column_sums[c];
+    }
+    unsigned short *out = &(*box_sums)(r, 0);
+    for (int c = kBoxRadius; c < cols - kBoxRadius; ++c) {
+      sum += column_sums[c + kBoxRadius];
+      out[c] = sum;
+      sum -= column_sums[c - kBoxRadius];
+    }
+    const unsigned char *removed = &image(r - kBoxRadius, 0);
+    for (int c = 0; c < cols; ++c) {
+      column_sums[c] -= removed[c];
+    }
+  }
+}
+
+class BriefDescriber : public Describer {
+ public:
+  BriefDescriber() {
+    ComputeSteeredPatterns();
+  }
+
+  virtual void Describe(const vector<Feature *> &features,
+                        const Image &image,
+                        const detector::DetectorData *detector_data,
+                        vector<Descriptor *> *descriptors) {
+    (void) detector_data; // There is no matching detector for BRIEF.
+
+    descriptors->resize(features.size());
+    ByteImage *byte_image = image.AsArray3Du();
+    if (!byte_image ||
+        byte_image->Height() <= 2 * kBoxRadius ||
+        byte_image->Width() <= 2 * kBoxRadius) {
+      LOG(ERROR) << "Invalid input image for BRIEF describer";
+      for (int i = 0; i < features.size(); ++i) {
+        (*descriptors)[i] = NULL;
+      }
+      return;
+    }
+    const int rows = byte_image->Height(), cols = byte_image->Width();
+    Array3D<unsigned short> box_sums;
+    BoxSums(*byte_image, &box_sums);
+
+    // The tests of the features far enough from the border compare the
+    // box sums at fixed offsets from the center of the feature.
+    const int margin = kPatchRadius + kBoxRadius;
+    std::vector<int> offsets(kNumAngles * 2 * kBriefTests);
+    for (int a = 0; a < kNumAngles; ++a) {
+      for (int t = 0; t < kBriefTests; ++t) {
+        const int *pattern = patterns_[a][t];
+        offsets[(a * kBriefTests + t) * 2] = pattern[1] * cols + pattern[0];
+        offsets[(a * kBriefTests + t) * 2 + 1] = pattern[3] * cols + pattern[2];
+      }
+    }
+
+    for (int i = 0; i < features.size(); ++i) {
+      PointFeature *point = dynamic_cast<PointFeature *>(features[i]);
+      BinaryDescriptor *descriptor = NULL;
+      if (point) {
+        descriptor = new BinaryDescriptor(kBriefBytes);
+        int angle = int(floor(point->orientation * kNumAngles / (2 * M_PI)
+                              + 0.5));
+        angle = (angle % kNumAngles + kNumAngles) % kNumAngles;
+        const int row = int(floor(point->y() + 0.5));
+        const int col = int(floor(point->x() + 0.5));
+
+        unsigned char *bits = &descriptor->bits[0];
+        if (row >= margin && row < rows - margin &&
+            col >= margin && col < cols - margin) {
+          const unsigned short *center = &box_sums(row, col);
+          const int *offset = &offsets[angle * 2 * kBriefTests];
+          for (int t = 0; t < kBriefTests; ++t, offset += 2) {
+            bits[t / 8] |= (center[offset[0]] < center[offset[1]]) << (t % 8);
+          }
+        } else {
+          // Clamping the boxes replicates the border of the image.
+          const int *pattern = patterns_[angle][0];
+          for (int t = 0; t < kBriefTests; ++t, pattern += 4) {
+            int r1 = Clamp(row + pattern[1], kBoxRadius, rows - 1 - kBoxRadius);
+            int c1 = Clamp(col + pattern[0], kBoxRadius, cols - 1 - kBoxRadius);
+            int r2 = Clamp(row + pattern[3], kBoxRadius, rows - 1 - kBoxRadius);
+            int c2 = Clamp(col + pattern[2], kBoxRadius, cols - 1 - kBoxRadius);
+            bits[t / 8] |= (box_sums(r1, c1) < box_sums(r2, c2)) << (t % 8);
+          }
+        }
+      }
+      (*descriptors)[i] = descriptor;
+    }
+  }
+
+ private:
+  // Draws the pairs of the tests from an isotropic gaussian of variance
+  // S^2 / 25 for patches of size S (the G II pattern of [1]), with a fixed
+  // seed so that all the describers agree. The points are kept in the disc
+  // of radius kPatchRadius, so that the rotated patterns stay in the patch.
+  void ComputeSteeredPatterns() {
+    const double sigma = (2 * kPatchRadius + 1) / 5.0;
+    unsigned int seed = 1;
+    double pairs[kBriefTests][4];
+    for (int t = 0; t < kBriefTests; ++t) {
+      do {
+        for (int j = 0; j < 4; j += 2) {
+          double x, y;
+          do {
+            x = sigma * NextGaussian(&seed);
+            y = sigma * NextGaussian(&seed);
+          } while (x * x + y * y > kPatchRadius * kPatchRadius);
+          pairs[t][j] = x;
+          pairs[t][j + 1] = y;
+        }
+      } while (floor(pairs[t][0] + 0.5) == floor(pairs[t][2] + 0.5) &&
+               floor(pairs[t][1] + 0.5) == floor(pairs[t][3] + 0.5));
+    }
+    for (int a = 0; a < kNumAngles; ++a) {
+      double c = cos(2 * M_PI * a / kNumAngles);
+      double s = sin(2 * M_PI * a / kNumAngles);
+      for (int t = 0; t < kBriefTests; ++t) {
+        for (int j = 0; j < 4; j += 2) {
+          double x = pairs[t][j], y = pairs[t][j + 1];
+          patterns_[a][t][j] = int(floor(c * x - s * y + 0.5));
+          patterns_[a][t][j + 1] = int(floor(s * x + c * y + 0.5));
+        }
+      }
+    }
+  }
+
+  static int Clamp(int value, int min_value, int max_value) {
+    return std::min(std::max(value, min_value), max_value);
+  }
+
+  // Box-Muller transform of a linear congruential generator.
+  static double NextGaussian(unsigned int *seed) {
+    double u1 = (NextUniform(seed) + 1.0) / 65537.0;
+    double u2 = NextUniform(seed) / 65536.0;
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+  }
+  static unsigned int NextUniform(unsigned int *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) & 0xffff;
+  }
+
+  // The (x1, y1, x2, y2) offsets of the tests, for each rotation.
+  int patterns_[kNumAngles][kBriefTests][4];
+};
+
+}  // namespace
+
+Describer *CreateBriefDescriber() {
+  return new BriefDescriber;
+}
+
+}  // namespace descriptor
+}  // namespace libmv
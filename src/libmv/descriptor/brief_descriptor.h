@@ -0,0 +1,47 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_DESCRIPTOR_BRIEF_DESCRIPTOR_H
+#define LIBMV_DESCRIPTOR_BRIEF_DESCRIPTOR_H
+
+namespace libmv {
+namespace descriptor {
+
+class Describer;
+
+/**
+ * Creates a BRIEF describer.
+ * Implementation of :
+ * [1] M. Calonder, V. Lepetit, C. Strecha and P. Fua. BRIEF: Binary Robust
+ * Independent Elementary Features. In ECCV, pages 778-792, 2010.
+ * Each descriptor is a 32 bytes BinaryDescriptor, whose 256 bits compare the
+ * intensities of pairs of pixels around the feature, smoothed over 5x5 boxes.
+ * The pairs are rotated by the orientation of the feature as in ORB [2], so
+ * the descriptor is rotation invariant with a detector that estimates it
+ * (e.g. the FAST detector with bRotationInvariant).
+ * [2] E. Rublee, V. Rabaud, K. Konolige and G. Bradski. ORB: an efficient
+ * alternative to SIFT or SURF. In ICCV, 2011.
+ */
+Describer *CreateBriefDescriber();
+
+}  // namespace descriptor
+}  // namespace libmv
+
+#endif  // LIBMV_DESCRIPTOR_BRIEF_DESCRIPTOR_H
@@ -0,0 +1,110 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/base/scoped_ptr.h"
+#include "libmv/base/vector.h"
+#include "libmv/base/vector_utils.h"
+#include "libmv/correspondence/feature.h"
+#include "libmv/descriptor/binary_descriptor.h"
+#include "libmv/descriptor/descriptor.h"
+#include "libmv/descriptor/descriptor_factory.h"
+#include "libmv/image/image.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+using descriptor::BinaryDescriptor;
+
+int HammingDistance(const BinaryDescriptor &a, const BinaryDescriptor &b) {
+  int distance = 0;
+  for (int i = 0; i < 8 * a.bits.size(); ++i) {
+    distance += ((a.bits[i / 8] ^ b.bits[i / 8]) >> (i % 8)) & 1;
+  }
+  return distance;
+}
+
+// A random image, and the same image turned upside down.
+void RandomImages(int rows, int cols, Array3Du *image, Array3Du *rotated) {
+  image->Resize(rows, cols);
+  rotated->Resize(rows, cols);
+  unsigned seed = 1;
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      seed = seed * 1103515245 + 12345;
+      (*image)(r, c) = (seed >> 16) & 0xff;
+      (*rotated)(rows - 1 - r, cols - 1 - c) = (*image)(r, c);
+    }
+  }
+}
+
+TEST(BriefDescriber, RotationInvariant) {
+  const int rows = 80, cols = 100;
+  Array3Du *array = new Array3Du, *rotated_array = new Array3Du;
+  RandomImages(rows, cols, array, rotated_array);
+  Image image(array), rotated_image(rotated_array);
+
+  // Features inside the image and on its border, and the same features in
+  // the image turned upside down.
+  vector<Feature *> features, rotated_features;
+  const float xs[] = { 50, 30, 70, 0, 99 };
+  const float ys[] = { 40, 20, 60, 0, 79 };
+  for (int i = 0; i < 5; ++i) {
+    PointFeature *feature = new PointFeature(xs[i], ys[i]);
+    feature->orientation = 0.3;
+    features.push_back(feature);
+    PointFeature *rotated = new PointFeature(cols - 1 - xs[i],
+                                             rows - 1 - ys[i]);
+    rotated->orientation = 0.3 + M_PI;
+    rotated_features.push_back(rotated);
+  }
+
+  scoped_ptr<descriptor::Describer> describer(
+      descriptor::describerFactory(descriptor::BRIEF_DESCRIBER));
+  vector<descriptor::Descriptor *> descriptors, rotated_descriptors;
+  describer->Describe(features, image, NULL, &descriptors);
+  describer->Describe(rotated_features, rotated_image, NULL,
+                      &rotated_descriptors);
+  ASSERT_EQ(5, descriptors.size());
+  ASSERT_EQ(5, rotated_descriptors.size());
+
+  for (int i = 0; i < 5; ++i) {
+    BinaryDescriptor *descriptor =
+        dynamic_cast<BinaryDescriptor *>(descriptors[i]);
+    BinaryDescriptor *rotated_descriptor =
+        dynamic_cast<BinaryDescriptor *>(rotated_descriptors[i]);
+    ASSERT_TRUE(descriptor != NULL);
+    ASSERT_TRUE(rotated_descriptor != NULL);
+    EXPECT_EQ(32, descriptor->bits.size());
+    EXPECT_EQ(0, HammingDistance(*descriptor, *rotated_descriptor));
+  }
+  // Different places of a random image have unrelated descriptors.
+  EXPECT_LT(64, HammingDistance(
+      *dynamic_cast<BinaryDescriptor *>(descriptors[1]),
+      *dynamic_cast<BinaryDescriptor *>(descriptors[2])));
+
+  DeleteElements(&features);
+  DeleteElements(&rotated_features);
+  DeleteElements(&descriptors);
+  DeleteElements(&rotated_descriptors);
+}
+
+}  // namespace
+}  // namespace libmv
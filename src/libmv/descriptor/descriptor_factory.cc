@@ -25,6 +25,7 @@
 #include "libmv/descriptor/dipole_descriptor.h"
 #include "libmv/descriptor/surf_descriptor.h"
 #include "libmv/descriptor/daisy_descriptor.h"
+#include "libmv/descriptor/brief_descriptor.h"
 #include "libmv/logging/logging.h"
 
 namespace libmv {
@@ -46,6 +47,9 @@ Describer *describerFactory(eDescriber edescriber)  {
   case DAISY_DESCRIBER:
     return descriptor::CreateDaisyDescriber();
     break;
+  case BRIEF_DESCRIBER:
+    return descriptor::CreateBriefDescriber();
+    break;
   default:
     LOG(FATAL) << "ERROR : undefined Describer value : " << edescriber;
   }
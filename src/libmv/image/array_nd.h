@@ -23,7 +23,9 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <new>
 
 #include "libmv/image/tuple.h"
 
@@ -41,37 +43,115 @@ class ArrayND : public BaseArray {
   typedef Tuple<int, N> Index;
 
   /// Create an empty array.
-  ArrayND() : data_(NULL) { Resize(Index(0)); }
+  ArrayND() : data_(NULL), own_data_(true) { Resize(Index(0)); }
 
   /// Create an array with the specified shape.
-  ArrayND(const Index &shape) : data_(NULL) { Resize(shape); }
+  ArrayND(const Index &shape) : data_(NULL), own_data_(true) { Resize(shape); }
 
   /// Create an array with the specified shape.
-  ArrayND(int *shape) : data_(NULL) { Resize(shape); }
+  ArrayND(int *shape) : data_(NULL), own_data_(true) { Resize(shape); }
 
-  /// Copy constructor.
-  ArrayND(const ArrayND<T, N> &b) : data_(NULL) {
+  /// Create a view of existing data; see SetView().
+  ArrayND(T *data, const Index &shape) : data_(NULL), own_data_(true) {
+    SetView(data, shape);
+  }
+
+  /// Create a view of existing data with the given strides; see SetView().
+  ArrayND(T *data, const Index &shape, const Index &strides)
+      : data_(NULL), own_data_(true) {
+    SetView(data, shape, strides);
+  }
+
+  /// Copy constructor. The copy owns its data, even if b is a view.
+  ArrayND(const ArrayND<T, N> &b) : data_(NULL), own_data_(true) {
     ResizeLike(b);
-    std::memcpy(Data(), b.Data(), sizeof(T) * Size());
+    CopyElements(b);
   }
 
-  ArrayND(int s0) : data_(NULL) { Resize(s0); }
-  ArrayND(int s0, int s1) : data_(NULL) { Resize(s0, s1); }
-  ArrayND(int s0, int s1, int s2) : data_(NULL) { Resize(s0, s1, s2); }
+  ArrayND(int s0) : data_(NULL), own_data_(true) { Resize(s0); }
+  ArrayND(int s0, int s1) : data_(NULL), own_data_(true) { Resize(s0, s1); }
+  ArrayND(int s0, int s1, int s2) : data_(NULL), own_data_(true) {
+    Resize(s0, s1, s2);
+  }
 
   /// Destructor deletes pixel data.
   ~ArrayND() {
-    delete [] data_;
+    Release();
   }
 
   /// Assignation copies pixel data.
   ArrayND &operator=(const ArrayND<T, N> &b) {
     assert(this != &b);
     ResizeLike(b);
-    std::memcpy(Data(), b.Data(), sizeof(T) * Size());
+    CopyElements(b);
     return *this;
   }
 
+  /// Exchanges the contents of two arrays in constant time. Use this rather
+  /// than assignation to move an array without copying its data.
+  void Swap(ArrayND<T, N> &other) {
+    Index shape = shape_;
+    shape_ = other.shape_;
+    other.shape_ = shape;
+    Index strides = strides_;
+    strides_ = other.strides_;
+    other.strides_ = strides;
+    T *data = data_;
+    data_ = other.data_;
+    other.data_ = data;
+    bool own_data = own_data_;
+    own_data_ = other.own_data_;
+    other.own_data_ = own_data;
+  }
+
+  /// Makes the array a view of data, which is neither copied nor freed and
+  /// must outlive the array. Element index is at data + Offset(index); by
+  /// default the elements are contiguous, in row major order.
+  void SetView(T *data, const Index &shape) {
+    Release();
+    SetStrides(shape);
+    data_ = data;
+    own_data_ = false;
+  }
+  void SetView(T *data, const Index &shape, const Index &strides) {
+    Release();
+    shape_.Reset(shape);
+    strides_.Reset(strides);
+    data_ = data;
+    own_data_ = false;
+  }
+
+  /// Makes the array a view of the region of array starting at origin, with
+  /// the given shape. Writing to the view writes to array, which must outlive
+  /// the view. Unless the region spans whole rows, the view is not contiguous.
+  void SetRegionView(ArrayND<T, N> *array,
+                     const Index &origin,
+                     const Index &shape) {
+    for (int i = 0; i < N; ++i) {
+      assert(0 <= origin(i) && origin(i) + shape(i) <= array->Shape(i));
+    }
+    SetView(array->Data() + array->Offset(origin), shape, array->Strides());
+  }
+
+  /// Whether the array owns its data, as opposed to being a view.
+  bool OwnsData() const {
+    return own_data_;
+  }
+
+  /// Whether the elements are contiguous in row major order, so that they
+  /// can be accessed as Data()[0] to Data()[Size() - 1]. Arrays owning their
+  /// data always are; most of the image functions require it.
+  bool IsContiguous() const {
+    int stride = 1;
+    for (int i = N - 1; i >= 0; --i) {
+      if (Shape(i) != 1 && Stride(i) != stride) {
+        return false;
+      }
+      stride *= Shape(i);
+    }
+    return true;
+  }
+
   const Index &Shapes() const {
     return shape_;
   }
@@ -80,21 +160,17 @@ class ArrayND : public BaseArray {
     return strides_;
   }
 
-  /// Create an array of shape s.
+  /// Create an array of shape s. Views keep their data if the shape matches
+  /// and they are contiguous; otherwise the array allocates its own data.
   void Resize(const Index &new_shape) {
-    if (data_ != NULL && shape_ == new_shape) {
+    if (data_ != NULL && shape_ == new_shape && IsContiguous()) {
       // Don't bother realloacting if the shapes match.
       return;
     }
-    shape_.Reset(new_shape);
-    strides_(N - 1) = 1;
-    for (int i = N - 1; i > 0; --i) {
-      strides_(i - 1) = strides_(i) * shape_(i);
-    }
-    delete [] data_;
-    data_ = NULL;
+    Release();
+    SetStrides(new_shape);
     if (Size() > 0) {
-      data_ = new T[Size()];
+      data_ = Allocate(Size());
     }
   }
 
@@ -141,22 +217,32 @@ class ArrayND : public BaseArray {
     ResizeLike(other);
     T *data = Data();
     const D *other_data = other.Data();
-    for (int i = 0; i < Size(); ++i) {
-      data[i] = T(other_data[i]);
+    if (other.IsContiguous()) {
+      for (int i = 0; i < Size(); ++i) {
+        data[i] = T(other_data[i]);
+      }
+    } else {
+      for (int i = 0; i < Size(); ++i) {
+        data[i] = T(other_data[other.OffsetOfElement(i)]);
+      }
     }
   }
 
   void Fill(T value) {
-    for (int i = 0; i < Size(); ++i) {
-      Data()[i] = value;
+    if (IsContiguous()) {
+      for (int i = 0; i < Size(); ++i) {
+        Data()[i] = value;
+      }
+    } else {
+      for (int i = 0; i < Size(); ++i) {
+        Data()[OffsetOfElement(i)] = value;
+      }
     }
   }
 
   // Match Eigen's API.
   void fill(T value) {
-    for (int i = 0; i < Size(); ++i) {
-      Data()[i] = value;
-    }
+    Fill(value);
   }
 
   /// Return a tuple containing the length of each axis.
@@ -193,6 +279,17 @@ class ArrayND : public BaseArray {
   /// Constant pointer to the first element of the array.
   const T *Data() const { return data_; }
 
+  /// Distance between the first element and the i-th one in row major order,
+  /// for arrays which may not be contiguous.
+  int OffsetOfElement(int i) const {
+    int offset = 0;
+    for (int axis = N - 1; axis >= 0; --axis) {
+      offset += (i % Shape(axis)) * Stride(axis);
+      i /= Shape(axis);
+    }
+    return offset;
+  }
+
   /// Distance between the first element and the element at position index.
   int Offset(const Index &index) const {
     int offset = 0;
@@ -295,9 +392,15 @@ class ArrayND : public BaseArray {
 
   bool operator==(const ArrayND<T, N> &other) const {
     if (shape_ != other.shape_) return false;
-    if (strides_ != other.strides_) return false;
+    if (IsContiguous() && other.IsContiguous()) {
+      for (int i = 0; i < Size(); ++i) {
+        if (Data()[i] != other.Data()[i])
+          return false;
+      }
+      return true;
+    }
     for (int i = 0; i < Size(); ++i) {
-      if (this->Data()[i] != other.Data()[i])
+      if (Data()[OffsetOfElement(i)] != other.Data()[other.OffsetOfElement(i)])
         return false;
     }
     return true;
@@ -312,7 +415,8 @@ class ArrayND : public BaseArray {
     ArrayND<T, N> res;
     res.ResizeLike(*this);
     for (int i = 0; i < res.Size(); ++i) {
-      res.Data()[i] = Data()[i] * other.Data()[i];
+      res.Data()[i] = Data()[OffsetOfElement(i)] *
+                      other.Data()[other.OffsetOfElement(i)];
     }
     return res;
   }
@@ -326,6 +430,64 @@ class ArrayND : public BaseArray {
 
   /// Pointer to the first element of the array.
   T *data_;
+
+  /// Whether data_ was allocated by the array, rather than given to it.
+  bool own_data_;
+
+ private:
+  /// Alignment of the data allocated by the arrays: a cache line, which is
+  /// also enough for the widest SIMD loads.
+  enum { kAlignment = 64 };
+
+  /// Allocates size elements aligned to kAlignment. The address of the block
+  /// returned by malloc() is kept just before the elements.
+  static T *Allocate(int size) {
+    char *block = static_cast<char *>(
+        std::malloc(size * sizeof(T) + kAlignment + sizeof(void *)));
+    if (!block) {
+      throw std::bad_alloc();
+    }
+    char *aligned = block + sizeof(void *) + kAlignment
+        - (reinterpret_cast<size_t>(block + sizeof(void *)) % kAlignment);
+    reinterpret_cast<void **>(aligned)[-1] = block;
+    T *data = reinterpret_cast<T *>(aligned);
+    for (int i = 0; i < size; ++i) {
+      new (data + i) T;
+    }
+    return data;
+  }
+
+  /// Frees the data if the array owns it, leaving an empty array.
+  void Release() {
+    if (own_data_ && data_) {
+      for (int i = 0; i < Size(); ++i) {
+        data_[i].~T();
+      }
+      std::free(reinterpret_cast<void **>(data_)[-1]);
+    }
+    data_ = NULL;
+    own_data_ = true;
+  }
+
+  void SetStrides(const Index &shape) {
+    shape_.Reset(shape);
+    strides_(N - 1) = 1;
+    for (int i = N - 1; i > 0; --i) {
+      strides_(i - 1) = strides_(i) * shape_(i);
+    }
+  }
+
+  /// Copies the elements of other, which has the same shape, into this array,
+  /// which is contiguous.
+  void CopyElements(const ArrayND<T, N> &other) {
+    if (other.IsContiguous()) {
+      std::memcpy(Data(), other.Data(), sizeof(T) * Size());
+    } else {
+      for (int i = 0; i < Size(); ++i) {
+        Data()[i] = other.Data()[other.OffsetOfElement(i)];
+      }
+    }
+  }
 };
 
 /// 3D array (row, column, channel).
@@ -339,11 +501,26 @@ class Array3D : public ArrayND<T, 3> {
   Array3D(int height, int width, int depth=1)
       : Base(height, width, depth) {
   }
+  // A view of existing data; see ArrayND(T *, const Index &).
+  Array3D(T *data, int height, int width, int depth=1)
+      : Base(data, MakeShape(height, width, depth)) {
+  }
 
   void Resize(int height, int width, int depth=1) {
     Base::Resize(height, width, depth);
   }
 
+  /// Makes the array a view of the height x width region of image whose top
+  /// left pixel is (row, column), with all the channels; see SetRegionView().
+  void SetRegionView(Array3D<T> *image,
+                     int row, int column,
+                     int height, int width) {
+    int origin[] = {row, column, 0};
+    int shape[] = {height, width, image->Depth()};
+    Base::SetRegionView(image, typename Base::Index(origin),
+                        typename Base::Index(shape));
+  }
+
   int Height() const {
     return Base::Shape(0);
   }
@@ -373,6 +550,12 @@ class Array3D : public ArrayND<T, 3> {
     assert(0 <= i1 && i1 < Width());
     return Base::operator()(i0,i1,i2);
   }
+
+ private:
+  static typename Base::Index MakeShape(int height, int width, int depth) {
+    int shape[] = {height, width, depth};
+    return typename Base::Index(shape);
+  }
 };
 
 typedef Array3D<unsigned char> Array3Du;
@@ -24,6 +24,7 @@
 using libmv::ArrayND;
 using libmv::Array3D;
 using libmv::Array3Df;
+using libmv::Array3Du;
 
 namespace {
 
@@ -183,6 +184,80 @@ TEST(ArrayND, 3DAccessor) {
   EXPECT_EQ(2, *(a.Data() + a.Stride(0) + a.Stride(1) + a.Stride(2)));
 }
 
+TEST(ArrayND, ViewOfExistingData) {
+  float data[6] = { 0, 1, 2, 3, 4, 5 };
+  {
+    Array3Df a(data, 2, 3);
+    EXPECT_EQ(data, a.Data());
+    EXPECT_EQ(2, a.Height());
+    EXPECT_EQ(3, a.Width());
+    EXPECT_EQ(4, a(1, 1));
+    a(0, 2) = 7;
+
+    // Resizing to another shape allocates.
+    a.Resize(3, 3);
+    EXPECT_NE(data, a.Data());
+  }
+  EXPECT_EQ(7, data[2]);
+}
+
+TEST(ArrayND, RegionView) {
+  Array3Df image(4, 5, 2);
+  for (int i = 0; i < image.Size(); ++i) {
+    image.Data()[i] = i;
+  }
+  Array3Df region;
+  region.SetRegionView(&image, 1, 2, 2, 3);
+  EXPECT_FALSE(region.OwnsData());
+  EXPECT_FALSE(region.IsContiguous());
+  EXPECT_EQ(2, region.Height());
+  EXPECT_EQ(3, region.Width());
+  EXPECT_EQ(2, region.Depth());
+  EXPECT_EQ(image(1, 2, 1), region(0, 0, 1));
+  EXPECT_EQ(image(2, 4, 0), region(1, 2, 0));
+
+  region.Fill(-1);
+  EXPECT_EQ(-1, image(2, 3, 1));
+  EXPECT_EQ(-1, image(1, 2, 0));
+  EXPECT_NE(-1, image(1, 1, 0));
+  EXPECT_NE(-1, image(3, 2, 0));
+
+  // Copies are contiguous and own their data.
+  Array3Df copy(region);
+  EXPECT_TRUE(copy.OwnsData());
+  EXPECT_TRUE(copy.IsContiguous());
+  EXPECT_TRUE(copy == region);
+  EXPECT_EQ(image(2, 4, 1), copy(1, 2, 1));
+
+  // Whole rows are contiguous.
+  region.SetRegionView(&image, 1, 0, 2, 5);
+  EXPECT_TRUE(region.IsContiguous());
+}
+
+TEST(ArrayND, AlignedAllocation) {
+  for (int size = 1; size < 10; ++size) {
+    Array3Du a(size, 3);
+    EXPECT_EQ(0, reinterpret_cast<size_t>(a.Data()) % 64);
+  }
+}
+
+TEST(ArrayND, Swap) {
+  Array3Df a(2, 3);
+  a.Fill(1);
+  float data[4] = { 2, 2, 2, 2 };
+  Array3Df b(data, 2, 2);
+  float *a_data = a.Data();
+
+  a.Swap(b);
+  EXPECT_EQ(data, a.Data());
+  EXPECT_FALSE(a.OwnsData());
+  EXPECT_EQ(2, a.Width());
+  EXPECT_EQ(a_data, b.Data());
+  EXPECT_TRUE(b.OwnsData());
+  EXPECT_EQ(3, b.Width());
+  EXPECT_EQ(1, b(1, 2));
+}
+
 TEST(ArrayND, CopyFrom) {
   ArrayND<int,3> a(2,2,1);
   a(0,0, 0) = 1;
@@ -23,6 +23,8 @@
 
 // A generic cache interface.
 
+#include <cstddef>
+
 namespace libmv {
 
 // Cache key / value pairs.  Pinned objects count toward maximum size
@@ -35,13 +37,13 @@ class Cache {
   virtual void StoreAndPin(const K &key, V *value) {
     StoreAndPinSized(key, value, 1);
   }
-  virtual void StoreAndPinSized(const K &key, V *value, const int size) = 0;
+  virtual void StoreAndPinSized(const K &key, V *value, const size_t size) = 0;
   virtual void Unpin(const K &key) = 0;
   virtual void MassUnpin() = 0;
   virtual bool ContainsKey(const K &key) = 0;
-  virtual void SetMaxSize(const int size) = 0;
-  virtual int MaxSize() const = 0;
-  virtual int Size() const = 0;
+  virtual void SetMaxSize(const size_t size) = 0;
+  virtual size_t MaxSize() const = 0;
+  virtual size_t Size() const = 0;
   virtual ~Cache() {}
 };
 }  // namespace libmv
@@ -0,0 +1,199 @@
+// Copyright (c) 2007, 2008 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/image/cached_image_sequence.h"
+
+namespace libmv {
+
+class ReadAheadTask : public Task {
+ public:
+  ReadAheadTask(CachedImageSequence *sequence, int i)
+      : sequence_(sequence), i_(i) {}
+  virtual void Run() {
+    sequence_->RunReadAhead(i_);
+  }
+
+ private:
+  CachedImageSequence *sequence_;
+  int i_;
+};
+
+CachedImageSequence::CachedImageSequence(ImageCache *cache)
+    : cache_(cache),
+      pool_(NULL),
+      read_ahead_(0),
+      direction_(READ_AHEAD_FOLLOW),
+      max_in_flight_(0),
+      last_frame_(-1),
+      step_(1),
+      num_read_ahead_tasks_(0) {}
+
+CachedImageSequence::~CachedImageSequence() {
+  StopReadAhead();
+}
+
+Image *CachedImageSequence::GetImage(int i) {
+  if (!pool_) {
+    return FetchOrLoadImage(i);
+  }
+  BeginConsumerLoad(i);
+  Image *image = FetchOrLoadImage(i);
+
+  MutexLock lock(&mutex_);
+  read_ahead_frames_.erase(i);
+  read_ahead_done_.SignalAll();
+  if (direction_ == READ_AHEAD_FOLLOW) {
+    if (last_frame_ != -1 && i != last_frame_) {
+      step_ = i > last_frame_ ? 1 : -1;
+    }
+  } else {
+    step_ = direction_ == READ_AHEAD_FORWARD ? 1 : -1;
+  }
+  last_frame_ = i;
+
+  // Cancel the frames which did not start and are not ahead anymore.
+  std::map<int, ReadAheadState>::iterator it = read_ahead_frames_.begin();
+  while (it != read_ahead_frames_.end()) {
+    int distance = (it->first - i) * step_;
+    if (it->second == READ_AHEAD_QUEUED &&
+        (distance <= 0 || distance > read_ahead_)) {
+      read_ahead_frames_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  ScheduleReadAhead();
+  return image;
+}
+
+void CachedImageSequence::Unpin(int i) {
+  TaggedImageKey cache_key(this, i);
+  cache_->Unpin(cache_key);
+}
+
+bool CachedImageSequence::IsCached(int i) {
+  TaggedImageKey cache_key(this, i);
+  return cache_->ContainsKey(cache_key);
+}
+
+void CachedImageSequence::SetReadAhead(ThreadPool *pool,
+                                       int num_frames,
+                                       ReadAheadDirection direction,
+                                       int max_in_flight) {
+  StopReadAhead();
+  MutexLock lock(&mutex_);
+  pool_ = num_frames > 0 ? pool : NULL;
+  read_ahead_ = num_frames;
+  direction_ = direction;
+  max_in_flight_ = max_in_flight;
+  if (pool_ && max_in_flight_ <= 0) {
+    max_in_flight_ = pool_->num_threads();
+  }
+  last_frame_ = -1;
+  step_ = direction == READ_AHEAD_BACKWARD ? -1 : 1;
+}
+
+void CachedImageSequence::StopReadAhead() {
+  MutexLock lock(&mutex_);
+  pool_ = NULL;
+  read_ahead_frames_.clear();
+  while (num_read_ahead_tasks_ > 0) {
+    read_ahead_done_.Wait(&mutex_);
+  }
+}
+
+Image *CachedImageSequence::FetchOrLoadImage(int i) {
+  Image *image;
+  TaggedImageKey cache_key(this, i);
+  if (cache_->FetchAndPin(cache_key, &image)) {
+    return image;
+  }
+  image = LoadImage(i);
+  if (!image) {
+    return 0;
+  }
+  return cache_->FetchOrStoreAndPinSized(cache_key, image,
+                                         image->MemorySizeInBytes());
+}
+
+// Waits for frame i if it is being loaded, then marks it as loaded by the
+// consumer until GetImage() is done with it, so that read ahead scheduled
+// from the previous frame meanwhile does not load it again.
+void CachedImageSequence::BeginConsumerLoad(int i) {
+  MutexLock lock(&mutex_);
+  std::map<int, ReadAheadState>::iterator it;
+  while ((it = read_ahead_frames_.find(i)) != read_ahead_frames_.end() &&
+         it->second != READ_AHEAD_QUEUED) {
+    read_ahead_done_.Wait(&mutex_);
+  }
+  // If it did not start yet, it is cheaper to load it here than to wait in
+  // line; its task is cancelled.
+  read_ahead_frames_[i] = READ_AHEAD_LOADING_BY_CONSUMER;
+}
+
+// Requires mutex_ to be held.
+void CachedImageSequence::ScheduleReadAhead() {
+  if (!pool_ || last_frame_ == -1) {
+    return;
+  }
+  int length = Length();
+  for (int k = 1; k <= read_ahead_; ++k) {
+    if (static_cast<int>(read_ahead_frames_.size()) >= max_in_flight_) {
+      break;
+    }
+    int j = last_frame_ + k * step_;
+    if (j < 0 || j >= length) {
+      break;
+    }
+    if (read_ahead_frames_.count(j) || IsCached(j)) {
+      continue;
+    }
+    read_ahead_frames_[j] = READ_AHEAD_QUEUED;
+    num_read_ahead_tasks_++;
+    pool_->Schedule(new ReadAheadTask(this, j));
+  }
+}
+
+void CachedImageSequence::RunReadAhead(int i) {
+  bool cancelled;
+  {
+    MutexLock lock(&mutex_);
+    std::map<int, ReadAheadState>::iterator it = read_ahead_frames_.find(i);
+    cancelled = it == read_ahead_frames_.end() ||
+                it->second != READ_AHEAD_QUEUED;
+    if (!cancelled) {
+      it->second = READ_AHEAD_LOADING;
+    }
+  }
+  if (!cancelled && FetchOrLoadImage(i)) {
+    Unpin(i);
+  }
+  MutexLock lock(&mutex_);
+  if (!cancelled) {
+    read_ahead_frames_.erase(i);
+    // Keep the pipeline full until the next request.
+    ScheduleReadAhead();
+  }
+  num_read_ahead_tasks_--;
+  read_ahead_done_.SignalAll();
+}
+
+}  // namespace libmv
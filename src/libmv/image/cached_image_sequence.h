@@ -21,6 +21,9 @@
 #ifndef LIBMV_IMAGE_CACHED_IMAGE_SEQUENCE_H_
 #define LIBMV_IMAGE_CACHED_IMAGE_SEQUENCE_H_
 
+#include <map>
+
+#include "libmv/base/thread.h"
 #include "libmv/image/image.h"
 #include "libmv/image/lru_cache.h"
 #include "libmv/image/image_sequence.h"
@@ -32,48 +35,100 @@ namespace libmv {
 typedef std::pair<void *, int> TaggedImageKey;
 
 // A image cache that is shared among many image sequences (or anything that
-// produces images).
+// produces images). It is thread safe; by default the images are spread over
+// 16 shards so that threads loading different images rarely contend.
 class ImageCache : public LRUCache<TaggedImageKey, Image> {
  public:
   typedef LRUCache<TaggedImageKey, Image> Base;
-  ImageCache() : Base(10*1024*1024) {}
-  ImageCache(int max_cache_size_in_bytes) : Base(max_cache_size_in_bytes) {}
+  ImageCache() : Base(10*1024*1024, 16) {}
+  ImageCache(size_t max_cache_size_in_bytes, int num_shards = 16)
+      : Base(max_cache_size_in_bytes, num_shards) {}
+};
+
+class ThreadPool;
+
+// The order in which a CachedImageSequence reads ahead of its consumer.
+enum ReadAheadDirection {
+  READ_AHEAD_FORWARD,
+  READ_AHEAD_BACKWARD,
+  // Forward or backward, like the last step between the frames requested.
+  READ_AHEAD_FOLLOW
 };
 
 class CachedImageSequence : public ImageSequence {
  public:
-  virtual ~CachedImageSequence() {}
-  CachedImageSequence(ImageCache *cache)
-      : cache_(cache) {}
-
-  virtual Image *GetImage(int i) {
-    Image *image;
-    TaggedImageKey cache_key(this, i);
-    if (!cache_->FetchAndPin(cache_key, &image)) {
-      image = LoadImage(i);
-      if (!image) {
-        return 0;
-      }
-      cache_->StoreAndPinSized(cache_key, image, image->MemorySizeInBytes());
-    }
-    return image;
-  }
+  virtual ~CachedImageSequence();
+  CachedImageSequence(ImageCache *cache);
 
-  virtual void Unpin(int i) {
-    TaggedImageKey cache_key(this, i);
-    cache_->Unpin(cache_key);
-  }
+  // Several threads can load images at once. If two threads load the same
+  // image, the first one stored in the cache wins.
+  virtual Image *GetImage(int i);
+
+  virtual void Unpin(int i);
+
+  // Whether image i is in the cache, without pinning it.
+  bool IsCached(int i);
 
   virtual ImageCache *Cache() {
     return cache_;
   }
 
+  // Loads the frames ahead of the consumer in the background: each
+  // GetImage(i) queues the loading of the num_frames frames after (or before)
+  // i on pool, keeping at most max_in_flight of them queued or running. The
+  // loaded images are left unpinned in the cache. Queued frames which fall
+  // out of the window when the consumer seeks elsewhere are cancelled.
+  //
+  // A frame requested while it is being loaded is waited for rather than
+  // loaded twice. The pool must outlive the sequence, GetImage() must not be
+  // called from the threads of the pool, and subclasses must call
+  // StopReadAhead() in their destructor since the pool calls LoadImage().
+  // If max_in_flight is 0, it is the number of threads of the pool.
+  void SetReadAhead(ThreadPool *pool,
+                    int num_frames,
+                    ReadAheadDirection direction = READ_AHEAD_FOLLOW,
+                    int max_in_flight = 0);
+
+  // Cancels the queued frames and waits for the ones being loaded.
+  void StopReadAhead();
+
   // Subclasses must override these. The cached image sequence will take care
   // of storing the generated
   virtual Image *LoadImage(int i) = 0;
 
  private:
+  friend class ReadAheadTask;
+
+  // The state of a frame in read_ahead_frames_.
+  enum ReadAheadState {
+    READ_AHEAD_QUEUED,
+    READ_AHEAD_LOADING,
+    // Being loaded by GetImage() itself; read ahead leaves it alone.
+    READ_AHEAD_LOADING_BY_CONSUMER
+  };
+
+  Image *FetchOrLoadImage(int i);
+  void BeginConsumerLoad(int i);
+  void ScheduleReadAhead();
+  void RunReadAhead(int i);
+
   ImageCache *cache_;
+
+  ThreadPool *pool_;
+  int read_ahead_;
+  ReadAheadDirection direction_;
+  int max_in_flight_;
+
+  // The last frame requested, and the direction to read ahead of it.
+  int last_frame_;
+  int step_;
+
+  // The frames queued on the pool or being loaded, by the pool or by
+  // GetImage().
+  Mutex mutex_;
+  ConditionVariable read_ahead_done_;
+  std::map<int, ReadAheadState> read_ahead_frames_;
+  int num_read_ahead_tasks_;
 };
 
 }  // namespace libmv
@@ -18,10 +18,19 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <algorithm>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define LIBMV_CONVOLVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/base/vector.h"
 #include "libmv/image/image.h"
 #include "libmv/image/convolve.h"
+#include "libmv/image/scratch_image_pool.h"
 
 namespace libmv {
 
@@ -62,36 +71,161 @@ void ComputeGaussianKernel(double sigma, Vec *kernel, Vec *derivative) {
   *derivative /= factor;
 }
 
-template <int size, bool vertical>
-void FastConvolve(const Vec &kernel, int width, int height,
-                  const float* src, int src_stride, int src_line_stride,
-                  float* dst, int dst_stride) {
-  double coefficients[2 * size + 1];
-  for (int k = 0; k < 2 * size + 1; ++k) {
-    coefficients[k] = kernel(2 * size - k);
+namespace {
+
+#ifdef LIBMV_CONVOLVE_SSE2
+// Stores four floats at out[0], out[stride], out[2 * stride], out[3 * stride].
+inline void StoreSums(__m128 sums, float *out, int stride) {
+  if (stride == 1) {
+    _mm_storeu_ps(out, sums);
+  } else {
+    float values[4];
+    _mm_storeu_ps(values, sums);
+    for (int i = 0; i < 4; ++i) {
+      out[i * stride] = values[i];
+    }
+  }
+}
+#endif
+
+// Computes out[x * out_stride] = sum_k rows[k][x] * coefficients[k] for k in
+// [0, n) and x in [0, width). kSize is n if it is known at compile time, so
+// that the loop over the coefficients is unrolled, or 0.
+//
+// The sums are accumulated in double like the original implementation, so that
+// blurring does not drift by a float ulp.
+template<int kSize>
+void ConvolveRows(const float *const *rows, const double *coefficients,
+                  int n, int width, float *out, int out_stride) {
+  const int size = kSize ? kSize : n;
+  int x = 0;
+#ifdef LIBMV_CONVOLVE_SSE2
+  for (; x + 4 <= width; x += 4) {
+    __m128d sum_low = _mm_setzero_pd();
+    __m128d sum_high = _mm_setzero_pd();
+    for (int k = 0; k < size; ++k) {
+      __m128 pixels = _mm_loadu_ps(rows[k] + x);
+      __m128d coefficient = _mm_set1_pd(coefficients[k]);
+      sum_low = _mm_add_pd(sum_low,
+          _mm_mul_pd(_mm_cvtps_pd(pixels), coefficient));
+      sum_high = _mm_add_pd(sum_high,
+          _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(pixels, pixels)),
+                     coefficient));
+    }
+    StoreSums(_mm_movelh_ps(_mm_cvtpd_ps(sum_low), _mm_cvtpd_ps(sum_high)),
+              out + x * out_stride, out_stride);
+  }
+#endif
+  for (; x < width; ++x) {
+    double sum = 0;
+    for (int k = 0; k < size; ++k) {
+      sum += rows[k][x] * coefficients[k];
+    }
+    out[x * out_stride] = static_cast<float>(sum);
+  }
+}
+
+// Use a dispatch table to make most convolutions used in practice use the
+// fast path.
+void ConvolveRows(const float *const *rows, const double *coefficients,
+                  int n, int width, float *out, int out_stride) {
+  switch (n) {
+#define static_convolution( size ) case size: \
+  ConvolveRows<size>(rows, coefficients, n, width, out, out_stride); break;
+    static_convolution(3)
+    static_convolution(5)
+    static_convolution(7)
+    static_convolution(9)
+    static_convolution(11)
+    static_convolution(13)
+    static_convolution(15)
+#undef static_convolution
+    default:
+      ConvolveRows<0>(rows, coefficients, n, width, out, out_stride);
   }
-  // Fast path: if the kernel has a certain size, use the constant sized loops.
-  for (int y = 0; y < height; ++y) {
+}
+
+// A kernel flipped so that the coefficient of the pixel at offset k from the
+// output is coefficients[k + half_width].
+struct FlippedKernel {
+  explicit FlippedKernel(const Vec &kernel)
+      : half_width(kernel.size() / 2),
+        coefficients(kernel.size()) {
+    assert(kernel.size() % 2 == 1);
+    for (int k = 0; k < kernel.size(); ++k) {
+      coefficients[k] = kernel(kernel.size() - 1 - k);
+    }
+  }
+
+  int half_width;
+  vector<double> coefficients;
+};
+
+// Convolves horizontally the num_rows rows of src, whose pixel (y, x) is at
+// src[y * src_line_stride + x * src_stride], into dst. Pixels outside of the
+// rows count as zero.
+//
+// Each row is copied in a zero padded buffer, and the output is the weighted
+// sum of the shifted views of that buffer.
+void ConvolveRowsHorizontally(const FlippedKernel &kernel,
+                              const float *src,
+                              int src_line_stride,
+                              int src_stride,
+                              int width,
+                              int num_rows,
+                              float *dst,
+                              int dst_line_stride,
+                              int dst_stride) {
+  int half_width = kernel.half_width;
+  int num_coefficients = kernel.coefficients.size();
+  vector<float> padded(width + 2 * half_width, 0.0f);
+  vector<const float *> rows(num_coefficients);
+  for (int k = 0; k < num_coefficients; ++k) {
+    rows[k] = padded.data() + k;
+  }
+  for (int y = 0; y < num_rows; ++y) {
+    const float *src_row = src + y * src_line_stride;
     for (int x = 0; x < width; ++x) {
-      double sum = 0;
-      for (int k = -size; k <= size; ++k) {
-        if (vertical) {
-          if (y + k >= 0 && y + k < height) {
-            sum += src[k * src_line_stride] * coefficients[k + size];
-          }
-        } else {
-          if (x + k >= 0 && x + k < width) {
-            sum += src[k * src_stride] * coefficients[k + size];
-          }
-        }
-      }
-      dst[0] = static_cast<float>(sum);
-      src += src_stride;
-      dst += dst_stride;
+      padded[half_width + x] = src_row[x * src_stride];
     }
+    ConvolveRows(rows.data(), kernel.coefficients.data(), num_coefficients,
+                 width, dst + y * dst_line_stride, dst_stride);
   }
 }
 
+// Convolves vertically the rows [y_begin, y_end) of an image of the given
+// height, and stores row y_begin of the result at dst. Row y of the image is
+// the contiguous row at src + (y - src_first_row) * src_line_stride; only the
+// rows within the half width of the kernel from the output need to be there.
+// Rows outside of the image count as zero.
+void ConvolveRowsVertically(const FlippedKernel &kernel,
+                            const float *src,
+                            int src_first_row,
+                            int src_line_stride,
+                            int width,
+                            int height,
+                            int y_begin,
+                            int y_end,
+                            float *dst,
+                            int dst_line_stride,
+                            int dst_stride) {
+  int half_width = kernel.half_width;
+  vector<const float *> rows(kernel.coefficients.size());
+  for (int y = y_begin; y < y_end; ++y) {
+    // Only sum the rows inside the image.
+    int k_begin = std::max(-half_width, -y);
+    int k_end = std::min(half_width, height - 1 - y);
+    for (int k = k_begin; k <= k_end; ++k) {
+      rows[k - k_begin] = src + (y + k - src_first_row) * src_line_stride;
+    }
+    ConvolveRows(rows.data(), kernel.coefficients.data() + k_begin + half_width,
+                 k_end - k_begin + 1, width,
+                 dst + (y - y_begin) * dst_line_stride, dst_stride);
+  }
+}
+
+// Convolves the first channel of in into the given plane of out. Pixels outside
+// of the image count as zero.
 template<bool vertical>
 void Convolve(const Array3Df &in,
               const Vec &kernel,
@@ -105,55 +239,105 @@ void Convolve(const Array3Df &in,
     plane = 0;
   }
 
-  assert(kernel.size() % 2 == 1);
   assert(&in != out_pointer);
 
+  FlippedKernel flipped_kernel(kernel);
   int src_line_stride = in.Stride(0);
   int src_stride = in.Stride(1);
-  int dst_stride = out.Stride(1);
   const float* src = in.Data();
   float* dst = out.Data() + plane;
 
-  // Use a dispatch table to make most convolutions used in practice use the
-  // fast path.
-  int half_width = kernel.size() / 2;
-  switch (half_width) {
-#define static_convolution( size ) case size: \
-  FastConvolve<size, vertical>(kernel, width, height, src, src_stride, \
-                               src_line_stride, dst, dst_stride); break;
-    static_convolution(1)
-    static_convolution(2)
-    static_convolution(3)
-    static_convolution(4)
-    static_convolution(5)
-    static_convolution(6)
-    static_convolution(7)
-#undef static_convolution
-    default:
-      int dynamic_size = kernel.size() / 2;
-      for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-          double sum = 0;
-          // Slow path: this loop cannot be unrolled.
-          for (int k = -dynamic_size; k <= dynamic_size; ++k) {
-            if(vertical) {
-              if (y + k >= 0 && y + k < height) {
-                sum += src[k * src_line_stride] * kernel(2 * dynamic_size - (k + dynamic_size));
-              }
-            } else {
-              if (x + k >= 0 && x + k < width) {
-                sum += src[k * src_stride] * kernel(2 * dynamic_size - (k + dynamic_size));
-              }
-            }
-          }
-          dst[0] = static_cast<float>(sum);
-          src += src_stride;
-          dst += dst_stride;
-        }
+  if (!vertical) {
+    ConvolveRowsHorizontally(flipped_kernel, src, src_line_stride, src_stride,
+                             width, height, dst, out.Stride(0), out.Stride(1));
+    return;
+  }
+
+  // The vertical pass needs contiguous rows; pack the first channel if the
+  // input is interleaved.
+  vector<float> packed;
+  if (src_stride != 1) {
+    packed.resize(width * height);
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        packed[y * width + x] = src[y * src_line_stride + x * src_stride];
       }
+    }
+    src = packed.data();
+    src_line_stride = width;
   }
+  ConvolveRowsVertically(flipped_kernel, src, 0, src_line_stride, width,
+                         height, 0, height, dst, out.Stride(0), out.Stride(1));
 }
 
+// Computes the rows of BlurredImageAndDerivativesChannels() in one tile of
+// tile_height rows. The intermediate images only span the tile and the half
+// width of the kernel around it, so they stay in cache, and the tiles can be
+// computed concurrently. The arithmetic is the same as convolving the whole
+// image pass after pass.
+class BlurredImageAndDerivativesTile {
+ public:
+  BlurredImageAndDerivativesTile(const Array3Df &in,
+                                 const FlippedKernel &kernel,
+                                 const FlippedKernel &derivative,
+                                 int tile_height,
+                                 Array3Df *blurred_and_gradxy)
+      : in_(in),
+        kernel_(kernel),
+        derivative_(derivative),
+        tile_height_(tile_height),
+        out_(blurred_and_gradxy) {}
+
+  void operator()(int tile) const {
+    int width = in_.Width();
+    int height = in_.Height();
+    int y_begin = tile * tile_height_;
+    int y_end = std::min(height, y_begin + tile_height_);
+    int num_rows = y_end - y_begin;
+    // The rows of the input may be strided (e.g. a region view), but the
+    // pixels of each row are adjacent; see BlurredImageAndDerivativesChannels.
+    const float *in = in_.Data();
+    int in_line_stride = in_.Stride(0);
+    float *out = out_->Data() + y_begin * out_->Stride(0);
+    int out_line_stride = out_->Stride(0);
+    int out_stride = out_->Stride(1);
+    int out_channel_stride = out_->Stride(2);
+
+    // Blurred image and first derivative in x, from the vertical blur. The
+    // intermediate rows come from the scratch pool of the worker thread.
+    ScopedScratchImage blurred(num_rows, width);
+    ConvolveRowsVertically(kernel_, in, 0, in_line_stride, width, height,
+                           y_begin, y_end, blurred->Data(), width, 1);
+    ConvolveRowsHorizontally(kernel_, blurred->Data(), width, 1, width,
+                             num_rows, out, out_line_stride, out_stride);
+    ConvolveRowsHorizontally(derivative_, blurred->Data(), width, 1, width,
+                             num_rows, out + out_channel_stride,
+                             out_line_stride, out_stride);
+
+    // First derivative in y, from the horizontal blur of the rows around the
+    // tile.
+    int rows_begin = std::max(0, y_begin - derivative_.half_width);
+    int rows_end = std::min(height, y_end + derivative_.half_width);
+    ScopedScratchImage blurred_rows(rows_end - rows_begin, width);
+    ConvolveRowsHorizontally(kernel_, in + rows_begin * in_line_stride,
+                             in_line_stride, 1, width, rows_end - rows_begin,
+                             blurred_rows->Data(), width, 1);
+    ConvolveRowsVertically(derivative_, blurred_rows->Data(), rows_begin,
+                           width, width, height, y_begin, y_end,
+                           out + 2 * out_channel_stride, out_line_stride,
+                           out_stride);
+  }
+
+ private:
+  const Array3Df &in_;
+  const FlippedKernel &kernel_;
+  const FlippedKernel &derivative_;
+  int tile_height_;
+  Array3Df *out_;
+};
+
+}  // namespace
+
 void ConvolveHorizontal(const Array3Df &in,
                         const Vec &kernel,
                         Array3Df *out_pointer,
@@ -174,9 +358,9 @@ void ConvolveGaussian(const Array3Df &in,
   Vec kernel, derivative;
   ComputeGaussianKernel(sigma, &kernel, &derivative);
 
-  Array3Df tmp;
-  ConvolveVertical(in, kernel, &tmp);
-  ConvolveHorizontal(tmp, kernel, out_pointer);
+  ScopedScratchImage tmp(in.Height(), in.Width(), in.Depth());
+  ConvolveVertical(in, kernel, tmp.get());
+  ConvolveHorizontal(*tmp, kernel, out_pointer);
 }
 
 void BlurredImageAndDerivatives(const Array3Df &in,
@@ -186,18 +370,18 @@ void BlurredImageAndDerivatives(const Array3Df &in,
                                 Array3Df *gradient_y) {
   Vec kernel, derivative;
   ComputeGaussianKernel(sigma, &kernel, &derivative);
-  Array3Df tmp;
+  ScopedScratchImage tmp(in.Height(), in.Width(), in.Depth());
 
   // Compute convolved image.
-  ConvolveVertical(in, kernel, &tmp);
-  ConvolveHorizontal(tmp, kernel, blurred_image);
+  ConvolveVertical(in, kernel, tmp.get());
+  ConvolveHorizontal(*tmp, kernel, blurred_image);
 
   // Compute first derivative in x (reusing vertical convolution above).
-  ConvolveHorizontal(tmp, derivative, gradient_x);
+  ConvolveHorizontal(*tmp, derivative, gradient_x);
 
   // Compute first derivative in y.
-  ConvolveHorizontal(in, kernel, &tmp);
-  ConvolveVertical(tmp, derivative, gradient_y);
+  ConvolveHorizontal(in, kernel, tmp.get());
+  ConvolveVertical(*tmp, derivative, gradient_y);
 }
 
 // Compute the gaussian blur of an image and the derivatives of the blurred
@@ -206,24 +390,32 @@ void BlurredImageAndDerivatives(const Array3Df &in,
 // three values are needed at the same time.
 void BlurredImageAndDerivativesChannels(const Array3Df &in,
                                         double sigma,
-                                        Array3Df *blurred_and_gradxy) {
+                                        Array3Df *blurred_and_gradxy,
+                                        ThreadPool *pool) {
   assert(in.Depth() == 1);
 
   Vec kernel, derivative;
   ComputeGaussianKernel(sigma, &kernel, &derivative);
+  FlippedKernel flipped_kernel(kernel), flipped_derivative(derivative);
 
-  // Compute convolved image.
-  Array3Df tmp;
-  ConvolveVertical(in, kernel, &tmp);
   blurred_and_gradxy->Resize(in.Height(), in.Width(), 3);
-  ConvolveHorizontal(tmp, kernel, blurred_and_gradxy, 0);
 
-  // Compute first derivative in x.
-  ConvolveHorizontal(tmp, derivative, blurred_and_gradxy, 1);
+  // The tiles follow the row stride of the input, but need the pixels of a
+  // row to be adjacent; pack the other views first.
+  Array3Df packed;
+  const Array3Df *contiguous_rows = &in;
+  if (in.Stride(1) != 1 && in.Width() > 1) {
+    packed.CopyFrom(in);
+    contiguous_rows = &packed;
+  }
 
-  // Compute first derivative in y.
-  ConvolveHorizontal(in, kernel, &tmp);
-  ConvolveVertical(tmp, derivative, blurred_and_gradxy, 2);
+  // Small enough tiles for the intermediate rows of a 4K image to fit in L2.
+  const int kTileHeight = 16;
+  int num_tiles = (in.Height() + kTileHeight - 1) / kTileHeight;
+  BlurredImageAndDerivativesTile tile(*contiguous_rows, flipped_kernel,
+                                      flipped_derivative, kTileHeight,
+                                      blurred_and_gradxy);
+  ParallelFor(pool, 0, num_tiles, tile);
 }
 
 void BoxFilterHorizontal(const Array3Df &in,
@@ -297,9 +489,9 @@ void BoxFilterVertical(const Array3Df &in,
 void BoxFilter(const Array3Df &in,
                int box_width,
                Array3Df *out) {
-  Array3Df tmp;
-  BoxFilterHorizontal(in, box_width, &tmp);
-  BoxFilterVertical(tmp, box_width, out);
+  ScopedScratchImage tmp(in.Height(), in.Width(), in.Depth());
+  BoxFilterHorizontal(in, box_width, tmp.get());
+  BoxFilterVertical(*tmp, box_width, out);
 }
 
 }  // namespace libmv
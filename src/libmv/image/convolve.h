@@ -26,6 +26,8 @@
 
 namespace libmv {
 
+class ThreadPool;
+
 // TODO(keir): Find a better place for these functions. gaussian.h in numeric?
 
 // Zero mean Gaussian.
@@ -70,10 +72,12 @@ void BlurredImageAndDerivatives(const FloatImage &in,
                                 FloatImage *gradient_y);
 
 // Blur and take the gradients of an image, storing the results inside the
-// three channels of blurred_and_gradxy.
+// three channels of blurred_and_gradxy. The image is processed in tiles of
+// rows, which are spread on pool if it is not NULL.
 void BlurredImageAndDerivativesChannels(const FloatImage &in,
                                         double sigma,
-                                        FloatImage *blurred_and_gradxy);
+                                        FloatImage *blurred_and_gradxy,
+                                        ThreadPool *pool = NULL);
 
 void BoxFilterHorizontal(const FloatImage &in,
                          int window_size,
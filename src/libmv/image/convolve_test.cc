@@ -20,6 +20,7 @@
 
 #include <iostream>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/convolve.h"
 #include "libmv/image/image.h"
 #include "libmv/numeric/numeric.h"
@@ -107,4 +108,111 @@ TEST(Convolve, BlurredImageAndDerivativesChannelsVerticalSlope) {
   EXPECT_NEAR(blurred_and_derivatives(5, 5, 2),  2.0, 1e-7);
 }
 
+// Direct implementation of a convolution with zero borders, reading the first
+// channel of the input.
+void ReferenceConvolve(const FloatImage &in, const Vec &kernel, bool vertical,
+                       FloatImage *out) {
+  int half_width = kernel.size() / 2;
+  out->Resize(in.Height(), in.Width(), 1);
+  for (int y = 0; y < in.Height(); ++y) {
+    for (int x = 0; x < in.Width(); ++x) {
+      double sum = 0;
+      for (int k = -half_width; k <= half_width; ++k) {
+        int xx = vertical ? x : x + k;
+        int yy = vertical ? y + k : y;
+        if (in.Contains(yy, xx)) {
+          sum += in(yy, xx, 0) * kernel(half_width - k);
+        }
+      }
+      (*out)(y, x) = sum;
+    }
+  }
+}
+
+TEST(Convolve, MatchesReferenceOnInterleavedImages) {
+  // An odd width exercises the scalar tail of the vectorized loops, and the
+  // second kernel is larger than the image height.
+  FloatImage in(13, 19, 2);
+  for (int i = 0; i < in.Size(); ++i) {
+    in.Data()[i] = (i * 37 % 101) / 10.0;
+  }
+  Vec kernel(5), wide_kernel(29);
+  kernel << 1, 2, -3, 4, 5;
+  for (int k = 0; k < wide_kernel.size(); ++k) {
+    wide_kernel(k) = k % 3 - 0.5 * k;
+  }
+  const Vec *kernels[] = { &kernel, &wide_kernel };
+  for (int i = 0; i < 2; ++i) {
+    for (int vertical = 0; vertical < 2; ++vertical) {
+      FloatImage expected, convolved(13, 19, 3);
+      ReferenceConvolve(in, *kernels[i], vertical, &expected);
+      if (vertical) {
+        ConvolveVertical(in, *kernels[i], &convolved, 1);
+      } else {
+        ConvolveHorizontal(in, *kernels[i], &convolved, 1);
+      }
+      for (int y = 0; y < in.Height(); ++y) {
+        for (int x = 0; x < in.Width(); ++x) {
+          EXPECT_EQ(expected(y, x), convolved(y, x, 1));
+        }
+      }
+    }
+  }
+}
+
+TEST(Convolve, BlurredImageAndDerivativesChannelsMatchesSeparatePasses) {
+  // Heights which are not a multiple of the tile height, or smaller than the
+  // kernel.
+  int heights[] = { 37, 3 };
+  for (int i = 0; i < 2; ++i) {
+    FloatImage in(heights[i], 23);
+    for (int j = 0; j < in.Size(); ++j) {
+      in.Data()[j] = (j * 37 % 101) / 10.0;
+    }
+    FloatImage blurred, gradient_x, gradient_y;
+    BlurredImageAndDerivatives(in, 1.5, &blurred, &gradient_x, &gradient_y);
+
+    ThreadPool pool(3);
+    FloatImage serial, parallel;
+    BlurredImageAndDerivativesChannels(in, 1.5, &serial);
+    BlurredImageAndDerivativesChannels(in, 1.5, &parallel, &pool);
+    EXPECT_TRUE(serial == parallel);
+    for (int y = 0; y < in.Height(); ++y) {
+      for (int x = 0; x < in.Width(); ++x) {
+        EXPECT_EQ(blurred(y, x), serial(y, x, 0));
+        EXPECT_EQ(gradient_x(y, x), serial(y, x, 1));
+        EXPECT_EQ(gradient_y(y, x), serial(y, x, 2));
+      }
+    }
+  }
+}
+
+TEST(Convolve, BlurredImageAndDerivativesChannelsOfViews) {
+  FloatImage image(29, 31), interleaved(29, 31, 2);
+  for (int i = 0; i < image.Size(); ++i) {
+    image.Data()[i] = (i * 37 % 101) / 10.0;
+  }
+  for (int i = 0; i < interleaved.Size(); ++i) {
+    interleaved.Data()[i] = (i * 53 % 97) / 10.0;
+  }
+
+  // A region, whose rows are strided, and the second channel of an
+  // interleaved image, whose pixels are strided.
+  FloatImage region, channel;
+  region.SetRegionView(&image, 3, 5, 20, 17);
+  int channel_shape[] = { 29, 31, 1 };
+  channel.SetView(interleaved.Data() + 1, FloatImage::Index(channel_shape),
+                  interleaved.Strides());
+  const FloatImage *views[] = { &region, &channel };
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_FALSE(views[i]->IsContiguous());
+    FloatImage copy(*views[i]);
+
+    FloatImage expected, actual;
+    BlurredImageAndDerivativesChannels(copy, 1.5, &expected);
+    BlurredImageAndDerivativesChannels(*views[i], 1.5, &actual);
+    EXPECT_TRUE(expected == actual);
+  }
+}
+
 }  // namespace
@@ -19,18 +19,24 @@
 // IN THE SOFTWARE.
 
 #include "libmv/image/filtered_sequence.h"
+#include "libmv/image/scratch_image_pool.h"
 
 namespace libmv {
 
 Filter::~Filter() {}
 
 FilteredImageSequence::FilteredImageSequence(ImageSequence *source,
-                                             Filter *filter)
+                                             Filter *filter,
+                                             ThreadPool *pool,
+                                             int read_ahead)
       : CachedImageSequence(source->Cache()),
         source_(source),
-        filter_(filter) {}
+        filter_(filter) {
+  SetReadAhead(pool, read_ahead);
+}
 
 FilteredImageSequence::~FilteredImageSequence() {
+  StopReadAhead();
   delete filter_;
 }
 
@@ -40,6 +46,9 @@ Image *FilteredImageSequence::LoadImage(int i) {
   Array3Df *source_image = source_->GetFloatImage(i);
   filter_->RunFilter(*source_image, destination_image);
   source_->Unpin(i);
+  // A frame is done; let the scratch images of shapes which are no longer
+  // used go.
+  ScratchImagePool::TrimAllThreads();
   return new Image(destination_image);
 }
 
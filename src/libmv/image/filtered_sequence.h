@@ -25,15 +25,23 @@
 
 namespace libmv {
 
+// Filters may be run on several frames at once by the read-ahead of a
+// FilteredImageSequence, so RunFilter() must not modify the filter.
 class Filter {
  public:
   virtual ~Filter();
   virtual void RunFilter(const Array3Df &source, Array3Df *destination) = 0;
 };
 
+// A sequence of the filtered images of another sequence. If pool is not NULL,
+// the read_ahead frames following the last one requested are filtered on it
+// in the background (see CachedImageSequence::SetReadAhead()).
 class FilteredImageSequence : public CachedImageSequence {
  public:
-  FilteredImageSequence(ImageSequence *source, Filter *filter);
+  FilteredImageSequence(ImageSequence *source,
+                        Filter *filter,
+                        ThreadPool *pool = NULL,
+                        int read_ahead = 0);
   virtual ~FilteredImageSequence();
   virtual Image *LoadImage(int i);
   virtual int Length() {
@@ -20,6 +20,7 @@
 
 #include <cstdio>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/image.h"
 #include "libmv/image/filtered_sequence.h"
 #include "libmv/image/mock_image_sequence.h"
@@ -91,4 +92,54 @@ TEST(FilteredSequence, TwoLevelFilters) {
   filterB.Unpin(1);
 }
 
+// Counts the images it filtered, from any thread.
+class CountingFilter : public Filter {
+ public:
+  CountingFilter(int *count, libmv::Mutex *mutex)
+      : count_(count), mutex_(mutex) {}
+  virtual ~CountingFilter() {}
+  void RunFilter(const Array3Df &source, Array3Df *destination) {
+    *destination = source;
+    libmv::MutexLock lock(mutex_);
+    (*count_)++;
+  }
+
+ private:
+  int *count_;
+  libmv::Mutex *mutex_;
+};
+
+TEST(FilteredSequence, ReadAheadFiltersEachFrameOnce) {
+  ImageCache cache;
+  MockImageSequence source(&cache);
+  Array3Df images[6];
+  for (int i = 0; i < 6; ++i) {
+    images[i].Resize(5, 5);
+    images[i].Fill(i);
+    source.Append(&images[i]);
+  }
+
+  libmv::ThreadPool pool(2);
+  libmv::Mutex mutex;
+  int count = 0;
+  {
+    FilteredImageSequence filtered(&source,
+                                   new CountingFilter(&count, &mutex),
+                                   &pool, 3);
+    for (int i = 0; i < 6; ++i) {
+      EXPECT_EQ(i, (*filtered.GetFloatImage(i))(2, 2));
+      filtered.Unpin(i);
+    }
+  }
+  EXPECT_EQ(6, count);
+
+  // Destroying the sequence with frames still queued on the pool is fine.
+  FilteredImageSequence *filtered =
+      new FilteredImageSequence(&source, new CountingFilter(&count, &mutex),
+                                &pool, 5);
+  filtered->GetFloatImage(0);
+  filtered->Unpin(0);
+  delete filtered;
+}
+
 }  // namespace
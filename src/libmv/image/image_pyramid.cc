@@ -23,6 +23,7 @@
 #include "libmv/image/image_pyramid.h"
 #include "libmv/image/convolve.h"
 #include "libmv/image/sample.h"
+#include "libmv/image/scratch_image_pool.h"
 
 namespace libmv {
 
@@ -46,12 +47,25 @@ class ConcreteImagePyramid : public ImagePyramid {
 
     BlurredImageAndDerivativesChannels(image, sigma, &levels_[0]);
 
-    vector<FloatImage> downsamples(num_levels);
-    downsamples[0] = image;  // FIXME: useless copy
-
+    // The downsampled images are only needed to blur the levels, so they are
+    // scratch images. They are computed in one pass.
+    ScratchImagePool *pool = ScratchImagePool::ForThisThread();
+    vector<FloatImage> downsampled(NumLevels() - 1);
+    vector<FloatImage *> downsampled_pointers(NumLevels() - 1);
+    int height = image.Height(), width = image.Width();
+    for (int i = 0; i < NumLevels() - 1; ++i) {
+      height /= 2;
+      width /= 2;
+      pool->Acquire(height, width, image.Depth(), &downsampled[i]);
+      downsampled_pointers[i] = &downsampled[i];
+    }
+    if (NumLevels() > 1) {
+      DownsamplePyramid(image, NumLevels() - 1, &downsampled_pointers[0]);
+    }
     for (int i = 1; i < NumLevels(); ++i) {
-      DownsampleChannelsBy2(downsamples[i-1], &downsamples[i]);
-      BlurredImageAndDerivativesChannels(downsamples[i], sigma, &levels_[i]);
+      BlurredImageAndDerivativesChannels(downsampled[i - 1], sigma,
+                                         &levels_[i]);
+      pool->Release(&downsampled[i - 1]);
     }
   }
 
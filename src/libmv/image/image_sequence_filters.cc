@@ -30,13 +30,14 @@ namespace {
 
 class BlurAndTakeDerivativesFilter : public Filter {
  public:
-  BlurAndTakeDerivativesFilter(double sigma)
-      : sigma_(sigma) {}
+  BlurAndTakeDerivativesFilter(double sigma, ThreadPool *pool)
+      : sigma_(sigma), pool_(pool) {}
   virtual ~BlurAndTakeDerivativesFilter() {}
   virtual void RunFilter(const Array3Df &source, Array3Df *destination) {
-    BlurredImageAndDerivativesChannels(source, sigma_, destination);
+    BlurredImageAndDerivativesChannels(source, sigma_, destination, pool_);
   }
   double sigma_;
+  ThreadPool *pool_;
 };
 
 class DownSampleBy2Filter : public Filter {
@@ -50,13 +51,21 @@ class DownSampleBy2Filter : public Filter {
 }  // namespace
 
 ImageSequence *BlurSequenceAndTakeDerivatives(ImageSequence *source,
-                                              double sigma) {
+                                              double sigma,
+                                              ThreadPool *pool,
+                                              int read_ahead) {
   return new FilteredImageSequence(source,
-                                   new BlurAndTakeDerivativesFilter(sigma));
+                                   new BlurAndTakeDerivativesFilter(sigma,
+                                                                    pool),
+                                   pool,
+                                   read_ahead);
 }
 
-ImageSequence *DownsampleSequenceBy2(ImageSequence *source) {
-  return new FilteredImageSequence(source, new DownSampleBy2Filter());
+ImageSequence *DownsampleSequenceBy2(ImageSequence *source,
+                                     ThreadPool *pool,
+                                     int read_ahead) {
+  return new FilteredImageSequence(source, new DownSampleBy2Filter(), pool,
+                                   read_ahead);
 }
 
 }  // namespace libmv
@@ -21,19 +21,30 @@
 #ifndef LIBMV_IMAGE_IMAGE_SEQUENCE_FILTERS_H_
 #define LIBMV_IMAGE_IMAGE_SEQUENCE_FILTERS_H_
 
+#include <cstddef>
+
 namespace libmv {
 
 class ImageSequence;
+class ThreadPool;
+
+// If pool is not NULL, the sequences below filter the read_ahead frames
+// following the last one requested on it (see FilteredImageSequence).
 
 // Produce a three-channel sequence from a monochrome sequence with:
 // Channel 0: Source image Gaussian blurred with a kernel of variance sigma.
 // Channel 1: X derivative of channel 0.
 // Channel 2: Y derivative of channel 0.
+// Each image is also split in tiles of rows filtered on pool.
 ImageSequence *BlurSequenceAndTakeDerivatives(ImageSequence *source,
-                                              double sigma);
+                                              double sigma,
+                                              ThreadPool *pool = NULL,
+                                              int read_ahead = 0);
 
 // Downsample each image in source by 2 in each dimension.
-ImageSequence *DownsampleSequenceBy2(ImageSequence *source);
+ImageSequence *DownsampleSequenceBy2(ImageSequence *source,
+                                     ThreadPool *pool = NULL,
+                                     int read_ahead = 0);
 
 }  // namespace libmv
 
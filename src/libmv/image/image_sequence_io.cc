@@ -18,16 +18,32 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#if (defined WIN32 || defined _WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 #include "libmv/image/image_io.h"
 #include "libmv/image/image_sequence_io.h"
 #include "libmv/image/cached_image_sequence.h"
+#include "libmv/logging/logging.h"
 
 namespace libmv {
 
 // An image sequence loaded from disk with caching behaviour.
 class LazyImageSequenceFromFiles : public CachedImageSequence {
  public:
-  virtual ~LazyImageSequenceFromFiles() {}
+  virtual ~LazyImageSequenceFromFiles() {
+    StopReadAhead();
+  }
 
   LazyImageSequenceFromFiles(const std::vector<std::string> &image_filenames,
                         ImageCache *cache)
@@ -59,4 +75,367 @@ ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
   return new LazyImageSequenceFromFiles(filenames, cache);
 }
 
+ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
+                                      ImageCache *cache,
+                                      ThreadPool *pool,
+                                      int read_ahead) {
+  LazyImageSequenceFromFiles *sequence =
+      new LazyImageSequenceFromFiles(filenames, cache);
+  sequence->SetReadAhead(pool, read_ahead);
+  return sequence;
+}
+
+namespace {
+
+// A frame cache file is a header, a table with the type and shape of each
+// frame, then the pixels of each frame in row major order, in the native
+// byte order. The table and the frames start on page boundaries so that the
+// frames are aligned for SIMD loads once mapped.
+const char kFrameCacheMagic[8] = {'L', 'I', 'B', 'M', 'V', 'F', 'C', '1'};
+const int kFrameCacheByteOrder = 0x01020304;
+const size_t kFrameCacheAlignment = 4096;
+
+struct FrameCacheHeader {
+  char magic[8];
+  int byte_order;
+  int num_frames;
+};
+
+struct FrameCacheEntry {
+  int type;
+  int height;
+  int width;
+  int depth;
+};
+
+size_t AlignToPage(size_t offset) {
+  return (offset + kFrameCacheAlignment - 1) / kFrameCacheAlignment
+      * kFrameCacheAlignment;
+}
+
+size_t FrameSizeInBytes(const FrameCacheEntry &entry) {
+  size_t pixel_size = entry.type == Image::BYTE ? 1 : sizeof(float);
+  return static_cast<size_t>(entry.height) * entry.width * entry.depth
+      * pixel_size;
+}
+
+bool WritePadding(FILE *file, size_t *offset) {
+  static const char zeros[kFrameCacheAlignment] = { 0 };
+  size_t padding = AlignToPage(*offset) - *offset;
+  *offset += padding;
+  return fwrite(zeros, 1, padding, file) == padding;
+}
+
+bool WriteFrames(ImageSequence *sequence, FILE *file) {
+  FrameCacheHeader header;
+  memcpy(header.magic, kFrameCacheMagic, sizeof(header.magic));
+  header.byte_order = kFrameCacheByteOrder;
+  header.num_frames = sequence->Length();
+  std::vector<FrameCacheEntry> entries(header.num_frames);
+  size_t offset = sizeof(header);
+  if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+      !WritePadding(file, &offset)) {
+    return false;
+  }
+  // The table is written once the shapes are known.
+  size_t table_size = entries.size() * sizeof(FrameCacheEntry);
+  offset += table_size;
+  if (fseek(file, static_cast<long>(table_size), SEEK_CUR) != 0 ||
+      !WritePadding(file, &offset)) {
+    return false;
+  }
+  for (int i = 0; i < header.num_frames; ++i) {
+    Image *image = sequence->GetImage(i);
+    if (!image) {
+      return false;
+    }
+    FrameCacheEntry &entry = entries[i];
+    const void *data;
+    if (Array3Du *array = image->AsArray3Du()) {
+      entry.type = Image::BYTE;
+      entry.height = array->Height();
+      entry.width = array->Width();
+      entry.depth = array->Depth();
+      data = array->Data();
+    } else if (Array3Df *array = image->AsArray3Df()) {
+      entry.type = Image::FLOAT;
+      entry.height = array->Height();
+      entry.width = array->Width();
+      entry.depth = array->Depth();
+      data = array->Data();
+    } else {
+      LOG(ERROR) << "Frame " << i << " is neither a byte nor a float image.";
+      sequence->Unpin(i);
+      return false;
+    }
+    size_t size = FrameSizeInBytes(entry);
+    bool written = fwrite(data, 1, size, file) == size;
+    sequence->Unpin(i);
+    offset += size;
+    if (!written || !WritePadding(file, &offset)) {
+      return false;
+    }
+  }
+  return fseek(file, static_cast<long>(AlignToPage(sizeof(header))),
+               SEEK_SET) == 0 &&
+         (entries.empty() ||
+          fwrite(&entries[0], sizeof(FrameCacheEntry), entries.size(), file)
+              == entries.size());
+}
+
+// A read-write, copy-on-write mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0) {}
+  ~MappedFile() {
+    if (!data_) {
+      return;
+    }
+#if (defined WIN32 || defined _WIN32)
+    UnmapViewOfFile(data_);
+#else
+    munmap(data_, size_);
+#endif
+  }
+
+  bool Open(const char *filename) {
+#if (defined WIN32 || defined _WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+        static_cast<LONGLONG>(static_cast<size_t>(size.QuadPart)) ==
+            size.QuadPart) {
+      mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    }
+    if (mapping) {
+      data_ = static_cast<char *>(
+          MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+      size_ = static_cast<size_t>(size.QuadPart);
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0 &&
+        static_cast<off_t>(static_cast<size_t>(status.st_size)) ==
+            status.st_size) {
+      size_ = status.st_size;
+      void *data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+      data_ = data == MAP_FAILED ? NULL : static_cast<char *>(data);
+    }
+    close(fd);
+#endif
+    return data_ != NULL;
+  }
+
+  char *data() { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  char *data_;
+  size_t size_;
+};
+
+// The images are views of the mapping, created when the file is opened; they
+// never change, so there is nothing to pin.
+class MappedImageSequence : public ImageSequence {
+ public:
+  virtual ~MappedImageSequence() {
+    for (size_t i = 0; i < images_.size(); ++i) {
+      delete images_[i];
+    }
+  }
+
+  bool Open(const char *filename) {
+    if (!file_.Open(filename)) {
+      return false;
+    }
+    const char *data = file_.data();
+    size_t size = file_.size();
+    FrameCacheHeader header;
+    if (size < sizeof(header)) {
+      return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kFrameCacheMagic, sizeof(header.magic)) != 0 ||
+        header.byte_order != kFrameCacheByteOrder ||
+        header.num_frames < 0) {
+      return false;
+    }
+    size_t offset = AlignToPage(sizeof(header));
+    size_t table_size = header.num_frames * sizeof(FrameCacheEntry);
+    if (size < offset + table_size) {
+      return false;
+    }
+    const FrameCacheEntry *entries =
+        reinterpret_cast<const FrameCacheEntry *>(data + offset);
+    offset = AlignToPage(offset + table_size);
+    for (int i = 0; i < header.num_frames; ++i) {
+      const FrameCacheEntry &entry = entries[i];
+      if ((entry.type != Image::BYTE && entry.type != Image::FLOAT) ||
+          entry.height < 0 || entry.width < 0 || entry.depth < 0) {
+        return false;
+      }
+      size_t frame_size = FrameSizeInBytes(entry);
+      if (size < offset + frame_size) {
+        return false;
+      }
+      char *pixels = file_.data() + offset;
+      if (entry.type == Image::BYTE) {
+        images_.push_back(new Image(new Array3Du(
+            reinterpret_cast<unsigned char *>(pixels),
+            entry.height, entry.width, entry.depth)));
+      } else {
+        images_.push_back(new Image(new Array3Df(
+            reinterpret_cast<float *>(pixels),
+            entry.height, entry.width, entry.depth)));
+      }
+      offset = AlignToPage(offset + frame_size);
+    }
+    return true;
+  }
+
+  virtual Image *GetImage(int i) {
+    return images_[i];
+  }
+
+  virtual void Unpin(int) {}
+
+  virtual int Length() {
+    return images_.size();
+  }
+
+ private:
+  MappedFile file_;
+  std::vector<Image *> images_;
+};
+
+// Whether a was modified strictly after b. Sub-second times are compared where
+// stat() reports them. Equal times do not count as newer, so a file written in
+// the same clock tick as the cache still makes the cache stale.
+bool IsModifiedAfter(const struct stat &a, const struct stat &b) {
+#if (defined WIN32 || defined _WIN32)
+  return a.st_mtime > b.st_mtime;
+#elif defined __APPLE__
+  if (a.st_mtimespec.tv_sec != b.st_mtimespec.tv_sec) {
+    return a.st_mtimespec.tv_sec > b.st_mtimespec.tv_sec;
+  }
+  return a.st_mtimespec.tv_nsec > b.st_mtimespec.tv_nsec;
+#else
+  if (a.st_mtim.tv_sec != b.st_mtim.tv_sec) {
+    return a.st_mtim.tv_sec > b.st_mtim.tv_sec;
+  }
+  return a.st_mtim.tv_nsec > b.st_mtim.tv_nsec;
+#endif
+}
+
+bool IsNewerThanFiles(const char *filename,
+                      const std::vector<std::string> &filenames) {
+  struct stat status;
+  if (stat(filename, &status) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    struct stat file_status;
+    if (stat(filenames[i].c_str(), &file_status) != 0 ||
+        !IsModifiedAfter(status, file_status)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Creates and opens a new file next to filename, with a name no other process
+// writing the same file uses. The name is stored in *temporary_filename.
+FILE *OpenTemporaryFile(const char *filename,
+                        std::string *temporary_filename) {
+#if (defined WIN32 || defined _WIN32)
+  char suffix[32];
+  sprintf(suffix, ".%d.tmp", _getpid());
+  *temporary_filename = std::string(filename) + suffix;
+  return fopen(temporary_filename->c_str(), "wb");
+#else
+  std::string name = std::string(filename) + ".XXXXXX";
+  std::vector<char> buffer(name.begin(), name.end());
+  buffer.push_back('\0');
+  int fd = mkstemp(&buffer[0]);
+  if (fd < 0) {
+    return NULL;
+  }
+  *temporary_filename = &buffer[0];
+  // mkstemp() makes the file private to the user; the cache is meant to be
+  // shared like the files it was decoded from.
+  fchmod(fd, 0644);
+  FILE *file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    remove(temporary_filename->c_str());
+  }
+  return file;
+#endif
+}
+
+}  // namespace
+
+bool WriteFrameCache(ImageSequence *sequence, const char *filename) {
+  std::string temporary_filename;
+  FILE *file = OpenTemporaryFile(filename, &temporary_filename);
+  if (!file) {
+    LOG(ERROR) << "Couldn't open a temporary file for " << filename;
+    return false;
+  }
+  bool written = WriteFrames(sequence, file);
+  written = fclose(file) == 0 && written;
+#if (defined WIN32 || defined _WIN32)
+  // Unlike POSIX, rename() does not replace an existing file on Windows.
+  remove(filename);
+#endif
+  if (!written || rename(temporary_filename.c_str(), filename) != 0) {
+    LOG(ERROR) << "Couldn't write the frame cache " << filename;
+    remove(temporary_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+ImageSequence *ImageSequenceFromFrameCache(const char *filename) {
+  MappedImageSequence *sequence = new MappedImageSequence;
+  if (!sequence->Open(filename)) {
+    delete sequence;
+    return NULL;
+  }
+  return sequence;
+}
+
+ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
+                                      ImageCache *cache,
+                                      const char *frame_cache) {
+  if (IsNewerThanFiles(frame_cache, filenames)) {
+    ImageSequence *sequence = ImageSequenceFromFrameCache(frame_cache);
+    if (sequence && sequence->Length() == static_cast<int>(filenames.size())) {
+      return sequence;
+    }
+    delete sequence;
+  }
+  ImageSequence *files = ImageSequenceFromFiles(filenames, cache);
+  if (WriteFrameCache(files, frame_cache)) {
+    ImageSequence *sequence = ImageSequenceFromFrameCache(frame_cache);
+    if (sequence) {
+      delete files;
+      return sequence;
+    }
+  }
+  return files;
+}
+
 }  // namespace libmv
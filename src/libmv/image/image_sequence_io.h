@@ -28,11 +28,43 @@ namespace libmv {
 
 class ImageSequence;
 class ImageCache;
+class ThreadPool;
 
 // An image sequence loaded from disk. Images in the sequerce are float images.
 ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
                                       ImageCache *cache);
 
+// Same, but the read_ahead frames ahead of the last one requested, forward or
+// backward like the consumer, are decoded on pool in the background. See
+// CachedImageSequence::SetReadAhead() for the details.
+ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
+                                      ImageCache *cache,
+                                      ThreadPool *pool,
+                                      int read_ahead);
+
+// Writes the frames of sequence to filename, uncompressed, in a format that
+// ImageSequenceFromFrameCache() maps in memory. The file is written under a
+// unique temporary name and renamed, so that other processes never see it
+// partially written, even when several of them write the same cache. Returns
+// false on failure.
+bool WriteFrameCache(ImageSequence *sequence, const char *filename);
+
+// An image sequence over a file written by WriteFrameCache(). The file is
+// mapped in memory and the images are views of the mapping, so opening it
+// neither reads nor decodes anything, and the processes mapping the same file
+// share its pages. The images may be modified; the changes are private to the
+// sequence. Returns NULL if the file cannot be mapped, or was not written by
+// WriteFrameCache() on a machine with the same byte order.
+ImageSequence *ImageSequenceFromFrameCache(const char *filename);
+
+// Maps frame_cache if it was modified after all the files, otherwise decodes
+// the files and writes frame_cache first; a file modified at the same time as
+// the frame cache makes it stale. Falls back to decoding the files through
+// cache when the frame cache cannot be written.
+ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
+                                      ImageCache *cache,
+                                      const char *frame_cache);
+
 // TODO(keir): Add a from AVI or from MOV here.
 
 }  // namespace libmv
@@ -18,19 +18,28 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstdio>
 #include <string>
 #include <vector>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/cached_image_sequence.h"
 #include "libmv/image/image_io.h"
 #include "libmv/image/image_sequence_io.h"
+#include "libmv/image/mock_image_sequence.h"
 #include "testing/testing.h"
 
 using libmv::Image;
 using libmv::ImageCache;
 using libmv::ImageSequence;
 using libmv::ImageSequenceFromFiles;
+using libmv::ImageSequenceFromFrameCache;
+using libmv::MockImageSequence;
+using libmv::WriteFrameCache;
 using libmv::Array3Df;
+using libmv::ThreadPool;
 using std::string;
 
 namespace {
@@ -78,4 +87,162 @@ TEST(ImageSequenceIO, FromFiles) {
   unlink(image2_fn.c_str());
 }
 
+TEST(ImageSequenceIO, FromFilesWithReadAhead) {
+  const int kNumFrames = 8;
+  std::vector<std::string> files;
+  for (int i = 0; i < kNumFrames; ++i) {
+    Array3Df image(1, 2);
+    image(0,0) = i / 255.f;
+    image(0,1) = 1.f;
+    char filename[32];
+    sprintf(filename, "/read_ahead_%d.pgm", i);
+    files.push_back(string(THIS_SOURCE_DIR) + filename);
+    WritePnm(image, files.back().c_str());
+  }
+
+  ThreadPool pool(2);
+  ImageCache cache;
+  ImageSequence *sequence = ImageSequenceFromFiles(files, &cache, &pool, 3);
+  EXPECT_EQ(kNumFrames, sequence->Length());
+
+  // Backward, then seek to the start and go forward.
+  int frames[] = { 7, 6, 5, 4, 0, 1, 2, 3, 4, 5 };
+  for (int k = 0; k < 10; ++k) {
+    int i = frames[k];
+    Array3Df *image = sequence->GetFloatImage(i);
+    ASSERT_TRUE(image);
+    EXPECT_NEAR(i / 255.f, (*image)(0,0), 1e-6);
+    EXPECT_EQ(1.f, (*image)(0,1));
+    sequence->Unpin(i);
+  }
+  delete sequence;
+
+  for (int i = 0; i < kNumFrames; ++i) {
+    unlink(files[i].c_str());
+  }
+}
+
+TEST(ImageSequenceIO, FrameCacheRoundTrip) {
+  ImageCache cache;
+  MockImageSequence source(&cache);
+  Array3Df image1(3, 5);
+  Array3Df image2(2, 7, 3);
+  for (int i = 0; i < image1.Size(); ++i) {
+    image1.Data()[i] = i * 0.25f;
+  }
+  for (int i = 0; i < image2.Size(); ++i) {
+    image2.Data()[i] = -i;
+  }
+  source.Append(&image1);
+  source.Append(&image2);
+
+  string frame_cache = string(THIS_SOURCE_DIR) + "/frames.cache";
+  ASSERT_TRUE(WriteFrameCache(&source, frame_cache.c_str()));
+  ImageSequence *sequence = ImageSequenceFromFrameCache(frame_cache.c_str());
+  ASSERT_TRUE(sequence);
+  EXPECT_EQ(2, sequence->Length());
+
+  Array3Df *image = sequence->GetFloatImage(0);
+  ASSERT_TRUE(image);
+  EXPECT_TRUE(image1 == *image);
+  EXPECT_EQ(0, reinterpret_cast<size_t>(image->Data()) % 16);
+  sequence->Unpin(0);
+
+  image = sequence->GetFloatImage(1);
+  ASSERT_TRUE(image);
+  EXPECT_TRUE(image2 == *image);
+  EXPECT_EQ(0, reinterpret_cast<size_t>(image->Data()) % 16);
+
+  // Writes stay private to the sequence.
+  (*image)(0, 0, 0) = 42.f;
+  sequence->Unpin(1);
+  delete sequence;
+  sequence = ImageSequenceFromFrameCache(frame_cache.c_str());
+  ASSERT_TRUE(sequence);
+  EXPECT_EQ(0.f, (*sequence->GetFloatImage(1))(0, 0, 0));
+  sequence->Unpin(1);
+  delete sequence;
+
+  unlink(frame_cache.c_str());
+}
+
+TEST(ImageSequenceIO, FrameCacheRejectsOtherFiles) {
+  EXPECT_FALSE(ImageSequenceFromFrameCache("/nonexistent/frames.cache"));
+
+  Array3Df image(4, 4);
+  image.Fill(0.5f);
+  string image_fn = string(THIS_SOURCE_DIR) + "/not_a_cache.pgm";
+  WritePnm(image, image_fn.c_str());
+  EXPECT_FALSE(ImageSequenceFromFrameCache(image_fn.c_str()));
+  unlink(image_fn.c_str());
+}
+
+TEST(ImageSequenceIO, FromFilesWithFrameCache) {
+  Array3Df image1(1, 2);
+  image1(0,0) = 1.f;
+  image1(0,1) = 0.f;
+  string image1_fn = string(THIS_SOURCE_DIR) + "/1.pgm";
+  WritePnm(image1, image1_fn.c_str());
+  std::vector<std::string> files;
+  files.push_back(image1_fn);
+
+  string frame_cache = string(THIS_SOURCE_DIR) + "/files.cache";
+  ImageCache cache;
+  for (int pass = 0; pass < 2; ++pass) {
+    // The first pass decodes the file and writes the frame cache, the second
+    // one maps it.
+    ImageSequence *sequence =
+        ImageSequenceFromFiles(files, &cache, frame_cache.c_str());
+    ASSERT_TRUE(sequence);
+    EXPECT_FALSE(sequence->Cache());
+    Array3Df *image = sequence->GetFloatImage(0);
+    ASSERT_TRUE(image);
+    EXPECT_EQ(2, image->Width());
+    EXPECT_EQ((*image)(0,0), 1.f);
+    EXPECT_EQ((*image)(0,1), 0.f);
+    sequence->Unpin(0);
+    delete sequence;
+  }
+
+  unlink(image1_fn.c_str());
+  unlink(frame_cache.c_str());
+}
+
+TEST(ImageSequenceIO, FrameCacheModifiedWithFileIsStale) {
+  Array3Df image1(1, 2);
+  image1(0,0) = 1.f;
+  image1(0,1) = 0.f;
+  string image1_fn = string(THIS_SOURCE_DIR) + "/stale.pgm";
+  WritePnm(image1, image1_fn.c_str());
+  std::vector<std::string> files;
+  files.push_back(image1_fn);
+
+  string frame_cache = string(THIS_SOURCE_DIR) + "/stale.cache";
+  ImageCache first_cache;
+  delete ImageSequenceFromFiles(files, &first_cache, frame_cache.c_str());
+
+  // Edit the file, and give it the modification time of the frame cache, as
+  // happens on file systems with a coarse clock.
+  image1(0,0) = 0.f;
+  image1(0,1) = 1.f;
+  WritePnm(image1, image1_fn.c_str());
+  struct timeval times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };
+  ASSERT_EQ(0, utimes(image1_fn.c_str(), times));
+  ASSERT_EQ(0, utimes(frame_cache.c_str(), times));
+
+  ImageCache cache;
+  ImageSequence *sequence =
+      ImageSequenceFromFiles(files, &cache, frame_cache.c_str());
+  ASSERT_TRUE(sequence);
+  Array3Df *image = sequence->GetFloatImage(0);
+  ASSERT_TRUE(image);
+  EXPECT_EQ((*image)(0,0), 0.f);
+  EXPECT_EQ((*image)(0,1), 1.f);
+  sequence->Unpin(0);
+  delete sequence;
+
+  unlink(image1_fn.c_str());
+  unlink(frame_cache.c_str());
+}
+
 }  // namespace
@@ -18,210 +18,332 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 //
-// A simple LRU cache. It uses a fair amount of space per-item, so do not use
-// this to store many small items. Instead, use this for heavy-weight objects
-// like images.
+// A thread safe LRU cache. It uses a fair amount of space per-item, so do not
+// use this to store many small items. Instead, use this for heavy-weight
+// objects like images.
 
 #ifndef LIBMV_IMAGE_LRU_CACHE_H_
 #define LIBMV_IMAGE_LRU_CACHE_H_
 
-#include <map>
-#include <list>
 #include <cassert>
-#include <cstdio>
+#include <cstddef>
+#include <map>
+#include <utility>
 
+#include "libmv/base/thread.h"
 #include "libmv/image/cache.h"
 
-using std::map;
-using std::list;
-
 namespace libmv {
 namespace lru_cache {
 
-// A queue which stores unique keys. It allows removal of arbitrary items by
-// key (which may be anywhere in the queue), and also containment queries.
+// Spreads the keys over the shards of an LRUCache. Works for integer, pointer
+// and pair keys; specialize it for other key types.
 template<typename K>
-class SetQueue {
- public:
-  // O(log n)
-  void Enqueue(const K &key) {
-    assert(!Contains(key));
-    queue_.push_front(key);
-    queue_positions_[key] = queue_.begin();
+struct Hash {
+  size_t operator()(const K &key) const {
+    return static_cast<size_t>(key);
   }
-  // O(log n)
-  void Remove(const K &key) {
-    assert(Contains(key));
-    typename Map::iterator it = queue_positions_.find(key);
-    queue_.erase(it->second);
-    queue_positions_.erase(it);
-  }
-  // O(1)
-  void Dequeue(K *key) {
-    assert(!queue_.empty());
-    *key = queue_.back();
-    Remove(*key);
-  }
-  // O(log n)
-  bool Contains(const K &key) {
-    return queue_positions_.find(key) != queue_positions_.end();
-  }
-  // O(n)
-  void Clear() {
-    queue_positions_.clear();
-    queue_.clear();
-  }
-  // O(1) in most implementations however may be O(n)
-  int Size() {
-    assert(queue_.size() == queue_positions_.size());
-    return queue_.size();
+};
+
+template<typename T>
+struct Hash<T *> {
+  size_t operator()(T *key) const {
+    // The low bits of heap pointers are mostly zero.
+    return reinterpret_cast<size_t>(key) >> 4;
   }
-  // O(1)
-  bool Empty() {
-    assert(queue_.empty() == queue_positions_.empty());
-    return queue_.empty();
+};
+
+template<typename A, typename B>
+struct Hash<std::pair<A, B> > {
+  size_t operator()(const std::pair<A, B> &key) const {
+    return Hash<A>()(key.first) * 31 + Hash<B>()(key.second);
   }
- private:
-  typedef list<K> Queue;
-  typedef map<const K, typename Queue::iterator> Map;
-  Queue queue_;
-  Map queue_positions_;
 };
 
 }  // namespace lru_cache
 
 template<typename K, typename V> class Cache;
 
-template<typename K, typename V>
+// All the methods are thread safe. The items are spread over num_shards shards
+// by the hash of their key, each with its own lock, so that threads working on
+// different keys rarely wait for each other. Within a shard the items are
+// found in O(log n), and the unpinned ones are kept in an intrusive list from
+// the least to the most recently used, so pinning, unpinning and evicting
+// are O(1) once the item is found. Eviction picks the least recently used
+// unpinned item of the whole cache, looking at the oldest one of each shard.
+//
+// Sizes are size_t, so that the budget can exceed 2 GB on 64 bit platforms.
+template<typename K, typename V, typename H = lru_cache::Hash<K> >
 class LRUCache : public Cache<K, V> {
  public:
-  // O(1)
-  LRUCache(int max_size)
-    : max_size_(max_size),
-      size_(0) {}
-  // O(n log n)
+  explicit LRUCache(size_t max_size, int num_shards = 1)
+    : shards_(new Shard[num_shards]),
+      num_shards_(num_shards),
+      max_size_(max_size),
+      size_(0),
+      clock_(0) {
+    assert(num_shards > 0);
+  }
+  // O(n)
+  virtual ~LRUCache() {
+    for (int i = 0; i < num_shards_; ++i) {
+      typename CacheMap::iterator it;
+      for (it = shards_[i].items.begin(); it != shards_[i].items.end(); ++it)
+        delete it->second.ptr;
+    }
+    delete [] shards_;
+  }
+  // O(log n)
   void Pin(const K &key) {
-    assert(ContainsKey(key));
-    CachedItem *item = &(items_[key]);
-    if (Pin(key, item))
-      DeleteUnpinnedItemsIfNecessary();
+    Shard *shard = ShardFor(key);
+    MutexLock lock(&shard->mutex);
+    typename CacheMap::iterator it = shard->items.find(key);
+    assert(it != shard->items.end());
+    Pin(shard, &it->second);
   }
-  // O(n log n)
+  // O(log n), plus the evictions.
   virtual void Unpin(const K &key) {
-    assert(ContainsKey(key));
-    CachedItem *item = &(items_[key]);
-    if (Unpin(key, item))
+    bool possible_delete_needed;
+    {
+      Shard *shard = ShardFor(key);
+      MutexLock lock(&shard->mutex);
+      typename CacheMap::iterator it = shard->items.find(key);
+      assert(it != shard->items.end());
+      possible_delete_needed = Unpin(shard, &it->second);
+    }
+    if (possible_delete_needed)
       DeleteUnpinnedItemsIfNecessary();
   }
-  // O(n log n)
+  // O(n), plus the evictions. Unpins the items entirely, whatever the number
+  // of times they were pinned.
   virtual void MassUnpin() {
     bool possible_delete_needed = false;
-    for (typename CacheMap::iterator it = items_.begin();
-        it != items_.end(); ++it) {
-      possible_delete_needed |= Unpin(it->first, &it->second);
+    for (int i = 0; i < num_shards_; ++i) {
+      Shard *shard = &shards_[i];
+      MutexLock lock(&shard->mutex);
+      typename CacheMap::iterator it;
+      for (it = shard->items.begin(); it != shard->items.end(); ++it) {
+        CachedItem *item = &it->second;
+        while (item->use_count > 0) {
+          possible_delete_needed |= Unpin(shard, item);
+        }
+      }
     }
     if (possible_delete_needed)
       DeleteUnpinnedItemsIfNecessary();
   }
-  // O(n log n)
+  // O(log n)
   virtual bool FetchAndPin(const K &key, V **value) {
-    if (!ContainsKey(key)) {
+    Shard *shard = ShardFor(key);
+    MutexLock lock(&shard->mutex);
+    typename CacheMap::iterator it = shard->items.find(key);
+    if (it == shard->items.end()) {
       return false;
-    } 
-    Pin(key);
-    *value = items_[key].ptr;
+    }
+    Pin(shard, &it->second);
+    *value = it->second.ptr;
     return true;
   }
-  // O(n log n)
-  virtual void StoreAndPinSized(const K &key, V *value, const int size) {
-    size_ += size;
-    CachedItem new_item;
-    new_item.ptr = value;
-    new_item.use_count = 1;
-    new_item.size = size;
-    items_[key] = new_item;
+  // O(log n), plus the evictions. The key must not be in the cache.
+  virtual void StoreAndPinSized(const K &key, V *value, const size_t size) {
+    {
+      Shard *shard = ShardFor(key);
+      MutexLock lock(&shard->mutex);
+      assert(shard->items.find(key) == shard->items.end());
+      Insert(shard, key, value, size);
+    }
     DeleteUnpinnedItemsIfNecessary();
   }
-  // O(1)
+  // O(log n), plus the evictions. Like StoreAndPinSized(), except that if
+  // another thread stored the key first, value is deleted and the cached
+  // value is pinned instead. Returns the pinned value.
+  V *FetchOrStoreAndPinSized(const K &key, V *value, const size_t size) {
+    V *cached_value = value;
+    {
+      Shard *shard = ShardFor(key);
+      MutexLock lock(&shard->mutex);
+      typename CacheMap::iterator it = shard->items.find(key);
+      if (it == shard->items.end()) {
+        Insert(shard, key, value, size);
+      } else {
+        Pin(shard, &it->second);
+        cached_value = it->second.ptr;
+      }
+    }
+    if (cached_value != value) {
+      delete value;
+    } else {
+      DeleteUnpinnedItemsIfNecessary();
+    }
+    return cached_value;
+  }
+  // O(log n)
   virtual bool ContainsKey(const K &key) {
-    return items_.find(key) != items_.end();
+    Shard *shard = ShardFor(key);
+    MutexLock lock(&shard->mutex);
+    return shard->items.find(key) != shard->items.end();
   }
   // O(1)
-  virtual int MaxSize() const {
+  virtual size_t MaxSize() const {
+    MutexLock lock(&size_mutex_);
     return max_size_;
   }
   // O(1)
-  virtual int Size() const {
+  virtual size_t Size() const {
+    MutexLock lock(&size_mutex_);
     return size_;
   }
-  // O(n log n)
-  virtual void SetMaxSize(const int max_size) {
-    max_size_ = max_size;
+  // The evictions.
+  virtual void SetMaxSize(const size_t max_size) {
+    {
+      MutexLock lock(&size_mutex_);
+      max_size_ = max_size;
+    }
     DeleteUnpinnedItemsIfNecessary();
   }
-  // O(n)
-  virtual ~LRUCache() {
-    typename CacheMap::iterator it;
-    for (it = items_.begin(); it != items_.end(); ++it)
-      delete it->second.ptr;
-  }
 
  private:
-  // O(n log n)
-  void DeleteUnpinnedItemsIfNecessary() {
-    while (!unpinned_items_.Empty() &&
-           size_ > max_size_) {
-      K key_to_remove;
-      unpinned_items_.Dequeue(&key_to_remove);
-      typename CacheMap::iterator it = items_.find(key_to_remove);
-      assert(it != items_.end());
-      CachedItem *item = &it->second;
-      delete item->ptr;
-      size_ -= item->size;
-      items_.erase(it);
-    }
-  }
-  
   struct CachedItem {
     V *ptr;
     int use_count;
-    int size;
-    CachedItem() : ptr(NULL) {}
+    size_t size;
+    // When the item was last unpinned, to compare items across shards.
+    unsigned long last_use;
+    // The list of unpinned items of the shard, while use_count is 0.
+    CachedItem *newer;
+    CachedItem *older;
+    const K *key;
+    CachedItem() : ptr(NULL), newer(NULL), older(NULL), key(NULL) {}
   };
+  typedef std::map<const K, CachedItem> CacheMap;
+
+  struct Shard {
+    Shard() : newest_unpinned(NULL), oldest_unpinned(NULL) {}
+    Mutex mutex;
+    CacheMap items;
+    CachedItem *newest_unpinned;
+    CachedItem *oldest_unpinned;
+  };
+
+  Shard *ShardFor(const K &key) {
+    return &shards_[H()(key) % num_shards_];
+  }
+
+  // The following require the lock of the shard to be held.
+
   // O(log n)
-  bool Pin(const K &key, CachedItem *item) {
-    assert(ContainsKey(key));
-    bool res = false;
+  void Insert(Shard *shard, const K &key, V *value, size_t size) {
+    typename CacheMap::iterator it =
+        shard->items.insert(std::make_pair(key, CachedItem())).first;
+    CachedItem *item = &it->second;
+    item->ptr = value;
+    item->use_count = 1;
+    item->size = size;
+    item->key = &it->first;
+    MutexLock lock(&size_mutex_);
+    size_ += size;
+  }
+  // O(1)
+  void Pin(Shard *shard, CachedItem *item) {
     if (item->use_count == 0) {
-      unpinned_items_.Remove(key);
-      res = true;
+      RemoveFromUnpinnedItems(shard, item);
     }
     item->use_count++;
-    return res;
   }
-  // O(log n)
-  // Using this function prevents the need to do a lookup for the CachedItem
-  // (when not debugging). It returns whether the item was entirely unpinned
-  // and hence whether DeleteUnpinnedItemsIfNecessary() should be called.
-  bool Unpin(const K &key, CachedItem *item) {
-    assert(ContainsKey(key));
+  // O(1)
+  // Returns whether the item was entirely unpinned and hence whether
+  // DeleteUnpinnedItemsIfNecessary() should be called.
+  bool Unpin(Shard *shard, CachedItem *item) {
     assert(item->use_count > 0);
-    assert(item == &(items_[key]));
-    bool res = false;
-    if (item->use_count == 1) {
-      unpinned_items_.Enqueue(key);
-      res = true;
-    }
     item->use_count--;
-    return res;
+    if (item->use_count > 0) {
+      return false;
+    }
+    {
+      MutexLock lock(&size_mutex_);
+      item->last_use = ++clock_;
+    }
+    item->newer = NULL;
+    item->older = shard->newest_unpinned;
+    if (shard->newest_unpinned) {
+      shard->newest_unpinned->newer = item;
+    } else {
+      shard->oldest_unpinned = item;
+    }
+    shard->newest_unpinned = item;
+    return true;
+  }
+  // O(1)
+  void RemoveFromUnpinnedItems(Shard *shard, CachedItem *item) {
+    if (item->newer) {
+      item->newer->older = item->older;
+    } else {
+      shard->newest_unpinned = item->older;
+    }
+    if (item->older) {
+      item->older->newer = item->newer;
+    } else {
+      shard->oldest_unpinned = item->newer;
+    }
+    item->newer = item->older = NULL;
   }
-  
-  lru_cache::SetQueue<K> unpinned_items_;
-  typedef map<const K, CachedItem> CacheMap;
-  CacheMap items_;
 
-  int max_size_;
-  int size_;
+  // O(number of shards) per eviction. Must be called without any lock held;
+  // the evicted items are deleted outside of the locks.
+  void DeleteUnpinnedItemsIfNecessary() {
+    for (;;) {
+      if (Size() <= MaxSize()) {
+        return;
+      }
+      Shard *oldest_shard = NULL;
+      unsigned long oldest_use = 0;
+      for (int i = 0; i < num_shards_; ++i) {
+        MutexLock lock(&shards_[i].mutex);
+        CachedItem *item = shards_[i].oldest_unpinned;
+        if (item && (!oldest_shard || item->last_use < oldest_use)) {
+          oldest_shard = &shards_[i];
+          oldest_use = item->last_use;
+        }
+      }
+      if (!oldest_shard) {
+        return;
+      }
+      V *evicted = NULL;
+      {
+        // The shard may have changed since it was looked at; evict whatever
+        // is its oldest item now, unless another thread made room already.
+        MutexLock lock(&oldest_shard->mutex);
+        CachedItem *item = oldest_shard->oldest_unpinned;
+        if (!item) {
+          continue;
+        }
+        {
+          MutexLock size_lock(&size_mutex_);
+          if (size_ <= max_size_) {
+            return;
+          }
+          size_ -= item->size;
+        }
+        evicted = item->ptr;
+        RemoveFromUnpinnedItems(oldest_shard, item);
+        oldest_shard->items.erase(oldest_shard->items.find(*item->key));
+      }
+      delete evicted;
+    }
+  }
+
+  Shard *shards_;
+  int num_shards_;
+
+  // Guards the sizes and the clock. Taken after the lock of a shard, if any.
+  mutable Mutex size_mutex_;
+  size_t max_size_;
+  size_t size_;
+  unsigned long clock_;
+
+  // No copying allowed.
+  LRUCache(const LRUCache &);
+  void operator=(const LRUCache &);
 };
 
 }  // namespace libmv
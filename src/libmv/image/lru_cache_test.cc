@@ -18,6 +18,7 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/lru_cache.h"
 #include "testing/testing.h"
 
@@ -25,99 +26,7 @@ namespace {
 
 typedef libmv::LRUCache<int, int> TestCache;
 
-using libmv::lru_cache::SetQueue;
-
-TEST(SetQueue, QueueAndDequeueOrder) {
-  SetQueue<int> queue;
-  int n;
-  
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-  
-  queue.Enqueue(10);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 1);
-  
-  queue.Enqueue(20);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 2);
-  
-  queue.Enqueue(30);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 3);
-  
-  queue.Dequeue(&n);
-  
-  EXPECT_EQ(n, 10);
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 2);
-  
-  queue.Dequeue(&n);
-  
-  EXPECT_EQ(n, 20);
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 1);
-  
-  queue.Dequeue(&n);
-  
-  EXPECT_EQ(n, 30);
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-}
-
-TEST(SetQueue, Clear) {
-  SetQueue<int> queue;
-  
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-  
-  queue.Enqueue(10);  
-  queue.Enqueue(20);  
-  queue.Enqueue(30);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 3);
-  
-  queue.Clear();
-  
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-}
-
-TEST(SetQueue, Remove) {
-  SetQueue<int> queue;
-  int n;
-  
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-  
-  queue.Enqueue(10);  
-  queue.Enqueue(20);  
-  queue.Enqueue(30);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 3);
-  
-  queue.Remove(10);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 2);
-  
-  queue.Remove(30);
-  
-  EXPECT_FALSE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 1);
-  
-  queue.Dequeue(&n);
-  
-  EXPECT_EQ(n, 20);
-  
-  EXPECT_TRUE(queue.Empty());
-  EXPECT_EQ(queue.Size(), 0);
-}
+using libmv::ThreadPool;
 
 TEST(LRUCache, NullOnEmptyKey) {
   TestCache cache(10);
@@ -201,4 +110,100 @@ TEST(LRUCache, SizeDecreaseWhenMaxSizeChanged) {
   EXPECT_EQ(cache.Size(), 1);
 }
 
+TEST(LRUCache, EvictsLeastRecentlyUnpinnedFirst) {
+  // Same order whether the items are in one shard or spread over several.
+  for (int num_shards = 1; num_shards <= 4; num_shards += 3) {
+    TestCache cache(3, num_shards);
+    cache.StoreAndPin(4, new int(40));
+    cache.StoreAndPin(5, new int(50));
+    cache.StoreAndPin(6, new int(60));
+    cache.Unpin(5);
+    cache.Unpin(4);
+    cache.Unpin(6);
+    cache.StoreAndPin(7, new int(70));
+    EXPECT_FALSE(cache.ContainsKey(5));
+    EXPECT_TRUE(cache.ContainsKey(4));
+
+    // Pinning takes 4 out of the queue; 6 goes next.
+    int *ptr = NULL;
+    EXPECT_TRUE(cache.FetchAndPin(4, &ptr));
+    EXPECT_EQ(40, *ptr);
+    cache.StoreAndPin(8, new int(80));
+    EXPECT_FALSE(cache.ContainsKey(6));
+    EXPECT_TRUE(cache.ContainsKey(4));
+    EXPECT_EQ(cache.Size(), 3);
+  }
+}
+
+TEST(LRUCache, PinnedTwiceNeedsTwoUnpins) {
+  TestCache cache(1);
+  int *ptr = NULL;
+  cache.StoreAndPin(4, new int(40));
+  EXPECT_TRUE(cache.FetchAndPin(4, &ptr));
+  cache.Unpin(4);
+  cache.StoreAndPin(5, new int(50));
+  EXPECT_TRUE(cache.ContainsKey(4));
+  cache.Unpin(4);
+  EXPECT_FALSE(cache.ContainsKey(4));
+}
+
+TEST(LRUCache, FetchOrStoreKeepsTheFirstValue) {
+  TestCache cache(10);
+  int *first = new int(40);
+  EXPECT_EQ(first, cache.FetchOrStoreAndPinSized(4, first, 1));
+  EXPECT_EQ(first, cache.FetchOrStoreAndPinSized(4, new int(41), 1));
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_EQ(40, *first);
+}
+
+TEST(LRUCache, SizesAboveTwoGigabytes) {
+  if (sizeof(size_t) < 8) {
+    return;
+  }
+  const size_t kGigabyte = 1024 * 1024 * 1024;
+  TestCache cache(16 * kGigabyte, 4);
+  for (int i = 0; i < 10; ++i) {
+    cache.StoreAndPinSized(i, new int(i), 2 * kGigabyte);
+  }
+  EXPECT_EQ(20 * kGigabyte, cache.Size());
+  for (int i = 0; i < 10; ++i) {
+    cache.Unpin(i);
+  }
+  EXPECT_EQ(16 * kGigabyte, cache.Size());
+  EXPECT_FALSE(cache.ContainsKey(1));
+  EXPECT_TRUE(cache.ContainsKey(2));
+}
+
+class PinAndUnpinTask : public libmv::Task {
+ public:
+  PinAndUnpinTask(TestCache *cache, int first_key)
+      : cache_(cache), first_key_(first_key) {}
+  virtual void Run() {
+    for (int i = 0; i < 1000; ++i) {
+      int key = first_key_ + i % 20;
+      int *value;
+      if (!cache_->FetchAndPin(key, &value)) {
+        value = cache_->FetchOrStoreAndPinSized(key, new int(key), 1);
+      }
+      EXPECT_EQ(key, *value);
+      cache_->Unpin(key);
+    }
+  }
+
+ private:
+  TestCache *cache_;
+  int first_key_;
+};
+
+TEST(LRUCache, PinAndUnpinFromSeveralThreads) {
+  TestCache cache(16, 4);
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 8; ++i) {
+      pool.Schedule(new PinAndUnpinTask(&cache, 10 * i));
+    }
+  }
+  EXPECT_EQ(cache.Size(), 16);
+}
+
 }  // namespace
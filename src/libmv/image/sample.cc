@@ -0,0 +1,316 @@
+// Copyright (c) 2007, 2008 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define LIBMV_SAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/base/vector.h"
+#include "libmv/image/image.h"
+#include "libmv/image/sample.h"
+
+namespace libmv {
+namespace {
+
+// Each output row is computed in three steps:
+//
+//   1. The input rows under the vertical kernel are summed into one row,
+//      padded with clamped pixels for the binomial kernel.
+//   2. The summed row is split into its even and odd pixels.
+//   3. The output row is a weighted sum of shifted views of the even and odd
+//      rows.
+//
+// Steps 1 and 3 work on contiguous floats whatever the depth, so they are
+// vectorized; step 2 only moves pixels around.
+//
+// The binomial kernel is [1 4 6 4 1] in both directions, so the sums are
+// normalized by 1/256 at the end.
+
+// Pixels of padding on each side of the summed row for the binomial kernel.
+const int kBinomialPadding = 2;
+
+// Row buffers of one thread.
+struct DownsampleBuffers {
+  vector<float> summed;
+  vector<float> even;
+  vector<float> odd;
+};
+
+// out[i] = a[i] + b[i].
+void SumRows(const float *a, const float *b, int n, float *out) {
+  int i = 0;
+#ifdef LIBMV_SAMPLE_SSE2
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i),
+                                      _mm_loadu_ps(b + i)));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+// out[i] = (r[0][i] + r[4][i]) + 4 (r[1][i] + r[3][i]) + 6 r[2][i].
+void BinomialSumRows(const float *const *r, int n, float *out) {
+  int i = 0;
+#ifdef LIBMV_SAMPLE_SSE2
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 six = _mm_set1_ps(6.0f);
+  for (; i + 4 <= n; i += 4) {
+    __m128 outer = _mm_add_ps(_mm_loadu_ps(r[0] + i), _mm_loadu_ps(r[4] + i));
+    __m128 inner = _mm_add_ps(_mm_loadu_ps(r[1] + i), _mm_loadu_ps(r[3] + i));
+    __m128 sum = _mm_add_ps(outer, _mm_mul_ps(four, inner));
+    _mm_storeu_ps(out + i,
+                  _mm_add_ps(sum, _mm_mul_ps(six, _mm_loadu_ps(r[2] + i))));
+  }
+#endif
+  for (; i < n; ++i) {
+    float outer = r[0][i] + r[4][i];
+    float inner = r[1][i] + r[3][i];
+    out[i] = (outer + 4.0f * inner) + 6.0f * r[2][i];
+  }
+}
+
+// Splits the num_pixels pixels of row into its even and odd pixels.
+void SplitEvenOdd(const float *row, int num_pixels, int depth,
+                  float *even, float *odd) {
+  int num_pairs = num_pixels / 2;
+#ifdef LIBMV_SAMPLE_SSE2
+  if (depth == 1) {
+    int j = 0;
+    for (; j + 4 <= num_pairs; j += 4) {
+      __m128 a = _mm_loadu_ps(row + 2 * j);
+      __m128 b = _mm_loadu_ps(row + 2 * j + 4);
+      _mm_storeu_ps(even + j, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(odd + j, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    for (; j < num_pairs; ++j) {
+      even[j] = row[2 * j];
+      odd[j] = row[2 * j + 1];
+    }
+    return;
+  }
+#endif
+  const size_t pixel_size = depth * sizeof(float);
+  for (int j = 0; j < num_pairs; ++j) {
+    memcpy(even + j * depth, row + 2 * j * depth, pixel_size);
+    memcpy(odd + j * depth, row + (2 * j + 1) * depth, pixel_size);
+  }
+}
+
+// out[i] = (even[i] + odd[i]) / 4.
+void BoxCombine(const float *even, const float *odd, int n, float *out) {
+  int i = 0;
+#ifdef LIBMV_SAMPLE_SSE2
+  const __m128 quarter = _mm_set1_ps(0.25f);
+  for (; i + 4 <= n; i += 4) {
+    __m128 sum = _mm_add_ps(_mm_loadu_ps(even + i), _mm_loadu_ps(odd + i));
+    _mm_storeu_ps(out + i, _mm_mul_ps(sum, quarter));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = (even[i] + odd[i]) * 0.25f;
+  }
+}
+
+// out[i] = ((e[i] + e[i + 2 s]) + 4 (o[i] + o[i + s]) + 6 e[i + s]) / 256,
+// where s is the pixel stride.
+void BinomialCombine(const float *e, const float *o, int n, int s,
+                     float *out) {
+  int i = 0;
+#ifdef LIBMV_SAMPLE_SSE2
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 six = _mm_set1_ps(6.0f);
+  const __m128 normalization = _mm_set1_ps(1.0f / 256.0f);
+  for (; i + 4 <= n; i += 4) {
+    __m128 outer = _mm_add_ps(_mm_loadu_ps(e + i), _mm_loadu_ps(e + i + 2 * s));
+    __m128 inner = _mm_add_ps(_mm_loadu_ps(o + i), _mm_loadu_ps(o + i + s));
+    __m128 sum = _mm_add_ps(outer, _mm_mul_ps(four, inner));
+    sum = _mm_add_ps(sum, _mm_mul_ps(six, _mm_loadu_ps(e + i + s)));
+    _mm_storeu_ps(out + i, _mm_mul_ps(sum, normalization));
+  }
+#endif
+  for (; i < n; ++i) {
+    float outer = e[i] + e[i + 2 * s];
+    float inner = o[i] + o[i + s];
+    out[i] = ((outer + 4.0f * inner) + 6.0f * e[i + s]) * (1.0f / 256.0f);
+  }
+}
+
+// Last row of the input that output row r depends on.
+int LastInputRow(int r, int input_height, DownsampleKernel kernel) {
+  if (kernel == DOWNSAMPLE_BOX) {
+    return 2 * r + 1;
+  }
+  return std::min(2 * r + kBinomialPadding, input_height - 1);
+}
+
+// Computes row r of the downsampling of in into out, which already has its
+// final size.
+void DownsampleRow(const Array3Df &in, int r, DownsampleKernel kernel,
+                   DownsampleBuffers *buffers, Array3Df *out) {
+  const int depth = in.Depth();
+  const int out_width = out->Width();
+  if (out_width == 0) {
+    return;
+  }
+  float *out_row = &(*out)(r, 0, 0);
+
+  if (kernel == DOWNSAMPLE_BOX) {
+    const int n = 2 * out_width * depth;
+    buffers->summed.resize(n);
+    buffers->even.resize(n / 2);
+    buffers->odd.resize(n / 2);
+    SumRows(&in(2 * r, 0, 0), &in(2 * r + 1, 0, 0), n, &buffers->summed[0]);
+    SplitEvenOdd(&buffers->summed[0], 2 * out_width, depth,
+                 &buffers->even[0], &buffers->odd[0]);
+    BoxCombine(&buffers->even[0], &buffers->odd[0], out_width * depth,
+               out_row);
+    return;
+  }
+
+  // The summed row covers the input pixels [-2, 2 * out_width + 2), with the
+  // pixels outside of the input clamped to the border.
+  const int in_height = in.Height();
+  const int in_width = in.Width();
+  const int summed_width = 2 * out_width + 2 * kBinomialPadding;
+  buffers->summed.resize(summed_width * depth);
+  buffers->even.resize(summed_width / 2 * depth);
+  buffers->odd.resize(summed_width / 2 * depth);
+
+  const float *rows[5];
+  for (int k = 0; k < 5; ++k) {
+    int y = std::max(0, std::min(in_height - 1, 2 * r + k - kBinomialPadding));
+    rows[k] = &in(y, 0, 0);
+  }
+  float *summed = &buffers->summed[0];
+  int interior_width = std::min(in_width, summed_width - kBinomialPadding);
+  BinomialSumRows(rows, interior_width * depth,
+                  summed + kBinomialPadding * depth);
+  const size_t pixel_size = depth * sizeof(float);
+  for (int x = -kBinomialPadding; x < 0; ++x) {
+    memcpy(summed + (x + kBinomialPadding) * depth,
+           summed + kBinomialPadding * depth, pixel_size);
+  }
+  for (int x = interior_width; x < summed_width - kBinomialPadding; ++x) {
+    memcpy(summed + (x + kBinomialPadding) * depth,
+           summed + (interior_width - 1 + kBinomialPadding) * depth,
+           pixel_size);
+  }
+
+  SplitEvenOdd(summed, summed_width, depth,
+               &buffers->even[0], &buffers->odd[0]);
+  BinomialCombine(&buffers->even[0], &buffers->odd[0], out_width * depth,
+                  depth, out_row);
+}
+
+// Computes chunks of rows of the downsampling of in into out, for
+// ParallelFor().
+struct DownsampleRowChunk {
+  static const int kRowsPerChunk = 16;
+
+  DownsampleRowChunk(const Array3Df &in, DownsampleKernel kernel,
+                     Array3Df *out)
+      : in_(in), kernel_(kernel), out_(out) {}
+
+  void operator()(int chunk) const {
+    DownsampleBuffers buffers;
+    int end = std::min(out_->Height(), (chunk + 1) * kRowsPerChunk);
+    for (int r = chunk * kRowsPerChunk; r < end; ++r) {
+      DownsampleRow(in_, r, kernel_, &buffers, out_);
+    }
+  }
+
+  const Array3Df &in_;
+  DownsampleKernel kernel_;
+  Array3Df *out_;
+};
+
+void DownsampleRowsInParallel(const Array3Df &in, DownsampleKernel kernel,
+                              ThreadPool *pool, Array3Df *out) {
+  DownsampleRowChunk chunk(in, kernel, out);
+  int num_chunks = (out->Height() + DownsampleRowChunk::kRowsPerChunk - 1) /
+                   DownsampleRowChunk::kRowsPerChunk;
+  ParallelFor(pool, 0, num_chunks, chunk);
+}
+
+}  // namespace
+
+void DownsampleChannelsBy2(const Array3Df &in, Array3Df *out,
+                           DownsampleKernel kernel,
+                           ThreadPool *pool) {
+  Array3Df *levels[] = { out };
+  DownsamplePyramid(in, 1, levels, kernel, pool);
+}
+
+void DownsamplePyramid(const Array3Df &in,
+                       int num_downsamples,
+                       Array3Df *const *out,
+                       DownsampleKernel kernel,
+                       ThreadPool *pool) {
+  // Pixels must be contiguous along the rows; the rows may be strided.
+  assert(in.Stride(2) == 1 && in.Stride(1) == in.Depth());
+
+  const Array3Df *previous = &in;
+  for (int i = 0; i < num_downsamples; ++i) {
+    assert(out[i] != &in);
+    out[i]->Resize(previous->Height() / 2, previous->Width() / 2,
+                   previous->Depth());
+    previous = out[i];
+  }
+  if (num_downsamples == 0 || out[0]->Height() == 0 || out[0]->Width() == 0) {
+    return;
+  }
+
+  if (pool) {
+    // Level by level, with the rows of each level spread over the threads.
+    previous = &in;
+    for (int i = 0; i < num_downsamples; ++i) {
+      DownsampleRowsInParallel(*previous, kernel, pool, out[i]);
+      previous = out[i];
+    }
+    return;
+  }
+
+  // Stream the levels: a row of a level is computed as soon as the rows of
+  // the previous level it depends on are, while those are still in cache.
+  DownsampleBuffers buffers;
+  vector<int> rows_done(num_downsamples, 0);
+  for (int r = 0; r < out[0]->Height(); ++r) {
+    DownsampleRow(in, r, kernel, &buffers, out[0]);
+    ++rows_done[0];
+    for (int i = 1; i < num_downsamples; ++i) {
+      const Array3Df &source = *out[i - 1];
+      while (rows_done[i] < out[i]->Height() &&
+             LastInputRow(rows_done[i], source.Height(), kernel) <
+                 rows_done[i - 1]) {
+        DownsampleRow(source, rows_done[i], kernel, &buffers, out[i]);
+        ++rows_done[i];
+      }
+    }
+  }
+}
+
+}  // namespace libmv
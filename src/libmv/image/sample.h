@@ -25,6 +25,8 @@
 
 namespace libmv {
 
+class ThreadPool;
+
 /// Nearest neighbor interpolation.
 template<typename T>
 inline T SampleNearest(const Array3D<T> &image,
@@ -74,28 +76,35 @@ inline T SampleLinear(const Array3D<T> &image, float y, float x, int v = 0) {
            dy2 * ( dx1 * im21 + dx2 * im22 ));
 }
 
-// Downsample all channels by 2. If the image has odd width or height, the last
-// row or column is ignored.
-inline void DownsampleChannelsBy2(const Array3Df &in, Array3Df *out) {
-  int height = in.Height() / 2;
-  int width = in.Width() / 2;
-  int depth = in.Depth();
-
-  out->Resize(height, width, depth);
+// Antialiasing filters for downsampling by 2.
+enum DownsampleKernel {
+  // Mean of each 2x2 block of pixels. Output pixel (r, c) is centered on input
+  // pixel (2r + 0.5, 2c + 0.5).
+  DOWNSAMPLE_BOX,
+  // Separable [1 4 6 4 1] / 16 binomial, an approximate gaussian of sigma 1
+  // which attenuates the frequencies above the new Nyquist limit much more
+  // than the box. Output pixel (r, c) is centered on input pixel (2r, 2c);
+  // the input is clamped at the borders.
+  DOWNSAMPLE_BINOMIAL,
+};
 
-  // 2x2 box filter downsampling.
-  for (int r = 0; r < height; ++r) {
-    for (int c = 0; c < width; ++c) {
-      for (int k = 0; k < depth; ++k) {
-        (*out)(r, c, k) = (in(2 * r,     2 * c,     k) +
-                           in(2 * r + 1, 2 * c,     k) +
-                           in(2 * r,     2 * c + 1, k) +
-                           in(2 * r + 1, 2 * c + 1, k)) / 4.0f;
-      }
-    }
-  }
+// Downsample all channels by 2. If the image has odd width or height, the last
+// row or column is ignored by the box kernel. The rows are spread over pool if
+// it is not NULL.
+void DownsampleChannelsBy2(const Array3Df &in, Array3Df *out,
+                           DownsampleKernel kernel = DOWNSAMPLE_BOX,
+                           ThreadPool *pool = NULL);
 
-}
+// Downsample in by 2 num_downsamples times, into *out[0] to
+// *out[num_downsamples - 1]; *out[i] is the same as DownsampleChannelsBy2() of
+// *out[i - 1]. Without a pool, all the levels are computed in one pass over
+// the input, each row as soon as the rows it depends on are; with a pool, the
+// levels are computed one after the other, with their rows spread over pool.
+void DownsamplePyramid(const Array3Df &in,
+                       int num_downsamples,
+                       Array3Df *const *out,
+                       DownsampleKernel kernel = DOWNSAMPLE_BOX,
+                       ThreadPool *pool = NULL);
 
 }  // namespace libmv
 
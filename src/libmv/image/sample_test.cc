@@ -18,6 +18,9 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <algorithm>
+
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/sample.h"
 #include "testing/testing.h"
 
@@ -86,4 +89,115 @@ TEST(Image, DownsampleBy2MultiChannel) {
   EXPECT_FLOAT_EQ((5+6+7+8)/4.,    resampled_image(0, 0, 1));
   EXPECT_FLOAT_EQ((9+10+11+12)/4., resampled_image(0, 0, 2));
 }
+
+// Fills image with values that do not repeat along the rows or columns.
+void FillPattern(Array3Df *image) {
+  for (int r = 0; r < image->Height(); ++r) {
+    for (int c = 0; c < image->Width(); ++c) {
+      for (int k = 0; k < image->Depth(); ++k) {
+        (*image)(r, c, k) = ((r * 37 + c * 11 + k * 5) % 23) / 23.0f;
+      }
+    }
+  }
+}
+
+float ClampedPixel(const Array3Df &image, int r, int c, int k) {
+  r = std::max(0, std::min(image.Height() - 1, r));
+  c = std::max(0, std::min(image.Width() - 1, c));
+  return image(r, c, k);
+}
+
+TEST(Image, DownsampleBy2BoxOddSizes) {
+  // Odd sizes and depths exercise the vector and scalar paths.
+  Array3Df image(13, 23, 3);
+  FillPattern(&image);
+
+  Array3Df resampled_image;
+  DownsampleChannelsBy2(image, &resampled_image, DOWNSAMPLE_BOX);
+  ASSERT_EQ(6, resampled_image.Height());
+  ASSERT_EQ(11, resampled_image.Width());
+  ASSERT_EQ(3, resampled_image.Depth());
+  for (int r = 0; r < 6; ++r) {
+    for (int c = 0; c < 11; ++c) {
+      for (int k = 0; k < 3; ++k) {
+        float expected = (image(2 * r,     2 * c,     k) +
+                          image(2 * r + 1, 2 * c,     k) +
+                          image(2 * r,     2 * c + 1, k) +
+                          image(2 * r + 1, 2 * c + 1, k)) / 4.0f;
+        EXPECT_NEAR(expected, resampled_image(r, c, k), 1e-6);
+      }
+    }
+  }
+}
+
+TEST(Image, DownsampleBy2Binomial) {
+  for (int depth = 1; depth <= 2; ++depth) {
+    Array3Df image(17, 30, depth);
+    FillPattern(&image);
+
+    Array3Df resampled_image;
+    DownsampleChannelsBy2(image, &resampled_image, DOWNSAMPLE_BINOMIAL);
+    ASSERT_EQ(8, resampled_image.Height());
+    ASSERT_EQ(15, resampled_image.Width());
+    ASSERT_EQ(depth, resampled_image.Depth());
+
+    const float weights[] = { 1, 4, 6, 4, 1 };
+    for (int r = 0; r < 8; ++r) {
+      for (int c = 0; c < 15; ++c) {
+        for (int k = 0; k < depth; ++k) {
+          float expected = 0;
+          for (int i = 0; i < 5; ++i) {
+            for (int j = 0; j < 5; ++j) {
+              expected += weights[i] * weights[j] *
+                  ClampedPixel(image, 2 * r + i - 2, 2 * c + j - 2, k);
+            }
+          }
+          EXPECT_NEAR(expected / 256, resampled_image(r, c, k), 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TEST(Image, DownsampleBy2BinomialKeepsConstants) {
+  Array3Df image(9, 9);
+  image.Fill(0.5f);
+  Array3Df resampled_image;
+  DownsampleChannelsBy2(image, &resampled_image, DOWNSAMPLE_BINOMIAL);
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      EXPECT_FLOAT_EQ(0.5f, resampled_image(r, c));
+    }
+  }
+}
+
+// The streamed and threaded pyramids match downsampling level by level.
+TEST(Image, DownsamplePyramid) {
+  Array3Df image(100, 75);
+  FillPattern(&image);
+
+  for (int kernel = DOWNSAMPLE_BOX; kernel <= DOWNSAMPLE_BINOMIAL; ++kernel) {
+    DownsampleKernel downsample_kernel = DownsampleKernel(kernel);
+    Array3Df expected[4];
+    const Array3Df *previous = &image;
+    for (int i = 0; i < 4; ++i) {
+      DownsampleChannelsBy2(*previous, &expected[i], downsample_kernel);
+      previous = &expected[i];
+    }
+
+    ThreadPool pool(2);
+    ThreadPool *pools[] = { NULL, &pool };
+    for (int p = 0; p < 2; ++p) {
+      Array3Df levels[4];
+      Array3Df *out[] = { &levels[0], &levels[1], &levels[2], &levels[3] };
+      DownsamplePyramid(image, 4, out, downsample_kernel, pools[p]);
+      for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(expected[i], levels[i]);
+      }
+    }
+    EXPECT_EQ(6, expected[3].Height());
+    EXPECT_EQ(4, expected[3].Width());
+  }
+}
+
 }  // namespace
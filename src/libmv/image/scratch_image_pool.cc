@@ -0,0 +1,204 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <algorithm>
+
+#include <pthread.h>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/scratch_image_pool.h"
+
+namespace libmv {
+
+namespace {
+
+size_t SizeInBytes(const FloatImage &image) {
+  return image.Size() * sizeof(float);
+}
+
+// The budget shared by the pools of all the threads, and the bytes they keep.
+Mutex all_threads_mutex;
+size_t all_threads_max_bytes_pooled = 256 * 1024 * 1024;
+size_t all_threads_bytes_pooled = 0;
+unsigned all_threads_trim_generation = 0;
+
+pthread_key_t thread_scratch_pool_key;
+pthread_once_t thread_scratch_pool_key_once = PTHREAD_ONCE_INIT;
+
+void DeleteThreadScratchPool(void *pool) {
+  delete static_cast<ScratchImagePool *>(pool);
+}
+
+void CreateThreadScratchPoolKey() {
+  pthread_key_create(&thread_scratch_pool_key, DeleteThreadScratchPool);
+}
+
+}  // namespace
+
+ScratchImagePool::ScratchImagePool(size_t max_bytes_pooled)
+    : max_bytes_pooled_(max_bytes_pooled), clock_(0),
+      is_thread_pool_(false), trim_generation_(0) {}
+
+ScratchImagePool::ScratchImagePool(ThreadPoolTag)
+    : clock_(0), is_thread_pool_(true) {
+  MutexLock lock(&all_threads_mutex);
+  max_bytes_pooled_ = all_threads_max_bytes_pooled;
+  trim_generation_ = all_threads_trim_generation;
+}
+
+ScratchImagePool::~ScratchImagePool() {
+  for (PooledImages::iterator it = pooled_.begin(); it != pooled_.end(); ++it) {
+    delete it->second.image;
+  }
+  RemovePooledBytes(stats_.bytes_pooled);
+}
+
+void ScratchImagePool::Acquire(int height, int width, int depth,
+                               FloatImage *image) {
+  if (is_thread_pool_) {
+    unsigned trim_generation;
+    {
+      MutexLock lock(&all_threads_mutex);
+      trim_generation = all_threads_trim_generation;
+      max_bytes_pooled_ = all_threads_max_bytes_pooled;
+    }
+    if (trim_generation != trim_generation_) {
+      trim_generation_ = trim_generation;
+      Trim();
+    }
+  }
+
+  PooledImages::iterator it = pooled_.find(Shape(height, width, depth));
+  if (it != pooled_.end()) {
+    image->Swap(*it->second.image);
+    // Frees the previous data of image.
+    delete it->second.image;
+    RemovePooledBytes(SizeInBytes(*image));
+    pooled_.erase(it);
+    stats_.num_reuses++;
+  } else {
+    image->Resize(height, width, depth);
+    stats_.num_allocations++;
+  }
+  stats_.bytes_in_use += SizeInBytes(*image);
+  if (stats_.bytes_in_use > stats_.peak_bytes_in_use) {
+    stats_.peak_bytes_in_use = stats_.bytes_in_use;
+  }
+}
+
+void ScratchImagePool::Release(FloatImage *image) {
+  if (!image->OwnsData() || image->Size() == 0) {
+    return;
+  }
+  size_t size = SizeInBytes(*image);
+  stats_.bytes_in_use -= std::min(size, stats_.bytes_in_use);
+  if (size > max_bytes_pooled_) {
+    image->Resize(0, 0);
+    return;
+  }
+  PooledImage pooled;
+  pooled.image = new FloatImage;
+  pooled.image->Swap(*image);
+  pooled.release_time = clock_++;
+  pooled.used_since_trim = true;
+  pooled_.insert(std::make_pair(Shape(pooled.image->Height(),
+                                      pooled.image->Width(),
+                                      pooled.image->Depth()),
+                                pooled));
+  AddPooledBytes(size);
+
+  // Only this pool's images can be evicted; if the other threads keep the
+  // budget, this one keeps nothing.
+  while (!pooled_.empty() && IsOverBudget()) {
+    PooledImages::iterator oldest = pooled_.begin();
+    for (PooledImages::iterator it = pooled_.begin();
+         it != pooled_.end(); ++it) {
+      if (it->second.release_time < oldest->second.release_time) {
+        oldest = it;
+      }
+    }
+    Evict(oldest);
+  }
+}
+
+void ScratchImagePool::Trim() {
+  PooledImages::iterator it = pooled_.begin();
+  while (it != pooled_.end()) {
+    if (it->second.used_since_trim) {
+      it->second.used_since_trim = false;
+      ++it;
+    } else {
+      Evict(it++);
+    }
+  }
+}
+
+void ScratchImagePool::TrimAllThreads() {
+  MutexLock lock(&all_threads_mutex);
+  ++all_threads_trim_generation;
+}
+
+void ScratchImagePool::Evict(PooledImages::iterator it) {
+  RemovePooledBytes(SizeInBytes(*it->second.image));
+  delete it->second.image;
+  pooled_.erase(it);
+}
+
+void ScratchImagePool::AddPooledBytes(size_t bytes) {
+  stats_.bytes_pooled += bytes;
+  if (is_thread_pool_) {
+    MutexLock lock(&all_threads_mutex);
+    all_threads_bytes_pooled += bytes;
+  }
+}
+
+void ScratchImagePool::RemovePooledBytes(size_t bytes) {
+  stats_.bytes_pooled -= bytes;
+  if (is_thread_pool_) {
+    MutexLock lock(&all_threads_mutex);
+    all_threads_bytes_pooled -= bytes;
+  }
+}
+
+bool ScratchImagePool::IsOverBudget() const {
+  if (!is_thread_pool_) {
+    return stats_.bytes_pooled > max_bytes_pooled_;
+  }
+  MutexLock lock(&all_threads_mutex);
+  return all_threads_bytes_pooled > all_threads_max_bytes_pooled;
+}
+
+ScratchImagePool *ScratchImagePool::ForThisThread() {
+  pthread_once(&thread_scratch_pool_key_once, CreateThreadScratchPoolKey);
+  ScratchImagePool *pool =
+      static_cast<ScratchImagePool *>(pthread_getspecific(thread_scratch_pool_key));
+  if (!pool) {
+    pool = new ScratchImagePool(ThreadPoolTag());
+    pthread_setspecific(thread_scratch_pool_key, pool);
+  }
+  return pool;
+}
+
+void ScratchImagePool::SetMaxBytesPooledByAllThreads(size_t max_bytes) {
+  MutexLock lock(&all_threads_mutex);
+  all_threads_max_bytes_pooled = max_bytes;
+}
+
+}  // namespace libmv
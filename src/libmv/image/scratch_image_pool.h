@@ -0,0 +1,163 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_IMAGE_SCRATCH_IMAGE_POOL_H_
+#define LIBMV_IMAGE_SCRATCH_IMAGE_POOL_H_
+
+#include <cstddef>
+#include <map>
+
+#include "libmv/image/image.h"
+
+namespace libmv {
+
+// Recycles the data of temporary float images, so that the filters do not
+// allocate and free buffers of several megabytes for every frame. Released
+// images are kept by shape and handed out again to the next request for the
+// same shape.
+//
+// A pool is not thread safe; use the one of the calling thread, from
+// ScratchImagePool::ForThisThread(), or one per thread. The pools of the
+// threads share one budget, so that a thread pool does not keep a copy of
+// every temporary per worker.
+class ScratchImagePool {
+ public:
+  struct Stats {
+    Stats()
+        : bytes_in_use(0), peak_bytes_in_use(0), bytes_pooled(0),
+          num_allocations(0), num_reuses(0) {}
+
+    // Bytes of the images acquired and not released yet, and their maximum.
+    size_t bytes_in_use;
+    size_t peak_bytes_in_use;
+    // Bytes of the released images kept for reuse.
+    size_t bytes_pooled;
+    // Acquisitions which had to allocate, and those served from the pool.
+    int num_allocations;
+    int num_reuses;
+  };
+
+  // Keeps at most max_bytes_pooled of released images; the least recently
+  // released go first.
+  explicit ScratchImagePool(size_t max_bytes_pooled = 256 * 1024 * 1024);
+  ~ScratchImagePool();
+
+  // Gives image, whose previous data is freed, the shape height x width x
+  // depth, reusing the data of a released image of that shape if there is
+  // one. The contents are undefined.
+  void Acquire(int height, int width, int depth, FloatImage *image);
+
+  // Takes the data of image back into the pool, leaving image empty. Views
+  // are left as they are.
+  void Release(FloatImage *image);
+
+  // Frees the pooled images which were not acquired since the previous call.
+  // Call it once per frame, so that shapes which stop being used, after a
+  // change of resolution for example, do not hold on to memory.
+  void Trim();
+
+  // Trim() for the pools of all the threads; each one trims itself on its
+  // next acquisition. Thread safe; call it at frame boundaries.
+  static void TrimAllThreads();
+
+  const Stats &stats() const {
+    return stats_;
+  }
+
+  // The pool of the calling thread, created on first use and deleted when
+  // the thread exits.
+  static ScratchImagePool *ForThisThread();
+
+  // Sets the bytes of released images kept by the pools of all the threads
+  // together, 256 MB by default. Thread safe.
+  static void SetMaxBytesPooledByAllThreads(size_t max_bytes);
+
+ private:
+  struct Shape {
+    Shape(int height, int width, int depth)
+        : height(height), width(width), depth(depth) {}
+    bool operator<(const Shape &other) const {
+      if (height != other.height) return height < other.height;
+      if (width != other.width) return width < other.width;
+      return depth < other.depth;
+    }
+    int height, width, depth;
+  };
+  struct PooledImage {
+    FloatImage *image;
+    // When the image was released, to evict the oldest first.
+    unsigned long release_time;
+    // Whether the image was in use since the last Trim().
+    bool used_since_trim;
+  };
+  typedef std::multimap<Shape, PooledImage> PooledImages;
+
+  // Pools of ForThisThread(), which count their images against the budget
+  // of all the threads.
+  struct ThreadPoolTag {};
+  explicit ScratchImagePool(ThreadPoolTag);
+
+  void Evict(PooledImages::iterator it);
+  void AddPooledBytes(size_t bytes);
+  void RemovePooledBytes(size_t bytes);
+  bool IsOverBudget() const;
+
+  size_t max_bytes_pooled_;
+  PooledImages pooled_;
+  unsigned long clock_;
+  Stats stats_;
+  // Whether this is a thread's pool, and the TrimAllThreads() call it saw
+  // last.
+  bool is_thread_pool_;
+  unsigned trim_generation_;
+
+  // No copying allowed.
+  ScratchImagePool(const ScratchImagePool &);
+  void operator=(const ScratchImagePool &);
+};
+
+// A scratch image acquired from the pool of the calling thread for the
+// lifetime of the object.
+class ScopedScratchImage {
+ public:
+  ScopedScratchImage(int height, int width, int depth = 1)
+      : pool_(ScratchImagePool::ForThisThread()) {
+    pool_->Acquire(height, width, depth, &image_);
+  }
+  ~ScopedScratchImage() {
+    pool_->Release(&image_);
+  }
+
+  FloatImage *get() { return &image_; }
+  FloatImage &operator*() { return image_; }
+  FloatImage *operator->() { return &image_; }
+
+ private:
+  ScratchImagePool *pool_;
+  FloatImage image_;
+
+  // No copying allowed.
+  ScopedScratchImage(const ScopedScratchImage &);
+  void operator=(const ScopedScratchImage &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_SCRATCH_IMAGE_POOL_H_
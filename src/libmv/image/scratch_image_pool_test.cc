@@ -0,0 +1,182 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/base/thread_pool.h"
+#include "libmv/image/scratch_image_pool.h"
+#include "testing/testing.h"
+
+using libmv::FloatImage;
+using libmv::ScopedScratchImage;
+using libmv::ScratchImagePool;
+
+namespace {
+
+TEST(ScratchImagePool, ReusesReleasedImagesOfTheSameShape) {
+  ScratchImagePool pool;
+  FloatImage a, b;
+  pool.Acquire(10, 20, 3, &a);
+  EXPECT_EQ(10, a.Height());
+  EXPECT_EQ(20, a.Width());
+  EXPECT_EQ(3, a.Depth());
+  float *data = a.Data();
+  pool.Release(&a);
+  EXPECT_EQ(0, a.Size());
+
+  pool.Acquire(10, 20, 1, &b);
+  EXPECT_NE(data, b.Data());
+  pool.Release(&b);
+  pool.Acquire(10, 20, 3, &a);
+  EXPECT_EQ(data, a.Data());
+
+  EXPECT_EQ(2, pool.stats().num_allocations);
+  EXPECT_EQ(1, pool.stats().num_reuses);
+  EXPECT_EQ(10 * 20 * 3 * sizeof(float), pool.stats().bytes_in_use);
+  EXPECT_EQ(10 * 20 * 3 * sizeof(float), pool.stats().peak_bytes_in_use);
+  EXPECT_EQ(10 * 20 * 1 * sizeof(float), pool.stats().bytes_pooled);
+}
+
+TEST(ScratchImagePool, KeepsAtMostMaxBytes) {
+  ScratchImagePool pool(2 * 100 * sizeof(float));
+  FloatImage a, b, c;
+  pool.Acquire(10, 10, 1, &a);
+  pool.Acquire(10, 10, 1, &b);
+  pool.Acquire(10, 10, 1, &c);
+  float *b_data = b.Data();
+  float *c_data = c.Data();
+  pool.Release(&a);
+  pool.Release(&b);
+  pool.Release(&c);
+  EXPECT_EQ(2 * 100 * sizeof(float), pool.stats().bytes_pooled);
+
+  // The oldest one, a, was freed.
+  pool.Acquire(10, 10, 1, &a);
+  pool.Acquire(10, 10, 1, &b);
+  EXPECT_TRUE((a.Data() == b_data && b.Data() == c_data) ||
+              (a.Data() == c_data && b.Data() == b_data));
+}
+
+TEST(ScratchImagePool, TrimFreesTheImagesNotUsedSinceTheLastTrim) {
+  ScratchImagePool pool;
+  FloatImage a, b;
+  pool.Acquire(10, 10, 1, &a);
+  pool.Acquire(20, 20, 1, &b);
+  pool.Release(&a);
+  pool.Release(&b);
+  pool.Trim();
+  EXPECT_EQ(500 * sizeof(float), pool.stats().bytes_pooled);
+
+  // Only the first shape is used during the next frame.
+  pool.Acquire(10, 10, 1, &a);
+  pool.Release(&a);
+  pool.Trim();
+  EXPECT_EQ(100 * sizeof(float), pool.stats().bytes_pooled);
+  pool.Trim();
+  EXPECT_EQ(0, pool.stats().bytes_pooled);
+}
+
+TEST(ScratchImagePool, ViewsAreNotTaken) {
+  ScratchImagePool pool;
+  float data[4];
+  FloatImage view(data, 2, 2);
+  pool.Release(&view);
+  EXPECT_EQ(data, view.Data());
+  EXPECT_EQ(0, pool.stats().bytes_pooled);
+}
+
+class AcquireTask : public libmv::Task {
+ public:
+  AcquireTask(ScratchImagePool **pool) : pool_(pool) {}
+  virtual void Run() {
+    ScopedScratchImage image(8, 8);
+    *pool_ = ScratchImagePool::ForThisThread();
+  }
+
+ private:
+  ScratchImagePool **pool_;
+};
+
+TEST(ScratchImagePool, OnePoolPerThread) {
+  ScratchImagePool *thread_pool = NULL;
+  {
+    libmv::ThreadPool threads(1);
+    threads.Schedule(new AcquireTask(&thread_pool));
+  }
+  EXPECT_TRUE(thread_pool);
+  EXPECT_NE(thread_pool, ScratchImagePool::ForThisThread());
+  EXPECT_EQ(ScratchImagePool::ForThisThread(),
+            ScratchImagePool::ForThisThread());
+
+  {
+    ScopedScratchImage image(8, 8);
+    EXPECT_EQ(64, image->Size());
+  }
+  EXPECT_EQ(64 * sizeof(float),
+            ScratchImagePool::ForThisThread()->stats().bytes_pooled);
+}
+
+class KeepImageTask : public libmv::Task {
+ public:
+  KeepImageTask(size_t *bytes_pooled) : bytes_pooled_(bytes_pooled) {}
+  virtual void Run() {
+    { ScopedScratchImage image(10, 10); }
+    *bytes_pooled_ = ScratchImagePool::ForThisThread()->stats().bytes_pooled;
+  }
+
+ private:
+  size_t *bytes_pooled_;
+};
+
+TEST(ScratchImagePool, ThreadsShareOneBudget) {
+  ScratchImagePool::SetMaxBytesPooledByAllThreads(100 * sizeof(float));
+  // Fills the budget from this thread; older images of this pool go.
+  { ScopedScratchImage image(10, 10); }
+  EXPECT_EQ(100 * sizeof(float),
+            ScratchImagePool::ForThisThread()->stats().bytes_pooled);
+
+  // Another thread cannot keep anything on top of it.
+  size_t bytes_pooled = 1;
+  {
+    libmv::ThreadPool threads(1);
+    threads.Schedule(new KeepImageTask(&bytes_pooled));
+  }
+  EXPECT_EQ(0, bytes_pooled);
+
+  ScratchImagePool::SetMaxBytesPooledByAllThreads(256 * 1024 * 1024);
+  {
+    libmv::ThreadPool threads(1);
+    threads.Schedule(new KeepImageTask(&bytes_pooled));
+  }
+  EXPECT_EQ(100 * sizeof(float), bytes_pooled);
+}
+
+TEST(ScratchImagePool, TrimAllThreadsTrimsOnTheNextAcquisition) {
+  ScratchImagePool *pool = ScratchImagePool::ForThisThread();
+  { ScopedScratchImage image(3, 3); }
+  ScratchImagePool::TrimAllThreads();
+  EXPECT_LE(9 * sizeof(float), pool->stats().bytes_pooled);
+
+  // Only the 4x4 image is used during the next frame.
+  { ScopedScratchImage image(4, 4); }
+  ScratchImagePool::TrimAllThreads();
+  { ScopedScratchImage image(4, 4); }
+  EXPECT_EQ(16 * sizeof(float), pool->stats().bytes_pooled);
+}
+
+}  // namespace
@@ -21,6 +21,9 @@
 #ifndef LIBMV_MULTIVIEW_RANDOM_SAMPLE_H_
 #define LIBMV_MULTIVIEW_RANDOM_SAMPLE_H_
 
+#include <algorithm>
+#include <cmath>
+
 #include "libmv/base/vector.h"
 #include "libmv/logging/logging.h"
 
@@ -39,7 +42,7 @@ namespace libmv {
     \param samples       num_samples of numbers in [0, total_samples) is placed
                          here on return.
 */
-static void UniformSample(int num_samples,
+inline void UniformSample(int num_samples,
                           int total_samples,
                           vector<int> *samples) {
   samples->resize(0);
@@ -58,6 +61,192 @@ static void UniformSample(int num_samples,
   }
 }
 
+/*!
+    Advance the random state and return the next random number, which is
+    uniformly distributed over all unsigned ints. This is a xorshift generator;
+    unlike rand() it keeps its state in \a state, so several threads can each
+    draw a reproducible stream. The state must not be zero.
+*/
+inline unsigned int NextRandom(unsigned int *state) {
+  unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/*!
+    Return a random state for stream \a stream of the generator seeded with
+    \a seed. Different streams give unrelated sequences, so giving each unit of
+    parallel work its own stream makes the results independent of scheduling.
+*/
+inline unsigned int RandomStateForStream(unsigned int seed,
+                                         unsigned int stream) {
+  // Mix the bits (MurmurHash3 finalizer) so nearby streams diverge at once.
+  unsigned int x = seed ^ (stream * 0x9e3779b9u);
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x ? x : 1;
+}
+
+/*!
+    Same as UniformSample() above, but drawing from the random state \a state
+    (see NextRandom()) instead of rand(). It uses Floyd's algorithm, which
+    draws exactly num_samples numbers without allocating anything of size
+    total_samples, then shuffles them into random order. It takes
+    O(num_samples^2) time, so it is meant for small subsets like the minimal
+    samples of a kernel.
+*/
+inline void UniformSample(int num_samples,
+                          int total_samples,
+                          unsigned int *state,
+                          vector<int> *samples) {
+  CHECK_LE(num_samples, total_samples);
+  samples->resize(num_samples);
+  for (int i = 0, j = total_samples - num_samples; i < num_samples;
+       ++i, ++j) {
+    // Pick t in [0, j]; if it was picked already, j itself was not.
+    int t = NextRandom(state) % (j + 1);
+    for (int k = 0; k < i; ++k) {
+      if ((*samples)[k] == t) {
+        t = j;
+        break;
+      }
+    }
+    (*samples)[i] = t;
+  }
+  // Floyd's algorithm tends to put the large numbers last.
+  for (int i = num_samples - 1; i > 0; --i) {
+    std::swap((*samples)[i], (*samples)[NextRandom(state) % (i + 1)]);
+  }
+}
+
+/*!
+    Draws random subsets of [0, total) in O(num_samples) time, from a random
+    stream of its own. Two samplers built with the same seed give the same
+    subsets, whatever else runs in the process; give each thread its own
+    sampler rather than sharing one.
+
+    It keeps a permutation of [0, total) and runs a partial Fisher-Yates
+    shuffle on it for each subset, so there is no rejection, even when
+    num_samples is close to total.
+*/
+class RandomSampler {
+ public:
+  explicit RandomSampler(unsigned int seed = 0)
+      : state_(RandomStateForStream(seed, 0)) {}
+
+  /*!
+      Place num_samples distinct numbers of [0, total_samples), in random
+      order, in \a samples.
+  */
+  void Sample(int num_samples, int total_samples, vector<int> *samples) {
+    CHECK_LE(num_samples, total_samples);
+    if (indices_.size() != total_samples) {
+      indices_.resize(total_samples);
+      for (int i = 0; i < total_samples; ++i) {
+        indices_[i] = i;
+      }
+    }
+    samples->resize(num_samples);
+    for (int i = 0; i < num_samples; ++i) {
+      int j = i + NextRandom(&state_) % (total_samples - i);
+      std::swap(indices_[i], indices_[j]);
+      (*samples)[i] = indices_[i];
+    }
+  }
+
+ private:
+  unsigned int state_;
+  vector<int> indices_;
+};
+
+/*!
+    PROSAC sampler: draws its subsets from the best samples first, then from
+    more and more of them until it samples uniformly from all of them, as in
+
+      O. Chum and J. Matas. Matching with PROSAC - Progressive Sample
+      Consensus. CVPR 2005.
+
+    The samples must be sorted by decreasing quality, i.e. sample 0 is the
+    most likely to be an inlier. With well ranked matches (for example sorted
+    by their distance ratio, as FindCandidateMatches_Ratio() numbers them) a
+    good model is usually found in a fraction of the iterations needed when
+    sampling uniformly. With a poor ranking it degrades to uniform sampling,
+    once max_iterations subsets have been drawn.
+
+    The first call to Sample() fixes the subset and sample sizes; calling it
+    with different ones starts over.
+*/
+class ProsacSampler {
+ public:
+  explicit ProsacSampler(unsigned int seed = 0, int max_iterations = 200000)
+      : uniform_(seed),
+        max_iterations_(max_iterations),
+        num_samples_(0),
+        total_samples_(0) {}
+
+  void Sample(int num_samples, int total_samples, vector<int> *samples) {
+    CHECK_LE(num_samples, total_samples);
+    if (num_samples != num_samples_ || total_samples != total_samples_) {
+      Reset(num_samples, total_samples);
+    }
+
+    // Grow the subset of the best samples once it has been drawn from as
+    // often as it would have been, on average, by max_iterations uniform
+    // draws among all samples.
+    ++iteration_;
+    if (iteration_ >= growth_iteration_ && subset_size_ < total_samples_) {
+      double next_average = average_draws_ * (subset_size_ + 1) /
+                            (subset_size_ + 1 - num_samples_);
+      growth_iteration_ += ceil(next_average - average_draws_);
+      average_draws_ = next_average;
+      ++subset_size_;
+    }
+
+    if (growth_iteration_ >= iteration_) {
+      // Always include the newest sample of the subset, so that each subset
+      // is drawn as in the paper.
+      uniform_.Sample(num_samples_ - 1, subset_size_ - 1, samples);
+      samples->push_back(subset_size_ - 1);
+    } else {
+      uniform_.Sample(num_samples_, subset_size_, samples);
+    }
+  }
+
+ private:
+  void Reset(int num_samples, int total_samples) {
+    num_samples_ = num_samples;
+    total_samples_ = total_samples;
+    iteration_ = 0;
+    subset_size_ = num_samples;
+    growth_iteration_ = 1;
+    average_draws_ = max_iterations_;
+    for (int i = 0; i < num_samples; ++i) {
+      average_draws_ *= double(num_samples - i) / (total_samples - i);
+    }
+  }
+
+  RandomSampler uniform_;
+  int max_iterations_;
+  int num_samples_;
+  int total_samples_;
+
+  // Number of subsets drawn so far.
+  int iteration_;
+  // Subsets are drawn from the subset_size_ best samples.
+  int subset_size_;
+  // Iteration at which subset_size_ grows next.
+  double growth_iteration_;
+  // Average number of subsets, out of max_iterations_ uniform draws, made of
+  // the subset_size_ best samples only.
+  double average_draws_;
+};
+
 }  // namespace libmv
 
 #endif  // LIBMV_MULTIVIEW_RANDOM_SAMPLE_H_
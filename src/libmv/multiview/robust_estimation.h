@@ -21,8 +21,12 @@
 #ifndef LIBMV_MULTIVIEW_ROBUST_ESTIMATION_H_
 #define LIBMV_MULTIVIEW_ROBUST_ESTIMATION_H_
 
+#include <algorithm>
+#include <cstdlib>
 #include <set>
+#include <vector>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/base/vector.h"
 #include "libmv/logging/logging.h"
 #include "libmv/multiview/random_sample.h"
@@ -50,6 +54,38 @@ class MLEScorer {
     }
     return cost;
   }
+
+  // Same as above, but gives up as soon as the cost exceeds max_cost, in which
+  // case the returned cost is only known to be above max_cost and the inliers
+  // are incomplete. Since the cost only grows with each sample, a model which
+  // cannot beat max_cost is rejected without scoring every sample. Inliers may
+  // be NULL.
+  double Score(const Kernel &kernel,
+               const typename Kernel::Model &model,
+               const vector<int> &samples,
+               vector<int> *inliers,
+               double max_cost) const {
+    double cost = 0.0;
+    for (int j = 0; j < samples.size() && cost <= max_cost; ++j) {
+      double error = kernel.Error(samples[j], model);
+      if (error < threshold_) {
+        cost += error;
+        if (inliers) {
+          inliers->push_back(samples[j]);
+        }
+      } else {
+        cost += threshold_;
+      }
+    }
+    return cost;
+  }
+
+  bool IsInlier(const Kernel &kernel,
+                const typename Kernel::Model &model,
+                int sample) const {
+    return kernel.Error(sample, model) < threshold_;
+  }
+
  private:
   double threshold_;
 };
@@ -70,9 +106,16 @@ static uint IterationsRequired(int min_samples,
 // 2. Kernel::MINIMUM_SAMPLES
 // 3. Kernel::Fit(vector<int>, vector<Kernel::Model> *)
 // 4. Kernel::Error(Model, int) -> error
-template<typename Kernel, typename Scorer>
+//
+// The subsets to fit are drawn by the sampler, which provides
+//
+//   Sampler::Sample(int num_samples, int total_samples, vector<int> *samples)
+//
+// such as RandomSampler (uniform) or ProsacSampler (best samples first).
+template<typename Kernel, typename Scorer, typename Sampler>
 typename Kernel::Model Estimate(const Kernel &kernel,
                                 const Scorer &scorer,
+                                Sampler *sampler,
                                 vector<int> *best_inliers = NULL,
                                 double *best_score = NULL,
                                 double outliers_probability = 1e-2) {
@@ -106,18 +149,21 @@ typename Kernel::Model Estimate(const Kernel &kernel,
   }
 
   vector<int> sample;
+  vector<typename Kernel::Model> models;
+  vector<int> inliers;
   for (iteration = 0;
        iteration < max_iterations &&
        iteration < really_max_iterations; ++iteration) {
-    UniformSample(min_samples, total_samples, &sample);
+    sampler->Sample(min_samples, total_samples, &sample);
 
-    vector<typename Kernel::Model> models;
+    models.resize(0);
     kernel.Fit(sample, &models);
     VLOG(4) << "Fitted subset; found " << models.size() << " model(s).";
 
     // Compute costs for each fit.
     for (int i = 0; i < models.size(); ++i) {
-      vector<int> inliers;
+      // Reuse the buffer (or the previous best inliers, after a swap).
+      inliers.resize(0);
       double cost = scorer.Score(kernel, models[i], all_samples, &inliers);
       VLOG(5) << "Fit cost: " << cost
               << ", number of inliers: " << inliers.size();
@@ -149,6 +195,223 @@ typename Kernel::Model Estimate(const Kernel &kernel,
   return best_model;
 }
 
+// Same as above, sampling uniformly. The sampler is seeded from rand(), so
+// srand() still makes the results reproducible.
+template<typename Kernel, typename Scorer>
+typename Kernel::Model Estimate(const Kernel &kernel,
+                                const Scorer &scorer,
+                                vector<int> *best_inliers = NULL,
+                                double *best_score = NULL,
+                                double outliers_probability = 1e-2) {
+  RandomSampler sampler(rand());
+  return Estimate(kernel, scorer, &sampler, best_inliers, best_score,
+                  outliers_probability);
+}
+
+// Settings for ParallelEstimate().
+struct RobustEstimationOptions {
+  RobustEstimationOptions()
+      : pool(NULL),
+        hypotheses_per_round(0),
+        preemptive_test_samples(0),
+        seed(0) {}
+
+  // Threads to fit and score the hypotheses on. If NULL, everything runs on
+  // the calling thread (with the same results).
+  ThreadPool *pool;
+
+  // Number of hypotheses fitted and scored in parallel between two updates of
+  // the best model and of the number of iterations needed. If 0, eight per
+  // thread.
+  int hypotheses_per_round;
+
+  // If d > 0, run the T(d,d) test of Chum and Matas [1] on each model: d
+  // random samples are checked first, and the model is dropped without
+  // scoring the others unless all of them are inliers. This saves most of the
+  // scoring time when there are many samples, at the cost of sometimes
+  // missing a good model, so more iterations may be needed. d = 1 is the
+  // usual choice.
+  //
+  // [1] O. Chum and J. Matas. Randomized RANSAC with T(d,d) test. British
+  //     Machine Vision Conference (BMVC), 2002.
+  int preemptive_test_samples;
+
+  // Seed of the random samples. The results only depend on the seed, not on
+  // the number of threads or their scheduling.
+  unsigned int seed;
+};
+
+namespace robust_estimation {
+
+// Fits and scores the hypotheses of one round, one hypothesis per index.
+// Hypothesis i draws its samples from its own random stream and only writes
+// to its own slot, so the results do not depend on which thread runs it. The
+// slots are kept across rounds so that their buffers are reused.
+template<typename Kernel, typename Scorer>
+class HypothesisEvaluator {
+ public:
+  struct Slot {
+    vector<int> sample;
+    vector<typename Kernel::Model> models;
+    int best_model;
+    double best_cost;
+  };
+
+  HypothesisEvaluator(const Kernel &kernel,
+                      const Scorer &scorer,
+                      const vector<int> &all_samples,
+                      const RobustEstimationOptions &options,
+                      std::vector<Slot> *slots)
+      : first_hypothesis(0), max_cost(HUGE_VAL),
+        kernel_(kernel), scorer_(scorer), all_samples_(all_samples),
+        options_(options), slots_(slots) {}
+
+  void operator()(int i) {
+    Slot &slot = (*slots_)[i];
+    unsigned int random_state =
+        RandomStateForStream(options_.seed, first_hypothesis + i);
+    UniformSample(Kernel::MINIMUM_SAMPLES, all_samples_.size(),
+                  &random_state, &slot.sample);
+
+    slot.models.resize(0);
+    kernel_.Fit(slot.sample, &slot.models);
+
+    slot.best_model = -1;
+    slot.best_cost = HUGE_VAL;
+    for (int j = 0; j < slot.models.size(); ++j) {
+      if (!PassesPreemptiveTest(slot.models[j], &random_state)) {
+        continue;
+      }
+      // Models which cannot beat the best of the previous rounds are cut
+      // short; they would not be picked anyway.
+      double cost = scorer_.Score(kernel_, slot.models[j], all_samples_,
+                                  NULL, std::min(max_cost, slot.best_cost));
+      if (cost < slot.best_cost) {
+        slot.best_cost = cost;
+        slot.best_model = j;
+      }
+    }
+  }
+
+  // Set before each round.
+  int first_hypothesis;
+  double max_cost;
+
+ private:
+  bool PassesPreemptiveTest(const typename Kernel::Model &model,
+                            unsigned int *random_state) const {
+    for (int k = 0; k < options_.preemptive_test_samples; ++k) {
+      int sample = NextRandom(random_state) % all_samples_.size();
+      if (!scorer_.IsInlier(kernel_, model, sample)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const Kernel &kernel_;
+  const Scorer &scorer_;
+  const vector<int> &all_samples_;
+  const RobustEstimationOptions &options_;
+  std::vector<Slot> *slots_;
+};
+
+}  // namespace robust_estimation
+
+// Same as Estimate() above, but fits and scores the hypotheses in parallel on
+// options.pool, in rounds of options.hypotheses_per_round. Each hypothesis has
+// its own random stream derived from options.seed, and the best model of a
+// round is picked in hypothesis order, so the result is reproducible whatever
+// the number of threads. Scoring stops early on models which cannot beat the
+// best so far, and optionally runs the T(d,d) test first. Only the inliers of
+// models which improve on the best are collected. Works with any kernel and
+// with scorers providing the bounded Score() and IsInlier() of MLEScorer.
+template<typename Kernel, typename Scorer>
+typename Kernel::Model ParallelEstimate(
+    const Kernel &kernel,
+    const Scorer &scorer,
+    const RobustEstimationOptions &options,
+    vector<int> *best_inliers = NULL,
+    double *best_score = NULL,
+    double outliers_probability = 1e-2) {
+  typedef robust_estimation::HypothesisEvaluator<Kernel, Scorer> Evaluator;
+
+  CHECK(outliers_probability < 1.0);
+  CHECK(outliers_probability > 0.0);
+  const size_t min_samples = Kernel::MINIMUM_SAMPLES;
+  const size_t total_samples = kernel.NumSamples();
+
+  size_t max_iterations = 100;
+  const size_t really_max_iterations = 1000;
+
+  double best_cost = HUGE_VAL;
+  typename Kernel::Model best_model;
+  vector<int> inliers;
+
+  // Test if we have sufficient points to for the kernel.
+  if (total_samples < min_samples)  {
+    if (best_inliers) {
+      best_inliers->resize(0);
+    }
+    return best_model;
+  }
+
+  vector<int> all_samples;
+  for (int i = 0; i < total_samples; ++i) {
+    all_samples.push_back(i);
+  }
+
+  int hypotheses_per_round = options.hypotheses_per_round;
+  if (hypotheses_per_round <= 0) {
+    int num_threads = options.pool ? options.pool->num_threads() + 1 : 1;
+    hypotheses_per_round = 8 * num_threads;
+  }
+
+  std::vector<typename Evaluator::Slot> slots(hypotheses_per_round);
+  Evaluator evaluator(kernel, scorer, all_samples, options, &slots);
+
+  size_t iteration = 0;
+  while (iteration < max_iterations && iteration < really_max_iterations) {
+    int num_hypotheses = std::min(
+        size_t(hypotheses_per_round),
+        std::min(max_iterations, really_max_iterations) - iteration);
+
+    evaluator.first_hypothesis = iteration;
+    evaluator.max_cost = best_cost;
+    ParallelFor(options.pool, 0, num_hypotheses, evaluator);
+    iteration += num_hypotheses;
+
+    bool improved = false;
+    for (int i = 0; i < num_hypotheses; ++i) {
+      const typename Evaluator::Slot &slot = slots[i];
+      if (slot.best_cost < best_cost) {
+        best_cost = slot.best_cost;
+        best_model = slot.models[slot.best_model];
+        improved = true;
+      }
+    }
+    if (improved) {
+      inliers.resize(0);
+      scorer.Score(kernel, best_model, all_samples, &inliers);
+      double best_inlier_ratio = inliers.size() / double(total_samples);
+      VLOG(4) << "New best cost: " << best_cost << " with "
+              << inliers.size() << " inlying of "
+              << total_samples << " total samples.";
+      if (best_inlier_ratio) {
+        max_iterations = IterationsRequired(min_samples,
+                                            outliers_probability,
+                                            best_inlier_ratio);
+      }
+    }
+  }
+  if (best_inliers) {
+    best_inliers->swap(inliers);
+  }
+  if (best_score)
+    *best_score = best_cost;
+  return best_model;
+}
+
 } // namespace libmv
 
 #endif  // LIBMV_MULTIVIEW_ROBUST_ESTIMATION_H_
@@ -18,6 +18,7 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/base/vector.h"
 #include "libmv/multiview/random_sample.h"
 #include "libmv/multiview/robust_estimation.h"
@@ -43,6 +44,93 @@ TEST(UniformSampleTest, NoRepetions) {
   }
 }
 
+TEST(UniformSampleTest, SeededIsUniform) {
+  unsigned int state = RandomStateForStream(3, 0);
+  vector<int> samples;
+  for (int total = 1; total < 500; total *= 2) {
+    for (int num_samples = 1; num_samples <= total; num_samples *= 2) {
+      UniformSample(num_samples, total, &state, &samples);
+      ASSERT_EQ(num_samples, samples.size());
+      std::vector<bool> in_set(total, false);
+      for (int i = 0; i < num_samples; ++i) {
+        ASSERT_LT(samples[i], total);
+        EXPECT_FALSE(in_set[samples[i]]);
+        in_set[samples[i]] = true;
+      }
+    }
+  }
+
+  // Every number is drawn as often, in every position.
+  const int kDraws = 40000;
+  int counts[2][5] = {{ 0 }};
+  for (int i = 0; i < kDraws; ++i) {
+    UniformSample(2, 5, &state, &samples);
+    ++counts[0][samples[0]];
+    ++counts[1][samples[1]];
+  }
+  for (int position = 0; position < 2; ++position) {
+    for (int j = 0; j < 5; ++j) {
+      EXPECT_NEAR(kDraws / 5, counts[position][j], kDraws / 50);
+    }
+  }
+}
+
+TEST(RandomSampler, NoRepetitions) {
+  RandomSampler sampler;
+  vector<int> samples;
+  for (int total = 1; total < 500; total *= 2) {
+    for (int num_samples = 1; num_samples <= total; num_samples *= 2) {
+      sampler.Sample(num_samples, total, &samples);
+      ASSERT_EQ(num_samples, samples.size());
+      std::vector<bool> in_set(total, false);
+      for (int i = 0; i < num_samples; ++i) {
+        ASSERT_LT(samples[i], total);
+        EXPECT_FALSE(in_set[samples[i]]);
+        in_set[samples[i]] = true;
+      }
+    }
+  }
+}
+
+TEST(RandomSampler, SameSeedSameSamples) {
+  RandomSampler a(7), b(7), c(8);
+  vector<int> samples_a, samples_b, samples_c;
+  bool all_same_as_c = true;
+  for (int i = 0; i < 10; ++i) {
+    a.Sample(4, 100, &samples_a);
+    b.Sample(4, 100, &samples_b);
+    c.Sample(4, 100, &samples_c);
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(samples_a[j], samples_b[j]);
+      all_same_as_c &= samples_a[j] == samples_c[j];
+    }
+  }
+  EXPECT_FALSE(all_same_as_c);
+}
+
+TEST(ProsacSampler, StartsWithTheBestSamples) {
+  ProsacSampler sampler;
+  vector<int> samples;
+  int max_sample = 0;
+  for (int i = 0; i < 100; ++i) {
+    sampler.Sample(2, 1000, &samples);
+    ASSERT_EQ(2, samples.size());
+    EXPECT_NE(samples[0], samples[1]);
+    max_sample = std::max(max_sample, std::max(samples[0], samples[1]));
+  }
+  // Uniform sampling would have reached far beyond the first samples.
+  EXPECT_LT(max_sample, 100);
+
+  // Eventually, all the samples are used.
+  ProsacSampler short_sampler(0, 1000);
+  std::vector<bool> drawn(1000, false);
+  for (int i = 0; i < 5000; ++i) {
+    short_sampler.Sample(2, 1000, &samples);
+    drawn[samples[0]] = drawn[samples[1]] = true;
+  }
+  EXPECT_TRUE(drawn[999]);
+}
+
 struct LineKernel {
   LineKernel(const Mat2X &xs) : xs_(xs) {}
 
@@ -137,6 +225,23 @@ TEST(RobustLineFitter, OneOutlier) {
   ASSERT_EQ(5, inliers.size());
 }
 
+TEST(RobustLineFitter, ProsacWithRankedSamples) {
+  // y = 2x + 1 on the 30 best ranked points, noise on the others.
+  Mat2X xy(2, 100);
+  for (int i = 0; i < 100; ++i) {
+    xy(0, i) = i;
+    xy(1, i) = i < 30 ? 2 * i + 1 : (i * 37) % 101;
+  }
+
+  LineKernel kernel(xy);
+  ProsacSampler sampler;
+  vector<int> inliers;
+  Vec2 ba = Estimate(kernel, MLEScorer<LineKernel>(4), &sampler, &inliers);
+  EXPECT_NEAR(2.0, ba[1], 1e-9);
+  EXPECT_NEAR(1.0, ba[0], 1e-9);
+  EXPECT_LE(30, inliers.size());
+}
+
 // Test if the robust estimator do not return inlier if too few point
 // was given for an estimation.
 TEST(RobustLineFitter, TooFewPoints) {
@@ -151,4 +256,85 @@ TEST(RobustLineFitter, TooFewPoints) {
   ASSERT_EQ(0, inliers.size());
 }
 
+// y = 2x + 1 on x = 0..99, with every third point moved off the line.
+static void MakeLineWithOutliers(Mat2X *xy) {
+  xy->resize(2, 100);
+  for (int i = 0; i < 100; ++i) {
+    (*xy)(0, i) = i;
+    (*xy)(1, i) = 2 * i + 1;
+    if (i % 3 == 0) {
+      (*xy)(1, i) += 50 + i;
+    }
+  }
+}
+
+TEST(ParallelRobustLineFitter, ManyOutliers) {
+  Mat2X xy;
+  MakeLineWithOutliers(&xy);
+
+  LineKernel kernel(xy);
+  ThreadPool pool(3);
+  RobustEstimationOptions options;
+  options.pool = &pool;
+  vector<int> inliers;
+  Vec2 ba = ParallelEstimate(kernel, MLEScorer<LineKernel>(4), options,
+                             &inliers);
+  EXPECT_NEAR(2.0, ba[1], 1e-9);
+  EXPECT_NEAR(1.0, ba[0], 1e-9);
+  ASSERT_EQ(66, inliers.size());
+}
+
+TEST(ParallelRobustLineFitter, SameResultWithOrWithoutThreads) {
+  Mat2X xy;
+  MakeLineWithOutliers(&xy);
+  // Give the points on the line a little noise so that the hypotheses do not
+  // all have the same cost.
+  for (int i = 0; i < xy.cols(); ++i) {
+    xy(1, i) += 0.01 * ((i * 7) % 5 - 2);
+  }
+
+  LineKernel kernel(xy);
+  RobustEstimationOptions options;
+  options.seed = 42;
+  options.hypotheses_per_round = 5;
+  double serial_score;
+  Vec2 serial = ParallelEstimate(kernel, MLEScorer<LineKernel>(4), options,
+                                 NULL, &serial_score);
+
+  ThreadPool pool(4);
+  options.pool = &pool;
+  double parallel_score;
+  Vec2 parallel = ParallelEstimate(kernel, MLEScorer<LineKernel>(4), options,
+                                   NULL, &parallel_score);
+  EXPECT_EQ(serial[0], parallel[0]);
+  EXPECT_EQ(serial[1], parallel[1]);
+  EXPECT_EQ(serial_score, parallel_score);
+}
+
+TEST(ParallelRobustLineFitter, PreemptiveTest) {
+  Mat2X xy;
+  MakeLineWithOutliers(&xy);
+
+  LineKernel kernel(xy);
+  RobustEstimationOptions options;
+  options.preemptive_test_samples = 1;
+  vector<int> inliers;
+  Vec2 ba = ParallelEstimate(kernel, MLEScorer<LineKernel>(4), options,
+                             &inliers);
+  EXPECT_NEAR(2.0, ba[1], 1e-9);
+  EXPECT_NEAR(1.0, ba[0], 1e-9);
+  ASSERT_EQ(66, inliers.size());
+}
+
+TEST(ParallelRobustLineFitter, TooFewPoints) {
+  Mat2X xy(2, 1);
+  xy << 1,
+        3;
+  LineKernel kernel(xy);
+  vector<int> inliers;
+  ParallelEstimate(kernel, MLEScorer<LineKernel>(4),
+                   RobustEstimationOptions(), &inliers);
+  ASSERT_EQ(0, inliers.size());
+}
+
 }  // namespace
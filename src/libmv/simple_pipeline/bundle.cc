@@ -18,168 +18,1134 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
-#define V3DLIB_ENABLE_SUITESPARSE 1
+#include "libmv/simple_pipeline/bundle.h"
 
+#include <cmath>
+#include <cstdlib>
 #include <map>
+#include <utility>
+#include <vector>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/base/vector.h"
 #include "libmv/logging/logging.h"
-#include "libmv/multiview/fundamental.h"
-#include "libmv/multiview/projection.h"
 #include "libmv/numeric/numeric.h"
+#include "libmv/simple_pipeline/camera_intrinsics.h"
 #include "libmv/simple_pipeline/reconstruction.h"
 #include "libmv/simple_pipeline/tracks.h"
-#include "third_party/ssba/Geometry/v3d_cameramatrix.h"
-#include "third_party/ssba/Geometry/v3d_metricbundle.h"
-#include "third_party/ssba/Math/v3d_linear.h"
-#include "third_party/ssba/Math/v3d_linear_utils.h"
+
+#include "colamd.h"
+extern "C" {
+#include "ldl.h"
+}
 
 namespace libmv {
 
-void EuclideanBundle(const Tracks &tracks,
-                     EuclideanReconstruction *reconstruction) {
-  vector<Marker> markers = tracks.AllMarkers();
-
-  // "index" in this context is the index that V3D's optimizer will see. The
-  // V3D index must be dense in that the cameras are numbered 0...n-1, which is
-  // not the case for the "image" numbering that arises from the tracks
-  // structure. The complicated mapping is necessary to convert between the two
-  // representations.
-  std::map<EuclideanCamera *, int> camera_to_index;
-  std::map<EuclideanPoint *, int> point_to_index;
-  vector<EuclideanCamera *> index_to_camera;
-  vector<EuclideanPoint *> index_to_point;
-  int num_cameras = 0;
-  int num_points = 0;
-  for (int i = 0; i < markers.size(); ++i) {
-    const Marker &marker = markers[i];
-    EuclideanCamera *camera = reconstruction->CameraForImage(marker.image);
-    EuclideanPoint *point = reconstruction->PointForTrack(marker.track);
-    if (camera && point) {
-      if (camera_to_index.find(camera) == camera_to_index.end()) {
-        camera_to_index[camera] = num_cameras;
-        index_to_camera.push_back(camera);
-        num_cameras++;
-      }
-      if (point_to_index.find(point) == point_to_index.end()) {
-        point_to_index[point] = num_points;
-        index_to_point.push_back(point);
-        num_points++;
-      }
-    }
-  }
-
-  // Make a V3D identity matrix, needed in a few places for K, since this
-  // assumes a calibrated setup.
-  V3D::Matrix3x3d identity3x3;
-  identity3x3[0][0] = 1.0;
-  identity3x3[0][1] = 0.0;
-  identity3x3[0][2] = 0.0;
-  identity3x3[1][0] = 0.0;
-  identity3x3[1][1] = 1.0;
-  identity3x3[1][2] = 0.0;
-  identity3x3[2][0] = 0.0;
-  identity3x3[2][1] = 0.0;
-  identity3x3[2][2] = 1.0;
-
-  // Convert libmv's cameras to V3D's cameras.
-  std::vector<V3D::CameraMatrix> v3d_cameras(index_to_camera.size());
-  for (int k = 0; k < index_to_camera.size(); ++k) {
-    V3D::Matrix3x3d R;
-    V3D::Vector3d t;
-
-    // Libmv's rotation matrix type.
-    const Mat3 &R_libmv = index_to_camera[k]->R;
-    const Vec3 &t_libmv = index_to_camera[k]->t;
+BundleOptions::BundleOptions()
+    : max_iterations(50),
+      function_tolerance(1e-10),
+      parameter_tolerance(1e-10),
+      bundle_intrinsics(BUNDLE_NO_INTRINSICS),
+      pool(NULL) {}
+
+namespace {
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMajorMatX;
+typedef Eigen::Map<RowMajorMatX> BlockMap;
+typedef Eigen::Map<Vec> VecMap;
+
+// The intrinsics refined by EuclideanBundle(), in this order. The others
+// (aspect ratio, k3, p1 and p2) are held constant.
+enum {
+  OFFSET_FOCAL_LENGTH,
+  OFFSET_PRINCIPAL_POINT_X,
+  OFFSET_PRINCIPAL_POINT_Y,
+  OFFSET_K1,
+  OFFSET_K2,
+  INTRINSICS_SIZE
+};
+
+// Apply the intrinsics to the normalized point (x, y) like
+// CameraIntrinsics::ApplyIntrinsics(), but with the refined intrinsics taken
+// from parameters. Also gives the 2x2 derivative with respect to (x, y) and,
+// if d_parameters is not NULL, the 2xINTRINSICS_SIZE derivative with respect
+// to the parameters, both row major. The columns of the parameters which are
+// not refined are zero, which keeps them constant.
+void ApplyIntrinsics(const CameraIntrinsics &intrinsics,
+                     const double *parameters,
+                     int bundle_intrinsics,
+                     double x, double y,
+                     double *image,
+                     double *d_normalized,
+                     double *d_parameters) {
+  const double focal = parameters[OFFSET_FOCAL_LENGTH];
+  const double aspect =
+      intrinsics.focal_length_y() / intrinsics.focal_length_x();
+  const double k1 = parameters[OFFSET_K1];
+  const double k2 = parameters[OFFSET_K2];
+  const double k3 = intrinsics.k3();
+  const double p1 = intrinsics.p1();
+  const double p2 = intrinsics.p2();
+
+  double r2 = x*x + y*y;
+  double r4 = r2 * r2;
+  double r6 = r4 * r2;
+  double r_coeff = 1 + k1*r2 + k2*r4 + k3*r6;
+  double xd = x * r_coeff + 2*p1*x*y + p2*(r2 + 2*x*x);
+  double yd = y * r_coeff + 2*p2*x*y + p1*(r2 + 2*y*y);
+
+  image[0] = focal * xd + parameters[OFFSET_PRINCIPAL_POINT_X];
+  image[1] = aspect * focal * yd + parameters[OFFSET_PRINCIPAL_POINT_Y];
+
+  // Derivative of r_coeff with respect to r2.
+  double dr_coeff = k1 + 2*k2*r2 + 3*k3*r4;
+  d_normalized[0] = focal * (r_coeff + 2*x*x*dr_coeff + 2*p1*y + 6*p2*x);
+  d_normalized[1] = focal * (2*x*y*dr_coeff + 2*p1*x + 2*p2*y);
+  d_normalized[2] = aspect * focal * (2*x*y*dr_coeff + 2*p2*y + 2*p1*x);
+  d_normalized[3] = aspect * focal *
+                    (r_coeff + 2*y*y*dr_coeff + 2*p2*x + 6*p1*y);
+
+  if (!d_parameters) {
+    return;
+  }
+  Eigen::Map<Eigen::Matrix<double, 2, INTRINSICS_SIZE, Eigen::RowMajor> >
+      J(d_parameters);
+  J.setZero();
+  if (bundle_intrinsics & BUNDLE_FOCAL_LENGTH) {
+    J(0, OFFSET_FOCAL_LENGTH) = xd;
+    J(1, OFFSET_FOCAL_LENGTH) = aspect * yd;
+  }
+  if (bundle_intrinsics & BUNDLE_PRINCIPAL_POINT) {
+    J(0, OFFSET_PRINCIPAL_POINT_X) = 1;
+    J(1, OFFSET_PRINCIPAL_POINT_Y) = 1;
+  }
+  if (bundle_intrinsics & BUNDLE_RADIAL_K1) {
+    J(0, OFFSET_K1) = focal * x * r2;
+    J(1, OFFSET_K1) = aspect * focal * y * r2;
+  }
+  if (bundle_intrinsics & BUNDLE_RADIAL_K2) {
+    J(0, OFFSET_K2) = focal * x * r4;
+    J(1, OFFSET_K2) = aspect * focal * y * r4;
+  }
+}
+
+// These are "model" classes which make it possible to use the same bundle
+// adjuster for both projective and euclidean reconstruction. They give the
+// projection of a point by a camera, its derivatives with respect to the
+// camera and point updates, and apply these updates.
+
+// Euclidean cameras are updated by a rotation (as an angle-axis vector)
+// applied after their current rotation, then a translation.
+struct EuclideanBundleModel {
+  typedef EuclideanReconstruction Reconstruction;
+  typedef EuclideanCamera Camera;
+  typedef EuclideanPoint Point;
+  enum { CAMERA_SIZE = 6, POINT_SIZE = 3 };
+
+  static bool SupportsIntrinsics() { return true; }
+
+  static void Project(const Camera &camera,
+                      const Point &point,
+                      const CameraIntrinsics *intrinsics,
+                      const double *intrinsics_parameters,
+                      int bundle_intrinsics,
+                      double *image,
+                      double *camera_jacobian,
+                      double *point_jacobian,
+                      double *intrinsics_jacobian) {
+    Vec3 rotated = camera.R * point.X;
+    Vec3 projected = rotated + camera.t;
+    double x = projected(0) / projected(2);
+    double y = projected(1) / projected(2);
+
+    Mat2 d_normalized = Mat2::Identity();
+    if (intrinsics) {
+      double d[4];
+      ApplyIntrinsics(*intrinsics, intrinsics_parameters, bundle_intrinsics,
+                      x, y, image, d, intrinsics_jacobian);
+      d_normalized << d[0], d[1],
+                      d[2], d[3];
+    } else {
+      image[0] = x;
+      image[1] = y;
+    }
+    if (!camera_jacobian) {
+      return;
+    }
+
+    Mat23 d_projected;
+    d_projected << 1 / projected(2), 0, -x / projected(2),
+                   0, 1 / projected(2), -y / projected(2);
+    d_projected = d_normalized * d_projected;
+
+    Eigen::Map<Eigen::Matrix<double, 2, 6, Eigen::RowMajor> >
+        J_camera(camera_jacobian);
+    J_camera.block<2, 3>(0, 0) = -d_projected * SkewMat(rotated);
+    J_camera.block<2, 3>(0, 3) = d_projected;
+
+    Eigen::Map<Eigen::Matrix<double, 2, 3, Eigen::RowMajor> >
+        J_point(point_jacobian);
+    J_point = d_projected * camera.R;
+  }
 
+  static void UpdateCamera(const double *delta, Camera *camera) {
+    Vec3 w(delta[0], delta[1], delta[2]);
+    double angle = w.norm();
+    if (angle > 0) {
+      camera->R = Eigen::AngleAxisd(angle, w / angle).toRotationMatrix() *
+                  camera->R;
+    }
+    camera->t += Vec3(delta[3], delta[4], delta[5]);
+  }
+
+  static void UpdatePoint(const double *delta, Point *point) {
+    point->X += Vec3(delta[0], delta[1], delta[2]);
+  }
+
+  static double SquaredNorm(const Camera &camera) {
+    return camera.t.squaredNorm();
+  }
+
+  static double SquaredNorm(const Point &point) {
+    return point.X.squaredNorm();
+  }
+};
+
+// Projective cameras and points are updated additively, then scaled back to
+// unit norm since their scale is arbitrary.
+struct ProjectiveBundleModel {
+  typedef ProjectiveReconstruction Reconstruction;
+  typedef ProjectiveCamera Camera;
+  typedef ProjectivePoint Point;
+  enum { CAMERA_SIZE = 12, POINT_SIZE = 4 };
+
+  static bool SupportsIntrinsics() { return false; }
+
+  static void Project(const Camera &camera,
+                      const Point &point,
+                      const CameraIntrinsics * /* intrinsics */,
+                      const double * /* intrinsics_parameters */,
+                      int /* bundle_intrinsics */,
+                      double *image,
+                      double *camera_jacobian,
+                      double *point_jacobian,
+                      double * /* intrinsics_jacobian */) {
+    Vec3 projected = camera.P * point.X;
+    image[0] = projected(0) / projected(2);
+    image[1] = projected(1) / projected(2);
+    if (!camera_jacobian) {
+      return;
+    }
+
+    // The camera parameters are the entries of P, row by row.
+    Eigen::Map<Eigen::Matrix<double, 2, 12, Eigen::RowMajor> >
+        J_camera(camera_jacobian);
+    J_camera.setZero();
+    Vec4 X = point.X / projected(2);
+    J_camera.block<1, 4>(0, 0) = X.transpose();
+    J_camera.block<1, 4>(0, 8) = -image[0] * X.transpose();
+    J_camera.block<1, 4>(1, 4) = X.transpose();
+    J_camera.block<1, 4>(1, 8) = -image[1] * X.transpose();
+
+    Eigen::Map<Eigen::Matrix<double, 2, 4, Eigen::RowMajor> >
+        J_point(point_jacobian);
+    J_point.row(0) = (camera.P.row(0) - image[0] * camera.P.row(2)) /
+                     projected(2);
+    J_point.row(1) = (camera.P.row(1) - image[1] * camera.P.row(2)) /
+                     projected(2);
+  }
+
+  static void UpdateCamera(const double *delta, Camera *camera) {
     for (int i = 0; i < 3; ++i) {
-      for (int j = 0; j < 3; ++j) {
-        R[i][j] = R_libmv(i, j);
-      }
-      t[i] = t_libmv(i);
-    }
-    v3d_cameras[k].setIntrinsic(identity3x3);
-    v3d_cameras[k].setRotation(R);
-    v3d_cameras[k].setTranslation(t);
-  }
-  LG << "Number of cameras: " << index_to_camera.size();
-
-  // Convert libmv's points to V3D's points.
-  std::vector<V3D::Vector3d> v3d_points(index_to_point.size());
-  for (int i = 0; i < index_to_point.size(); i++) {
-    v3d_points[i][0] = index_to_point[i]->X(0);
-    v3d_points[i][1] = index_to_point[i]->X(1);
-    v3d_points[i][2] = index_to_point[i]->X(2);
-  }
-  LG << "Number of points: " << index_to_point.size();
-
-  // Convert libmv's measurements to v3d measurements.
-  int num_residuals = 0;
-  std::vector<V3D::Vector2d> v3d_measurements;
-  std::vector<int> v3d_camera_for_measurement;
-  std::vector<int> v3d_point_for_measurement;
-  for (int i = 0; i < markers.size(); ++i) {
-    EuclideanCamera *camera = reconstruction->CameraForImage(markers[i].image);
-    EuclideanPoint *point = reconstruction->PointForTrack(markers[i].track);
-    if (!camera || !point) {
+      for (int j = 0; j < 4; ++j) {
+        camera->P(i, j) += delta[4 * i + j];
+      }
+    }
+    camera->P /= camera->P.norm();
+  }
+
+  static void UpdatePoint(const double *delta, Point *point) {
+    point->X += Vec4(delta[0], delta[1], delta[2], delta[3]);
+    point->X /= point->X.norm();
+  }
+
+  static double SquaredNorm(const Camera &camera) {
+    return camera.P.squaredNorm();
+  }
+
+  static double SquaredNorm(const Point &point) {
+    return point.X.squaredNorm();
+  }
+};
+
+// Sparse Levenberg-Marquardt bundle adjuster.
+//
+// The normal equations of an iteration are
+//
+//   [ U   W ] [ dy ]   [ b_y ]
+//   [ W'  V ] [ dp ] = [ b_p ]
+//
+// where p are the points and y the cameras, plus the intrinsics when they are
+// refined. V is block diagonal, with one small block per point, so the points
+// are eliminated first: the reduced camera system
+//
+//   (U - W V^-1 W') dy = b_y - W V^-1 b_p
+//
+// is solved with a sparse LDL' factorization, then each point is updated
+// independently with dp = V^-1 (b_p - W' dy).
+//
+// The reduced system is made of blocks, one per pair of cameras (or camera and
+// intrinsics) seeing a common point. Its sparsity pattern does not change
+// between iterations, so the block layout, the fill-reducing ordering and the
+// symbolic factorization are computed once. Each block is then computed
+// independently, which allows computing them in parallel.
+template<typename Model>
+class SchurBundler {
+ public:
+  typedef typename Model::Camera Camera;
+  typedef typename Model::Point Point;
+  enum {
+    CAMERA_SIZE = Model::CAMERA_SIZE,
+    POINT_SIZE = Model::POINT_SIZE
+  };
+  typedef Eigen::Matrix<double, POINT_SIZE, POINT_SIZE> PointMatrix;
+  typedef Eigen::Matrix<double, POINT_SIZE, 1> PointVector;
+
+  // Refines the cameras of images, or all cameras if images is NULL.
+  SchurBundler(const Tracks &tracks,
+               const BundleOptions &options,
+               const vector<int> *images,
+               typename Model::Reconstruction *reconstruction,
+               CameraIntrinsics *intrinsics);
+
+  void Solve();
+
+  // The steps of an iteration which run in parallel. They only write to data
+  // owned by their index.
+  void EvaluateObservation(int i, bool with_jacobians);
+  void EliminatePoint(int j);
+  void ComputeReducedBlock(int s);
+  void UpdatePoint(int j);
+
+ private:
+  struct Observation {
+    // Index in cameras_; see IsVariable().
+    int camera;
+    int point;
+    double x, y;
+  };
+
+  void SetupReducedSystem();
+  double EvaluateCost(bool with_jacobians);
+  bool ComputeStep();
+  double ApplyStep();
+  void SaveParameters();
+  void RestoreParameters();
+
+  int NumObservations() const { return observations_.size(); }
+  int NumPoints() const { return points_.size(); }
+  int NumCameras() const { return num_variable_cameras_; }
+  // The cameras held constant come after the others in cameras_.
+  bool IsVariable(int camera) const {
+    return camera < num_variable_cameras_;
+  }
+
+  // The Jacobian of observation o with respect to reduced block b, which is
+  // either its camera or the intrinsics.
+  double *ReducedJacobian(int o, int b) {
+    if (b == intrinsics_block_) {
+      return &intrinsics_jacobians_[o * 2 * INTRINSICS_SIZE];
+    }
+    return &camera_jacobians_[o * 2 * CAMERA_SIZE];
+  }
+
+  // The W blocks (cross terms between the reduced blocks and the points) are
+  // indexed by observation for the cameras, then by point for the intrinsics.
+  // Those of the observations by constant cameras are unused.
+  int IntrinsicsW(int j) const { return NumObservations() + j; }
+  int BlockOfW(int w) const {
+    return w < NumObservations() ? observations_[w].camera : intrinsics_block_;
+  }
+  int OffsetOfW(int w) const {
+    if (w < NumObservations()) {
+      return w * CAMERA_SIZE * POINT_SIZE;
+    }
+    return NumObservations() * CAMERA_SIZE * POINT_SIZE +
+           (w - NumObservations()) * INTRINSICS_SIZE * POINT_SIZE;
+  }
+
+  const BundleOptions &options_;
+  CameraIntrinsics *intrinsics_;
+  int bundle_intrinsics_;
+  double intrinsics_parameters_[INTRINSICS_SIZE];
+
+  std::vector<Camera *> cameras_;
+  int num_variable_cameras_;
+  std::vector<Point *> points_;
+  std::vector<Observation> observations_;
+  // Observations of point j are point_observations_[start[j]..start[j+1]).
+  std::vector<int> point_observations_start_;
+  std::vector<int> point_observations_;
+
+  // Residuals and row major Jacobians of each observation.
+  std::vector<double> residuals_;
+  std::vector<double> camera_jacobians_;
+  std::vector<double> point_jacobians_;
+  std::vector<double> intrinsics_jacobians_;
+
+  // Per point: the inverse of the damped V block, the right hand side b_p,
+  // and the step.
+  std::vector<double> v_inverse_;
+  std::vector<double> point_rhs_;
+  std::vector<double> point_step_;
+  // The W blocks, and W V^-1.
+  std::vector<double> w_;
+  std::vector<double> w_v_inverse_;
+
+  // Blocks of the reduced system: one per camera, then one for the
+  // intrinsics if refined.
+  int intrinsics_block_;
+  std::vector<int> block_start_;
+  std::vector<int> block_size_;
+
+  // Non-zero block pairs (row <= column) of the reduced system, stored row
+  // major in reduced_values_, along with the terms they are made of: the
+  // observations contributing to U, and the pairs of W blocks contributing to
+  // the Schur complement.
+  std::vector<int> slot_row_;
+  std::vector<int> slot_column_;
+  std::vector<int> slot_offset_;
+  std::vector<int> slot_observations_start_;
+  std::vector<int> slot_observations_;
+  std::vector<int> slot_schur_start_;
+  std::vector<std::pair<int, int> > slot_schur_;
+  std::vector<double> reduced_values_;
+  // The diagonal of U, which the damping is proportional to.
+  std::vector<double> u_diagonal_;
+  std::vector<double> reduced_rhs_;
+  std::vector<double> reduced_step_;
+
+  // The reduced system in compressed column form, with both triangles. Entry
+  // k is reduced_values_[value_source_[k]].
+  std::vector<int> Ap_, Ai_;
+  std::vector<double> Ax_;
+  std::vector<int> value_source_;
+  std::vector<int> diagonal_entry_;
+
+  // Fill-reducing permutation and LDL' factorization.
+  std::vector<int> P_, Pinv_;
+  std::vector<int> Lp_, Li_, Parent_, Lnz_, Flag_, Pattern_;
+  std::vector<double> Lx_, D_, Y_;
+
+  // Levenberg-Marquardt damping.
+  double mu_;
+
+  // Parameters and residuals before the last step, to undo it. The
+  // Jacobians are only evaluated at accepted steps, so they need no copy.
+  vector<Camera> saved_cameras_;
+  vector<Point> saved_points_;
+  double saved_intrinsics_parameters_[INTRINSICS_SIZE];
+  std::vector<double> saved_residuals_;
+};
+
+template<typename Bundler>
+struct EvaluateObservationFunctor {
+  EvaluateObservationFunctor(Bundler *bundler, bool with_jacobians)
+      : bundler(bundler), with_jacobians(with_jacobians) {}
+  void operator()(int i) { bundler->EvaluateObservation(i, with_jacobians); }
+  Bundler *bundler;
+  bool with_jacobians;
+};
+
+template<typename Bundler>
+struct EliminatePointFunctor {
+  explicit EliminatePointFunctor(Bundler *bundler) : bundler(bundler) {}
+  void operator()(int j) { bundler->EliminatePoint(j); }
+  Bundler *bundler;
+};
+
+template<typename Bundler>
+struct ComputeReducedBlockFunctor {
+  explicit ComputeReducedBlockFunctor(Bundler *bundler) : bundler(bundler) {}
+  void operator()(int s) { bundler->ComputeReducedBlock(s); }
+  Bundler *bundler;
+};
+
+template<typename Bundler>
+struct UpdatePointFunctor {
+  explicit UpdatePointFunctor(Bundler *bundler) : bundler(bundler) {}
+  void operator()(int j) { bundler->UpdatePoint(j); }
+  Bundler *bundler;
+};
+
+template<typename Model>
+SchurBundler<Model>::SchurBundler(
+    const Tracks &tracks,
+    const BundleOptions &options,
+    const vector<int> *images,
+    typename Model::Reconstruction *reconstruction,
+    CameraIntrinsics *intrinsics)
+    : options_(options),
+      intrinsics_(intrinsics),
+      bundle_intrinsics_(BUNDLE_NO_INTRINSICS),
+      intrinsics_block_(-1),
+      mu_(1e-4) {
+  if (intrinsics_) {
+    CHECK(Model::SupportsIntrinsics());
+    intrinsics_parameters_[OFFSET_FOCAL_LENGTH] = intrinsics->focal_length();
+    intrinsics_parameters_[OFFSET_PRINCIPAL_POINT_X] =
+        intrinsics->principal_point_x();
+    intrinsics_parameters_[OFFSET_PRINCIPAL_POINT_Y] =
+        intrinsics->principal_point_y();
+    intrinsics_parameters_[OFFSET_K1] = intrinsics->k1();
+    intrinsics_parameters_[OFFSET_K2] = intrinsics->k2();
+    bundle_intrinsics_ = options.bundle_intrinsics;
+  }
+
+  // Number the cameras and points densely, in the order of the images and
+  // tracks. The variable cameras come first.
+  std::vector<bool> is_variable(tracks.MaxImage() + 1, images == NULL);
+  if (images) {
+    for (int i = 0; i < images->size(); ++i) {
+      if ((*images)[i] <= tracks.MaxImage()) {
+        is_variable[(*images)[i]] = true;
+      }
+    }
+  }
+  std::vector<int> camera_for_image(tracks.MaxImage() + 1, -1);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int image = 0; image <= tracks.MaxImage(); ++image) {
+      Camera *camera = reconstruction->CameraForImage(image);
+      if (camera && tracks.NumMarkersInImage(image) > 0 &&
+          is_variable[image] == (pass == 0)) {
+        camera_for_image[image] = cameras_.size();
+        cameras_.push_back(camera);
+      }
+    }
+    if (pass == 0) {
+      num_variable_cameras_ = cameras_.size();
+    }
+  }
+
+  // Only the points seen by a variable camera are refined, from all their
+  // observations.
+  point_observations_start_.push_back(0);
+  for (int track = 0; track <= tracks.MaxTrack(); ++track) {
+    Point *point = reconstruction->PointForTrack(track);
+    if (!point) {
       continue;
     }
-    V3D::Vector2d v3d_point;
-    v3d_point[0] = markers[i].x;
-    v3d_point[1] = markers[i].y;
-    v3d_measurements.push_back(v3d_point);
-    v3d_camera_for_measurement.push_back(camera_to_index[camera]);
-    v3d_point_for_measurement.push_back(point_to_index[point]);
-    num_residuals++;
-  }
-  LG << "Number of residuals: " << num_residuals;
-  
-  // This is calibrated reconstruction, so use zero distortion.
-  V3D::StdDistortionFunction v3d_distortion;
-  v3d_distortion.k1 = 0;
-  v3d_distortion.k2 = 0;
-  v3d_distortion.p1 = 0;
-  v3d_distortion.p2 = 0;
-
-  // Finally, run the bundle adjustment.
-  V3D::optimizerVerbosenessLevel = 1;
-  double const inlierThreshold = 500000.0;
-  V3D::CommonInternalsMetricBundleOptimizer opt(V3D::FULL_BUNDLE_METRIC,
-                                                inlierThreshold,
-                                                identity3x3,
-                                                v3d_distortion,
-                                                v3d_cameras,
-                                                v3d_points,
-                                                v3d_measurements,
-                                                v3d_camera_for_measurement,
-                                                v3d_point_for_measurement);
-  opt.maxIterations = 50;
-  opt.minimize();
-  LG << "Bundle status: " << opt.status;
-
-  // Convert V3D's cameras back to libmv's cameras.
-  for (int k = 0; k < num_cameras; k++) {
-    V3D::Matrix3x4d const Rt = v3d_cameras[k].getOrientation();
-    for (int i = 0; i < 3; ++i) {
-      for (int j = 0; j < 3; ++j) {
-        index_to_camera[k]->R(i, j) = Rt[i][j];
+    bool seen_by_variable_camera = false;
+    for (int i = 0; i < tracks.NumMarkersForTrack(track); ++i) {
+      int camera = camera_for_image[tracks.MarkerForTrack(track, i).image];
+      if (camera != -1 && IsVariable(camera)) {
+        seen_by_variable_camera = true;
       }
-      index_to_camera[k]->t(i) = Rt[i][3];
     }
+    if (!seen_by_variable_camera) {
+      continue;
+    }
+    for (int i = 0; i < tracks.NumMarkersForTrack(track); ++i) {
+      const Marker &marker = tracks.MarkerForTrack(track, i);
+      if (camera_for_image[marker.image] == -1) {
+        continue;
+      }
+      Observation observation;
+      observation.camera = camera_for_image[marker.image];
+      observation.point = points_.size();
+      observation.x = marker.x;
+      observation.y = marker.y;
+      point_observations_.push_back(observations_.size());
+      observations_.push_back(observation);
+    }
+    points_.push_back(point);
+    point_observations_start_.push_back(observations_.size());
   }
+  LG << "Number of cameras: " << NumCameras() << " refined, "
+     << cameras_.size() - NumCameras() << " held constant.";
+  LG << "Number of points: " << NumPoints();
+  LG << "Number of residuals: " << NumObservations();
 
-  // Convert V3D's points back to libmv's points.
-  for (int k = 0; k < num_points; k++) {
-    for (int i = 0; i < 3; ++i) {
-      index_to_point[k]->X(i) = v3d_points[k][i];
+  residuals_.resize(2 * NumObservations());
+  camera_jacobians_.resize(2 * CAMERA_SIZE * NumObservations());
+  point_jacobians_.resize(2 * POINT_SIZE * NumObservations());
+  if (bundle_intrinsics_) {
+    intrinsics_jacobians_.resize(2 * INTRINSICS_SIZE * NumObservations());
+  }
+  v_inverse_.resize(POINT_SIZE * POINT_SIZE * NumPoints());
+  point_rhs_.resize(POINT_SIZE * NumPoints());
+  point_step_.resize(POINT_SIZE * NumPoints());
+
+  SetupReducedSystem();
+}
+
+template<typename Model>
+void SchurBundler<Model>::SetupReducedSystem() {
+  for (int i = 0; i < NumCameras(); ++i) {
+    block_start_.push_back(i * CAMERA_SIZE);
+    block_size_.push_back(CAMERA_SIZE);
+  }
+  if (bundle_intrinsics_) {
+    intrinsics_block_ = NumCameras();
+    block_start_.push_back(NumCameras() * CAMERA_SIZE);
+    block_size_.push_back(INTRINSICS_SIZE);
+  }
+  int num_blocks = block_size_.size();
+  int n = num_blocks ? block_start_.back() + block_size_.back() : 0;
+
+  int num_w = NumObservations() + (bundle_intrinsics_ ? NumPoints() : 0);
+  w_.resize(OffsetOfW(num_w));
+  w_v_inverse_.resize(w_.size());
+
+  // Find the non-zero block pairs and their terms.
+  std::map<std::pair<int, int>, int> slot_for_blocks;
+  std::vector<std::vector<int> > observations_for_slot;
+  std::vector<std::vector<std::pair<int, int> > > schur_for_slot;
+  for (int b = 0; b < num_blocks; ++b) {
+    slot_for_blocks[std::make_pair(b, b)] = b;
+  }
+  observations_for_slot.resize(num_blocks);
+  schur_for_slot.resize(num_blocks);
+
+  std::vector<int> w_for_point;
+  for (int j = 0; j < NumPoints(); ++j) {
+    w_for_point.clear();
+    for (int k = point_observations_start_[j];
+         k < point_observations_start_[j + 1]; ++k) {
+      int o = point_observations_[k];
+      int camera = observations_[o].camera;
+      if (bundle_intrinsics_) {
+        observations_for_slot[intrinsics_block_].push_back(o);
+      }
+      if (!IsVariable(camera)) {
+        continue;
+      }
+      w_for_point.push_back(o);
+      observations_for_slot[camera].push_back(o);
+      if (bundle_intrinsics_) {
+        std::pair<int, int> blocks(camera, intrinsics_block_);
+        if (slot_for_blocks.find(blocks) == slot_for_blocks.end()) {
+          slot_for_blocks[blocks] = observations_for_slot.size();
+          observations_for_slot.push_back(std::vector<int>());
+          schur_for_slot.push_back(std::vector<std::pair<int, int> >());
+        }
+        observations_for_slot[slot_for_blocks[blocks]].push_back(o);
+      }
+    }
+    if (bundle_intrinsics_) {
+      w_for_point.push_back(IntrinsicsW(j));
     }
+    for (int k = 0; k < w_for_point.size(); ++k) {
+      for (int l = 0; l < w_for_point.size(); ++l) {
+        int w1 = w_for_point[k];
+        int w2 = w_for_point[l];
+        std::pair<int, int> blocks(BlockOfW(w1), BlockOfW(w2));
+        if (blocks.first > blocks.second) {
+          continue;
+        }
+        if (slot_for_blocks.find(blocks) == slot_for_blocks.end()) {
+          slot_for_blocks[blocks] = observations_for_slot.size();
+          observations_for_slot.push_back(std::vector<int>());
+          schur_for_slot.push_back(std::vector<std::pair<int, int> >());
+        }
+        schur_for_slot[slot_for_blocks[blocks]].push_back(
+            std::make_pair(w1, w2));
+      }
+    }
+  }
+
+  // Flatten the slots.
+  int num_slots = observations_for_slot.size();
+  slot_row_.resize(num_slots);
+  slot_column_.resize(num_slots);
+  slot_offset_.resize(num_slots);
+  int num_values = 0;
+  for (std::map<std::pair<int, int>, int>::const_iterator it =
+           slot_for_blocks.begin(); it != slot_for_blocks.end(); ++it) {
+    int s = it->second;
+    slot_row_[s] = it->first.first;
+    slot_column_[s] = it->first.second;
+  }
+  slot_observations_start_.push_back(0);
+  slot_schur_start_.push_back(0);
+  for (int s = 0; s < num_slots; ++s) {
+    slot_offset_[s] = num_values;
+    num_values += block_size_[slot_row_[s]] * block_size_[slot_column_[s]];
+    slot_observations_.insert(slot_observations_.end(),
+                              observations_for_slot[s].begin(),
+                              observations_for_slot[s].end());
+    slot_observations_start_.push_back(slot_observations_.size());
+    slot_schur_.insert(slot_schur_.end(),
+                       schur_for_slot[s].begin(),
+                       schur_for_slot[s].end());
+    slot_schur_start_.push_back(slot_schur_.size());
+  }
+  reduced_values_.resize(num_values);
+  u_diagonal_.resize(n);
+  reduced_rhs_.resize(n);
+  reduced_step_.resize(n);
+
+  // Lay out both triangles of the reduced system in compressed column form.
+  std::vector<std::vector<std::pair<int, int> > > columns(n);
+  for (int s = 0; s < num_slots; ++s) {
+    int row_block = slot_row_[s];
+    int column_block = slot_column_[s];
+    for (int r = 0; r < block_size_[row_block]; ++r) {
+      for (int c = 0; c < block_size_[column_block]; ++c) {
+        int row = block_start_[row_block] + r;
+        int column = block_start_[column_block] + c;
+        int source = slot_offset_[s] + r * block_size_[column_block] + c;
+        columns[column].push_back(std::make_pair(row, source));
+        if (row_block != column_block) {
+          columns[row].push_back(std::make_pair(column, source));
+        }
+      }
+    }
+  }
+  Ap_.push_back(0);
+  diagonal_entry_.resize(n);
+  for (int column = 0; column < n; ++column) {
+    for (int k = 0; k < columns[column].size(); ++k) {
+      if (columns[column][k].first == column) {
+        diagonal_entry_[column] = Ai_.size();
+      }
+      Ai_.push_back(columns[column][k].first);
+      value_source_.push_back(columns[column][k].second);
+    }
+    Ap_.push_back(Ai_.size());
+  }
+  Ax_.resize(Ai_.size());
+
+  // Order the blocks to reduce the fill-in, then expand the ordering to the
+  // scalar unknowns.
+  std::vector<int> block_Ap(1, 0), block_Ai;
+  for (int b = 0; b < num_blocks; ++b) {
+    for (int k = Ap_[block_start_[b]]; k < Ap_[block_start_[b] + 1]; ++k) {
+      // Every row of a block is present in the first column of the block.
+      int row = Ai_[k];
+      int row_block = row < NumCameras() * CAMERA_SIZE ?
+          row / CAMERA_SIZE : intrinsics_block_;
+      if (row == block_start_[row_block]) {
+        block_Ai.push_back(row_block);
+      }
+    }
+    block_Ap.push_back(block_Ai.size());
+  }
+  std::vector<int> block_order(num_blocks + 1);
+  int stats[COLAMD_STATS];
+  if (num_blocks == 0 ||
+      !symamd(num_blocks, &block_Ai[0], &block_Ap[0], &block_order[0],
+              NULL, stats, &calloc, &free)) {
+    for (int b = 0; b < num_blocks; ++b) {
+      block_order[b] = b;
+    }
+  }
+  for (int k = 0; k < num_blocks; ++k) {
+    int b = block_order[k];
+    for (int i = 0; i < block_size_[b]; ++i) {
+      P_.push_back(block_start_[b] + i);
+    }
+  }
+  Pinv_.resize(n);
+  Lp_.resize(n + 1);
+  Parent_.resize(n);
+  Lnz_.resize(n);
+  Flag_.resize(n);
+  Pattern_.resize(n);
+  D_.resize(n);
+  Y_.resize(n);
+  if (n > 0) {
+    ldl_symbolic(n, &Ap_[0], &Ai_[0], &Lp_[0], &Parent_[0], &Lnz_[0],
+                 &Flag_[0], &P_[0], &Pinv_[0]);
+  }
+  Li_.resize(Lp_[n]);
+  Lx_.resize(Lp_[n]);
+  LG << "Reduced camera system: " << n << " unknowns, " << Ai_.size()
+     << " non-zeros, " << Lp_[n] << " non-zeros in the factorization.";
+}
+
+template<typename Model>
+void SchurBundler<Model>::EvaluateObservation(int i, bool with_jacobians) {
+  const Observation &observation = observations_[i];
+  double image[2];
+  Model::Project(*cameras_[observation.camera],
+                 *points_[observation.point],
+                 intrinsics_,
+                 intrinsics_parameters_,
+                 bundle_intrinsics_,
+                 image,
+                 with_jacobians ? &camera_jacobians_[i * 2 * CAMERA_SIZE]
+                                : NULL,
+                 with_jacobians ? &point_jacobians_[i * 2 * POINT_SIZE]
+                                : NULL,
+                 with_jacobians && bundle_intrinsics_
+                     ? &intrinsics_jacobians_[i * 2 * INTRINSICS_SIZE]
+                     : NULL);
+  residuals_[2 * i + 0] = image[0] - observation.x;
+  residuals_[2 * i + 1] = image[1] - observation.y;
+}
+
+template<typename Model>
+double SchurBundler<Model>::EvaluateCost(bool with_jacobians) {
+  EvaluateObservationFunctor<SchurBundler> evaluate(this, with_jacobians);
+  ParallelFor(options_.pool, 0, NumObservations(), evaluate, 64);
+  double cost = 0;
+  for (int i = 0; i < residuals_.size(); ++i) {
+    cost += residuals_[i] * residuals_[i];
+  }
+  return cost / 2;
+}
+
+template<typename Model>
+void SchurBundler<Model>::EliminatePoint(int j) {
+  PointMatrix V = PointMatrix::Zero();
+  PointVector b = PointVector::Zero();
+  for (int k = point_observations_start_[j];
+       k < point_observations_start_[j + 1]; ++k) {
+    int o = point_observations_[k];
+    Eigen::Map<Eigen::Matrix<double, 2, POINT_SIZE, Eigen::RowMajor> >
+        J_point(&point_jacobians_[o * 2 * POINT_SIZE]);
+    V += J_point.transpose() * J_point;
+    b -= J_point.transpose() * Vec2(residuals_[2 * o], residuals_[2 * o + 1]);
+  }
+  for (int i = 0; i < POINT_SIZE; ++i) {
+    V(i, i) += mu_ * std::min(std::max(V(i, i), 1e-6), 1e32);
+  }
+  Eigen::Map<PointMatrix> V_inverse(&v_inverse_[j * POINT_SIZE * POINT_SIZE]);
+  V_inverse = V.inverse();
+  Eigen::Map<PointVector> point_rhs(&point_rhs_[j * POINT_SIZE]);
+  point_rhs = b;
+
+  // W = J_y' J_p for the camera of each observation, and summed over the
+  // observations for the intrinsics.
+  for (int k = point_observations_start_[j];
+       k < point_observations_start_[j + 1]; ++k) {
+    int o = point_observations_[k];
+    if (!IsVariable(observations_[o].camera)) {
+      continue;
+    }
+    BlockMap J_point(&point_jacobians_[o * 2 * POINT_SIZE], 2, POINT_SIZE);
+    BlockMap J_camera(&camera_jacobians_[o * 2 * CAMERA_SIZE],
+                      2, CAMERA_SIZE);
+    BlockMap W(&w_[OffsetOfW(o)], CAMERA_SIZE, POINT_SIZE);
+    BlockMap WV(&w_v_inverse_[OffsetOfW(o)], CAMERA_SIZE, POINT_SIZE);
+    W.noalias() = J_camera.transpose() * J_point;
+    WV.noalias() = W * V_inverse;
+  }
+  if (bundle_intrinsics_) {
+    int w = IntrinsicsW(j);
+    BlockMap W(&w_[OffsetOfW(w)], INTRINSICS_SIZE, POINT_SIZE);
+    BlockMap WV(&w_v_inverse_[OffsetOfW(w)], INTRINSICS_SIZE, POINT_SIZE);
+    W.setZero();
+    for (int k = point_observations_start_[j];
+         k < point_observations_start_[j + 1]; ++k) {
+      int o = point_observations_[k];
+      BlockMap J_point(&point_jacobians_[o * 2 * POINT_SIZE], 2, POINT_SIZE);
+      BlockMap J_intrinsics(&intrinsics_jacobians_[o * 2 * INTRINSICS_SIZE],
+                            2, INTRINSICS_SIZE);
+      W.noalias() += J_intrinsics.transpose() * J_point;
+    }
+    WV.noalias() = W * V_inverse;
+  }
+}
+
+template<typename Model>
+void SchurBundler<Model>::ComputeReducedBlock(int s) {
+  int row_block = slot_row_[s];
+  int column_block = slot_column_[s];
+  int rows = block_size_[row_block];
+  int columns = block_size_[column_block];
+  BlockMap S(&reduced_values_[slot_offset_[s]], rows, columns);
+  S.setZero();
+  for (int k = slot_observations_start_[s];
+       k < slot_observations_start_[s + 1]; ++k) {
+    int o = slot_observations_[k];
+    BlockMap J_row(ReducedJacobian(o, row_block), 2, rows);
+    BlockMap J_column(ReducedJacobian(o, column_block), 2, columns);
+    S.noalias() += J_row.transpose() * J_column;
+  }
+  if (row_block == column_block) {
+    for (int i = 0; i < rows; ++i) {
+      u_diagonal_[block_start_[row_block] + i] = S(i, i);
+    }
+  }
+  for (int k = slot_schur_start_[s]; k < slot_schur_start_[s + 1]; ++k) {
+    int w1 = slot_schur_[k].first;
+    int w2 = slot_schur_[k].second;
+    BlockMap WV(&w_v_inverse_[OffsetOfW(w1)], rows, POINT_SIZE);
+    BlockMap W(&w_[OffsetOfW(w2)], columns, POINT_SIZE);
+    S.noalias() -= WV * W.transpose();
+  }
+}
+
+template<typename Model>
+void SchurBundler<Model>::UpdatePoint(int j) {
+  PointVector b = Eigen::Map<PointVector>(&point_rhs_[j * POINT_SIZE]);
+  for (int k = point_observations_start_[j];
+       k < point_observations_start_[j + 1]; ++k) {
+    int o = point_observations_[k];
+    if (!IsVariable(observations_[o].camera)) {
+      continue;
+    }
+    BlockMap W(&w_[OffsetOfW(o)], CAMERA_SIZE, POINT_SIZE);
+    b -= W.transpose() * VecMap(
+        &reduced_step_[block_start_[observations_[o].camera]], CAMERA_SIZE);
+  }
+  if (bundle_intrinsics_) {
+    BlockMap W(&w_[OffsetOfW(IntrinsicsW(j))], INTRINSICS_SIZE, POINT_SIZE);
+    b -= W.transpose() * VecMap(
+        &reduced_step_[block_start_[intrinsics_block_]], INTRINSICS_SIZE);
+  }
+  Eigen::Map<PointVector> step(&point_step_[j * POINT_SIZE]);
+  step = Eigen::Map<PointMatrix>(&v_inverse_[j * POINT_SIZE * POINT_SIZE]) *
+         b;
+  Model::UpdatePoint(&point_step_[j * POINT_SIZE], points_[j]);
+}
+
+template<typename Model>
+bool SchurBundler<Model>::ComputeStep() {
+  EliminatePointFunctor<SchurBundler> eliminate_point(this);
+  ParallelFor(options_.pool, 0, NumPoints(), eliminate_point, 16);
+  ComputeReducedBlockFunctor<SchurBundler> compute_block(this);
+  ParallelFor(options_.pool, 0, slot_row_.size(), compute_block, 4);
+
+  // Right hand side: b_y - W V^-1 b_p.
+  std::fill(reduced_rhs_.begin(), reduced_rhs_.end(), 0.0);
+  for (int o = 0; o < NumObservations(); ++o) {
+    Vec2 residual(residuals_[2 * o], residuals_[2 * o + 1]);
+    int camera = observations_[o].camera;
+    if (IsVariable(camera)) {
+      VecMap(&reduced_rhs_[block_start_[camera]], CAMERA_SIZE) -=
+          BlockMap(&camera_jacobians_[o * 2 * CAMERA_SIZE],
+                   2, CAMERA_SIZE).transpose() * residual;
+    }
+    if (bundle_intrinsics_) {
+      VecMap(&reduced_rhs_[block_start_[intrinsics_block_]],
+             INTRINSICS_SIZE) -=
+          BlockMap(&intrinsics_jacobians_[o * 2 * INTRINSICS_SIZE],
+                   2, INTRINSICS_SIZE).transpose() * residual;
+    }
+  }
+  int num_w = NumObservations() + (bundle_intrinsics_ ? NumPoints() : 0);
+  for (int w = 0; w < num_w; ++w) {
+    if (w < NumObservations() && !IsVariable(observations_[w].camera)) {
+      continue;
+    }
+    int block = BlockOfW(w);
+    int point = w < NumObservations() ? observations_[w].point
+                                      : w - NumObservations();
+    VecMap(&reduced_rhs_[block_start_[block]], block_size_[block]) -=
+        BlockMap(&w_v_inverse_[OffsetOfW(w)],
+                 block_size_[block], POINT_SIZE) *
+        Eigen::Map<PointVector>(&point_rhs_[point * POINT_SIZE]);
   }
+
+  // Damp and factorize the reduced system, then solve it.
+  int n = reduced_rhs_.size();
+  for (int k = 0; k < Ax_.size(); ++k) {
+    Ax_[k] = reduced_values_[value_source_[k]];
+  }
+  for (int i = 0; i < n; ++i) {
+    Ax_[diagonal_entry_[i]] +=
+        mu_ * std::min(std::max(u_diagonal_[i], 1e-6), 1e32);
+  }
+  if (n > 0) {
+    int rank = ldl_numeric(n, &Ap_[0], &Ai_[0], &Ax_[0],
+                           &Lp_[0], &Parent_[0], &Lnz_[0],
+                           &Li_[0], &Lx_[0], &D_[0], &Y_[0],
+                           &Pattern_[0], &Flag_[0], &P_[0], &Pinv_[0]);
+    if (rank != n) {
+      VLOG(1) << "Reduced camera system is singular.";
+      return false;
+    }
+    ldl_perm(n, &Y_[0], &reduced_rhs_[0], &P_[0]);
+    ldl_lsolve(n, &Y_[0], &Lp_[0], &Li_[0], &Lx_[0]);
+    ldl_dsolve(n, &Y_[0], &D_[0]);
+    ldl_ltsolve(n, &Y_[0], &Lp_[0], &Li_[0], &Lx_[0]);
+    ldl_permt(n, &reduced_step_[0], &Y_[0], &P_[0]);
+  }
+  return true;
+}
+
+// Applies the step and returns its squared norm.
+template<typename Model>
+double SchurBundler<Model>::ApplyStep() {
+  for (int i = 0; i < NumCameras(); ++i) {
+    Model::UpdateCamera(&reduced_step_[block_start_[i]], cameras_[i]);
+  }
+  if (bundle_intrinsics_) {
+    for (int i = 0; i < INTRINSICS_SIZE; ++i) {
+      intrinsics_parameters_[i] +=
+          reduced_step_[block_start_[intrinsics_block_] + i];
+    }
+  }
+  UpdatePointFunctor<SchurBundler> update_point(this);
+  ParallelFor(options_.pool, 0, NumPoints(), update_point, 16);
+
+  double step_norm = 0;
+  for (int i = 0; i < reduced_step_.size(); ++i) {
+    step_norm += reduced_step_[i] * reduced_step_[i];
+  }
+  for (int i = 0; i < point_step_.size(); ++i) {
+    step_norm += point_step_[i] * point_step_[i];
+  }
+  return step_norm;
+}
+
+template<typename Model>
+void SchurBundler<Model>::SaveParameters() {
+  saved_cameras_.resize(NumCameras());
+  for (int i = 0; i < NumCameras(); ++i) {
+    saved_cameras_[i] = *cameras_[i];
+  }
+  saved_points_.resize(NumPoints());
+  for (int j = 0; j < NumPoints(); ++j) {
+    saved_points_[j] = *points_[j];
+  }
+  std::copy(intrinsics_parameters_, intrinsics_parameters_ + INTRINSICS_SIZE,
+            saved_intrinsics_parameters_);
+  saved_residuals_ = residuals_;
+}
+
+template<typename Model>
+void SchurBundler<Model>::RestoreParameters() {
+  for (int i = 0; i < NumCameras(); ++i) {
+    *cameras_[i] = saved_cameras_[i];
+  }
+  for (int j = 0; j < NumPoints(); ++j) {
+    *points_[j] = saved_points_[j];
+  }
+  std::copy(saved_intrinsics_parameters_,
+            saved_intrinsics_parameters_ + INTRINSICS_SIZE,
+            intrinsics_parameters_);
+  residuals_.swap(saved_residuals_);
+}
+
+template<typename Model>
+void SchurBundler<Model>::Solve() {
+  if (NumObservations() == 0) {
+    return;
+  }
+  double cost = EvaluateCost(true);
+  LG << "Initial bundle cost: " << cost;
+
+  // Past this damping the steps are too small to change anything.
+  const double kMaxDamping = 1e16;
+
+  int iteration;
+  for (iteration = 0; iteration < options_.max_iterations; ++iteration) {
+    if (!ComputeStep()) {
+      mu_ *= 10;
+      if (mu_ > kMaxDamping) {
+        LG << "Bundle stopped: the damped system cannot be factorized.";
+        break;
+      }
+      continue;
+    }
+
+    double parameters_norm = 0;
+    for (int i = 0; i < NumCameras(); ++i) {
+      parameters_norm += Model::SquaredNorm(*cameras_[i]);
+    }
+    for (int j = 0; j < NumPoints(); ++j) {
+      parameters_norm += Model::SquaredNorm(*points_[j]);
+    }
+    parameters_norm = sqrt(parameters_norm);
+
+    SaveParameters();
+    double step_norm = sqrt(ApplyStep());
+    double new_cost = EvaluateCost(false);
+    VLOG(1) << "Bundle iteration " << iteration << ": cost " << new_cost
+            << ", step " << step_norm << ", damping " << mu_;
+
+    if (step_norm <= options_.parameter_tolerance *
+                     (parameters_norm + options_.parameter_tolerance)) {
+      if (new_cost > cost) {
+        RestoreParameters();
+      }
+      LG << "Bundle converged: step too small.";
+      break;
+    }
+    if (new_cost < cost) {
+      bool converged = cost - new_cost <= options_.function_tolerance * cost;
+      cost = EvaluateCost(true);
+      mu_ = std::max(mu_ / 10, 1e-16);
+      if (converged) {
+        LG << "Bundle converged: cost decrease too small.";
+        break;
+      }
+    } else {
+      RestoreParameters();
+      mu_ *= 10;
+      if (mu_ > kMaxDamping) {
+        LG << "Bundle converged: no step decreases the cost.";
+        break;
+      }
+    }
+  }
+  LG << "Final bundle cost: " << cost << " after " << iteration
+     << " iterations.";
+
+  if (bundle_intrinsics_) {
+    Mat3 K = intrinsics_->K();
+    double aspect = K(1, 1) / K(0, 0);
+    K(0, 0) = intrinsics_parameters_[OFFSET_FOCAL_LENGTH];
+    K(1, 1) = aspect * intrinsics_parameters_[OFFSET_FOCAL_LENGTH];
+    K(0, 2) = intrinsics_parameters_[OFFSET_PRINCIPAL_POINT_X];
+    K(1, 2) = intrinsics_parameters_[OFFSET_PRINCIPAL_POINT_Y];
+    intrinsics_->SetK(K);
+    intrinsics_->set_radial_distortion(intrinsics_parameters_[OFFSET_K1],
+                                       intrinsics_parameters_[OFFSET_K2],
+                                       intrinsics_->k3());
+  }
+}
+
+}  // namespace
+
+void EuclideanBundle(const Tracks &tracks,
+                     EuclideanReconstruction *reconstruction) {
+  EuclideanBundle(tracks, BundleOptions(), reconstruction, NULL);
+}
+
+void EuclideanBundle(const Tracks &tracks,
+                     const BundleOptions &options,
+                     EuclideanReconstruction *reconstruction,
+                     CameraIntrinsics *intrinsics) {
+  SchurBundler<EuclideanBundleModel> bundler(tracks, options, NULL,
+                                             reconstruction, intrinsics);
+  bundler.Solve();
+}
+
+void EuclideanBundleImages(const Tracks &tracks,
+                           const vector<int> &images,
+                           const BundleOptions &options,
+                           EuclideanReconstruction *reconstruction) {
+  SchurBundler<EuclideanBundleModel> bundler(tracks, options, &images,
+                                             reconstruction, NULL);
+  bundler.Solve();
+}
+
+void ProjectiveBundle(const Tracks &tracks,
+                      ProjectiveReconstruction *reconstruction) {
+  ProjectiveBundle(tracks, BundleOptions(), reconstruction);
+}
+
+void ProjectiveBundle(const Tracks &tracks,
+                      const BundleOptions &options,
+                      ProjectiveReconstruction *reconstruction) {
+  SchurBundler<ProjectiveBundleModel> bundler(tracks, options, NULL,
+                                              reconstruction, NULL);
+  bundler.Solve();
 }
 
-void ProjectiveBundle(const Tracks & /*tracks*/,
-                      ProjectiveReconstruction * /*reconstruction*/) {
-  // TODO(keir): Implement this! This can't work until we have a better bundler
-  // than SSBA, since SSBA has no support for projective bundling.
+void ProjectiveBundleImages(const Tracks &tracks,
+                            const vector<int> &images,
+                            const BundleOptions &options,
+                            ProjectiveReconstruction *reconstruction) {
+  SchurBundler<ProjectiveBundleModel> bundler(tracks, options, &images,
+                                              reconstruction, NULL);
+  bundler.Solve();
 }
 
 }  // namespace libmv
@@ -21,12 +21,52 @@
 #ifndef LIBMV_SIMPLE_PIPELINE_BUNDLE_H
 #define LIBMV_SIMPLE_PIPELINE_BUNDLE_H
 
+#include "libmv/base/vector.h"
+
 namespace libmv {
 
+class CameraIntrinsics;
 class EuclideanReconstruction;
 class ProjectiveReconstruction;
+class ThreadPool;
 class Tracks;
 
+/*!
+    Which camera intrinsics EuclideanBundle() refines, as a bitwise or of
+    these. The focal length keeps the aspect ratio of the intrinsics.
+*/
+enum BundleIntrinsics {
+  BUNDLE_NO_INTRINSICS   = 0,
+  BUNDLE_FOCAL_LENGTH    = (1 << 0),
+  BUNDLE_PRINCIPAL_POINT = (1 << 1),
+  BUNDLE_RADIAL_K1       = (1 << 2),
+  BUNDLE_RADIAL_K2       = (1 << 3)
+};
+
+/*!
+    Settings of the bundle adjuster.
+
+    \a max_iterations bounds the number of Levenberg-Marquardt iterations.
+    The minimization also stops once an iteration decreases the cost by less
+    than \a function_tolerance relatively, or changes the parameters by less
+    than \a parameter_tolerance relatively.
+
+    \a bundle_intrinsics selects the intrinsics to refine (see
+    \l BundleIntrinsics); it only applies when intrinsics are given.
+
+    If \a pool is not NULL, the residuals, the Jacobians and the reduced
+    camera system are computed on its threads.
+*/
+struct BundleOptions {
+  BundleOptions();
+
+  int max_iterations;
+  double function_tolerance;
+  double parameter_tolerance;
+  int bundle_intrinsics;
+  ThreadPool *pool;
+};
+
 /*!
     Refine camera poses and 3D coordinates using bundle adjustment.
 
@@ -47,6 +87,41 @@ class Tracks;
 void EuclideanBundle(const Tracks &tracks,
                      EuclideanReconstruction *reconstruction);
 
+/*!
+    Same as above, with the given \a options.
+
+    If \a intrinsics is NULL, the markers are in normalized camera
+    coordinates, as above. Otherwise, the markers are in pixels and are
+    compared to the points projected with \a intrinsics, of which those
+    selected by \a options.bundle_intrinsics are refined in-place too.
+
+    The minimization is a sparse Levenberg-Marquardt which eliminates the
+    points first, so that each iteration only factorizes the reduced camera
+    system (the Schur complement of the points), with a sparse LDL'
+    factorization.
+*/
+void EuclideanBundle(const Tracks &tracks,
+                     const BundleOptions &options,
+                     EuclideanReconstruction *reconstruction,
+                     CameraIntrinsics *intrinsics);
+
+/*!
+    Refine the poses of the cameras of \a images and the 3D coordinates of the
+    points they see, holding the other cameras constant.
+
+    This is a local bundle adjustment, for example over the last cameras added
+    to a reconstruction: its cost only depends on the size of the window and
+    not on the size of the whole reconstruction. The cameras held constant
+    still constrain the points through their markers, which also fixes the
+    gauge of the reconstruction.
+
+    \sa EuclideanBundle
+*/
+void EuclideanBundleImages(const Tracks &tracks,
+                           const vector<int> &images,
+                           const BundleOptions &options,
+                           EuclideanReconstruction *reconstruction);
+
 /*!
     Refine camera poses and 3D coordinates using bundle adjustment.
 
@@ -67,6 +142,22 @@ void EuclideanBundle(const Tracks &tracks,
 void ProjectiveBundle(const Tracks &tracks,
                       ProjectiveReconstruction *reconstruction);
 
+/// Same as above, with the given \a options.
+void ProjectiveBundle(const Tracks &tracks,
+                      const BundleOptions &options,
+                      ProjectiveReconstruction *reconstruction);
+
+/*!
+    Refine the cameras of \a images and the homogeneous 3D coordinates of the
+    points they see, holding the other cameras constant.
+
+    \sa EuclideanBundleImages, ProjectiveBundle
+*/
+void ProjectiveBundleImages(const Tracks &tracks,
+                            const vector<int> &images,
+                            const BundleOptions &options,
+                            ProjectiveReconstruction *reconstruction);
+
 }  // namespace libmv
 
 #endif   // LIBMV_SIMPLE_PIPELINE_BUNDLE_H
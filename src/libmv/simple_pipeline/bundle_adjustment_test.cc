@@ -0,0 +1,270 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cmath>
+#include <cstdlib>
+
+#include "testing/testing.h"
+#include "libmv/base/thread_pool.h"
+#include "libmv/simple_pipeline/bundle.h"
+#include "libmv/simple_pipeline/camera_intrinsics.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+namespace {
+
+double Random(double min, double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+Mat3 SmallRotation(double angle) {
+  Vec3 axis(Random(-1, 1), Random(-1, 1), Random(-1, 1));
+  return Eigen::AngleAxisd(angle, axis.normalized()).toRotationMatrix();
+}
+
+// Cameras on a line looking down z, at points in front of them. Each point is
+// seen by the cameras close to it, so that the reduced camera system is
+// banded like for a real shot.
+void MakeScene(int num_cameras, int num_points,
+               EuclideanReconstruction *reconstruction) {
+  srand(5);
+  for (int i = 0; i < num_cameras; ++i) {
+    Vec3 center(0.5 * i, Random(-0.1, 0.1), Random(-0.1, 0.1));
+    Mat3 R = SmallRotation(0.1);
+    reconstruction->InsertCamera(i, R, -R * center);
+  }
+  for (int j = 0; j < num_points; ++j) {
+    Vec3 X(Random(-1, 0.5 * num_cameras), Random(-2, 2), Random(5, 8));
+    reconstruction->InsertPoint(j, X);
+  }
+}
+
+// Project every point in the cameras closer than 3 along x.
+void ProjectScene(const EuclideanReconstruction &reconstruction,
+                  const CameraIntrinsics *intrinsics,
+                  Tracks *tracks) {
+  vector<EuclideanCamera> cameras = reconstruction.AllCameras();
+  vector<EuclideanPoint> points = reconstruction.AllPoints();
+  for (int i = 0; i < cameras.size(); ++i) {
+    Vec3 center = -cameras[i].R.transpose() * cameras[i].t;
+    for (int j = 0; j < points.size(); ++j) {
+      if (fabs(points[j].X(0) - center(0)) > 3) {
+        continue;
+      }
+      Vec3 x = cameras[i].R * points[j].X + cameras[i].t;
+      x /= x(2);
+      if (intrinsics) {
+        intrinsics->ApplyIntrinsics(x(0), x(1), &x(0), &x(1));
+      }
+      tracks->Insert(cameras[i].image, points[j].track, x(0), x(1));
+    }
+  }
+}
+
+void Perturb(double amount, EuclideanReconstruction *reconstruction) {
+  vector<EuclideanCamera> cameras = reconstruction->AllCameras();
+  for (int i = 0; i < cameras.size(); ++i) {
+    Vec3 delta(Random(-1, 1), Random(-1, 1), Random(-1, 1));
+    reconstruction->InsertCamera(cameras[i].image,
+                                 SmallRotation(amount) * cameras[i].R,
+                                 cameras[i].t + amount * delta);
+  }
+  vector<EuclideanPoint> points = reconstruction->AllPoints();
+  for (int j = 0; j < points.size(); ++j) {
+    Vec3 delta(Random(-1, 1), Random(-1, 1), Random(-1, 1));
+    reconstruction->InsertPoint(points[j].track,
+                                points[j].X + amount * delta);
+  }
+}
+
+double RMSReprojectionError(const Tracks &tracks,
+                            const EuclideanReconstruction &reconstruction,
+                            const CameraIntrinsics *intrinsics) {
+  vector<Marker> markers = tracks.AllMarkers();
+  double error = 0;
+  for (int i = 0; i < markers.size(); ++i) {
+    const EuclideanCamera *camera =
+        reconstruction.CameraForImage(markers[i].image);
+    const EuclideanPoint *point =
+        reconstruction.PointForTrack(markers[i].track);
+    Vec3 x = camera->R * point->X + camera->t;
+    x /= x(2);
+    if (intrinsics) {
+      intrinsics->ApplyIntrinsics(x(0), x(1), &x(0), &x(1));
+    }
+    error += Square(x(0) - markers[i].x) + Square(x(1) - markers[i].y);
+  }
+  return sqrt(error / markers.size());
+}
+
+TEST(EuclideanBundle, RecoversPerturbedScene) {
+  EuclideanReconstruction reconstruction;
+  MakeScene(10, 100, &reconstruction);
+  Tracks tracks;
+  ProjectScene(reconstruction, NULL, &tracks);
+
+  Perturb(0.01, &reconstruction);
+  EXPECT_GT(RMSReprojectionError(tracks, reconstruction, NULL), 1e-3);
+
+  EuclideanBundle(tracks, &reconstruction);
+  EXPECT_LT(RMSReprojectionError(tracks, reconstruction, NULL), 1e-8);
+}
+
+TEST(EuclideanBundle, SameResultOnThreads) {
+  EuclideanReconstruction reconstruction;
+  MakeScene(10, 100, &reconstruction);
+  Tracks tracks;
+  ProjectScene(reconstruction, NULL, &tracks);
+  Perturb(0.01, &reconstruction);
+
+  EuclideanReconstruction serial = reconstruction;
+  EuclideanBundle(tracks, &serial);
+
+  ThreadPool pool(3);
+  BundleOptions options;
+  options.pool = &pool;
+  EuclideanBundle(tracks, options, &reconstruction, NULL);
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(serial.CameraForImage(i)->t, reconstruction.CameraForImage(i)->t);
+  }
+  for (int j = 0; j < 100; ++j) {
+    EXPECT_EQ(serial.PointForTrack(j)->X, reconstruction.PointForTrack(j)->X);
+  }
+}
+
+TEST(EuclideanBundle, OnlyRefinesGivenImages) {
+  EuclideanReconstruction original;
+  MakeScene(10, 100, &original);
+  Tracks tracks;
+  ProjectScene(original, NULL, &tracks);
+
+  // Perturb the last three cameras and every point.
+  EuclideanReconstruction reconstruction = original;
+  Perturb(0.01, &reconstruction);
+  for (int i = 0; i < 7; ++i) {
+    const EuclideanCamera *camera = original.CameraForImage(i);
+    reconstruction.InsertCamera(i, camera->R, camera->t);
+  }
+  EuclideanReconstruction perturbed = reconstruction;
+
+  vector<int> images;
+  images.push_back(7);
+  images.push_back(8);
+  images.push_back(9);
+  Tracks local_tracks;
+  for (int i = 0; i < images.size(); ++i) {
+    vector<Marker> markers = tracks.MarkersInImage(images[i]);
+    for (int j = 0; j < markers.size(); ++j) {
+      local_tracks.Insert(markers[j].image, markers[j].track,
+                          markers[j].x, markers[j].y);
+    }
+  }
+  EXPECT_GT(RMSReprojectionError(local_tracks, reconstruction, NULL), 1e-3);
+
+  EuclideanBundleImages(tracks, images, BundleOptions(), &reconstruction);
+  EXPECT_LT(RMSReprojectionError(local_tracks, reconstruction, NULL), 1e-8);
+
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(original.CameraForImage(i)->R,
+              reconstruction.CameraForImage(i)->R);
+    EXPECT_EQ(original.CameraForImage(i)->t,
+              reconstruction.CameraForImage(i)->t);
+  }
+  for (int j = 0; j < 100; ++j) {
+    if (!local_tracks.NumMarkersForTrack(j)) {
+      EXPECT_EQ(perturbed.PointForTrack(j)->X,
+                reconstruction.PointForTrack(j)->X);
+    }
+  }
+}
+
+TEST(EuclideanBundle, RefinesIntrinsics) {
+  EuclideanReconstruction reconstruction;
+  MakeScene(10, 200, &reconstruction);
+  CameraIntrinsics intrinsics;
+  intrinsics.SetFocalLength(500);
+  intrinsics.set_principal_point(320, 240);
+  intrinsics.set_radial_distortion(-0.05, 0, 0);
+  Tracks tracks;
+  ProjectScene(reconstruction, &intrinsics, &tracks);
+
+  CameraIntrinsics guess = intrinsics;
+  guess.SetFocalLength(480);
+  guess.set_principal_point(325, 238);
+  guess.set_radial_distortion(0, 0, 0);
+  Perturb(0.001, &reconstruction);
+
+  BundleOptions options;
+  options.bundle_intrinsics = BUNDLE_FOCAL_LENGTH |
+                              BUNDLE_PRINCIPAL_POINT |
+                              BUNDLE_RADIAL_K1;
+  options.max_iterations = 100;
+  EuclideanBundle(tracks, options, &reconstruction, &guess);
+
+  EXPECT_LT(RMSReprojectionError(tracks, reconstruction, &guess), 1e-6);
+  EXPECT_NEAR(500, guess.focal_length(), 1e-3);
+  EXPECT_NEAR(320, guess.principal_point_x(), 1e-3);
+  EXPECT_NEAR(240, guess.principal_point_y(), 1e-3);
+  EXPECT_NEAR(-0.05, guess.k1(), 1e-6);
+  EXPECT_EQ(0, guess.k2());
+}
+
+TEST(ProjectiveBundle, RecoversPerturbedScene) {
+  EuclideanReconstruction euclidean;
+  MakeScene(6, 60, &euclidean);
+  Tracks tracks;
+  ProjectScene(euclidean, NULL, &tracks);
+
+  ProjectiveReconstruction reconstruction;
+  for (int i = 0; i < 6; ++i) {
+    const EuclideanCamera *camera = euclidean.CameraForImage(i);
+    Mat34 P;
+    P << camera->R, camera->t;
+    for (int k = 0; k < 12; ++k) {
+      P(k / 4, k % 4) += Random(-0.002, 0.002);
+    }
+    reconstruction.InsertCamera(i, P);
+  }
+  for (int j = 0; j < 60; ++j) {
+    Vec4 X;
+    X << euclidean.PointForTrack(j)->X, 1;
+    for (int k = 0; k < 4; ++k) {
+      X(k) += Random(-0.01, 0.01);
+    }
+    reconstruction.InsertPoint(j, X);
+  }
+
+  ProjectiveBundle(tracks, &reconstruction);
+
+  vector<Marker> markers = tracks.AllMarkers();
+  double error = 0;
+  for (int i = 0; i < markers.size(); ++i) {
+    Vec3 x = reconstruction.CameraForImage(markers[i].image)->P *
+             reconstruction.PointForTrack(markers[i].track)->X;
+    error += Square(x(0) / x(2) - markers[i].x) +
+             Square(x(1) / x(2) - markers[i].y);
+  }
+  EXPECT_LT(sqrt(error / markers.size()), 1e-8);
+}
+
+}  // namespace
+}  // namespace libmv
@@ -73,6 +73,40 @@ struct InvertIntrinsicsCostFunction {
   double x, y;
 };
 
+// Analytic jacobian of InvertIntrinsicsCostFunction, i.e. of the distortion
+// model in ApplyIntrinsics() scaled by the focal length.
+struct InvertIntrinsicsJacobian {
+  typedef Mat2 JMatrixType;
+
+  InvertIntrinsicsJacobian(const InvertIntrinsicsCostFunction &f) : f(f) {}
+
+  Mat2 operator()(const Vec2 &u) const {
+    const CameraIntrinsics &intrinsics = f.intrinsics;
+    double x = u(0);
+    double y = u(1);
+    double k1 = intrinsics.k1();
+    double k2 = intrinsics.k2();
+    double k3 = intrinsics.k3();
+    double p1 = intrinsics.p1();
+    double p2 = intrinsics.p2();
+
+    double r2 = x*x + y*y;
+    double r_coeff = 1 + k1*r2 + k2*r2*r2 + k3*r2*r2*r2;
+    // Derivative of r_coeff with respect to r2.
+    double dr_coeff = k1 + 2*k2*r2 + 3*k3*r2*r2;
+
+    Mat2 jacobian;
+    jacobian(0, 0) = r_coeff + 2*x*x*dr_coeff + 2*p1*y + 6*p2*x;
+    jacobian(0, 1) = 2*x*y*dr_coeff + 2*p1*x + 2*p2*y;
+    jacobian(1, 0) = 2*x*y*dr_coeff + 2*p2*y + 2*p1*x;
+    jacobian(1, 1) = r_coeff + 2*y*y*dr_coeff + 2*p2*x + 6*p1*y;
+    jacobian.row(0) *= intrinsics.focal_length_x();
+    jacobian.row(1) *= intrinsics.focal_length_y();
+    return jacobian;
+  }
+  const InvertIntrinsicsCostFunction &f;
+};
+
 void CameraIntrinsics::InvertIntrinsics(double image_x,
                                         double image_y,
                                         double *normalized_x,
@@ -83,7 +117,8 @@ void CameraIntrinsics::InvertIntrinsics(double image_x,
   normalized(0) = (image_x - principal_point_x()) / focal_length_x();
   normalized(1) = (image_y - principal_point_y()) / focal_length_y();
 
-  typedef LevenbergMarquardt<InvertIntrinsicsCostFunction> Solver;
+  typedef LevenbergMarquardt<InvertIntrinsicsCostFunction,
+                             InvertIntrinsicsJacobian> Solver;
 
   InvertIntrinsicsCostFunction intrinsics_cost(*this, image_x, image_y);
   Solver::SolverParameters params;
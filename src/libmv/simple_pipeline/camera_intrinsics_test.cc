@@ -50,4 +50,27 @@ TEST(CameraIntrinsics, ApplyIsInvertibleSimple) {
   }
 }
 
+TEST(CameraIntrinsics, ApplyIsInvertibleHigherOrderDistortion) {
+  CameraIntrinsics intrinsics;
+  Mat3 K;
+  K << 500.0,   0.0, 250.0,
+         0.0, 520.0, 125.0,
+         0.0,   0.0,   1.0;
+  intrinsics.SetK(K);
+  intrinsics.set_radial_distortion(0.034, -0.01, 0.002);
+
+  for (double y = 0; y < 1000; y += 100) {
+    for (double x = 0; x < 1000; x += 100) {
+      double normalized_x, normalized_y;
+      intrinsics.InvertIntrinsics(x, y, &normalized_x, &normalized_y);
+
+      double xp, yp;
+      intrinsics.ApplyIntrinsics(normalized_x, normalized_y, &xp, &yp);
+
+      EXPECT_NEAR(x, xp, 1e-8) << "y: " << y;
+      EXPECT_NEAR(y, yp, 1e-8) << "x: " << x;
+    }
+  }
+}
+
 } // namespace libmv
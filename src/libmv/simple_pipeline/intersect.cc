@@ -45,7 +45,6 @@ struct EuclideanIntersectCostFunction {
 
   Vec operator()(const Vec3 &X) const {
     Vec residuals(2 * markers.size());
-    residuals.setZero();
     for (int i = 0; i < markers.size(); ++i) {
       const EuclideanCamera &camera =
           *reconstruction.CameraForImage(markers[i].image);
@@ -60,8 +59,52 @@ struct EuclideanIntersectCostFunction {
   const EuclideanReconstruction &reconstruction;
 };
 
+// Analytic jacobian of EuclideanIntersectCostFunction. With x = R * X + t, the
+// derivative of (x0 / x2, x1 / x2) with respect to X is
+//
+//   [ 1 / x2     0    -x0 / x2^2 ]
+//   [    0    1 / x2  -x1 / x2^2 ] * R
+struct EuclideanIntersectJacobian {
+  typedef Matrix<double, Dynamic, 3> JMatrixType;
+
+  EuclideanIntersectJacobian(const EuclideanIntersectCostFunction &f)
+    : f(f) {}
+
+  JMatrixType operator()(const Vec3 &X) const {
+    JMatrixType jacobian(2 * f.markers.size(), 3);
+    for (int i = 0; i < f.markers.size(); ++i) {
+      const EuclideanCamera &camera =
+          *f.reconstruction.CameraForImage(f.markers[i].image);
+      Vec3 projected = camera.R * X + camera.t;
+      double inverse_depth = 1.0 / projected(2);
+      jacobian.row(2*i + 0) = inverse_depth * (camera.R.row(0) -
+          projected(0) * inverse_depth * camera.R.row(2));
+      jacobian.row(2*i + 1) = inverse_depth * (camera.R.row(1) -
+          projected(1) * inverse_depth * camera.R.row(2));
+    }
+    return jacobian;
+  }
+  const EuclideanIntersectCostFunction &f;
+};
+
 }  // namespace
 
+namespace internal {
+
+void EuclideanIntersectJacobians(const vector<Marker> &markers,
+                                 const EuclideanReconstruction &reconstruction,
+                                 const Vec3 &X,
+                                 Mat *analytic,
+                                 Mat *numeric) {
+  EuclideanIntersectCostFunction f(markers, reconstruction);
+  EuclideanIntersectJacobian analytic_jacobian(f);
+  NumericJacobian<EuclideanIntersectCostFunction> numeric_jacobian(f);
+  *analytic = analytic_jacobian(X);
+  *numeric = numeric_jacobian(X);
+}
+
+}  // namespace internal
+
 bool EuclideanIntersect(const vector<Marker> &markers,
                         EuclideanReconstruction *reconstruction) {
   if (markers.size() < 2) {
@@ -94,7 +137,8 @@ bool EuclideanIntersect(const vector<Marker> &markers,
   Xp /= Xp(3);
   Vec3 X = Xp.head<3>();
 
-  typedef LevenbergMarquardt<EuclideanIntersectCostFunction> Solver;
+  typedef LevenbergMarquardt<EuclideanIntersectCostFunction,
+                             EuclideanIntersectJacobian> Solver;
 
   EuclideanIntersectCostFunction triangulate_cost(markers, *reconstruction);
   Solver::SolverParameters params;
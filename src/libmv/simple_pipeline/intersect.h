@@ -72,6 +72,19 @@ bool EuclideanIntersect(const vector<Marker> &markers,
 bool ProjectiveIntersect(const vector<Marker> &markers,
                          ProjectiveReconstruction *reconstruction);
 
+namespace internal {
+
+// The jacobian of the reprojection errors minimized by EuclideanIntersect()
+// at the point X, computed analytically as the solver does and by numeric
+// differentiation, to check one against the other.
+void EuclideanIntersectJacobians(const vector<Marker> &markers,
+                                 const EuclideanReconstruction &reconstruction,
+                                 const Vec3 &X,
+                                 Mat *analytic,
+                                 Mat *numeric);
+
+}  // namespace internal
+
 }  // namespace libmv
 
 #endif  // LIBMV_SIMPLE_PIPELINE_INTERSECT_H
@@ -0,0 +1,57 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "testing/testing.h"
+#include "libmv/simple_pipeline/intersect.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+namespace {
+
+TEST(EuclideanIntersect, JacobianMatchesNumeric) {
+  // Three cameras looking at a point from different sides, with markers which
+  // do not quite match it so that the residuals are not zero.
+  EuclideanReconstruction reconstruction;
+  vector<Marker> markers;
+  for (int i = 0; i < 3; ++i) {
+    Mat3 R = Eigen::AngleAxisd(0.2 * (i - 1), Vec3(0, 1, 0.1 * i).normalized())
+                 .toRotationMatrix();
+    reconstruction.InsertCamera(i, R, Vec3(0.5 * i - 0.5, 0.1 * i, 0.2));
+    Marker marker = { i, 0, 0.02 * i, -0.01 * i };
+    markers.push_back(marker);
+  }
+
+  Vec3 X(0.3, -0.4, 5.0);
+  Mat analytic, numeric;
+  internal::EuclideanIntersectJacobians(markers, reconstruction, X,
+                                        &analytic, &numeric);
+  ASSERT_EQ(6, analytic.rows());
+  ASSERT_EQ(3, analytic.cols());
+  for (int r = 0; r < 6; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(numeric(r, c), analytic(r, c), 1e-6)
+          << "row " << r << ", column " << c;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libmv
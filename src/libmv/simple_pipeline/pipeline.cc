@@ -19,10 +19,13 @@
 // IN THE SOFTWARE.
 
 #include <cstdio>
+#include <vector>
 
+#include "libmv/base/thread_pool.h"
 #include "libmv/logging/logging.h"
 #include "libmv/simple_pipeline/bundle.h"
 #include "libmv/simple_pipeline/intersect.h"
+#include "libmv/simple_pipeline/pipeline.h"
 #include "libmv/simple_pipeline/resect.h"
 #include "libmv/simple_pipeline/reconstruction.h"
 #include "libmv/simple_pipeline/tracks.h"
@@ -40,8 +43,16 @@ struct EuclideanPipelineRoutines {
   typedef EuclideanPoint Point;
 
   static void Bundle(const Tracks &tracks,
+                     const BundleOptions &options,
                      EuclideanReconstruction *reconstruction) {
-    EuclideanBundle(tracks, reconstruction);
+    EuclideanBundle(tracks, options, reconstruction, NULL);
+  }
+
+  static void BundleImages(const Tracks &tracks,
+                           const vector<int> &images,
+                           const BundleOptions &options,
+                           EuclideanReconstruction *reconstruction) {
+    EuclideanBundleImages(tracks, images, options, reconstruction);
   }
 
   static bool Resect(const vector<Marker> &markers,
@@ -54,6 +65,16 @@ struct EuclideanPipelineRoutines {
     return EuclideanIntersect(markers, reconstruction);
   }
 
+  static void CopyCamera(const EuclideanCamera &camera,
+                         EuclideanReconstruction *reconstruction) {
+    reconstruction->InsertCamera(camera.image, camera.R, camera.t);
+  }
+
+  static void CopyPoint(const EuclideanPoint &point,
+                        EuclideanReconstruction *reconstruction) {
+    reconstruction->InsertPoint(point.track, point.X);
+  }
+
   static Marker ProjectMarker(const EuclideanPoint &point,
                               const EuclideanCamera &camera,
                               const CameraIntrinsics &intrinsics) {
@@ -78,8 +99,16 @@ struct ProjectivePipelineRoutines {
   typedef ProjectivePoint Point;
 
   static void Bundle(const Tracks &tracks,
+                     const BundleOptions &options,
                      ProjectiveReconstruction *reconstruction) {
-    ProjectiveBundle(tracks, reconstruction);
+    ProjectiveBundle(tracks, options, reconstruction);
+  }
+
+  static void BundleImages(const Tracks &tracks,
+                           const vector<int> &images,
+                           const BundleOptions &options,
+                           ProjectiveReconstruction *reconstruction) {
+    ProjectiveBundleImages(tracks, images, options, reconstruction);
   }
 
   static bool Resect(const vector<Marker> &markers,
@@ -92,6 +121,16 @@ struct ProjectivePipelineRoutines {
     return ProjectiveIntersect(markers, reconstruction);
   }
 
+  static void CopyCamera(const ProjectiveCamera &camera,
+                         ProjectiveReconstruction *reconstruction) {
+    reconstruction->InsertCamera(camera.image, camera.P);
+  }
+
+  static void CopyPoint(const ProjectivePoint &point,
+                        ProjectiveReconstruction *reconstruction) {
+    reconstruction->InsertPoint(point.track, point.X);
+  }
+
   static Marker ProjectMarker(const ProjectivePoint &point,
                               const ProjectiveCamera &camera,
                               const CameraIntrinsics &intrinsics) {
@@ -110,88 +149,249 @@ struct ProjectivePipelineRoutines {
   }
 };
 
+// Bundles the whole reconstruction, or only the last cameras resected if local
+// bundle adjustment is enabled and a global one is not due. Returns whether
+// the whole reconstruction was bundled.
+template<typename PipelineRoutines>
+bool BundleAfterRound(
+    const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
+    const vector<int> &resected_images,
+    bool global_bundle_due,
+    typename PipelineRoutines::Reconstruction *reconstruction) {
+  int window = options.local_bundle_window;
+  if (window <= 0 || global_bundle_due ||
+      resected_images.size() <= static_cast<size_t>(window)) {
+    PipelineRoutines::Bundle(tracks, options.bundle_options, reconstruction);
+    return true;
+  }
+  vector<int> images;
+  for (int i = resected_images.size() - window;
+       i < resected_images.size(); ++i) {
+    images.push_back(resected_images[i]);
+  }
+  PipelineRoutines::BundleImages(tracks, images, options.bundle_options,
+                                 reconstruction);
+  return false;
+}
+
+// Intersects the i-th track of a pass. Each intersection is done in a scratch
+// reconstruction holding only the cameras it needs, so that the intersections
+// of a pass can run concurrently while the shared reconstruction is only read.
+template<typename PipelineRoutines>
+class IntersectTrackFunctor {
+ public:
+  typedef typename PipelineRoutines::Reconstruction Reconstruction;
+  typedef typename PipelineRoutines::Point Point;
+
+  IntersectTrackFunctor(const Reconstruction &reconstruction,
+                        const std::vector<vector<Marker> > &markers,
+                        vector<Point> *points,
+                        vector<int> *succeeded)
+      : reconstruction_(reconstruction),
+        markers_(markers),
+        points_(points),
+        succeeded_(succeeded) {}
+
+  void operator()(int i) {
+    const vector<Marker> &markers = markers_[i];
+    Reconstruction scratch;
+    for (int j = 0; j < markers.size(); ++j) {
+      PipelineRoutines::CopyCamera(
+          *reconstruction_.CameraForImage(markers[j].image), &scratch);
+    }
+    (*succeeded_)[i] = PipelineRoutines::Intersect(markers, &scratch);
+    if ((*succeeded_)[i]) {
+      (*points_)[i] = *scratch.PointForTrack(markers[0].track);
+    }
+  }
+
+ private:
+  const Reconstruction &reconstruction_;
+  const std::vector<vector<Marker> > &markers_;
+  vector<Point> *points_;
+  vector<int> *succeeded_;
+};
+
+// Same as IntersectTrackFunctor, for the resection of the i-th image of a pass.
+template<typename PipelineRoutines>
+class ResectImageFunctor {
+ public:
+  typedef typename PipelineRoutines::Reconstruction Reconstruction;
+  typedef typename PipelineRoutines::Camera Camera;
+
+  ResectImageFunctor(const Reconstruction &reconstruction,
+                     const std::vector<vector<Marker> > &markers,
+                     vector<Camera> *cameras,
+                     vector<int> *succeeded)
+      : reconstruction_(reconstruction),
+        markers_(markers),
+        cameras_(cameras),
+        succeeded_(succeeded) {}
+
+  void operator()(int i) {
+    const vector<Marker> &markers = markers_[i];
+    Reconstruction scratch;
+    for (int j = 0; j < markers.size(); ++j) {
+      PipelineRoutines::CopyPoint(
+          *reconstruction_.PointForTrack(markers[j].track), &scratch);
+    }
+    (*succeeded_)[i] = PipelineRoutines::Resect(markers, &scratch);
+    if ((*succeeded_)[i]) {
+      (*cameras_)[i] = *scratch.CameraForImage(markers[0].image);
+    }
+  }
+
+ private:
+  const Reconstruction &reconstruction_;
+  const std::vector<vector<Marker> > &markers_;
+  vector<Camera> *cameras_;
+  vector<int> *succeeded_;
+};
+
 }  // namespace
 
+CompleteReconstructionOptions::CompleteReconstructionOptions()
+    : local_bundle_window(0),
+      global_bundle_interval(50),
+      pool(NULL),
+      progress(NULL) {}
+
 template<typename PipelineRoutines>
 void InternalCompleteReconstruction(
     const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
     typename PipelineRoutines::Reconstruction *reconstruction) {
-  LG << "Waiting on input..."; getchar();
+  typedef typename PipelineRoutines::Camera Camera;
+  typedef typename PipelineRoutines::Point Point;
 
   int max_track = tracks.MaxTrack();
   int max_image = tracks.MaxImage();
   int num_resects = -1;
   int num_intersects = -1;
+
+  // The cameras in the order they were added, for local bundle adjustment.
+  vector<int> resected_images;
+  for (int image = 0; image <= max_image; ++image) {
+    if (reconstruction->CameraForImage(image)) {
+      resected_images.push_back(image);
+    }
+  }
+  int resects_since_global_bundle = 0;
+  bool bundled_locally = false;
   LG << "Max track: " << max_track;
   LG << "Max image: " << max_image;
   LG << "Number of markers: " << tracks.NumMarkers();
+
+  CompleteReconstructionStats stats;
+  stats.round = 0;
+  std::vector<vector<Marker> > pending_markers;
+  vector<int> succeeded;
   while (num_resects != 0 || num_intersects != 0) {
     // Do all possible intersections.
-    num_intersects = 0;
-    for (int track = 0; track < max_track; ++track) {
+    pending_markers.clear();
+    for (int track = 0; track <= max_track; ++track) {
       if (reconstruction->PointForTrack(track)) {
-        LG << "Skipping point: " << track;
         continue;
       }
-      vector<Marker> all_markers = tracks.MarkersForTrack(track);
-      LG << "Got " << all_markers.size() << " markers for track " << track;
-
+      int num_markers = tracks.NumMarkersForTrack(track);
       vector<Marker> reconstructed_markers;
-      for (int i = 0; i < all_markers.size(); ++i) {
-        if (reconstruction->CameraForImage(all_markers[i].image)) {
-          reconstructed_markers.push_back(all_markers[i]);
+      for (int i = 0; i < num_markers; ++i) {
+        const Marker &marker = tracks.MarkerForTrack(track, i);
+        if (reconstruction->CameraForImage(marker.image)) {
+          reconstructed_markers.push_back(marker);
         }
       }
-      LG << "Got " << reconstructed_markers.size()
-         << " reconstructed markers for track " << track;
       if (reconstructed_markers.size() >= 2) {
-        PipelineRoutines::Intersect(reconstructed_markers, reconstruction);
+        pending_markers.push_back(reconstructed_markers);
+      }
+    }
+    vector<Point> points(pending_markers.size());
+    succeeded.resize(pending_markers.size());
+    IntersectTrackFunctor<PipelineRoutines> intersect(*reconstruction,
+                                                      pending_markers,
+                                                      &points,
+                                                      &succeeded);
+    ParallelFor(options.pool, 0, pending_markers.size(), intersect);
+    num_intersects = 0;
+    for (int i = 0; i < pending_markers.size(); ++i) {
+      if (succeeded[i]) {
+        PipelineRoutines::CopyPoint(points[i], reconstruction);
         num_intersects++;
-        LG << "Ran Intersect() for track " << track;
       }
     }
     if (num_intersects) {
-      PipelineRoutines::Bundle(tracks, reconstruction);
+      bundled_locally = !BundleAfterRound<PipelineRoutines>(
+          tracks, options, resected_images, false, reconstruction);
       LG << "Ran Bundle() after intersections.";
     }
     LG << "Did " << num_intersects << " intersects.";
-    LG << "Waiting on input..."; getchar();
-
-    LG << "Bailing on rest of reconstruction early.";
-    return;
 
     // Do all possible resections.
-    num_resects = 0;
-    for (int image = 0; image < max_image; ++image) {
+    pending_markers.clear();
+    for (int image = 0; image <= max_image; ++image) {
       if (reconstruction->CameraForImage(image)) {
-        LG << "Skipping frame: " << image;
         continue;
       }
-      vector<Marker> all_markers = tracks.MarkersInImage(image);
-      LG << "Got " << all_markers.size() << " markers for image " << image;
-
+      int num_markers = tracks.NumMarkersInImage(image);
       vector<Marker> reconstructed_markers;
-      for (int i = 0; i < all_markers.size(); ++i) {
-        if (reconstruction->PointForTrack(all_markers[i].track)) {
-          reconstructed_markers.push_back(all_markers[i]);
+      for (int i = 0; i < num_markers; ++i) {
+        const Marker &marker = tracks.MarkerInImage(image, i);
+        if (reconstruction->PointForTrack(marker.track)) {
+          reconstructed_markers.push_back(marker);
         }
       }
-      LG << "Got " << reconstructed_markers.size()
-         << " reconstructed markers for image " << image;
       if (reconstructed_markers.size() >= 5) {
-        if (PipelineRoutines::Resect(reconstructed_markers, reconstruction)) {
-          num_resects++;
-          LG << "Ran Resect() for image " << image;
-        } else {
-          LG << "Failed Resect() for image " << image;
-        }
+        pending_markers.push_back(reconstructed_markers);
+      }
+    }
+    vector<Camera> cameras(pending_markers.size());
+    succeeded.resize(pending_markers.size());
+    ResectImageFunctor<PipelineRoutines> resect(*reconstruction,
+                                                pending_markers,
+                                                &cameras,
+                                                &succeeded);
+    ParallelFor(options.pool, 0, pending_markers.size(), resect);
+    num_resects = 0;
+    for (int i = 0; i < pending_markers.size(); ++i) {
+      int image = pending_markers[i][0].image;
+      if (succeeded[i]) {
+        PipelineRoutines::CopyCamera(cameras[i], reconstruction);
+        resected_images.push_back(image);
+        num_resects++;
+      } else {
+        LG << "Failed Resect() for image " << image;
       }
     }
     if (num_resects) {
-      PipelineRoutines::Bundle(tracks, reconstruction);
+      resects_since_global_bundle += num_resects;
+      bool global_bundle_due =
+          resects_since_global_bundle >= options.global_bundle_interval;
+      if (BundleAfterRound<PipelineRoutines>(tracks, options,
+                                             resected_images,
+                                             global_bundle_due,
+                                             reconstruction)) {
+        resects_since_global_bundle = 0;
+        bundled_locally = false;
+      } else {
+        bundled_locally = true;
+      }
     }
     LG << "Did " << num_resects << " resects.";
-    LG << "Waiting on input..."; getchar();
+
+    stats.round++;
+    if (options.progress) {
+      stats.num_intersects = num_intersects;
+      stats.num_resects = num_resects;
+      stats.num_failed_resects = pending_markers.size() - num_resects;
+      stats.num_points = reconstruction->AllPoints().size();
+      stats.num_cameras = reconstruction->AllCameras().size();
+      options.progress->Invoke(stats);
+    }
+  }
+  if (bundled_locally) {
+    PipelineRoutines::Bundle(tracks, options.bundle_options, reconstruction);
+    LG << "Ran final global Bundle().";
   }
 }
 
@@ -265,13 +465,31 @@ double ProjectiveReprojectionError(
 
 void EuclideanCompleteReconstruction(const Tracks &tracks,
                                      EuclideanReconstruction *reconstruction) {
+  EuclideanCompleteReconstruction(tracks, CompleteReconstructionOptions(),
+                                  reconstruction);
+}
+
+void EuclideanCompleteReconstruction(
+    const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
+    EuclideanReconstruction *reconstruction) {
   InternalCompleteReconstruction<EuclideanPipelineRoutines>(tracks,
+                                                            options,
                                                             reconstruction);
 }
 
 void ProjectiveCompleteReconstruction(const Tracks &tracks,
                                       ProjectiveReconstruction *reconstruction) {
+  ProjectiveCompleteReconstruction(tracks, CompleteReconstructionOptions(),
+                                   reconstruction);
+}
+
+void ProjectiveCompleteReconstruction(
+    const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
+    ProjectiveReconstruction *reconstruction) {
   InternalCompleteReconstruction<ProjectivePipelineRoutines>(tracks,
+                                                             options,
                                                              reconstruction);
 }
 
@@ -21,11 +21,74 @@
 #ifndef LIBMV_SIMPLE_PIPELINE_PIPELINE_H_
 #define LIBMV_SIMPLE_PIPELINE_PIPELINE_H_
 
+#include "libmv/simple_pipeline/bundle.h"
 #include "libmv/simple_pipeline/tracks.h"
 #include "libmv/simple_pipeline/reconstruction.h"
 
 namespace libmv {
 
+class ThreadPool;
+
+/*!
+    Statistics about a round of EuclideanCompleteReconstruction() or
+    ProjectiveCompleteReconstruction().
+
+    \a num_intersects and \a num_resects are the number of points and cameras
+    added by the round; \a num_failed_resects counts the cameras that could
+    not be resected. \a num_points and \a num_cameras are the totals in the
+    reconstruction at the end of the round, bundle adjustment included.
+*/
+struct CompleteReconstructionStats {
+  int round;
+  int num_intersects;
+  int num_resects;
+  int num_failed_resects;
+  int num_points;
+  int num_cameras;
+};
+
+/*!
+    Receives the statistics of every round of the complete reconstruction.
+
+    Implementations are called from the thread running the reconstruction.
+*/
+class CompleteReconstructionProgress {
+ public:
+  virtual ~CompleteReconstructionProgress() {}
+  virtual void Invoke(const CompleteReconstructionStats &stats) = 0;
+};
+
+/*!
+    Settings of EuclideanCompleteReconstruction() and
+    ProjectiveCompleteReconstruction().
+
+    By default, each round of intersections or resections is followed by a
+    bundle adjustment of the whole reconstruction, so the time taken grows
+    quadratically with the length of the sequence. If \a local_bundle_window
+    is positive, only the last \a local_bundle_window resected cameras and the
+    points they see are bundled after each round. The whole reconstruction is
+    still bundled every \a global_bundle_interval resections, and once it is
+    complete.
+
+    \a bundle_options are used for every bundle adjustment.
+
+    If \a pool is not NULL, the intersections, then the resections, of a
+    round are computed in parallel on it. They only depend on the
+    reconstruction at the start of their pass and are merged in track or
+    image order, so the result is the same as without a pool.
+
+    If \a progress is not NULL, it is invoked at the end of every round.
+*/
+struct CompleteReconstructionOptions {
+  CompleteReconstructionOptions();
+
+  int local_bundle_window;
+  int global_bundle_interval;
+  BundleOptions bundle_options;
+  ThreadPool *pool;
+  CompleteReconstructionProgress *progress;
+};
+
 /*!
     Estimate camera poses and scene 3D coordinates for all frames and tracks.
 
@@ -48,6 +111,12 @@ namespace libmv {
 void EuclideanCompleteReconstruction(const Tracks &tracks,
                                      EuclideanReconstruction *reconstruction);
 
+/// Same as above, with the given \a options.
+void EuclideanCompleteReconstruction(
+    const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
+    EuclideanReconstruction *reconstruction);
+
 /*!
     Estimate camera matrices and homogeneous 3D coordinates for all frames and
     tracks.
@@ -71,6 +140,12 @@ void EuclideanCompleteReconstruction(const Tracks &tracks,
 void ProjectiveCompleteReconstruction(const Tracks &tracks,
                                       ProjectiveReconstruction *reconstruction);
 
+/// Same as above, with the given \a options.
+void ProjectiveCompleteReconstruction(
+    const Tracks &tracks,
+    const CompleteReconstructionOptions &options,
+    ProjectiveReconstruction *reconstruction);
+
 
 class CameraIntrinsics;
 
@@ -0,0 +1,147 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+
+#include <cmath>
+#include <cstdlib>
+
+#include "testing/testing.h"
+#include "libmv/base/thread_pool.h"
+#include "libmv/simple_pipeline/pipeline.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+namespace {
+
+double Random(double min, double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+// Cameras on a line looking down z; each point is seen by the cameras closer
+// than 2 to it along x, so the sequence has to be reconstructed incrementally.
+void MakeTracks(int num_cameras, int num_points,
+                EuclideanReconstruction *scene,
+                Tracks *tracks) {
+  srand(7);
+  for (int i = 0; i < num_cameras; ++i) {
+    Vec3 center(0.5 * i, Random(-0.1, 0.1), Random(-0.1, 0.1));
+    scene->InsertCamera(i, Mat3::Identity(), -center);
+  }
+  for (int j = 0; j < num_points; ++j) {
+    Vec3 X(Random(-1, 0.5 * num_cameras), Random(-2, 2), Random(5, 8));
+    scene->InsertPoint(j, X);
+    for (int i = 0; i < num_cameras; ++i) {
+      const EuclideanCamera *camera = scene->CameraForImage(i);
+      if (fabs(X(0) + camera->t(0)) > 2) {
+        continue;
+      }
+      Vec3 x = camera->R * X + camera->t;
+      tracks->Insert(i, j, x(0) / x(2), x(1) / x(2));
+    }
+  }
+}
+
+double RMSReprojectionError(const Tracks &tracks,
+                            const EuclideanReconstruction &reconstruction) {
+  vector<Marker> markers = tracks.AllMarkers();
+  double error = 0;
+  for (int i = 0; i < markers.size(); ++i) {
+    const EuclideanCamera *camera =
+        reconstruction.CameraForImage(markers[i].image);
+    const EuclideanPoint *point =
+        reconstruction.PointForTrack(markers[i].track);
+    Vec3 x = camera->R * point->X + camera->t;
+    error += Square(x(0) / x(2) - markers[i].x) +
+             Square(x(1) / x(2) - markers[i].y);
+  }
+  return sqrt(error / markers.size());
+}
+
+class CountRounds : public CompleteReconstructionProgress {
+ public:
+  CountRounds() : num_rounds(0), num_resects(0) {}
+  virtual void Invoke(const CompleteReconstructionStats &stats) {
+    EXPECT_EQ(num_rounds + 1, stats.round);
+    num_rounds = stats.round;
+    num_resects += stats.num_resects;
+    num_cameras = stats.num_cameras;
+  }
+  int num_rounds;
+  int num_resects;
+  int num_cameras;
+};
+
+TEST(EuclideanCompleteReconstruction, ReconstructsSequence) {
+  EuclideanReconstruction scene;
+  Tracks tracks;
+  MakeTracks(12, 300, &scene, &tracks);
+
+  EuclideanReconstruction reconstruction;
+  for (int i = 0; i < 2; ++i) {
+    const EuclideanCamera *camera = scene.CameraForImage(i);
+    reconstruction.InsertCamera(i, camera->R, camera->t);
+  }
+
+  CountRounds progress;
+  CompleteReconstructionOptions options;
+  options.progress = &progress;
+  EuclideanCompleteReconstruction(tracks, options, &reconstruction);
+
+  EXPECT_EQ(12, reconstruction.AllCameras().size());
+  EXPECT_EQ(300, reconstruction.AllPoints().size());
+  EXPECT_LT(RMSReprojectionError(tracks, reconstruction), 1e-6);
+  EXPECT_EQ(10, progress.num_resects);
+  EXPECT_EQ(12, progress.num_cameras);
+  EXPECT_GT(progress.num_rounds, 1);
+}
+
+TEST(EuclideanCompleteReconstruction, SameResultOnThreads) {
+  EuclideanReconstruction scene;
+  Tracks tracks;
+  MakeTracks(12, 300, &scene, &tracks);
+
+  EuclideanReconstruction serial;
+  for (int i = 0; i < 2; ++i) {
+    const EuclideanCamera *camera = scene.CameraForImage(i);
+    serial.InsertCamera(i, camera->R, camera->t);
+  }
+  EuclideanReconstruction parallel = serial;
+
+  CompleteReconstructionOptions options;
+  options.local_bundle_window = 4;
+  options.global_bundle_interval = 6;
+  EuclideanCompleteReconstruction(tracks, options, &serial);
+
+  ThreadPool pool(3);
+  options.pool = &pool;
+  EuclideanCompleteReconstruction(tracks, options, &parallel);
+
+  for (int i = 0; i < 12; ++i) {
+    EXPECT_EQ(serial.CameraForImage(i)->R, parallel.CameraForImage(i)->R);
+    EXPECT_EQ(serial.CameraForImage(i)->t, parallel.CameraForImage(i)->t);
+  }
+  for (int j = 0; j < 300; ++j) {
+    EXPECT_EQ(serial.PointForTrack(j)->X, parallel.PointForTrack(j)->X);
+  }
+}
+
+}  // namespace
+}  // namespace libmv
@@ -78,7 +78,6 @@ struct EuclideanResectCostFunction {
 
     // Compute the reprojection error for each coordinate.
     Vec residuals(2 * markers.size());
-    residuals.setZero();
     for (int i = 0; i < markers.size(); ++i) {
       const EuclideanPoint &point =
           *reconstruction.PointForTrack(markers[i].track);
@@ -95,8 +94,79 @@ struct EuclideanResectCostFunction {
   const Mat3 &initial_R;
 };
 
+// Analytic jacobian of EuclideanResectCostFunction. With dR = R(w) the
+// rotation of the euler vector w and v = initial_R * X, the derivative of
+// dR * v with respect to w is [1]
+//
+//   -dR * [v]_x * (w * w' + (dR' - I) * [w]_x) / |w|^2
+//
+// which is -[v]_x for w = 0. It is chained with the derivative of the
+// projection like in EuclideanIntersectJacobian.
+//
+// [1] G. Gallego and A. Yezzi. A compact formula for the derivative of a 3-D
+//     rotation in exponential coordinates.
+struct EuclideanResectJacobian {
+  typedef Matrix<double, Dynamic, 6> JMatrixType;
+
+  EuclideanResectJacobian(const EuclideanResectCostFunction &f) : f(f) {}
+
+  JMatrixType operator()(const Vec6 &dRt) const {
+    Vec3 w = dRt.head<3>();
+    Mat3 dR = RotationFromEulerVector(w);
+    Mat3 R = dR * f.initial_R;
+    Vec3 t = dRt.tail<3>();
+
+    // The factor to the right of [v]_x in the derivative of the rotation.
+    double theta2 = w.squaredNorm();
+    Mat3 dR_factor = Mat3::Identity();
+    if (theta2 > 0) {
+      dR_factor = (w * w.transpose() +
+                   (dR.transpose() - Mat3::Identity()) * CrossProductMatrix(w))
+                  / theta2;
+    }
+    Mat3 negative_dR = -dR;
+
+    JMatrixType jacobian(2 * f.markers.size(), 6);
+    for (int i = 0; i < f.markers.size(); ++i) {
+      const EuclideanPoint &point =
+          *f.reconstruction.PointForTrack(f.markers[i].track);
+      Vec3 projected = R * point.X + t;
+      double inverse_depth = 1.0 / projected(2);
+      Matrix<double, 2, 3> projection_jacobian;
+      projection_jacobian << inverse_depth, 0,
+                             -projected(0) * inverse_depth * inverse_depth,
+                             0, inverse_depth,
+                             -projected(1) * inverse_depth * inverse_depth;
+      Mat3 rotation_jacobian = negative_dR *
+          CrossProductMatrix(f.initial_R * point.X) * dR_factor;
+      jacobian.block<2, 3>(2*i, 0) = projection_jacobian * rotation_jacobian;
+      jacobian.block<2, 3>(2*i, 3) = projection_jacobian;
+    }
+    return jacobian;
+  }
+
+  const EuclideanResectCostFunction &f;
+};
+
 }  // namespace
 
+namespace internal {
+
+void EuclideanResectJacobians(const vector<Marker> &markers,
+                              const EuclideanReconstruction &reconstruction,
+                              const Mat3 &initial_R,
+                              const Vec6 &dRt,
+                              Mat *analytic,
+                              Mat *numeric) {
+  EuclideanResectCostFunction f(markers, reconstruction, initial_R);
+  EuclideanResectJacobian analytic_jacobian(f);
+  NumericJacobian<EuclideanResectCostFunction> numeric_jacobian(f);
+  *analytic = analytic_jacobian(dRt);
+  *numeric = numeric_jacobian(dRt);
+}
+
+}  // namespace internal
+
 bool EuclideanResect(const vector<Marker> &markers,
                      EuclideanReconstruction *reconstruction) {
   if (markers.size() < 5) {
@@ -149,7 +219,8 @@ bool EuclideanResect(const vector<Marker> &markers,
   }
 
   // Refine the result.
-  typedef LevenbergMarquardt<EuclideanResectCostFunction> Solver;
+  typedef LevenbergMarquardt<EuclideanResectCostFunction,
+                             EuclideanResectJacobian> Solver;
 
   // Give the cost our initial guess for R.
   EuclideanResectCostFunction resect_cost(markers, *reconstruction, R);
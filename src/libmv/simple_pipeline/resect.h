@@ -22,6 +22,8 @@
 #define LIBMV_SIMPLE_PIPELINE_RESECT_H
 
 #include "libmv/base/vector.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/simple_pipeline/reconstruction.h"
 
 namespace libmv {
 
@@ -79,6 +81,21 @@ bool EuclideanResect(const vector<Marker> &markers,
 bool ProjectiveResect(const vector<Marker> &markers,
                       ProjectiveReconstruction *reconstruction);
 
+namespace internal {
+
+// The jacobian of the reprojection errors minimized by EuclideanResect() at
+// the pose dRt, the euler vector of a rotation applied after initial_R
+// followed by the translation, computed analytically as the solver does and
+// by numeric differentiation, to check one against the other.
+void EuclideanResectJacobians(const vector<Marker> &markers,
+                              const EuclideanReconstruction &reconstruction,
+                              const Mat3 &initial_R,
+                              const Vec6 &dRt,
+                              Mat *analytic,
+                              Mat *numeric);
+
+}  // namespace internal
+
 }  // namespace libmv
 
 #endif  // LIBMV_SIMPLE_PIPELINE_RESECT_H
@@ -0,0 +1,78 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "testing/testing.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/resect.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+namespace {
+
+// Points in front of a camera, and markers in its image which do not quite
+// match them so that the residuals are not zero.
+void MakeResectScene(EuclideanReconstruction *reconstruction,
+                     vector<Marker> *markers) {
+  const double points[][3] = {
+    { -1.0, -0.5, 5.0 }, { 1.0, -0.7, 6.0 }, { 0.3, 1.2, 4.5 },
+    { -0.8, 0.9, 7.0 }, { 1.4, 0.4, 5.5 }, { 0.1, -1.1, 6.5 },
+  };
+  for (int i = 0; i < 6; ++i) {
+    reconstruction->InsertPoint(i, Vec3(points[i][0], points[i][1],
+                                        points[i][2]));
+    Marker marker = { 0, i, 0.05 * i - 0.1, 0.1 - 0.03 * i };
+    markers->push_back(marker);
+  }
+}
+
+void ExpectResectJacobianIsNumeric(const Mat3 &initial_R, const Vec6 &dRt) {
+  EuclideanReconstruction reconstruction;
+  vector<Marker> markers;
+  MakeResectScene(&reconstruction, &markers);
+
+  Mat analytic, numeric;
+  internal::EuclideanResectJacobians(markers, reconstruction, initial_R, dRt,
+                                     &analytic, &numeric);
+  ASSERT_EQ(12, analytic.rows());
+  ASSERT_EQ(6, analytic.cols());
+  for (int r = 0; r < 12; ++r) {
+    for (int c = 0; c < 6; ++c) {
+      EXPECT_NEAR(numeric(r, c), analytic(r, c), 1e-6)
+          << "row " << r << ", column " << c;
+    }
+  }
+}
+
+TEST(EuclideanResect, JacobianMatchesNumericAtIdentity) {
+  Vec6 dRt;
+  dRt << 0, 0, 0, 0.1, -0.2, 0.3;
+  ExpectResectJacobianIsNumeric(Mat3::Identity(), dRt);
+}
+
+TEST(EuclideanResect, JacobianMatchesNumeric) {
+  Mat3 initial_R =
+      Eigen::AngleAxisd(0.3, Vec3(1, 2, -1).normalized()).toRotationMatrix();
+  Vec6 dRt;
+  dRt << 0.2, -0.1, 0.35, 0.1, -0.2, 0.3;
+  ExpectResectJacobianIsNumeric(initial_R, dRt);
+}
+
+}  // namespace
+}  // namespace libmv
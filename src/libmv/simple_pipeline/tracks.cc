@@ -21,29 +21,92 @@
 #include <algorithm>
 #include <vector>
 
+#include "libmv/logging/logging.h"
 #include "libmv/numeric/numeric.h"
 #include "libmv/simple_pipeline/tracks.h"
 
 namespace libmv {
+namespace {
 
-Tracks::Tracks(const Tracks &other) {
-  markers_ = other.markers_;
+void AddIndex(int id, int index, std::vector<std::vector<int> > *indices) {
+  if (id >= indices->size()) {
+    indices->resize(id + 1);
+  }
+  (*indices)[id].push_back(index);
 }
 
-Tracks::Tracks(const vector<Marker> &markers) : markers_(markers) {}
+}  // namespace
 
-void Tracks::Insert(int image, int track, double x, double y) {
-  // TODO(keir): Wow, this is quadratic for repeated insertions. Fix this by
-  // adding a smarter data structure like a set<>.
+Tracks::Tracks(const Tracks &other)
+    : markers_(other.markers_),
+      marker_indices_in_image_(other.marker_indices_in_image_),
+      marker_indices_for_track_(other.marker_indices_for_track_) {}
+
+Tracks::Tracks(const vector<Marker> &markers) {
+  for (int i = 0; i < markers.size(); ++i) {
+    Insert(markers[i].image, markers[i].track, markers[i].x, markers[i].y);
+  }
+}
+
+int Tracks::FindMarker(int image, int track) const {
+  if (image < 0 || image >= marker_indices_in_image_.size() ||
+      track < 0 || track >= marker_indices_for_track_.size()) {
+    return -1;
+  }
+  // Search whichever of the image and the track has fewer markers.
+  const std::vector<int> &image_indices = marker_indices_in_image_[image];
+  const std::vector<int> &track_indices = marker_indices_for_track_[track];
+  if (image_indices.size() < track_indices.size()) {
+    for (int i = 0; i < image_indices.size(); ++i) {
+      if (markers_[image_indices[i]].track == track) {
+        return image_indices[i];
+      }
+    }
+  } else {
+    for (int i = 0; i < track_indices.size(); ++i) {
+      if (markers_[track_indices[i]].image == image) {
+        return track_indices[i];
+      }
+    }
+  }
+  return -1;
+}
+
+void Tracks::RemoveMarkersAt(const std::vector<int> &sorted_indices) {
+  // Compact the markers, keeping the others in their order.
+  int size = 0;
+  int next = 0;
   for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image == image &&
-        markers_[i].track == track) {
-      markers_[i].x = x;
-      markers_[i].y = y;
-      return;
+    if (next < sorted_indices.size() && sorted_indices[next] == i) {
+      ++next;
+      continue;
     }
+    markers_[size++] = markers_[i];
+  }
+  markers_.resize(size);
+
+  // Every index past the first removed marker moved, so rebuild the indices.
+  // Markers are stored in insertion order, so the lists stay in that order.
+  marker_indices_in_image_.clear();
+  marker_indices_for_track_.clear();
+  for (int i = 0; i < markers_.size(); ++i) {
+    AddIndex(markers_[i].image, i, &marker_indices_in_image_);
+    AddIndex(markers_[i].track, i, &marker_indices_for_track_);
+  }
+}
+
+void Tracks::Insert(int image, int track, double x, double y) {
+  CHECK_GE(image, 0);
+  CHECK_GE(track, 0);
+  int index = FindMarker(image, track);
+  if (index >= 0) {
+    markers_[index].x = x;
+    markers_[index].y = y;
+    return;
   }
   Marker marker = { image, track, x, y };
+  AddIndex(image, markers_.size(), &marker_indices_in_image_);
+  AddIndex(track, markers_.size(), &marker_indices_for_track_);
   markers_.push_back(marker);
 }
 
@@ -53,20 +116,16 @@ vector<Marker> Tracks::AllMarkers() const {
 
 vector<Marker> Tracks::MarkersInImage(int image) const {
   vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (image == markers_[i].image) {
-      markers.push_back(markers_[i]);
-    }
+  for (int i = 0; i < NumMarkersInImage(image); ++i) {
+    markers.push_back(MarkerInImage(image, i));
   }
   return markers;
 }
 
 vector<Marker> Tracks::MarkersForTrack(int track) const {
   vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (track == markers_[i].track) {
-      markers.push_back(markers_[i]);
-    }
+  for (int i = 0; i < NumMarkersForTrack(track); ++i) {
+    markers.push_back(MarkerForTrack(track, i));
   }
   return markers;
 }
@@ -75,12 +134,12 @@ vector<Marker> Tracks::MarkersForTracksInBothImages(int image1, int image2) cons
   std::vector<int> image1_tracks;
   std::vector<int> image2_tracks;
 
-  for (int i = 0; i < markers_.size(); ++i) {
-    int image = markers_[i].image;
-    if (image == image1) {
-      image1_tracks.push_back(markers_[i].track);
-    } else if (image == image2) {
-      image2_tracks.push_back(markers_[i].track);
+  for (int i = 0; i < NumMarkersInImage(image1); ++i) {
+    image1_tracks.push_back(MarkerInImage(image1, i).track);
+  }
+  if (image2 != image1) {
+    for (int i = 0; i < NumMarkersInImage(image2); ++i) {
+      image2_tracks.push_back(MarkerInImage(image2, i).track);
     }
   }
 
@@ -92,63 +151,66 @@ vector<Marker> Tracks::MarkersForTracksInBothImages(int image1, int image2) cons
                         image2_tracks.begin(), image2_tracks.end(),
                         std::back_inserter(intersection));
 
+  // Return the markers in the order they are stored, as if filtering all the
+  // markers.
+  std::vector<int> indices;
+  for (int i = 0; i < intersection.size(); ++i) {
+    indices.push_back(FindMarker(image1, intersection[i]));
+    indices.push_back(FindMarker(image2, intersection[i]));
+  }
+  std::sort(indices.begin(), indices.end());
+
   vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if ((markers_[i].image == image1 || markers_[i].image == image2) &&
-        std::binary_search(intersection.begin(),intersection.end(),
-                           markers_[i].track)) {
-      markers.push_back(markers_[i]);
-    }
+  for (int i = 0; i < indices.size(); ++i) {
+    markers.push_back(markers_[indices[i]]);
   }
   return markers;
 }
 
 Marker Tracks::MarkerInImageForTrack(int image, int track) const {
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image == image && markers_[i].track == track) {
-      return markers_[i];
-    }
+  int index = FindMarker(image, track);
+  if (index >= 0) {
+    return markers_[index];
   }
   Marker null = { -1, -1, -1, -1 };
   return null;
 }
 
+int Tracks::NumMarkersInImage(int image) const {
+  if (image < 0 || image >= marker_indices_in_image_.size()) {
+    return 0;
+  }
+  return marker_indices_in_image_[image].size();
+}
+
+int Tracks::NumMarkersForTrack(int track) const {
+  if (track < 0 || track >= marker_indices_for_track_.size()) {
+    return 0;
+  }
+  return marker_indices_for_track_[track].size();
+}
+
 void Tracks::RemoveMarkersForTrack(int track) {
-  int size = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].track != track) {
-      markers_[size++] = markers_[i];
-    }
+  if (NumMarkersForTrack(track) > 0) {
+    std::vector<int> indices = marker_indices_for_track_[track];
+    std::sort(indices.begin(), indices.end());
+    RemoveMarkersAt(indices);
   }
-  markers_.resize(size);
 }
 
 void Tracks::RemoveMarker(int image, int track) {
-  int size = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image != image || markers_[i].track != track) {
-      markers_[size++] = markers_[i];
-    }
+  int index = FindMarker(image, track);
+  if (index >= 0) {
+    RemoveMarkersAt(std::vector<int>(1, index));
   }
-  markers_.resize(size);
 }
 
 int Tracks::MaxImage() const {
-  // TODO(MatthiasF): maintain a max_image_ member (updated on Insert)
-  int max_image = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    max_image = std::max(markers_[i].image, max_image);
-  }
-  return max_image;
+  return std::max(int(marker_indices_in_image_.size()) - 1, 0);
 }
 
 int Tracks::MaxTrack() const {
-  // TODO(MatthiasF): maintain a max_track_ member (updated on Insert)
-  int max_track = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    max_track = std::max(markers_[i].track, max_track);
-  }
-  return max_track;
+  return std::max(int(marker_indices_for_track_.size()) - 1, 0);
 }
 
 int Tracks::NumMarkers() const {
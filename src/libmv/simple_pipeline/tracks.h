@@ -23,6 +23,8 @@
 
 #include "libmv/base/vector.h"
 
+#include <vector>
+
 namespace libmv {
 
 /*!
@@ -50,6 +52,11 @@ struct Marker {
     
     The container has several fast lookups for queries typically needed for
     structure from motion algorithms, such as \l MarkersForTracksInBothImages().
+    The markers are indexed by image and by track, so looking up the markers of
+    an image or a track costs time proportional to the number of markers
+    returned rather than to the total number of markers. For loops over an
+    image or a track, \l MarkerInImage() and \l MarkerForTrack() avoid copying
+    the markers.
     
     \sa Marker
 */
@@ -95,6 +102,22 @@ class Tracks {
   /// Returns the marker in \a image belonging to \a track.
   Marker MarkerInImageForTrack(int image, int track) const;
 
+  /// Returns the number of markers visible in \a image.
+  int NumMarkersInImage(int image) const;
+
+  /// Returns the \a i'th marker visible in \a image, in insertion order.
+  const Marker &MarkerInImage(int image, int i) const {
+    return markers_[marker_indices_in_image_[image][i]];
+  }
+
+  /// Returns the number of markers belonging to \a track.
+  int NumMarkersForTrack(int track) const;
+
+  /// Returns the \a i'th marker belonging to \a track, in insertion order.
+  const Marker &MarkerForTrack(int track, int i) const {
+    return markers_[marker_indices_for_track_[track][i]];
+  }
+
   /// Removes all the markers belonging to \a track.
   void RemoveMarkersForTrack(int track);
 
@@ -111,7 +134,22 @@ class Tracks {
   int NumMarkers() const;
 
  private:
+  // Returns the index in markers_ of the marker, or -1 if there is none.
+  int FindMarker(int image, int track) const;
+
+  // Removes the markers at the given sorted indices into markers_, keeping the
+  // other markers in order, and rebuilds the indices. Linear in the number of
+  // markers.
+  void RemoveMarkersAt(const std::vector<int> &sorted_indices);
+
   vector<Marker> markers_;
+
+  // Indices into markers_ of the markers for each image and track id, in
+  // insertion order. Image and track ids are small non-negative integers, so
+  // these are indexed directly by id. Trailing empty lists are trimmed, so the
+  // maximum ids are the sizes minus one.
+  std::vector<std::vector<int> > marker_indices_in_image_;
+  std::vector<std::vector<int> > marker_indices_for_track_;
 };
 
 }  // namespace libmv
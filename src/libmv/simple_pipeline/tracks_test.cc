@@ -0,0 +1,147 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "testing/testing.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+
+TEST(Tracks, InsertReplacesExistingMarker) {
+  Tracks tracks;
+  tracks.Insert(1, 2, 10.0, 20.0);
+  tracks.Insert(1, 3, 11.0, 21.0);
+  tracks.Insert(1, 2, 12.0, 22.0);
+
+  EXPECT_EQ(2, tracks.NumMarkers());
+  Marker marker = tracks.MarkerInImageForTrack(1, 2);
+  EXPECT_EQ(1, marker.image);
+  EXPECT_EQ(2, marker.track);
+  EXPECT_EQ(12.0, marker.x);
+  EXPECT_EQ(22.0, marker.y);
+
+  marker = tracks.MarkerInImageForTrack(2, 2);
+  EXPECT_EQ(-1, marker.image);
+  EXPECT_EQ(-1, marker.track);
+}
+
+TEST(Tracks, MarkersInImageAndForTrack) {
+  Tracks tracks;
+  for (int image = 0; image < 4; ++image) {
+    for (int track = 0; track < 5; ++track) {
+      if ((image + track) % 2 == 0) {
+        tracks.Insert(image, track, image, track);
+      }
+    }
+  }
+
+  ASSERT_EQ(2, tracks.NumMarkersInImage(1));
+  vector<Marker> markers = tracks.MarkersInImage(1);
+  ASSERT_EQ(2, markers.size());
+  EXPECT_EQ(1, markers[0].track);
+  EXPECT_EQ(3, markers[1].track);
+  EXPECT_EQ(1, tracks.MarkerInImage(1, 0).track);
+  EXPECT_EQ(3, tracks.MarkerInImage(1, 1).track);
+
+  ASSERT_EQ(2, tracks.NumMarkersForTrack(4));
+  markers = tracks.MarkersForTrack(4);
+  ASSERT_EQ(2, markers.size());
+  EXPECT_EQ(0, markers[0].image);
+  EXPECT_EQ(2, markers[1].image);
+  EXPECT_EQ(2, tracks.MarkerForTrack(4, 1).image);
+
+  EXPECT_EQ(0, tracks.NumMarkersInImage(7));
+  EXPECT_EQ(0, tracks.NumMarkersForTrack(-1));
+}
+
+TEST(Tracks, MarkersForTracksInBothImages) {
+  Tracks tracks;
+  tracks.Insert(0, 0, 0, 0);
+  tracks.Insert(0, 1, 0, 0);
+  tracks.Insert(1, 1, 0, 0);
+  tracks.Insert(1, 2, 0, 0);
+  tracks.Insert(2, 1, 0, 0);
+
+  vector<Marker> markers = tracks.MarkersForTracksInBothImages(0, 1);
+  ASSERT_EQ(2, markers.size());
+  EXPECT_EQ(0, markers[0].image);
+  EXPECT_EQ(1, markers[0].track);
+  EXPECT_EQ(1, markers[1].image);
+  EXPECT_EQ(1, markers[1].track);
+}
+
+TEST(Tracks, RemoveKeepsIndicesAndMaxima) {
+  Tracks tracks;
+  tracks.Insert(0, 0, 0, 0);
+  tracks.Insert(0, 1, 0, 0);
+  tracks.Insert(1, 0, 0, 0);
+  tracks.Insert(1, 1, 0, 0);
+  tracks.Insert(2, 3, 0, 0);
+  EXPECT_EQ(2, tracks.MaxImage());
+  EXPECT_EQ(3, tracks.MaxTrack());
+
+  tracks.RemoveMarker(0, 0);
+  EXPECT_EQ(4, tracks.NumMarkers());
+  EXPECT_EQ(-1, tracks.MarkerInImageForTrack(0, 0).image);
+  EXPECT_EQ(1, tracks.NumMarkersInImage(0));
+  EXPECT_EQ(2, tracks.MarkerInImageForTrack(2, 3).image);
+
+  tracks.RemoveMarkersForTrack(3);
+  EXPECT_EQ(3, tracks.NumMarkers());
+  EXPECT_EQ(1, tracks.MaxImage());
+  EXPECT_EQ(1, tracks.MaxTrack());
+
+  tracks.RemoveMarkersForTrack(1);
+  EXPECT_EQ(1, tracks.NumMarkers());
+  EXPECT_EQ(1, tracks.MarkerInImageForTrack(1, 0).image);
+  EXPECT_EQ(0, tracks.NumMarkersInImage(0));
+  EXPECT_EQ(1, tracks.MaxImage());
+  EXPECT_EQ(0, tracks.MaxTrack());
+
+  // Copies keep the indices.
+  Tracks copy(tracks);
+  EXPECT_EQ(1, copy.NumMarkersForTrack(0));
+  EXPECT_EQ(0, copy.MarkerForTrack(0, 0).track);
+}
+
+TEST(Tracks, RemoveKeepsMarkerOrder) {
+  Tracks tracks;
+  tracks.Insert(0, 0, 0, 0);
+  tracks.Insert(0, 1, 1, 0);
+  tracks.Insert(1, 0, 2, 0);
+  tracks.Insert(1, 1, 3, 0);
+  tracks.Insert(2, 0, 4, 0);
+
+  tracks.RemoveMarker(0, 1);
+  vector<Marker> markers = tracks.AllMarkers();
+  ASSERT_EQ(4, markers.size());
+  EXPECT_EQ(0, markers[0].x);
+  EXPECT_EQ(2, markers[1].x);
+  EXPECT_EQ(3, markers[2].x);
+  EXPECT_EQ(4, markers[3].x);
+
+  tracks.RemoveMarkersForTrack(0);
+  markers = tracks.AllMarkers();
+  ASSERT_EQ(1, markers.size());
+  EXPECT_EQ(3, markers[0].x);
+  EXPECT_EQ(1, tracks.NumMarkersInImage(1));
+  EXPECT_EQ(3, tracks.MarkerInImage(1, 0).x);
+}
+
+}  // namespace libmv
@@ -18,11 +18,15 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <algorithm>
+#include <cmath>
+
 #include "libmv/logging/logging.h"
 #include "libmv/tracking/klt_region_tracker.h"
 #include "libmv/image/image.h"
 #include "libmv/image/convolve.h"
 #include "libmv/image/sample.h"
+#include "libmv/image/scratch_image_pool.h"
 
 namespace libmv {
 
@@ -84,14 +88,21 @@ static bool SolveTrackingEquation(float gxx, float gxy, float gyy,
   return true;
 }
 
-bool KltRegionTracker::Track(const FloatImage &image1,
-                             const FloatImage &image2,
+PreparedFrame *KltRegionTracker::PrepareFrame(const FloatImage &image) const {
+  BlurredFrame *frame = new BlurredFrame(&image);
+  BlurredImageAndDerivativesChannels(image, sigma, &frame->image_and_gradient);
+  return frame;
+}
+
+bool KltRegionTracker::Track(const PreparedFrame &frame1,
+                             const PreparedFrame &frame2,
                              double  x1, double  y1,
                              double *x2, double *y2) const {
-  Array3Df image_and_gradient1;
-  Array3Df image_and_gradient2;
-  BlurredImageAndDerivativesChannels(image1, sigma, &image_and_gradient1);
-  BlurredImageAndDerivativesChannels(image2, sigma, &image_and_gradient2);
+  // Both frames come from PrepareFrame() above.
+  const Array3Df &image_and_gradient1 =
+      static_cast<const BlurredFrame &>(frame1).image_and_gradient;
+  const Array3Df &image_and_gradient2 =
+      static_cast<const BlurredFrame &>(frame2).image_and_gradient;
 
   int i;
   float dx = 0, dy = 0;
@@ -129,4 +140,179 @@ bool KltRegionTracker::Track(const FloatImage &image1,
   return false;
 }
 
+namespace {
+
+// Fixed point scales: a float intensity of 1 is 255 in the blurred image,
+// and a float gradient of 1 is 255 * 64 in the gradients, which leaves room
+// for gradients up to 2 before saturating.
+const int kIntensityScale = 255;
+const int kGradientScale = 255 * 64;
+
+// Bilinear weights are on 8 bits; samples keep 8 fractional bits.
+const int kWeightOne = 256;
+
+struct FixedPointFrame : public PreparedFrame {
+  explicit FixedPointFrame(const FloatImage *image) : PreparedFrame(image) {}
+
+  // Blurred image, and x and y gradients in channels 0 and 1.
+  Array3Du blurred;
+  Array3Ds gradient;
+};
+
+template<typename T>
+inline T RoundAndClamp(float value, int min_value, int max_value) {
+  int rounded = static_cast<int>(floor(value + 0.5f));
+  return static_cast<T>(std::max(min_value, std::min(max_value, rounded)));
+}
+
+// Same clamping as LinearInitAxis(), with the weight of x2 on 8 bits.
+inline void FixedPointInitAxis(double x, int size,
+                               int *x1, int *x2, int *weight2) {
+  const int ix = int(x);
+  if (ix < 0) {
+    *x1 = *x2 = 0;
+    *weight2 = 0;
+  } else if (ix > size - 2) {
+    *x1 = *x2 = size - 1;
+    *weight2 = 0;
+  } else {
+    *x1 = ix;
+    *x2 = ix + 1;
+    *weight2 = int((x - ix) * kWeightOne + 0.5);
+  }
+}
+
+// Bilinear sample of a fixed point array, times kWeightOne.
+struct FixedPointSampler {
+  FixedPointSampler(int height, int width, double y, double x) {
+    FixedPointInitAxis(y, height, &y1, &y2, &wy2);
+    FixedPointInitAxis(x, width, &x1, &x2, &wx2);
+    wy1 = kWeightOne - wy2;
+    wx1 = kWeightOne - wx2;
+  }
+
+  template<typename T>
+  int Sample(const Array3D<T> &image, int channel) const {
+    int row1 = wx1 * image(y1, x1, channel) + wx2 * image(y1, x2, channel);
+    int row2 = wx1 * image(y2, x1, channel) + wx2 * image(y2, x2, channel);
+    // The weights of an axis sum to 2^8 and the gradients are below 2^15 in
+    // magnitude, so each row is below 2^23 and the sum below 2^31.
+    return (wy1 * row1 + wy2 * row2) / kWeightOne;
+  }
+
+  int x1, x2, y1, y2;
+  int wx1, wx2, wy1, wy2;
+};
+
+// The largest window for which the sums of ComputeFixedPointTrackingEquation()
+// fit in 64 bits.
+const int kMaxFixedPointHalfWindowSize = 127;
+
+// ComputeTrackingEquation() on fixed point frames. The samples are below
+// 2^23 in magnitude, so their products are below 2^46 and the sums over at
+// most 255 x 255 < 2^17 pixels are exact in 64 bit integers. The results are
+// in the same units as the float version.
+void ComputeFixedPointTrackingEquation(const FixedPointFrame &frame1,
+                                       const FixedPointFrame &frame2,
+                                       double x1, double y1,
+                                       double x2, double y2,
+                                       int half_width,
+                                       float *gxx,
+                                       float *gxy,
+                                       float *gyy,
+                                       float *ex,
+                                       float *ey) {
+  int height1 = frame1.blurred.Height(), width1 = frame1.blurred.Width();
+  int height2 = frame2.blurred.Height(), width2 = frame2.blurred.Width();
+  long long sum_gxx = 0, sum_gxy = 0, sum_gyy = 0, sum_ex = 0, sum_ey = 0;
+  for (int r = -half_width; r <= half_width; ++r) {
+    for (int c = -half_width; c <= half_width; ++c) {
+      FixedPointSampler sampler1(height1, width1, y1 + r, x1 + c);
+      FixedPointSampler sampler2(height2, width2, y2 + r, x2 + c);
+      int I = sampler1.Sample(frame1.blurred, 0);
+      int J = sampler2.Sample(frame2.blurred, 0);
+      int gx = sampler2.Sample(frame2.gradient, 0);
+      int gy = sampler2.Sample(frame2.gradient, 1);
+      sum_gxx += static_cast<long long>(gx) * gx;
+      sum_gxy += static_cast<long long>(gx) * gy;
+      sum_gyy += static_cast<long long>(gy) * gy;
+      sum_ex += static_cast<long long>(I - J) * gx;
+      sum_ey += static_cast<long long>(I - J) * gy;
+    }
+  }
+  const double gradient_unit = double(kGradientScale) * kWeightOne;
+  const double intensity_unit = double(kIntensityScale) * kWeightOne;
+  *gxx = double(sum_gxx) / (gradient_unit * gradient_unit);
+  *gxy = double(sum_gxy) / (gradient_unit * gradient_unit);
+  *gyy = double(sum_gyy) / (gradient_unit * gradient_unit);
+  *ex = double(sum_ex) / (intensity_unit * gradient_unit);
+  *ey = double(sum_ey) / (intensity_unit * gradient_unit);
+}
+
+}  // namespace
+
+PreparedFrame *FixedPointKltRegionTracker::PrepareFrame(
+    const FloatImage &image) const {
+  FixedPointFrame *frame = new FixedPointFrame(&image);
+  ScopedScratchImage image_and_gradient(image.Height(), image.Width(), 3);
+  BlurredImageAndDerivativesChannels(image, sigma, image_and_gradient.get());
+
+  int height = image.Height(), width = image.Width();
+  frame->blurred.Resize(height, width);
+  frame->gradient.Resize(height, width, 2);
+  const float *in = image_and_gradient->Data();
+  unsigned char *blurred = frame->blurred.Data();
+  short *gradient = frame->gradient.Data();
+  for (int i = 0; i < height * width; ++i) {
+    blurred[i] = RoundAndClamp<unsigned char>(
+        in[3 * i] * kIntensityScale, 0, 255);
+    gradient[2 * i] = RoundAndClamp<short>(
+        in[3 * i + 1] * kGradientScale, -32767, 32767);
+    gradient[2 * i + 1] = RoundAndClamp<short>(
+        in[3 * i + 2] * kGradientScale, -32767, 32767);
+  }
+  return frame;
+}
+
+bool FixedPointKltRegionTracker::Track(const PreparedFrame &frame1,
+                                       const PreparedFrame &frame2,
+                                       double  x1, double  y1,
+                                       double *x2, double *y2) const {
+  // Both frames come from PrepareFrame() above.
+  const FixedPointFrame &fixed_point_frame1 =
+      static_cast<const FixedPointFrame &>(frame1);
+  const FixedPointFrame &fixed_point_frame2 =
+      static_cast<const FixedPointFrame &>(frame2);
+  CHECK_LE(half_window_size, kMaxFixedPointHalfWindowSize);
+
+  // The samples do not move for updates finer than the bilinear weights, so
+  // those count as converged too.
+  const double min_update = std::max(
+      min_update_squared_distance, 1.0 / (kWeightOne * kWeightOne));
+
+  float dx = 0, dy = 0;
+  for (int i = 0; i < max_iterations; ++i) {
+    float gxx, gxy, gyy, ex, ey;
+    ComputeFixedPointTrackingEquation(fixed_point_frame1,
+                                      fixed_point_frame2,
+                                      x1, y1,
+                                      *x2, *y2,
+                                      half_window_size,
+                                      &gxx, &gxy, &gyy, &ex, &ey);
+    if (!SolveTrackingEquation(gxx, gxy, gyy, ex, ey, min_determinant,
+                               &dx, &dy)) {
+      LG << "Determinant too small; failing tracking.";
+      return false;
+    }
+    *x2 += dx;
+    *y2 += dy;
+    if (dx * dx + dy * dy < min_update) {
+      LG << "Successful track in " << i << " iterations.";
+      return true;
+    }
+  }
+  LG << "Too many iterations.";
+  return false;
+}
+
 }  // namespace libmv
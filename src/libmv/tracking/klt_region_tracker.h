@@ -37,8 +37,10 @@ struct KltRegionTracker : public RegionTracker {
   virtual ~KltRegionTracker() {}
 
   // Tracker interface.
-  virtual bool Track(const FloatImage &image1,
-                     const FloatImage &image2,
+  using RegionTracker::Track;
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
 
@@ -50,6 +52,24 @@ struct KltRegionTracker : public RegionTracker {
   double sigma;
 };
 
+// The same tracker on fixed point frames: the blurred image is stored on 8
+// bits and the gradients on 16 bits, 5 bytes per pixel instead of 12, and
+// the sums of the tracking equation are accumulated in 64 bit integers from
+// integer bilinear samples. The images are expected in [0, 1], like the ones
+// from ReadImage(); values outside are clamped. half_window_size is at most
+// 127. Tracks agree with KltRegionTracker to a few hundredths of a pixel.
+struct FixedPointKltRegionTracker : public KltRegionTracker {
+  virtual ~FixedPointKltRegionTracker() {}
+
+  // Tracker interface.
+  using RegionTracker::Track;
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
+                     double  x1, double  y1,
+                     double *x2, double *y2) const;
+};
+
 }  // namespace libmv
 
 #endif  // LIBMV_REGION_TRACKING_KLT_REGION_TRACKER_H_
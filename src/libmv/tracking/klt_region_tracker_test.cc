@@ -18,8 +18,13 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <cmath>
+
 #include "libmv/tracking/klt_region_tracker.h"
+#include "libmv/base/scoped_ptr.h"
+#include "libmv/base/thread_pool.h"
 #include "libmv/image/image.h"
+#include "libmv/simple_pipeline/tracks.h"
 #include "testing/testing.h"
 
 namespace libmv {
@@ -46,5 +51,159 @@ TEST(KltRegionTracker, Track) {
   EXPECT_NEAR(y1, y0 + dy, 0.001);
 }
 
+TEST(KltRegionTracker, TrackPreparedFrames) {
+  Array3Df image1(51, 51);
+  image1.Fill(0);
+
+  Array3Df image2(image1);
+
+  int dx = 3, dy = 2;
+  int x0[] = { 12, 25, 37 };
+  int y0[] = { 14, 25, 36 };
+  for (int i = 0; i < 3; ++i) {
+    image1(y0[i], x0[i]) = 1.0f;
+    image2(y0[i] + dy, x0[i] + dx) = 1.0f;
+  }
+
+  KltRegionTracker tracker;
+  scoped_ptr<PreparedFrame> frame1(tracker.PrepareFrame(image1));
+  scoped_ptr<PreparedFrame> frame2(tracker.PrepareFrame(image2));
+
+  // Every point is tracked with the same prepared frames.
+  for (int i = 0; i < 3; ++i) {
+    double x1 = x0[i];
+    double y1 = y0[i];
+    EXPECT_TRUE(tracker.Track(*frame1, *frame2, x0[i], y0[i], &x1, &y1));
+
+    EXPECT_NEAR(x1, x0[i] + dx, 0.001);
+    EXPECT_NEAR(y1, y0[i] + dy, 0.001);
+  }
+}
+
+TEST(KltRegionTracker, TrackMany) {
+  Array3Df image1(51, 51);
+  image1.Fill(0);
+
+  Array3Df image2(image1);
+
+  int dx = 3, dy = 2;
+  vector<Marker> markers1, markers2;
+  for (int i = 0; i < 4; ++i) {
+    Marker marker = { 0, i, 10.0 + 10 * i, 40.0 - 9 * i };
+    image1(marker.y, marker.x) = 1.0f;
+    image2(marker.y + dy, marker.x + dx) = 1.0f;
+    markers1.push_back(marker);
+
+    // Start from the old position, in the second image.
+    marker.image = 1;
+    markers2.push_back(marker);
+  }
+
+  KltRegionTracker tracker;
+  scoped_ptr<PreparedFrame> frame1(tracker.PrepareFrame(image1));
+  scoped_ptr<PreparedFrame> frame2(tracker.PrepareFrame(image2));
+
+  ThreadPool pool(2);
+  vector<bool> tracked;
+  tracker.TrackMany(*frame1, *frame2, markers1, &markers2, &tracked, &pool);
+
+  ASSERT_EQ(4, markers2.size());
+  ASSERT_EQ(4, tracked.size());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(tracked[i]);
+    EXPECT_EQ(1, markers2[i].image);
+    EXPECT_EQ(i, markers2[i].track);
+    EXPECT_NEAR(markers1[i].x + dx, markers2[i].x, 0.001);
+    EXPECT_NEAR(markers1[i].y + dy, markers2[i].y, 0.001);
+  }
+}
+
+TEST(FixedPointKltRegionTracker, Track) {
+  Array3Df image1(51, 51);
+  image1.Fill(0);
+
+  Array3Df image2(image1);
+
+  int x0 = 25, y0 = 25;
+  int dx = 3, dy = 2;
+  image1(y0, x0) = 1.0f;
+  image2(y0 + dy, x0 + dx) = 1.0f;
+
+  double x1 = x0;
+  double y1 = y0;
+
+  FixedPointKltRegionTracker tracker;
+  EXPECT_TRUE(tracker.Track(image1, image2, x0, y0, &x1, &y1));
+
+  EXPECT_NEAR(x1, x0 + dx, 0.001);
+  EXPECT_NEAR(y1, y0 + dy, 0.001);
+}
+
+// A smooth blob moved by a fraction of a pixel is tracked as well as with
+// the float tracker.
+TEST(FixedPointKltRegionTracker, TrackSubpixelLikeFloat) {
+  Array3Df image1(51, 51), image2(51, 51);
+  double x0 = 25, y0 = 25;
+  double dx = 1.3, dy = -0.6;
+  for (int r = 0; r < 51; ++r) {
+    for (int c = 0; c < 51; ++c) {
+      double d1 = (c - x0) * (c - x0) + (r - y0) * (r - y0);
+      double d2 = (c - x0 - dx) * (c - x0 - dx) +
+                  (r - y0 - dy) * (r - y0 - dy);
+      image1(r, c) = exp(-d1 / 18.0);
+      image2(r, c) = exp(-d2 / 18.0);
+    }
+  }
+
+  KltRegionTracker float_tracker;
+  double float_x = x0, float_y = y0;
+  EXPECT_TRUE(float_tracker.Track(image1, image2, x0, y0,
+                                  &float_x, &float_y));
+
+  FixedPointKltRegionTracker tracker;
+  double x1 = x0, y1 = y0;
+  EXPECT_TRUE(tracker.Track(image1, image2, x0, y0, &x1, &y1));
+
+  EXPECT_NEAR(x0 + dx, x1, 0.05);
+  EXPECT_NEAR(y0 + dy, y1, 0.05);
+  EXPECT_NEAR(float_x, x1, 0.05);
+  EXPECT_NEAR(float_y, y1, 0.05);
+}
+
+// A large window sums far more products than the default one; the sums must
+// stay exact.
+TEST(FixedPointKltRegionTracker, TrackWithLargeWindowLikeFloat) {
+  const int size = 151;
+  Array3Df image1(size, size), image2(size, size);
+  double x0 = 75, y0 = 75;
+  double dx = 2.4, dy = 1.7;
+  for (int r = 0; r < size; ++r) {
+    for (int c = 0; c < size; ++c) {
+      // Ripples give strong gradients over the whole window.
+      double d1 = sqrt((c - x0) * (c - x0) + (r - y0) * (r - y0));
+      double d2 = sqrt((c - x0 - dx) * (c - x0 - dx) +
+                       (r - y0 - dy) * (r - y0 - dy));
+      image1(r, c) = 0.5 + 0.5 * cos(d1 / 3.0) * exp(-d1 / 60.0);
+      image2(r, c) = 0.5 + 0.5 * cos(d2 / 3.0) * exp(-d2 / 60.0);
+    }
+  }
+
+  KltRegionTracker float_tracker;
+  float_tracker.half_window_size = 60;
+  double float_x = x0, float_y = y0;
+  EXPECT_TRUE(float_tracker.Track(image1, image2, x0, y0,
+                                  &float_x, &float_y));
+
+  FixedPointKltRegionTracker tracker;
+  tracker.half_window_size = 60;
+  double x1 = x0, y1 = y0;
+  EXPECT_TRUE(tracker.Track(image1, image2, x0, y0, &x1, &y1));
+
+  EXPECT_NEAR(x0 + dx, x1, 0.05);
+  EXPECT_NEAR(y0 + dy, y1, 0.05);
+  EXPECT_NEAR(float_x, x1, 0.05);
+  EXPECT_NEAR(float_y, y1, 0.05);
+}
+
 }  // namespace
 }  // namespace libmv
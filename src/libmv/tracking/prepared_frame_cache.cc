@@ -0,0 +1,48 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/prepared_frame_cache.h"
+
+namespace libmv {
+
+PreparedFrameCache::PreparedFrameCache(const RegionTracker *tracker,
+                                       int max_frames)
+    : tracker_(tracker), cache_(max_frames) {}
+
+const PreparedFrame *PreparedFrameCache::FetchAndPin(int frame_number,
+                                                     const FloatImage &image) {
+  CachedFrame *cached_frame;
+  if (!cache_.FetchAndPin(frame_number, &cached_frame)) {
+    cached_frame = new CachedFrame;
+    cached_frame->image = image;
+    cached_frame->frame.reset(tracker_->PrepareFrame(cached_frame->image));
+    // Sizes are in frames. Another thread may have stored the frame
+    // meanwhile; then that copy is used and this one deleted.
+    cached_frame =
+        cache_.FetchOrStoreAndPinSized(frame_number, cached_frame, 1);
+  }
+  return cached_frame->frame.get();
+}
+
+void PreparedFrameCache::Unpin(int frame_number) {
+  cache_.Unpin(frame_number);
+}
+
+}  // namespace libmv
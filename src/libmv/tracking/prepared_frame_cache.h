@@ -0,0 +1,78 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_TRACKING_PREPARED_FRAME_CACHE_H_
+#define LIBMV_TRACKING_PREPARED_FRAME_CACHE_H_
+
+#include "libmv/base/scoped_ptr.h"
+#include "libmv/image/image.h"
+#include "libmv/image/lru_cache.h"
+#include "libmv/tracking/region_tracker.h"
+
+namespace libmv {
+
+// Keeps the frames prepared by a region tracker, keyed by frame number, so
+// that frame N, prepared to track from N-1 to N, is reused when tracking from
+// N to N+1 instead of being prepared again. For the pyramid tracker this saves
+// building the whole pyramid (downsampling, blurring and differentiating every
+// level) for every frame but the first.
+//
+// Frames are kept until they are unpinned and the cache is full, oldest first.
+// FetchAndPin(), Unpin() and ContainsFrame() may be called from several
+// threads at once, since the LRUCache underneath locks. Threads which miss on
+// the same frame at the same time each prepare it, and all but the first copy
+// stored are discarded; fetch a frame on one thread first to avoid the wasted
+// work. Only the destruction of the cache must be serialized with the other
+// calls, and ContainsFrame() may be stale by the time it returns.
+class PreparedFrameCache {
+ public:
+  // Caches up to max_frames frames prepared by tracker, which must outlive the
+  // cache. Two frames are enough to track forward or backward through a
+  // sequence.
+  explicit PreparedFrameCache(const RegionTracker *tracker,
+                              int max_frames = 2);
+
+  // Returns frame frame_number prepared by the tracker. On a miss, a copy of
+  // image is prepared, so image does not need to outlive the call. The frame
+  // stays valid until the matching Unpin().
+  const PreparedFrame *FetchAndPin(int frame_number, const FloatImage &image);
+
+  void Unpin(int frame_number);
+
+  bool ContainsFrame(int frame_number) {
+    return cache_.ContainsKey(frame_number);
+  }
+
+  struct CachedFrame {
+    CachedFrame() : frame(NULL) {}
+
+    // The prepared frame refers to this copy of the image.
+    FloatImage image;
+    scoped_ptr<PreparedFrame> frame;
+  };
+
+ private:
+  const RegionTracker *tracker_;
+  LRUCache<int, CachedFrame> cache_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_TRACKING_PREPARED_FRAME_CACHE_H_
@@ -27,32 +27,64 @@
 
 namespace libmv {
 
-static void MakePyramid(const FloatImage &image, int num_levels,
-                        std::vector<FloatImage> *pyramid) {
-  pyramid->resize(num_levels);
-  (*pyramid)[0] = image;
-  for (int i = 1; i < num_levels; ++i) {
-    DownsampleChannelsBy2((*pyramid)[i - 1], &(*pyramid)[i]);
+namespace {
+
+// Every level of the image pyramid, each prepared for the wrapped tracker.
+// Level 0 is the original image, which is not copied.
+class PyramidFrame : public PreparedFrame {
+ public:
+  PyramidFrame(const FloatImage *image, int num_levels)
+      : PreparedFrame(image), levels(num_levels), level_frames(num_levels) {}
+
+  virtual ~PyramidFrame() {
+    for (int i = 0; i < level_frames.size(); ++i) {
+      delete level_frames[i];
+    }
   }
+
+  // The downsampled images; levels[0] is unused. Never resized, since the
+  // level frames point into it.
+  std::vector<FloatImage> levels;
+  std::vector<PreparedFrame *> level_frames;
+};
+
+}  // namespace
+
+PreparedFrame *PyramidRegionTracker::PrepareFrame(
+    const FloatImage &image) const {
+  // Create all the levels of the pyramid, since tracking has to happen from
+  // the coarsest to finest levels, which means holding on to all levels of the
+  // pyraid at once.
+  PyramidFrame *frame = new PyramidFrame(&image, num_levels_);
+  frame->level_frames[0] = tracker_->PrepareFrame(image);
+  std::vector<FloatImage *> downsampled(num_levels_ - 1);
+  for (int i = 1; i < num_levels_; ++i) {
+    downsampled[i - 1] = &frame->levels[i];
+  }
+  if (num_levels_ > 1) {
+    DownsamplePyramid(image, num_levels_ - 1, &downsampled[0]);
+  }
+  for (int i = 1; i < num_levels_; ++i) {
+    frame->level_frames[i] = tracker_->PrepareFrame(frame->levels[i]);
+  }
+  return frame;
 }
 
-bool PyramidRegionTracker::Track(const FloatImage &image1,
-                                 const FloatImage &image2,
+bool PyramidRegionTracker::Track(const PreparedFrame &frame1,
+                                 const PreparedFrame &frame2,
                                  double  x1, double  y1,
                                  double *x2, double *y2) const {
+  // Both frames come from PrepareFrame() above.
+  const std::vector<PreparedFrame *> &pyramid1 =
+      static_cast<const PyramidFrame &>(frame1).level_frames;
+  const std::vector<PreparedFrame *> &pyramid2 =
+      static_cast<const PyramidFrame &>(frame2).level_frames;
+
   // Shrink the guessed x and y location to match the coarsest level + 1 (which
   // when gets corrected in the loop).
   *x2 /= pow(2., num_levels_);
   *y2 /= pow(2., num_levels_);
 
-  // Create all the levels of the pyramid, since tracking has to happen from
-  // the coarsest to finest levels, which means holding on to all levels of the
-  // pyraid at once.
-  std::vector<FloatImage> pyramid1(num_levels_);
-  std::vector<FloatImage> pyramid2(num_levels_);
-  MakePyramid(image1, num_levels_, &pyramid1);
-  MakePyramid(image2, num_levels_, &pyramid2);
-
   for (int i = num_levels_ - 1; i >= 0; --i) {
     // Position in the first image at pyramid level i.
     double xx = x1 / pow(2., i);
@@ -63,7 +95,8 @@ bool PyramidRegionTracker::Track(const FloatImage &image1,
     *y2 *= 2;
 
     // Track the point on this level with the base tracker.
-    bool succeeded = tracker_->Track(pyramid1[i], pyramid2[i], xx, yy, x2, y2);
+    bool succeeded = tracker_->Track(*pyramid1[i], *pyramid2[i],
+                                     xx, yy, x2, y2);
 
     if (i == 0 && !succeeded) {
       // Only fail on the highest-resolution level, because a failure on a
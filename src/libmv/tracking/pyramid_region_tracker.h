@@ -32,8 +32,11 @@ class PyramidRegionTracker : public RegionTracker {
   PyramidRegionTracker(RegionTracker *tracker, int num_levels)
       : tracker_(tracker), num_levels_(num_levels) {}
 
-  virtual bool Track(const FloatImage &image1,
-                     const FloatImage &image2,
+  // Prepares every level of the image pyramid with the wrapped tracker.
+  using RegionTracker::Track;
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
  private:
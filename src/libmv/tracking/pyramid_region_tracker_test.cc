@@ -19,6 +19,7 @@
 // IN THE SOFTWARE.
 
 #include "libmv/tracking/klt_region_tracker.h"
+#include "libmv/tracking/prepared_frame_cache.h"
 #include "libmv/tracking/pyramid_region_tracker.h"
 #include "libmv/image/image.h"
 #include "testing/testing.h"
@@ -73,5 +74,46 @@ TEST(PyramidKltRegionTracker, Track) {
   }
 }
 
+TEST(PyramidKltRegionTracker, TrackWithCachedFrames) {
+  // A 2x2 square moving by (6, 5) pixels each frame.
+  Array3Df images[3];
+  for (int i = 0; i < 3; ++i) {
+    images[i].Resize(100, 100);
+    images[i].Fill(0);
+    int x = 25 + 6 * i, y = 25 + 5 * i;
+    images[i](y + 0, x + 0) = 1.0f;
+    images[i](y + 0, x + 1) = 1.0f;
+    images[i](y + 1, x + 0) = 1.0f;
+    images[i](y + 1, x + 1) = 1.0f;
+  }
+
+  KltRegionTracker *klt_tracker = new KltRegionTracker;
+  klt_tracker->half_window_size = 3;
+  PyramidRegionTracker tracker(klt_tracker, 3);
+  PreparedFrameCache cache(&tracker);
+
+  double x = 25, y = 25;
+  const PreparedFrame *frame1 = cache.FetchAndPin(0, images[0]);
+  for (int i = 1; i < 3; ++i) {
+    const PreparedFrame *frame2 = cache.FetchAndPin(i, images[i]);
+    double x2 = x, y2 = y;
+    EXPECT_TRUE(tracker.Track(*frame1, *frame2, x, y, &x2, &y2));
+    EXPECT_NEAR(25 + 6 * i, x2, 0.001);
+    EXPECT_NEAR(25 + 5 * i, y2, 0.001);
+    x = x2;
+    y = y2;
+    cache.Unpin(i - 1);
+    frame1 = frame2;
+  }
+  cache.Unpin(2);
+
+  // The last two frames are kept, and not prepared again.
+  EXPECT_FALSE(cache.ContainsFrame(0));
+  EXPECT_TRUE(cache.ContainsFrame(1));
+  EXPECT_TRUE(cache.ContainsFrame(2));
+  EXPECT_EQ(frame1, cache.FetchAndPin(2, images[2]));
+  cache.Unpin(2);
+}
+
 }  // namespace
 }  // namespace libmv
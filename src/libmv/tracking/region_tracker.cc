@@ -0,0 +1,93 @@
+// Copyright (c) 2011 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/region_tracker.h"
+
+#include "libmv/base/scoped_ptr.h"
+#include "libmv/base/thread_pool.h"
+#include "libmv/logging/logging.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+
+bool RegionTracker::Track(const FloatImage &image1,
+                          const FloatImage &image2,
+                          double  x1, double  y1,
+                          double *x2, double *y2) const {
+  scoped_ptr<PreparedFrame> frame1(PrepareFrame(image1));
+  scoped_ptr<PreparedFrame> frame2(PrepareFrame(image2));
+  return Track(*frame1, *frame2, x1, y1, x2, y2);
+}
+
+PreparedFrame *RegionTracker::PrepareFrame(const FloatImage &image) const {
+  return new PreparedFrame(&image);
+}
+
+namespace {
+
+// Tracks marker i between the frames, writing only to the i'th outputs. The
+// results are written as one char per marker rather than to a vector<bool>, so
+// that no two workers ever store to the same word even if bools get packed.
+struct TrackMarker {
+  TrackMarker(const RegionTracker *tracker,
+              const PreparedFrame *frame1,
+              const PreparedFrame *frame2,
+              const vector<Marker> *markers1,
+              vector<Marker> *markers2,
+              vector<char> *tracked)
+      : tracker(tracker), frame1(frame1), frame2(frame2),
+        markers1(markers1), markers2(markers2), tracked(tracked) {}
+
+  void operator()(int i) {
+    const Marker &marker1 = (*markers1)[i];
+    Marker &marker2 = (*markers2)[i];
+    (*tracked)[i] = tracker->Track(*frame1, *frame2,
+                                   marker1.x, marker1.y,
+                                   &marker2.x, &marker2.y);
+  }
+
+  const RegionTracker *tracker;
+  const PreparedFrame *frame1;
+  const PreparedFrame *frame2;
+  const vector<Marker> *markers1;
+  vector<Marker> *markers2;
+  vector<char> *tracked;
+};
+
+}  // namespace
+
+void RegionTracker::TrackMany(const PreparedFrame &frame1,
+                              const PreparedFrame &frame2,
+                              const vector<Marker> &markers1,
+                              vector<Marker> *markers2,
+                              vector<bool> *tracked,
+                              ThreadPool *pool) const {
+  CHECK_EQ(markers1.size(), markers2->size());
+  vector<char> tracked_per_marker(markers1.size());
+  TrackMarker track_marker(this, &frame1, &frame2,
+                           &markers1, markers2, &tracked_per_marker);
+  ParallelFor(pool, 0, markers1.size(), track_marker);
+  tracked->resize(markers1.size());
+  for (int i = 0; i < markers1.size(); ++i) {
+    (*tracked)[i] = tracked_per_marker[i] != 0;
+  }
+}
+
+}  // namespace libmv
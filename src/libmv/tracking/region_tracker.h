@@ -21,10 +21,37 @@
 #ifndef LIBMV_TRACKING_TRACKER_H_
 #define LIBMV_TRACKING_TRACKER_H_
 
+#include "libmv/base/vector.h"
 #include "libmv/image/image.h"
 
 namespace libmv {
 
+struct Marker;
+class ThreadPool;
+
+// Per-frame data computed once by RegionTracker::PrepareFrame() and then
+// shared by every region tracked in or into that frame. The prepared frame
+// refers to the original image, which must outlive it.
+class PreparedFrame {
+ public:
+  explicit PreparedFrame(const FloatImage *image) : image_(image) {}
+  virtual ~PreparedFrame() {}
+
+  const FloatImage &image() const { return *image_; }
+
+ private:
+  const FloatImage *image_;
+};
+
+// Prepared frame for trackers which work on a blurred copy of the image.
+struct BlurredFrame : public PreparedFrame {
+  explicit BlurredFrame(const FloatImage *image) : PreparedFrame(image) {}
+  virtual ~BlurredFrame() {}
+
+  // Blurred image, x gradient and y gradient in channels 0, 1 and 2.
+  Array3Df image_and_gradient;
+};
+
 class RegionTracker {
  public:
   RegionTracker() {}
@@ -36,11 +63,49 @@ class RegionTracker {
       \a x2, \a y2 should start out as a best guess for the position in \a
       image2. If no guess is available, (\a x1, \a y1) is a good start. Returns
       true on success, false otherwise
+
+      This prepares both images and calls the PreparedFrame version below;
+      when tracking many points between the same two images, prepare them once
+      with PrepareFrame() instead.
   */
   virtual bool Track(const FloatImage &image1,
                      const FloatImage &image2,
                      double  x1, double  y1,
+                     double *x2, double *y2) const;
+
+  /*!
+      Do the per-frame work (blurring, gradients, ...) needed to track regions
+      in \a image. The result can be passed to Track() any number of times,
+      but only to this tracker (or one configured identically). The caller
+      takes ownership of the returned frame.
+  */
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+
+  /*!
+      Track a point from \a frame1 to \a frame2, which were both created by
+      PrepareFrame(). Same semantics as the FloatImage version above.
+  */
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
+                     double  x1, double  y1,
                      double *x2, double *y2) const = 0;
+
+  /*!
+      Track every marker in \a markers1 from \a frame1 to \a frame2.
+
+      On entry \a markers2 must hold one best guess per marker in \a
+      markers1, as for \a x2, \a y2 in Track(); on return it holds the
+      tracked positions, in the same order. (*\a tracked)[i] tells whether
+      marker i was tracked successfully. The markers are tracked in parallel
+      on \a pool, or serially if \a pool is NULL; either way the results are
+      the same.
+  */
+  void TrackMany(const PreparedFrame &frame1,
+                 const PreparedFrame &frame2,
+                 const vector<Marker> &markers1,
+                 vector<Marker> *markers2,
+                 vector<bool> *tracked,
+                 ThreadPool *pool = NULL) const;
 };
 
 }  // namespace libmv
@@ -25,18 +25,23 @@
 
 namespace libmv {
 
-bool RetrackRegionTracker::Track(const FloatImage &image1,
-                                 const FloatImage &image2,
+PreparedFrame *RetrackRegionTracker::PrepareFrame(
+    const FloatImage &image) const {
+  return tracker_->PrepareFrame(image);
+}
+
+bool RetrackRegionTracker::Track(const PreparedFrame &frame1,
+                                 const PreparedFrame &frame2,
                                  double  x1, double  y1,
                                  double *x2, double *y2) const {
   // Track forward, getting x2 and y2.
-  if (!tracker_->Track(image1, image2, x1, y1, x2, y2)) {
+  if (!tracker_->Track(frame1, frame2, x1, y1, x2, y2)) {
     return false;
   }
   // Now track x2 and y2 backward, to get xx1 and yy1 which, if the track is
   // good, should match x1 and y1 (but may not if the track is bad).
   double xx1 = *x2, yy1 = *x2;
-  if (!tracker_->Track(image2, image1, *x2, *y2, &xx1, &yy1)) {
+  if (!tracker_->Track(frame2, frame1, *x2, *y2, &xx1, &yy1)) {
     return false;
   }
   double dx = xx1 - x1;
@@ -34,8 +34,12 @@ class RetrackRegionTracker : public RegionTracker {
   RetrackRegionTracker(RegionTracker *tracker, double tolerance)
       : tracker_(tracker), tolerance_(tolerance) {}
 
-  virtual bool Track(const FloatImage &image1,
-                     const FloatImage &image2,
+  // Frames are prepared by the wrapped tracker, and shared between the forward
+  // and backward tracks.
+  using RegionTracker::Track;
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
  private:
@@ -92,14 +92,21 @@ static bool SolveTrackingEquation(const Mat2f &U,
   return true;
 }
 
-bool TrkltRegionTracker::Track(const FloatImage &image1,
-                               const FloatImage &image2,
+PreparedFrame *TrkltRegionTracker::PrepareFrame(const FloatImage &image) const {
+  BlurredFrame *frame = new BlurredFrame(&image);
+  BlurredImageAndDerivativesChannels(image, sigma, &frame->image_and_gradient);
+  return frame;
+}
+
+bool TrkltRegionTracker::Track(const PreparedFrame &frame1,
+                               const PreparedFrame &frame2,
                                double  x1, double  y1,
                                double *x2, double *y2) const {
-  Array3Df image_and_gradient1;
-  Array3Df image_and_gradient2;
-  BlurredImageAndDerivativesChannels(image1, sigma, &image_and_gradient1);
-  BlurredImageAndDerivativesChannels(image2, sigma, &image_and_gradient2);
+  // Both frames come from PrepareFrame() above.
+  const Array3Df &image_and_gradient1 =
+      static_cast<const BlurredFrame &>(frame1).image_and_gradient;
+  const Array3Df &image_and_gradient2 =
+      static_cast<const BlurredFrame &>(frame2).image_and_gradient;
 
   int i;
   Vec2f d = Vec2f::Zero();
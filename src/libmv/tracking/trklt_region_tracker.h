@@ -46,8 +46,10 @@ struct TrkltRegionTracker : public RegionTracker {
   virtual ~TrkltRegionTracker() {}
 
   // Tracker interface.
-  virtual bool Track(const FloatImage &image1,
-                     const FloatImage &image2,
+  using RegionTracker::Track;
+  virtual PreparedFrame *PrepareFrame(const FloatImage &image) const;
+  virtual bool Track(const PreparedFrame &frame1,
+                     const PreparedFrame &frame2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
 
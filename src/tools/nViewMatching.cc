@@ -46,7 +46,7 @@ using namespace std;
 
 DEFINE_string(detector, "FAST", "select the detector (FAST,STAR,SURF,MSER)");
 DEFINE_string(describer, "DIPOLE",
-              "select the descriptor (SIMPLIEST,SURF,DIPOLE,DAISY)");
+              "select the descriptor (SIMPLIEST,SURF,DIPOLE,DAISY,BRIEF)");
 DEFINE_bool(save_matches_results, true,
             "save images with detected and matched features");
 DEFINE_bool(save_matches_file, false,
@@ -155,6 +155,8 @@ int main(int argc, char **argv) {
     edescriber = descriptor::DIPOLE_DESCRIBER;
   } else if (FLAGS_describer == "DAISY") {
     edescriber = descriptor::DAISY_DESCRIBER;
+  } else if (FLAGS_describer == "BRIEF") {
+    edescriber = descriptor::BRIEF_DESCRIBER;
   } else {
     LOG(FATAL) << "ERROR : undefined Describer !";
   }
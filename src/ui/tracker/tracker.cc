@@ -23,9 +23,12 @@
 #include "ui/tracker/gl.h"
 
 #include "libmv/image/image.h"
+#include "libmv/image/scratch_image_pool.h"
+#include "libmv/base/thread_pool.h"
 #include "libmv/base/vector.h"
 #include "libmv/simple_pipeline/tracks.h"
 #include "libmv/tracking/klt_region_tracker.h"
+#include "libmv/tracking/prepared_frame_cache.h"
 #include "libmv/tracking/trklt_region_tracker.h"
 #include "libmv/tracking/pyramid_region_tracker.h"
 #include "libmv/tracking/retrack_region_tracker.h"
@@ -81,10 +84,37 @@ bool CopyRegionFromQImage(QImage image,
   return true;
 }
 
+// Returns frame number frame from the cache, converting qimage to a float
+// image only if the frame was not prepared already.
+static const libmv::PreparedFrame *FetchAndPinFrame(
+    libmv::PreparedFrameCache *cache, int frame, QImage qimage) {
+  libmv::FloatImage image;
+  if (!cache->ContainsFrame(frame)) {
+    int x0 = 0, y0 = 0;
+    CopyRegionFromQImage(qimage, qimage.width(), qimage.height(),
+                         &x0, &y0, &image);
+  }
+  return cache->FetchAndPin(frame, image);
+}
+
 Tracker::Tracker(libmv::Tracks *tracks, Scene *scene, QGLWidget *shareWidget)
   : QGLWidget(QGLFormat(QGL::SampleBuffers), 0, shareWidget),
     tracks_(tracks), scene_(scene),
-    current_image_(-1), active_track_(-1), dragged_(false) {}
+    current_image_(-1), active_track_(-1), dragged_(false),
+    thread_pool_(new libmv::ThreadPool()) {
+  // FIXME: the scoped_ptr in Tracking API require the client to heap allocate
+  libmv::TrkltRegionTracker *trklt_region_tracker =
+      new libmv::TrkltRegionTracker();
+  trklt_region_tracker->half_window_size = 5;
+  trklt_region_tracker->max_iterations = 200;
+  libmv::PyramidRegionTracker *pyramid_region_tracker =
+      new libmv::PyramidRegionTracker(trklt_region_tracker, 3);
+  region_tracker_.reset(
+      new libmv::RetrackRegionTracker(pyramid_region_tracker, 0.2));
+  // Keeps the previous and the current frame, so that each frame is prepared
+  // (pyramid, blur and gradients) once while stepping through the sequence.
+  frame_cache_.reset(new libmv::PreparedFrameCache(region_tracker_.get()));
+}
 
 Tracker::~Tracker() {}
 
@@ -108,52 +138,41 @@ void Tracker::SetImage(int image, QImage new_image, bool track) {
 
   // Track active trackers from the previous image into this one.
   if (track) {
-    // FIXME: the scoped_ptr in Tracking API require the client to heap allocate
-    libmv::TrkltRegionTracker *trklt_region_tracker =
-        new libmv::TrkltRegionTracker();
-    trklt_region_tracker->half_window_size = 5;
-    trklt_region_tracker->max_iterations = 200;
-    libmv::PyramidRegionTracker *pyramid_region_tracker =
-        new libmv::PyramidRegionTracker(trklt_region_tracker, 3);
-    libmv::RetrackRegionTracker region_tracker(pyramid_region_tracker, 0.2);
     vector<Marker> previous_markers = tracks_->MarkersInImage(previous_image);
+    vector<Marker> markers1, markers2;
     for (int i = 0; i < previous_markers.size(); i++) {
       const Marker &marker = previous_markers[i];
-      if (!selected_tracks_.contains(marker.track)) {
-        continue;
-      }
-      // TODO(keir): For now this uses a fixed size region. What's needed is
-      // an extension to use custom sized boxes around the tracked point.
-      int size = 64;
-      int half_size = size / 2;
-
-      // [xy][01] is the upper right box corner.
-      int x0 = marker.x - half_size;
-      int y0 = marker.y - half_size;
-      libmv::FloatImage old_patch;
-      if (!CopyRegionFromQImage(previous_image_, size, size,
-                                &x0, &y0,
-                                &old_patch)) {
-        selected_tracks_.remove(selected_tracks_.indexOf(marker.track));
-        continue;
+      if (selected_tracks_.contains(marker.track)) {
+        markers1.push_back(marker);
+        markers2.push_back(marker);
       }
+    }
 
-      int x1 = marker.x - half_size;
-      int y1 = marker.y - half_size;
-      libmv::FloatImage new_patch;
-      if (!CopyRegionFromQImage(new_image, size, size,
-                                &x1, &y1,
-                                &new_patch)) {
-        selected_tracks_.remove(selected_tracks_.indexOf(marker.track));
-        continue;
+    if (markers1.size() > 0) {
+      // Fetch the frames serially, since the QImages are shared. The previous
+      // frame was usually prepared when tracking into it.
+      const libmv::PreparedFrame *frame1 =
+          FetchAndPinFrame(frame_cache_.get(), previous_image, previous_image_);
+      const libmv::PreparedFrame *frame2 =
+          FetchAndPinFrame(frame_cache_.get(), current_image_, new_image);
+
+      // Track all the selected markers at once, then insert the results in
+      // marker order.
+      vector<bool> tracked;
+      region_tracker_->TrackMany(*frame1, *frame2, markers1, &markers2,
+                                 &tracked, thread_pool_.get());
+      frame_cache_->Unpin(previous_image);
+      frame_cache_->Unpin(current_image_);
+      libmv::ScratchImagePool::TrimAllThreads();
+
+      for (int i = 0; i < markers2.size(); i++) {
+        const Marker &marker = markers2[i];
+        if (tracked[i]) {
+          tracks_->Insert(current_image_, marker.track, marker.x, marker.y);
+        } else {
+          selected_tracks_.remove(selected_tracks_.indexOf(marker.track));
+        }
       }
-
-      double xx0 = marker.x - x0;
-      double yy0 = marker.y - y0;
-      double xx1 = marker.x - x1;
-      double yy1 = marker.y - y1;
-      region_tracker.Track(old_patch, new_patch, xx0, yy0, &xx1, &yy1);
-      tracks_->Insert(current_image_, marker.track, x1 + xx1, y1 + yy1);
     }
   }
   previous_image_ = new_image;
@@ -23,11 +23,14 @@
 
 #include <QGLWidget>
 #include "ui/tracker/gl.h"
+#include "libmv/base/scoped_ptr.h"
 
 namespace libmv {
 class Tracks;
 class RegionTracker;
+class PreparedFrameCache;
 class Marker;
+class ThreadPool;
 }  // namespace libmv
 
 class Scene;
@@ -71,6 +74,9 @@ class Tracker : public QGLWidget {
   vec2 last_position_;
   int active_track_;
   bool dragged_;
+  libmv::scoped_ptr<libmv::ThreadPool> thread_pool_;
+  libmv::scoped_ptr<libmv::RegionTracker> region_tracker_;
+  libmv::scoped_ptr<libmv::PreparedFrameCache> frame_cache_;
 };
 
 class Zoom : public QGLWidget {